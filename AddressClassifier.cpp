@@ -0,0 +1,608 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "AddressClassifier.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+#include <cwctype>
+#include <iterator>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define ADDRESS_CLASSIFIER_SSE2
+#endif
+
+namespace
+{
+    // The ASCII top level domains in the root zone, from the ICANN section of
+    // the public suffix list, and the names reserved for private networks.
+    // Sorted for binary search.
+    const wchar_t* const c_topLevelDomains[] =
+    {
+        L"aaa", L"aarp", L"abarth", L"abb", L"abbott", L"abbvie", L"abc", L"able", L"abogado", L"abudhabi", L"ac",
+        L"academy", L"accenture", L"accountant", L"accountants", L"aco", L"actor", L"ad", L"ads", L"adult", L"ae",
+        L"aeg", L"aero", L"aetna", L"af", L"afl", L"africa", L"ag", L"agakhan", L"agency", L"ai", L"aig", L"airbus",
+        L"airforce", L"airtel", L"akdn", L"al", L"alfaromeo", L"alibaba", L"alipay", L"allfinanz", L"allstate", L"ally",
+        L"alsace", L"alstom", L"am", L"amazon", L"americanexpress", L"americanfamily", L"amex", L"amfam", L"amica",
+        L"amsterdam", L"analytics", L"android", L"anquan", L"anz", L"ao", L"aol", L"apartments", L"app", L"apple",
+        L"aq", L"aquarelle", L"ar", L"arab", L"aramco", L"archi", L"army", L"arpa", L"art", L"arte", L"as", L"asda",
+        L"asia", L"associates", L"at", L"athleta", L"attorney", L"au", L"auction", L"audi", L"audible", L"audio",
+        L"auspost", L"author", L"auto", L"autos", L"avianca", L"aw", L"aws", L"ax", L"axa", L"az", L"azure", L"ba",
+        L"baby", L"baidu", L"banamex", L"bananarepublic", L"band", L"bank", L"bar", L"barcelona", L"barclaycard",
+        L"barclays", L"barefoot", L"bargains", L"baseball", L"basketball", L"bauhaus", L"bayern", L"bb", L"bbc", L"bbt",
+        L"bbva", L"bcg", L"bcn", L"be", L"beats", L"beauty", L"beer", L"bentley", L"berlin", L"best", L"bestbuy",
+        L"bet", L"bf", L"bg", L"bh", L"bharti", L"bi", L"bible", L"bid", L"bike", L"bing", L"bingo", L"bio", L"biz",
+        L"bj", L"black", L"blackfriday", L"blockbuster", L"blog", L"bloomberg", L"blue", L"bm", L"bms", L"bmw", L"bn",
+        L"bnpparibas", L"bo", L"boats", L"boehringer", L"bofa", L"bom", L"bond", L"boo", L"book", L"booking", L"bosch",
+        L"bostik", L"boston", L"bot", L"boutique", L"box", L"br", L"bradesco", L"bridgestone", L"broadway", L"broker",
+        L"brother", L"brussels", L"bs", L"bt", L"build", L"builders", L"business", L"buy", L"buzz", L"bv", L"bw", L"by",
+        L"bz", L"bzh", L"ca", L"cab", L"cafe", L"cal", L"call", L"calvinklein", L"cam", L"camera", L"camp", L"canon",
+        L"capetown", L"capital", L"capitalone", L"car", L"caravan", L"cards", L"care", L"career", L"careers", L"cars",
+        L"casa", L"case", L"cash", L"casino", L"cat", L"catering", L"catholic", L"cba", L"cbn", L"cbre", L"cbs", L"cc",
+        L"cd", L"center", L"ceo", L"cern", L"cf", L"cfa", L"cfd", L"cg", L"ch", L"chanel", L"channel", L"charity",
+        L"chase", L"chat", L"cheap", L"chintai", L"christmas", L"chrome", L"church", L"ci", L"cipriani", L"circle",
+        L"cisco", L"citadel", L"citi", L"citic", L"city", L"cityeats", L"cl", L"claims", L"cleaning", L"click",
+        L"clinic", L"clinique", L"clothing", L"cloud", L"club", L"clubmed", L"cm", L"cn", L"co", L"coach", L"codes",
+        L"coffee", L"college", L"cologne", L"com", L"comcast", L"commbank", L"community", L"company", L"compare",
+        L"computer", L"comsec", L"condos", L"construction", L"consulting", L"contact", L"contractors", L"cooking",
+        L"cookingchannel", L"cool", L"coop", L"corp", L"corsica", L"country", L"coupon", L"coupons", L"courses", L"cpa",
+        L"cr", L"credit", L"creditcard", L"creditunion", L"cricket", L"crown", L"crs", L"cruise", L"cruises", L"cu",
+        L"cuisinella", L"cv", L"cw", L"cx", L"cy", L"cymru", L"cyou", L"cz", L"dabur", L"dad", L"dance", L"data",
+        L"date", L"dating", L"datsun", L"day", L"dclk", L"dds", L"de", L"deal", L"dealer", L"deals", L"degree",
+        L"delivery", L"dell", L"deloitte", L"delta", L"democrat", L"dental", L"dentist", L"desi", L"design", L"dev",
+        L"dhl", L"diamonds", L"diet", L"digital", L"direct", L"directory", L"discount", L"discover", L"dish", L"diy",
+        L"dj", L"dk", L"dm", L"dnp", L"do", L"docs", L"doctor", L"dog", L"domains", L"dot", L"download", L"drive",
+        L"dtv", L"dubai", L"dunlop", L"dupont", L"durban", L"dvag", L"dvr", L"dz", L"earth", L"eat", L"ec", L"eco",
+        L"edeka", L"edu", L"education", L"ee", L"eg", L"email", L"emerck", L"energy", L"engineer", L"engineering",
+        L"enterprises", L"epson", L"equipment", L"ericsson", L"erni", L"es", L"esq", L"estate", L"et", L"etisalat",
+        L"eu", L"eurovision", L"eus", L"events", L"exchange", L"expert", L"exposed", L"express", L"extraspace", L"fage",
+        L"fail", L"fairwinds", L"faith", L"family", L"fan", L"fans", L"farm", L"farmers", L"fashion", L"fast", L"fedex",
+        L"feedback", L"ferrari", L"ferrero", L"fi", L"fiat", L"fidelity", L"fido", L"film", L"final", L"finance",
+        L"financial", L"fire", L"firestone", L"firmdale", L"fish", L"fishing", L"fit", L"fitness", L"fj", L"flickr",
+        L"flights", L"flir", L"florist", L"flowers", L"fly", L"fm", L"fo", L"foo", L"food", L"foodnetwork", L"football",
+        L"ford", L"forex", L"forsale", L"forum", L"foundation", L"fox", L"fr", L"free", L"fresenius", L"frl",
+        L"frogans", L"frontdoor", L"frontier", L"ftr", L"fujitsu", L"fun", L"fund", L"furniture", L"futbol", L"fyi",
+        L"ga", L"gal", L"gallery", L"gallo", L"gallup", L"game", L"games", L"gap", L"garden", L"gay", L"gb", L"gbiz",
+        L"gd", L"gdn", L"ge", L"gea", L"gent", L"genting", L"george", L"gf", L"gg", L"ggee", L"gh", L"gi", L"gift",
+        L"gifts", L"gives", L"giving", L"gl", L"glass", L"gle", L"global", L"globo", L"gm", L"gmail", L"gmbh", L"gmo",
+        L"gmx", L"gn", L"godaddy", L"gold", L"goldpoint", L"golf", L"goo", L"goodyear", L"goog", L"google", L"gop",
+        L"got", L"gov", L"gp", L"gq", L"gr", L"grainger", L"graphics", L"gratis", L"green", L"gripe", L"grocery",
+        L"group", L"gs", L"gt", L"gu", L"guardian", L"gucci", L"guge", L"guide", L"guitars", L"guru", L"gw", L"gy",
+        L"hair", L"hamburg", L"hangout", L"haus", L"hbo", L"hdfc", L"hdfcbank", L"health", L"healthcare", L"help",
+        L"helsinki", L"here", L"hermes", L"hgtv", L"hiphop", L"hisamitsu", L"hitachi", L"hiv", L"hk", L"hkt", L"hm",
+        L"hn", L"hockey", L"holdings", L"holiday", L"home", L"homedepot", L"homegoods", L"homes", L"homesense",
+        L"honda", L"horse", L"hospital", L"host", L"hosting", L"hot", L"hoteles", L"hotels", L"hotmail", L"house",
+        L"how", L"hr", L"hsbc", L"ht", L"hu", L"hughes", L"hyatt", L"hyundai", L"ibm", L"icbc", L"ice", L"icu", L"id",
+        L"ie", L"ieee", L"ifm", L"ikano", L"il", L"im", L"imamat", L"imdb", L"immo", L"immobilien", L"in", L"inc",
+        L"industries", L"infiniti", L"info", L"ing", L"ink", L"institute", L"insurance", L"insure", L"int", L"internal",
+        L"international", L"intranet", L"intuit", L"investments", L"io", L"ipiranga", L"iq", L"ir", L"irish", L"is",
+        L"ismaili", L"ist", L"istanbul", L"it", L"itau", L"itv", L"jaguar", L"java", L"jcb", L"je", L"jeep", L"jetzt",
+        L"jewelry", L"jio", L"jll", L"jmp", L"jnj", L"jo", L"jobs", L"joburg", L"jot", L"joy", L"jp", L"jpmorgan",
+        L"jprs", L"juegos", L"juniper", L"kaufen", L"kddi", L"ke", L"kerryhotels", L"kerrylogistics",
+        L"kerryproperties", L"kfh", L"kg", L"ki", L"kia", L"kids", L"kim", L"kinder", L"kindle", L"kitchen", L"kiwi",
+        L"km", L"kn", L"koeln", L"komatsu", L"kosher", L"kp", L"kpmg", L"kpn", L"kr", L"krd", L"kred", L"kuokgroup",
+        L"kw", L"ky", L"kyoto", L"kz", L"la", L"lacaixa", L"lamborghini", L"lamer", L"lan", L"lancaster", L"lancia",
+        L"land", L"landrover", L"lanxess", L"lasalle", L"lat", L"latino", L"latrobe", L"law", L"lawyer", L"lb", L"lc",
+        L"lds", L"lease", L"leclerc", L"lefrak", L"legal", L"lego", L"lexus", L"lgbt", L"li", L"lidl", L"life",
+        L"lifeinsurance", L"lifestyle", L"lighting", L"like", L"lilly", L"limited", L"limo", L"lincoln", L"linde",
+        L"link", L"lipsy", L"live", L"living", L"lk", L"llc", L"llp", L"loan", L"loans", L"local", L"localhost",
+        L"locker", L"locus", L"lol", L"london", L"lotte", L"lotto", L"love", L"lpl", L"lplfinancial", L"lr", L"ls",
+        L"lt", L"ltd", L"ltda", L"lu", L"lundbeck", L"luxe", L"luxury", L"lv", L"ly", L"ma", L"macys", L"madrid",
+        L"maif", L"maison", L"makeup", L"man", L"management", L"mango", L"map", L"market", L"marketing", L"markets",
+        L"marriott", L"marshalls", L"maserati", L"mattel", L"mba", L"mc", L"mckinsey", L"md", L"me", L"med", L"media",
+        L"meet", L"melbourne", L"meme", L"memorial", L"men", L"menu", L"merckmsd", L"mg", L"mh", L"miami", L"microsoft",
+        L"mil", L"mini", L"mint", L"mit", L"mitsubishi", L"mk", L"ml", L"mlb", L"mls", L"mma", L"mn", L"mo", L"mobi",
+        L"mobile", L"moda", L"moe", L"moi", L"mom", L"monash", L"money", L"monster", L"mormon", L"mortgage", L"moscow",
+        L"moto", L"motorcycles", L"mov", L"movie", L"mp", L"mq", L"mr", L"ms", L"msd", L"mt", L"mtn", L"mtr", L"mu",
+        L"museum", L"music", L"mutual", L"mv", L"mw", L"mx", L"my", L"mz", L"na", L"nab", L"nagoya", L"name", L"natura",
+        L"navy", L"nba", L"nc", L"ne", L"nec", L"net", L"netbank", L"netflix", L"network", L"neustar", L"new", L"news",
+        L"next", L"nextdirect", L"nexus", L"nf", L"nfl", L"ng", L"ngo", L"nhk", L"ni", L"nico", L"nike", L"nikon",
+        L"ninja", L"nissan", L"nissay", L"nl", L"no", L"nokia", L"northwesternmutual", L"norton", L"now", L"nowruz",
+        L"nowtv", L"nr", L"nra", L"nrw", L"ntt", L"nu", L"nyc", L"nz", L"obi", L"observer", L"office", L"okinawa",
+        L"olayan", L"olayangroup", L"oldnavy", L"ollo", L"om", L"omega", L"one", L"ong", L"onion", L"onl", L"online",
+        L"ooo", L"open", L"oracle", L"orange", L"org", L"organic", L"origins", L"osaka", L"otsuka", L"ott", L"ovh",
+        L"pa", L"page", L"panasonic", L"paris", L"pars", L"partners", L"parts", L"party", L"passagens", L"pay", L"pccw",
+        L"pe", L"pet", L"pf", L"pfizer", L"ph", L"pharmacy", L"phd", L"philips", L"phone", L"photo", L"photography",
+        L"photos", L"physio", L"pics", L"pictet", L"pictures", L"pid", L"pin", L"ping", L"pink", L"pioneer", L"pizza",
+        L"pk", L"pl", L"place", L"play", L"playstation", L"plumbing", L"plus", L"pm", L"pn", L"pnc", L"pohl", L"poker",
+        L"politie", L"porn", L"post", L"pr", L"pramerica", L"praxi", L"press", L"prime", L"pro", L"prod",
+        L"productions", L"prof", L"progressive", L"promo", L"properties", L"property", L"protection", L"pru",
+        L"prudential", L"ps", L"pt", L"pub", L"pw", L"pwc", L"py", L"qa", L"qpon", L"quebec", L"quest", L"racing",
+        L"radio", L"re", L"read", L"realestate", L"realtor", L"realty", L"recipes", L"red", L"redstone", L"redumbrella",
+        L"rehab", L"reise", L"reisen", L"reit", L"reliance", L"ren", L"rent", L"rentals", L"repair", L"report",
+        L"republican", L"rest", L"restaurant", L"review", L"reviews", L"rexroth", L"rich", L"richardli", L"ricoh",
+        L"ril", L"rio", L"rip", L"ro", L"rocher", L"rocks", L"rodeo", L"rogers", L"room", L"rs", L"rsvp", L"ru",
+        L"rugby", L"ruhr", L"run", L"rw", L"rwe", L"ryukyu", L"sa", L"saarland", L"safe", L"safety", L"sakura", L"sale",
+        L"salon", L"samsclub", L"samsung", L"sandvik", L"sandvikcoromant", L"sanofi", L"sap", L"sarl", L"sas", L"save",
+        L"saxo", L"sb", L"sbi", L"sbs", L"sc", L"sca", L"scb", L"schaeffler", L"schmidt", L"scholarships", L"school",
+        L"schule", L"schwarz", L"science", L"scot", L"sd", L"se", L"search", L"seat", L"secure", L"security", L"seek",
+        L"select", L"sener", L"services", L"seven", L"sew", L"sex", L"sexy", L"sfr", L"sg", L"sh", L"shangrila",
+        L"sharp", L"shaw", L"shell", L"shia", L"shiksha", L"shoes", L"shop", L"shopping", L"shouji", L"show",
+        L"showtime", L"si", L"silk", L"sina", L"singles", L"site", L"sj", L"sk", L"ski", L"skin", L"sky", L"skype",
+        L"sl", L"sling", L"sm", L"smart", L"smile", L"sn", L"sncf", L"so", L"soccer", L"social", L"softbank",
+        L"software", L"sohu", L"solar", L"solutions", L"song", L"sony", L"soy", L"spa", L"space", L"sport", L"spot",
+        L"sr", L"srl", L"ss", L"st", L"stada", L"staples", L"star", L"statebank", L"statefarm", L"stc", L"stcgroup",
+        L"stockholm", L"storage", L"store", L"stream", L"studio", L"study", L"style", L"su", L"sucks", L"supplies",
+        L"supply", L"support", L"surf", L"surgery", L"suzuki", L"sv", L"swatch", L"swiss", L"sx", L"sy", L"sydney",
+        L"systems", L"sz", L"tab", L"taipei", L"talk", L"taobao", L"target", L"tatamotors", L"tatar", L"tattoo", L"tax",
+        L"taxi", L"tc", L"tci", L"td", L"tdk", L"team", L"tech", L"technology", L"tel", L"temasek", L"tennis", L"test",
+        L"teva", L"tf", L"tg", L"th", L"thd", L"theater", L"theatre", L"tiaa", L"tickets", L"tienda", L"tiffany",
+        L"tips", L"tires", L"tirol", L"tj", L"tjmaxx", L"tjx", L"tk", L"tkmaxx", L"tl", L"tm", L"tmall", L"tn", L"to",
+        L"today", L"tokyo", L"tools", L"top", L"toray", L"toshiba", L"total", L"tours", L"town", L"toyota", L"toys",
+        L"tr", L"trade", L"trading", L"training", L"travel", L"travelchannel", L"travelers", L"travelersinsurance",
+        L"trust", L"trv", L"tt", L"tube", L"tui", L"tunes", L"tushu", L"tv", L"tvs", L"tw", L"tz", L"ua", L"ubank",
+        L"ubs", L"ug", L"uk", L"unicom", L"university", L"uno", L"uol", L"ups", L"us", L"uy", L"uz", L"va",
+        L"vacations", L"vana", L"vanguard", L"vc", L"ve", L"vegas", L"ventures", L"verisign", L"versicherung", L"vet",
+        L"vg", L"vi", L"viajes", L"video", L"vig", L"viking", L"villas", L"vin", L"vip", L"virgin", L"visa", L"vision",
+        L"viva", L"vivo", L"vlaanderen", L"vn", L"vodka", L"volkswagen", L"volvo", L"vote", L"voting", L"voto",
+        L"voyage", L"vu", L"vuelos", L"wales", L"walmart", L"walter", L"wang", L"wanggou", L"watch", L"watches",
+        L"weather", L"weatherchannel", L"webcam", L"weber", L"website", L"wedding", L"weibo", L"weir", L"wf",
+        L"whoswho", L"wien", L"wiki", L"williamhill", L"win", L"windows", L"wine", L"winners", L"wme", L"wolterskluwer",
+        L"woodside", L"work", L"works", L"world", L"wow", L"ws", L"wtc", L"wtf", L"xbox", L"xerox", L"xfinity",
+        L"xihuan", L"xin", L"xxx", L"xyz", L"yachts", L"yahoo", L"yamaxun", L"yandex", L"ye", L"yodobashi", L"yoga",
+        L"yokohama", L"you", L"youtube", L"yt", L"yun", L"zappos", L"zara", L"zero", L"zip", L"zm", L"zone", L"zuerich",
+        L"zw"
+    };
+
+    // Suffixes under which anyone can register a name, a host that is one of
+    // them is no site. The most used of the public suffix list only.
+    const wchar_t* const c_publicSuffixes[] =
+    {
+        L"ac.il", L"ac.jp", L"ac.th", L"ac.uk", L"co.id", L"co.il", L"co.in", L"co.jp", L"co.kr", L"co.nz", L"co.th",
+        L"co.uk", L"co.za", L"com.ar", L"com.au", L"com.br", L"com.cn", L"com.eg", L"com.hk", L"com.mx", L"com.my",
+        L"com.ph", L"com.pk", L"com.pl", L"com.ru", L"com.sa", L"com.sg", L"com.tr", L"com.tw", L"com.ua", L"com.vn",
+        L"edu.au", L"go.id", L"go.jp", L"go.kr", L"go.th", L"gob.ar", L"gob.mx", L"gov.au", L"gov.br", L"gov.cn",
+        L"gov.hk", L"gov.in", L"gov.sg", L"gov.tr", L"gov.tw", L"gov.uk", L"gov.za", L"ltd.uk", L"me.uk", L"ne.jp",
+        L"net.au", L"net.br", L"net.cn", L"net.in", L"net.nz", L"net.uk", L"or.id", L"or.jp", L"or.kr", L"org.au",
+        L"org.br", L"org.cn", L"org.hk", L"org.il", L"org.in", L"org.mx", L"org.nz", L"org.tr", L"org.tw", L"org.uk",
+        L"org.za", L"plc.uk", L"sch.uk"
+    };
+
+    bool IsInTable(const wchar_t* const* begin, const wchar_t* const* end, const std::wstring& name)
+    {
+        return std::binary_search(begin, end, name.c_str(), [](const wchar_t* a, const wchar_t* b)
+        {
+            return wcscmp(a, b) < 0;
+        });
+    }
+
+    // The ASCII characters RFC 3986 allows anywhere in a URI, reserved and
+    // unreserved, and the percent sign of encoded ones
+    bool IsUriCharacter(wchar_t c)
+    {
+        return c >= L'!' && c <= L'~' && c != L'"' && c != L'<' && c != L'>' && c != L'\\' &&
+            c != L'^' && c != L'`' && c != L'{' && c != L'|' && c != L'}';
+    }
+
+    bool IsSpace(wchar_t c)
+    {
+        return iswspace(c) || c == 0x00A0 || c == 0x1680 || (c >= 0x2000 && c <= 0x200B) || c == 0x2028 ||
+            c == 0x2029 || c == 0x202F || c == 0x205F || c == 0x3000 || c == 0xFEFF;
+    }
+
+    bool IsAsciiAlpha(wchar_t c)
+    {
+        return (c >= L'a' && c <= L'z') || (c >= L'A' && c <= L'Z');
+    }
+
+    bool IsAsciiDigit(wchar_t c)
+    {
+        return c >= L'0' && c <= L'9';
+    }
+
+    std::wstring ToLowerAscii(std::wstring text)
+    {
+        for (wchar_t& c : text)
+        {
+            if (c >= L'A' && c <= L'Z')
+            {
+                c += L'a' - L'A';
+            }
+        }
+        return text;
+    }
+
+    std::wstring Trim(const std::wstring& text)
+    {
+        size_t begin = 0;
+        size_t end = text.size();
+        while (begin < end && IsSpace(text[begin]))
+        {
+            ++begin;
+        }
+        while (end > begin && IsSpace(text[end - 1]))
+        {
+            --end;
+        }
+        return text.substr(begin, end - begin);
+    }
+}
+
+void AddressClassifier::SetSearchTemplate(const std::wstring& searchTemplate)
+{
+    if (IsValidSearchTemplate(searchTemplate))
+    {
+        m_searchTemplate = searchTemplate;
+    }
+}
+
+bool AddressClassifier::IsValidSearchTemplate(const std::wstring& searchTemplate)
+{
+    bool isWeb = searchTemplate.compare(0, 7, L"http://") == 0 || searchTemplate.compare(0, 8, L"https://") == 0;
+    return isWeb && searchTemplate.find(L"%s") != std::wstring::npos &&
+        FindNonUriCharacter(searchTemplate.c_str(), searchTemplate.size()) == searchTemplate.size();
+}
+
+AddressClassifier::Result AddressClassifier::Classify(const std::wstring& input) const
+{
+    Result result;
+    std::wstring text = Trim(input);
+    if (text.empty())
+    {
+        return result;
+    }
+
+    size_t schemeLength = GetSchemeLength(text);
+    if (schemeLength > 0)
+    {
+        std::wstring scheme = ToLowerAscii(text.substr(0, schemeLength));
+        std::wstring rest = text.substr(schemeLength + 1);
+
+        if (scheme.compare(L"http") == 0 || scheme.compare(L"https") == 0 || scheme.compare(L"ftp") == 0)
+        {
+            // "http:example.com" and "http:/example.com" read the way the
+            // URL parser does
+            rest.erase(0, (std::min)(rest.find_first_not_of(L"/\\"), rest.size()));
+            if (!rest.empty() && rest.find_first_of(L"/?#") != 0 &&
+                std::find_if(rest.begin(), rest.end(), IsSpace) == rest.end())
+            {
+                result.uri = scheme + L"://" + rest;
+                return result;
+            }
+        }
+        else if (scheme.compare(L"browser") == 0 && !rest.empty())
+        {
+            result.uri = scheme + L":" + rest;
+            return result;
+        }
+        else if (scheme.compare(L"file") == 0 && !rest.empty())
+        {
+            result.uri = scheme + L":" + EncodeSpaces(rest);
+            return result;
+        }
+        else if (schemeLength == 1 && (rest.empty() || rest[0] == L'\\' || rest[0] == L'/'))
+        {
+            // A drive letter, folder names may have spaces
+            std::wstring path = EncodeSpaces(text);
+            std::replace(path.begin(), path.end(), L'\\', L'/');
+            result.uri = L"file:///" + path;
+            return result;
+        }
+    }
+    else if (HasUriCharactersOnly(text))
+    {
+        size_t authorityEnd = text.find_first_of(L"/?#");
+        bool hasPath = authorityEnd != std::wstring::npos && text[authorityEnd] == L'/';
+        if (IsNavigableHost(text.substr(0, authorityEnd), hasPath))
+        {
+            result.uri = L"http://" + text;
+            return result;
+        }
+    }
+
+    result.uri = GetSearchUri(text);
+    result.isSearch = true;
+    return result;
+}
+
+std::wstring AddressClassifier::GetSearchUri(const std::wstring& query) const
+{
+    std::wstring uri = m_searchTemplate;
+    size_t placeholder = uri.find(L"%s");
+    return uri.replace(placeholder, 2, EncodeQuery(Trim(query)));
+}
+
+size_t AddressClassifier::FindNonUriCharacter(const wchar_t* text, size_t length)
+{
+    size_t i = 0;
+
+#ifdef ADDRESS_CLASSIFIER_SSE2
+    // '!' to '~' but for the nine characters RFC 3986 leaves out. The
+    // compares are signed, characters from U+8000 on are below '!'.
+    const __m128i first = _mm_set1_epi16(L'!');
+    const __m128i last = _mm_set1_epi16(L'~');
+    const __m128i excluded[] =
+    {
+        _mm_set1_epi16(L'"'), _mm_set1_epi16(L'<'), _mm_set1_epi16(L'>'),
+        _mm_set1_epi16(L'\\'), _mm_set1_epi16(L'^'), _mm_set1_epi16(L'`'),
+        _mm_set1_epi16(L'{'), _mm_set1_epi16(L'|'), _mm_set1_epi16(L'}'),
+    };
+
+    for (; i + 8 <= length; i += 8)
+    {
+#if WCHAR_MAX > 0xFFFF
+        // UTF-32, narrowed with signed saturation: anything past U+7FFF
+        // stays above '~'
+        __m128i chars = _mm_packs_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + 4)));
+#else
+        __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+#endif
+        __m128i invalid = _mm_or_si128(_mm_cmplt_epi16(chars, first), _mm_cmpgt_epi16(chars, last));
+        for (const __m128i& character : excluded)
+        {
+            invalid = _mm_or_si128(invalid, _mm_cmpeq_epi16(chars, character));
+        }
+
+        // Two mask bits per character
+        unsigned long mask = static_cast<unsigned long>(_mm_movemask_epi8(invalid));
+        if (mask != 0)
+        {
+#ifdef _MSC_VER
+            unsigned long bit = 0;
+            _BitScanForward(&bit, mask);
+#else
+            unsigned long bit = static_cast<unsigned long>(__builtin_ctz(mask));
+#endif
+            return i + bit / 2;
+        }
+    }
+#endif
+
+    for (; i < length; ++i)
+    {
+        if (!IsUriCharacter(text[i]))
+        {
+            return i;
+        }
+    }
+
+    return length;
+}
+
+size_t AddressClassifier::GetSchemeLength(const std::wstring& text)
+{
+    if (text.empty() || !IsAsciiAlpha(text[0]))
+    {
+        return 0;
+    }
+
+    size_t length = 1;
+    while (length < text.size() && (IsAsciiAlpha(text[length]) || IsAsciiDigit(text[length]) ||
+        text[length] == L'+' || text[length] == L'-' || text[length] == L'.'))
+    {
+        ++length;
+    }
+
+    if (length == text.size() || text[length] != L':')
+    {
+        return 0;
+    }
+
+    // Digits up to the path make it a port
+    size_t portEnd = text.find_first_not_of(L"0123456789", length + 1);
+    bool isPort = portEnd != length + 1 && (portEnd == std::wstring::npos || text[portEnd] == L'/' ||
+        text[portEnd] == L'?' || text[portEnd] == L'#');
+    return isPort ? 0 : length;
+}
+
+bool AddressClassifier::HasUriCharactersOnly(const std::wstring& text)
+{
+    // Letters beyond ASCII are encoded by the navigation, spaces aren't
+    size_t i = 0;
+    while ((i += FindNonUriCharacter(text.c_str() + i, text.size() - i)) < text.size())
+    {
+        if (text[i] < 0x80 || IsSpace(text[i]))
+        {
+            return false;
+        }
+        ++i;
+    }
+
+    return true;
+}
+
+bool AddressClassifier::IsNavigableHost(const std::wstring& authority, bool hasPath)
+{
+    // Credentials aren't part of the host
+    std::wstring host = ToLowerAscii(authority.substr(authority.rfind(L'@') + 1));
+
+    if (!host.empty() && host[0] == L'[')
+    {
+        size_t end = host.find(L']');
+        return end != std::wstring::npos && end > 1 &&
+            host.find_first_not_of(L"0123456789abcdef:.", 1) == end &&
+            (end + 1 == host.size() || host[end + 1] == L':');
+    }
+
+    bool hasPort = false;
+    size_t colon = host.rfind(L':');
+    if (colon != std::wstring::npos)
+    {
+        std::wstring port = host.substr(colon + 1);
+        if (port.empty() || port.size() > 5 || port.find_first_not_of(L"0123456789") != std::wstring::npos ||
+            std::stoi(port) > 65535)
+        {
+            return false;
+        }
+        hasPort = true;
+        host.erase(colon);
+    }
+
+    if (!host.empty() && host.back() == L'.')
+    {
+        host.pop_back();
+    }
+
+    if (host.empty() || !IsDomainName(host))
+    {
+        return IsIPv4Address(host);
+    }
+
+    if (host.compare(L"localhost") == 0 || IsIPv4Address(host))
+    {
+        return true;
+    }
+
+    // A single word is searched for, unless it's clearly an intranet host
+    size_t lastDot = host.rfind(L'.');
+    if (lastDot == std::wstring::npos)
+    {
+        return hasPort || hasPath;
+    }
+
+    // Like "node.js", a name with a port only
+    if (!IsKnownTopLevelDomain(host.substr(lastDot + 1)))
+    {
+        return hasPort;
+    }
+
+    return !IsPublicSuffix(host);
+}
+
+bool AddressClassifier::IsIPv4Address(const std::wstring& host)
+{
+    size_t parts = 0;
+    size_t start = 0;
+    while (start <= host.size())
+    {
+        size_t end = (std::min)(host.find(L'.', start), host.size());
+        size_t length = end - start;
+        if (length == 0 || length > 3 || host.find_first_not_of(L"0123456789", start) < end ||
+            std::stoi(host.substr(start, length)) > 255)
+        {
+            return false;
+        }
+
+        ++parts;
+        start = end + 1;
+    }
+
+    return parts == 4;
+}
+
+bool AddressClassifier::IsDomainName(const std::wstring& host)
+{
+    if (host.size() > 253)
+    {
+        return false;
+    }
+
+    // Labels of letters, digits, hyphens and underscores, or characters
+    // beyond ASCII for international names
+    size_t start = 0;
+    while (start <= host.size())
+    {
+        size_t end = (std::min)(host.find(L'.', start), host.size());
+        if (end == start || end - start > 63 || host[start] == L'-' || host[end - 1] == L'-')
+        {
+            return false;
+        }
+
+        for (size_t i = start; i < end; ++i)
+        {
+            wchar_t c = host[i];
+            if (!IsAsciiAlpha(c) && !IsAsciiDigit(c) && c != L'-' && c != L'_' && c < 0x80)
+            {
+                return false;
+            }
+        }
+
+        start = end + 1;
+    }
+
+    return true;
+}
+
+bool AddressClassifier::IsKnownTopLevelDomain(const std::wstring& label)
+{
+    // Punycode and native international ones aren't listed
+    if (label.compare(0, 4, L"xn--") == 0 ||
+        std::find_if(label.begin(), label.end(), [](wchar_t c) { return c >= 0x80; }) != label.end())
+    {
+        return true;
+    }
+
+    return IsInTable(std::begin(c_topLevelDomains), std::end(c_topLevelDomains), label);
+}
+
+bool AddressClassifier::IsPublicSuffix(const std::wstring& host)
+{
+    return IsInTable(std::begin(c_publicSuffixes), std::end(c_publicSuffixes), host);
+}
+
+std::wstring AddressClassifier::EncodeSpaces(const std::wstring& path)
+{
+    std::wstring encoded;
+    for (wchar_t c : path)
+    {
+        encoded += IsSpace(c) ? EncodeQuery(std::wstring(1, c)) : std::wstring(1, c);
+    }
+
+    return encoded;
+}
+
+std::wstring AddressClassifier::EncodeQuery(const std::wstring& query)
+{
+    // As encodeURIComponent does: UTF-8, then everything but the unreserved
+    // characters percent-encoded
+    std::string utf8;
+    for (size_t i = 0; i < query.size(); ++i)
+    {
+        uint32_t c = static_cast<uint32_t>(query[i]);
+        if (c >= 0xD800 && c <= 0xDBFF && i + 1 < query.size() && query[i + 1] >= 0xDC00 && query[i + 1] <= 0xDFFF)
+        {
+            c = 0x10000 + ((c - 0xD800) << 10) + (static_cast<uint32_t>(query[++i]) - 0xDC00);
+        }
+        else if (c >= 0xD800 && c <= 0xDFFF)
+        {
+            c = 0xFFFD;
+        }
+
+        if (c < 0x80)
+        {
+            utf8 += static_cast<char>(c);
+        }
+        else if (c < 0x800)
+        {
+            utf8 += static_cast<char>(0xC0 | (c >> 6));
+            utf8 += static_cast<char>(0x80 | (c & 0x3F));
+        }
+        else if (c < 0x10000)
+        {
+            utf8 += static_cast<char>(0xE0 | (c >> 12));
+            utf8 += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            utf8 += static_cast<char>(0x80 | (c & 0x3F));
+        }
+        else
+        {
+            utf8 += static_cast<char>(0xF0 | (c >> 18));
+            utf8 += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+            utf8 += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            utf8 += static_cast<char>(0x80 | (c & 0x3F));
+        }
+    }
+
+    const wchar_t* hex = L"0123456789ABCDEF";
+    std::wstring encoded;
+    encoded.reserve(utf8.size() * 3);
+    for (char byte : utf8)
+    {
+        unsigned char c = static_cast<unsigned char>(byte);
+        if (IsAsciiAlpha(c) || IsAsciiDigit(c) || (c != 0 && strchr("-_.!~*'()", c)))
+        {
+            encoded += static_cast<wchar_t>(c);
+        }
+        else
+        {
+            encoded += L'%';
+            encoded += hex[c >> 4];
+            encoded += hex[c & 0xF];
+        }
+    }
+
+    return encoded;
+}
@@ -0,0 +1,62 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+// Standard library only, so the classifier also builds for the tests in
+// tools/native
+#include <string>
+
+// Decides whether text typed in the address bar is an address or a search,
+// without trying to navigate first:
+//
+// * With a scheme, http, https, ftp, file and browser URIs are navigated to,
+//   any other scheme is searched for.
+// * Without one, the text has to be made of the characters RFC 3986 allows
+//   (letters beyond ASCII are fine, for international domain names) and its
+//   host has to be an IP literal, localhost, a name ending in a top level
+//   domain of the root zone that isn't just a public suffix like co.uk, or
+//   an intranet
+//   name followed by a port or a slash ("wiki/" or "build:8080").
+//
+// Anything else goes to the search provider's template, where %s stands for
+// the percent-encoded query.
+class AddressClassifier
+{
+public:
+    struct Result
+    {
+        std::wstring uri;
+        bool isSearch = false;
+    };
+
+    static constexpr const wchar_t* c_defaultSearchTemplate = L"https://www.bing.com/search?q=%s";
+
+    // Ignored unless IsValidSearchTemplate
+    void SetSearchTemplate(const std::wstring& searchTemplate);
+    Result Classify(const std::wstring& text) const;
+    std::wstring GetSearchUri(const std::wstring& query) const;
+
+    static bool IsValidSearchTemplate(const std::wstring& searchTemplate);
+    // Index of the first character of |text| that isn't one of the ASCII
+    // characters allowed in a URI, |length| if there's none. Eight
+    // characters at a time where SSE2 is available.
+    static size_t FindNonUriCharacter(const wchar_t* text, size_t length);
+
+protected:
+    std::wstring m_searchTemplate = c_defaultSearchTemplate;
+
+    // Length of the scheme |text| starts with, 0 if none; "host:port" isn't
+    // a scheme
+    static size_t GetSchemeLength(const std::wstring& text);
+    static bool HasUriCharactersOnly(const std::wstring& text);
+    static bool IsNavigableHost(const std::wstring& authority, bool hasPath);
+    static bool IsIPv4Address(const std::wstring& host);
+    static bool IsDomainName(const std::wstring& host);
+    static bool IsKnownTopLevelDomain(const std::wstring& label);
+    static bool IsPublicSuffix(const std::wstring& host);
+    static std::wstring EncodeQuery(const std::wstring& query);
+    // Whitespace in local paths percent-encoded, the rest left as it is
+    static std::wstring EncodeSpaces(const std::wstring& path);
+};
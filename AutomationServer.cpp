@@ -0,0 +1,329 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "BrowserWindow.h"
+#include "AutomationServer.h"
+
+AutomationServer::~AutomationServer()
+{
+    if (!m_thread.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeEvent.SetEvent();
+    m_thread.join();
+}
+
+HRESULT AutomationServer::Start(HWND hWnd, const std::wstring& pipeName, RequestHandler handler)
+{
+    m_hWnd = hWnd;
+    m_pipeName = pipeName;
+    m_handler = handler;
+    RETURN_IF_FAILED(m_wakeEvent.create(wil::EventOptions::None));
+
+    m_thread = std::thread([this]()
+    {
+        Run();
+    });
+
+    return S_OK;
+}
+
+bool AutomationServer::IsStopping()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stopping;
+}
+
+void AutomationServer::Run()
+{
+    wil::unique_event connectEvent;
+    if (FAILED(connectEvent.create(wil::EventOptions::ManualReset)))
+    {
+        return;
+    }
+
+    while (!IsStopping())
+    {
+        // A single instance that fails if another process has the name
+        wil::unique_hfile pipe(CreateNamedPipeW(m_pipeName.c_str(),
+            PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+            PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+            1, 64 * 1024, 64 * 1024, 0, nullptr));
+        if (!pipe)
+        {
+            OutputDebugString(L"Can't create the automation pipe\n");
+            return;
+        }
+
+        OVERLAPPED overlapped = {};
+        overlapped.hEvent = connectEvent.get();
+        bool connected = ConnectNamedPipe(pipe.get(), &overlapped) != FALSE;
+        DWORD error = GetLastError();
+        if (!connected && error == ERROR_IO_PENDING)
+        {
+            HANDLE handles[] = { m_wakeEvent.get(), connectEvent.get() };
+            if (WaitForMultipleObjects(ARRAYSIZE(handles), handles, FALSE, INFINITE) != WAIT_OBJECT_0 + 1)
+            {
+                CancelIoEx(pipe.get(), &overlapped);
+                DWORD bytes;
+                GetOverlappedResult(pipe.get(), &overlapped, &bytes, TRUE);
+                continue;
+            }
+
+            DWORD bytes;
+            connected = GetOverlappedResult(pipe.get(), &overlapped, &bytes, FALSE) != FALSE;
+        }
+        else if (!connected)
+        {
+            connected = error == ERROR_PIPE_CONNECTED;
+        }
+
+        if (!connected)
+        {
+            continue;
+        }
+
+        uint64_t connection;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            connection = ++m_connection;
+            m_answers.clear();
+            m_inFlight = 0;
+        }
+
+        OutputDebugString(L"Automation client connected\n");
+        Serve(pipe.get(), connection);
+        DisconnectNamedPipe(pipe.get());
+        OutputDebugString(L"Automation client disconnected\n");
+    }
+}
+
+void AutomationServer::Serve(HANDLE pipe, uint64_t connection)
+{
+    wil::unique_event readEvent;
+    wil::unique_event writeEvent;
+    if (FAILED(readEvent.create(wil::EventOptions::ManualReset)) ||
+        FAILED(writeEvent.create(wil::EventOptions::ManualReset)))
+    {
+        return;
+    }
+
+    OVERLAPPED readOverlapped = {};
+    OVERLAPPED writeOverlapped = {};
+    readOverlapped.hEvent = readEvent.get();
+    writeOverlapped.hEvent = writeEvent.get();
+    char readBuffer[16 * 1024];
+    std::string line;
+    std::string writing;
+    bool reading = false;
+    bool writePending = false;
+
+    while (true)
+    {
+        bool canRead;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopping)
+            {
+                break;
+            }
+
+            canRead = m_inFlight < c_maxInFlight;
+            // Everything answered since the last write goes out in one
+            if (writing.empty())
+            {
+                for (const std::string& answer : m_answers)
+                {
+                    writing += answer;
+                }
+                m_answers.clear();
+            }
+        }
+
+        if (!writePending && !writing.empty())
+        {
+            if (!WriteFile(pipe, writing.data(), static_cast<DWORD>(writing.size()), nullptr, &writeOverlapped) &&
+                GetLastError() != ERROR_IO_PENDING)
+            {
+                break;
+            }
+            writePending = true;
+        }
+
+        if (!reading && canRead)
+        {
+            if (!ReadFile(pipe, readBuffer, sizeof(readBuffer), nullptr, &readOverlapped) &&
+                GetLastError() != ERROR_IO_PENDING)
+            {
+                break;
+            }
+            reading = true;
+        }
+
+        HANDLE handles[3] = { m_wakeEvent.get() };
+        DWORD count = 1;
+        if (reading)
+        {
+            handles[count++] = readEvent.get();
+        }
+        if (writePending)
+        {
+            handles[count++] = writeEvent.get();
+        }
+
+        DWORD wait = WaitForMultipleObjects(count, handles, FALSE, INFINITE);
+        if (wait == WAIT_OBJECT_0)
+        {
+            continue;
+        }
+        if (wait >= WAIT_OBJECT_0 + count)
+        {
+            break;
+        }
+
+        DWORD bytes = 0;
+        if (handles[wait - WAIT_OBJECT_0] == writeEvent.get())
+        {
+            writePending = false;
+            if (!GetOverlappedResult(pipe, &writeOverlapped, &bytes, FALSE))
+            {
+                break;
+            }
+            writing.erase(0, bytes);
+            continue;
+        }
+
+        reading = false;
+        if (!GetOverlappedResult(pipe, &readOverlapped, &bytes, FALSE))
+        {
+            break;  // The client went away
+        }
+
+        const char* data = readBuffer;
+        const char* end = readBuffer + bytes;
+        while (data < end)
+        {
+            const char* newline = static_cast<const char*>(memchr(data, '\n', end - data));
+            if (!newline)
+            {
+                line.append(data, end);
+                break;
+            }
+
+            line.append(data, newline);
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            if (!line.empty())
+            {
+                Dispatch(line, connection);
+            }
+            line.clear();
+            data = newline + 1;
+        }
+
+        if (line.size() > c_maxLineBytes)
+        {
+            OutputDebugString(L"Automation request too long, disconnecting\n");
+            break;
+        }
+    }
+
+    // The buffers are on this stack, wait for the I/O still going on
+    CancelIoEx(pipe, nullptr);
+    DWORD bytes;
+    if (reading)
+    {
+        GetOverlappedResult(pipe, &readOverlapped, &bytes, TRUE);
+    }
+    if (writePending)
+    {
+        GetOverlappedResult(pipe, &writeOverlapped, &bytes, TRUE);
+    }
+}
+
+void AutomationServer::Dispatch(const std::string& line, uint64_t connection)
+{
+    ++m_requestCount;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_inFlight;
+    }
+
+    web::json::value request;
+    try
+    {
+        request = web::json::value::parse(utility::conversions::utf8_to_utf16(line));
+    }
+    catch (const std::exception&)
+    {
+        request = web::json::value::null();
+    }
+
+    web::json::value id = request.is_object() && request.has_field(L"id") ? request.at(L"id") : web::json::value::null();
+    Responder respond = [this, connection, id](HRESULT hr, const web::json::value& result)
+    {
+        web::json::value answer = web::json::value::object();
+        answer[L"id"] = id;
+        if (SUCCEEDED(hr))
+        {
+            answer[L"result"] = result;
+        }
+        else
+        {
+            WCHAR code[16];
+            StringCchPrintf(code, ARRAYSIZE(code), L"0x%08X", static_cast<unsigned int>(hr));
+            answer[L"error"] = web::json::value(code);
+            if (result.is_string())
+            {
+                answer[L"message"] = result;
+            }
+        }
+
+        Answer(connection, answer);
+    };
+
+    if (!request.is_object() || !request.has_field(L"command") || !request.at(L"command").is_string())
+    {
+        respond(E_INVALIDARG, web::json::value(L"Expected a JSON object with a command"));
+        return;
+    }
+
+    std::wstring command = request.at(L"command").as_string();
+    web::json::value args = request.has_field(L"args") && request.at(L"args").is_object() ?
+        request.at(L"args") : web::json::value::object();
+
+    RequestHandler handler = m_handler;
+    BrowserWindow::PostToUIThread(m_hWnd, [handler, command, args, respond]()
+    {
+        handler(command, args, respond);
+    });
+}
+
+void AutomationServer::Answer(uint64_t connection, web::json::value answer)
+{
+    std::string line = utility::conversions::to_utf8string(answer.serialize()) + "\n";
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (connection != m_connection)
+        {
+            return;
+        }
+
+        if (m_inFlight > 0)
+        {
+            --m_inFlight;
+        }
+        m_answers.push_back(std::move(line));
+    }
+
+    m_wakeEvent.SetEvent();
+}
@@ -0,0 +1,67 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <wil/resource.h>
+
+// Local control endpoint for scripted testing, opened only when the browser
+// is started with --automation[=<pipe name>]. A client connects to the
+// named pipe and writes one JSON request per line:
+//
+//   {"id": 7, "command": "navigate", "args": {"uri": "https://example.com"}}
+//
+// and reads one line back for every request, in the order they complete:
+//
+//   {"id": 7, "result": {...}}
+//   {"id": 7, "error": "0x80070057", "message": "..."}
+//
+// Requests can be pipelined. Up to c_maxInFlight run at a time; past that
+// the server stops reading until answers go out. One client at a time,
+// local clients only. The pipe is served by an overlapped I/O thread, the
+// requests run on the UI thread.
+class AutomationServer
+{
+public:
+    static const size_t c_maxInFlight = 256;
+    static const size_t c_maxLineBytes = 1024 * 1024;
+    static constexpr const wchar_t* c_defaultPipeName = L"\\\\.\\pipe\\wvbrowser-automation";
+
+    // Answers a request, from any thread; a failed |hr| is sent as an
+    // error with |result| as the message if it's a string
+    typedef std::function<void(HRESULT hr, const web::json::value& result)> Responder;
+    typedef std::function<void(const std::wstring& command, const web::json::value& args, Responder respond)> RequestHandler;
+
+    ~AutomationServer();
+
+    // |handler| runs on the UI thread of |hWnd| and must call its responder
+    // once, now or later
+    HRESULT Start(HWND hWnd, const std::wstring& pipeName, RequestHandler handler);
+    bool IsRunning() const { return m_thread.joinable(); }
+    uint64_t GetRequestCount() const { return m_requestCount; }
+
+protected:
+    HWND m_hWnd = nullptr;
+    std::wstring m_pipeName;
+    RequestHandler m_handler;
+    std::thread m_thread;
+    wil::unique_event m_wakeEvent;  // Answers queued, or stopping
+    std::atomic<uint64_t> m_requestCount{ 0 };
+
+    std::mutex m_mutex;
+    std::deque<std::string> m_answers;  // Lines to write to the client
+    size_t m_inFlight = 0;
+    uint64_t m_connection = 0;  // Answers for an earlier client are dropped
+    bool m_stopping = false;
+
+    void Run();
+    void Serve(HANDLE pipe, uint64_t connection);
+    void Dispatch(const std::string& line, uint64_t connection);
+    void Answer(uint64_t connection, web::json::value answer);
+    bool IsStopping();
+};
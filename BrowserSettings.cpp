@@ -0,0 +1,314 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "BrowserSettings.h"
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    SiteSetting SiteSettingFromJson(const web::json::value& object, const wchar_t* key)
+    {
+        if (!object.has_field(key) || !object.at(key).is_string())
+        {
+            return SiteSetting::Default;
+        }
+
+        const utility::string_t& value = object.at(key).as_string();
+        if (value.compare(L"allow") == 0)
+        {
+            return SiteSetting::Allow;
+        }
+
+        return value.compare(L"block") == 0 ? SiteSetting::Block : SiteSetting::Default;
+    }
+
+    void SiteSettingToJson(web::json::value& object, const wchar_t* key, SiteSetting setting)
+    {
+        if (setting != SiteSetting::Default)
+        {
+            object[key] = web::json::value(setting == SiteSetting::Allow ? L"allow" : L"block");
+        }
+    }
+
+    void UpdateBool(const web::json::value& update, const wchar_t* key, bool& target)
+    {
+        if (update.has_field(key) && update.at(key).is_boolean())
+        {
+            target = update.at(key).as_bool();
+        }
+    }
+
+    void UpdateNumber(const web::json::value& update, const wchar_t* key, double min, double max, double& target)
+    {
+        if (update.has_field(key) && update.at(key).is_number())
+        {
+            target = (std::max)(min, (std::min)(max, update.at(key).as_double()));
+        }
+    }
+
+    bool UpdateTrimmedString(const web::json::value& update, const wchar_t* key, std::wstring& target)
+    {
+        if (!update.has_field(key) || !update.at(key).is_string())
+        {
+            return false;
+        }
+
+        target = update.at(key).as_string();
+        target.erase(0, target.find_first_not_of(L" \t"));
+        target.erase(target.find_last_not_of(L" \t") + 1);
+
+        return true;
+    }
+}
+
+HRESULT BrowserSettings::Load(const std::wstring& path)
+{
+    m_path = path;
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        // First run, keep the defaults
+        return S_FALSE;
+    }
+
+    std::stringstream contents;
+    contents << file.rdbuf();
+
+    try
+    {
+        Update(web::json::value::parse(utility::conversions::to_string_t(contents.str())));
+    }
+    catch (const web::json::json_exception&)
+    {
+        OutputDebugString(L"Ignoring malformed settings file\n");
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    return S_OK;
+}
+
+HRESULT BrowserSettings::Save() const
+{
+    if (m_path.empty())
+    {
+        return E_UNEXPECTED;
+    }
+
+    std::ofstream file(m_path, std::ios::binary | std::ios::trunc);
+    file << utility::conversions::to_utf8string(ToJson().serialize());
+
+    return file ? S_OK : E_FAIL;
+}
+
+void BrowserSettings::Update(const web::json::value& update)
+{
+    if (!update.is_object())
+    {
+        return;
+    }
+
+    UpdateBool(update, L"scriptsEnabled", scriptsEnabled);
+    UpdateBool(update, L"blockPopups", blockPopups);
+    UpdateBool(update, L"imagesEnabled", imagesEnabled);
+    UpdateBool(update, L"throttleBackgroundTabs", throttleBackgroundTabs);
+    UpdateNumber(update, L"backgroundThrottleDelay", 0, 3600, backgroundThrottleDelay);
+    UpdateNumber(update, L"backgroundThrottleRate", 1, 100, backgroundThrottleRate);
+    UpdateNumber(update, L"memoryBudget", 0, 1024 * 1024, memoryBudget);
+    UpdateNumber(update, L"cacheQuota", 0, 1024 * 1024, cacheQuota);
+    UpdateNumber(update, L"siteDataQuota", 0, 1024 * 1024, siteDataQuota);
+
+    // Cleared goes back to the local page
+    if (UpdateTrimmedString(update, L"startPage", startPage) && startPage.empty())
+    {
+        startPage = c_defaultStartPage;
+    }
+
+    // Replaced as a whole; anything but HTTP(S) origins is left out
+    if (update.has_field(L"sharedCacheOrigins") && update.at(L"sharedCacheOrigins").is_array())
+    {
+        sharedCacheOrigins.clear();
+        for (const auto& item : update.at(L"sharedCacheOrigins").as_array())
+        {
+            std::wstring origin = item.is_string() ? item.as_string() : L"";
+            std::transform(origin.begin(), origin.end(), origin.begin(), towlower);
+            size_t schemeEnd = origin.find(L"://");
+            origin = origin.substr(0, origin.find_first_of(L"/?#", schemeEnd == std::wstring::npos ? 0 : schemeEnd + 3));
+            if ((origin.compare(0, 7, L"http://") == 0 && origin.size() > 7) ||
+                (origin.compare(0, 8, L"https://") == 0 && origin.size() > 8))
+            {
+                sharedCacheOrigins.push_back(origin);
+            }
+        }
+    }
+
+    // Cleared or without a %s goes back to the default provider
+    if (UpdateTrimmedString(update, L"searchTemplate", searchTemplate) &&
+        !AddressClassifier::IsValidSearchTemplate(searchTemplate))
+    {
+        searchTemplate = AddressClassifier::c_defaultSearchTemplate;
+    }
+
+    // The controls UI talks to the sync server over plain HTTP(S) only
+    if (UpdateTrimmedString(update, L"syncServer", syncServer))
+    {
+        if (syncServer.compare(0, 7, L"http://") != 0 && syncServer.compare(0, 8, L"https://") != 0)
+        {
+            syncServer.clear();
+        }
+        while (!syncServer.empty() && syncServer.back() == L'/')
+        {
+            syncServer.pop_back();
+        }
+    }
+
+    if (update.has_field(L"preload") && update.at(L"preload").is_string())
+    {
+        const utility::string_t& preload = update.at(L"preload").as_string();
+        preloadMode = preload.compare(L"off") == 0 ? PreloadMode::Off :
+            preload.compare(L"prerender") == 0 ? PreloadMode::Prerender : PreloadMode::Preconnect;
+    }
+
+    // {"overrides": {"example.com": {"scripts": "block"}}} replaces the
+    // overrides for the listed hosts; an empty object removes them.
+    if (update.has_field(L"overrides") && update.at(L"overrides").is_object())
+    {
+        for (const auto& entry : update.at(L"overrides").as_object())
+        {
+            std::wstring host = entry.first;
+            std::transform(host.begin(), host.end(), host.begin(), towlower);
+
+            SiteSettings site;
+            if (entry.second.is_object())
+            {
+                site.scripts = SiteSettingFromJson(entry.second, L"scripts");
+                site.popups = SiteSettingFromJson(entry.second, L"popups");
+                site.images = SiteSettingFromJson(entry.second, L"images");
+            }
+
+            if (host.empty() || (site.scripts == SiteSetting::Default &&
+                site.popups == SiteSetting::Default && site.images == SiteSetting::Default))
+            {
+                m_siteOverrides.erase(host);
+            }
+            else
+            {
+                m_siteOverrides[host] = site;
+            }
+        }
+    }
+}
+
+web::json::value BrowserSettings::ToJson() const
+{
+    web::json::value settings = web::json::value::object();
+    settings[L"scriptsEnabled"] = web::json::value::boolean(scriptsEnabled);
+    settings[L"blockPopups"] = web::json::value::boolean(blockPopups);
+    settings[L"imagesEnabled"] = web::json::value::boolean(imagesEnabled);
+    settings[L"throttleBackgroundTabs"] = web::json::value::boolean(throttleBackgroundTabs);
+    settings[L"backgroundThrottleDelay"] = web::json::value::number(backgroundThrottleDelay);
+    settings[L"backgroundThrottleRate"] = web::json::value::number(backgroundThrottleRate);
+    settings[L"memoryBudget"] = web::json::value::number(memoryBudget);
+    settings[L"startPage"] = web::json::value(startPage);
+    settings[L"syncServer"] = web::json::value(syncServer);
+    settings[L"searchTemplate"] = web::json::value(searchTemplate);
+    settings[L"sharedCacheOrigins"] = web::json::value::array();
+    for (size_t i = 0; i < sharedCacheOrigins.size(); ++i)
+    {
+        settings[L"sharedCacheOrigins"][i] = web::json::value(sharedCacheOrigins[i]);
+    }
+    settings[L"cacheQuota"] = web::json::value::number(cacheQuota);
+    settings[L"siteDataQuota"] = web::json::value::number(siteDataQuota);
+    settings[L"preload"] = web::json::value(preloadMode == PreloadMode::Off ? L"off" :
+        preloadMode == PreloadMode::Prerender ? L"prerender" : L"preconnect");
+
+    web::json::value overrides = web::json::value::object();
+    for (const auto& site : m_siteOverrides)
+    {
+        web::json::value entry = web::json::value::object();
+        SiteSettingToJson(entry, L"scripts", site.second.scripts);
+        SiteSettingToJson(entry, L"popups", site.second.popups);
+        SiteSettingToJson(entry, L"images", site.second.images);
+        overrides[site.first] = entry;
+    }
+    settings[L"overrides"] = overrides;
+
+    return settings;
+}
+
+bool BrowserSettings::AreScriptsEnabledFor(const std::wstring& uri) const
+{
+    const SiteSettings* site = FindOverride(uri);
+    return Resolve(site ? site->scripts : SiteSetting::Default, scriptsEnabled);
+}
+
+bool BrowserSettings::ArePopupsBlockedFor(const std::wstring& uri) const
+{
+    const SiteSettings* site = FindOverride(uri);
+    return !Resolve(site ? site->popups : SiteSetting::Default, !blockPopups);
+}
+
+bool BrowserSettings::AreImagesEnabledFor(const std::wstring& uri) const
+{
+    const SiteSettings* site = FindOverride(uri);
+    return Resolve(site ? site->images : SiteSetting::Default, imagesEnabled);
+}
+
+bool BrowserSettings::BlocksImagesAnywhere() const
+{
+    return !imagesEnabled || std::any_of(m_siteOverrides.begin(), m_siteOverrides.end(),
+        [](const std::pair<const std::wstring, SiteSettings>& site) { return site.second.images == SiteSetting::Block; });
+}
+
+std::wstring BrowserSettings::GetHostFromUri(const std::wstring& uri)
+{
+    size_t schemeEnd = uri.find(L"://");
+    if (schemeEnd == std::wstring::npos)
+    {
+        return std::wstring();
+    }
+
+    size_t hostStart = schemeEnd + 3;
+    size_t hostEnd = uri.find_first_of(L":/?#", hostStart);
+    std::wstring host = uri.substr(hostStart, hostEnd == std::wstring::npos ? std::wstring::npos : hostEnd - hostStart);
+    std::transform(host.begin(), host.end(), host.begin(), towlower);
+
+    return host;
+}
+
+const SiteSettings* BrowserSettings::FindOverride(const std::wstring& uri) const
+{
+    if (m_siteOverrides.empty())
+    {
+        return nullptr;
+    }
+
+    // www.example.com, then example.com, then com
+    std::wstring host = GetHostFromUri(uri);
+    size_t labelStart = 0;
+    while (labelStart < host.size())
+    {
+        auto site = m_siteOverrides.find(host.substr(labelStart));
+        if (site != m_siteOverrides.end())
+        {
+            return &site->second;
+        }
+
+        size_t dot = host.find(L'.', labelStart);
+        if (dot == std::wstring::npos)
+        {
+            break;
+        }
+
+        labelStart = dot + 1;
+    }
+
+    return nullptr;
+}
+
+bool BrowserSettings::Resolve(SiteSetting setting, bool allowedByDefault)
+{
+    return setting == SiteSetting::Default ? allowedByDefault : setting == SiteSetting::Allow;
+}
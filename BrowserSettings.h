@@ -0,0 +1,88 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+#include "AddressClassifier.h"
+
+enum class SiteSetting
+{
+    Default,  // Follow the browser wide setting
+    Allow,
+    Block
+};
+
+// How far the browser goes ahead of the user on predicted navigations
+enum class PreloadMode
+{
+    Off,
+    Preconnect,  // DNS prefetch and connection warm-up only
+    Prerender    // Also load the top candidate in a hidden tab
+};
+
+struct SiteSettings
+{
+    SiteSetting scripts = SiteSetting::Default;
+    SiteSetting popups = SiteSetting::Default;
+    SiteSetting images = SiteSetting::Default;
+};
+
+// Content settings enforced by the host on every tab. The settings page
+// only displays and edits them; this class is the source of truth and is
+// persisted to settings.json in the app data directory.
+class BrowserSettings
+{
+public:
+    bool scriptsEnabled = true;
+    bool blockPopups = true;
+    bool imagesEnabled = true;
+    PreloadMode preloadMode = PreloadMode::Preconnect;
+    // Hidden tabs get their CPU throttled after a grace period, see
+    // BrowserWindow::ThrottleBackgroundTabs
+    bool throttleBackgroundTabs = true;
+    double backgroundThrottleDelay = 10;  // Seconds hidden before throttling
+    double backgroundThrottleRate = 4;  // CPU slowdown factor
+    // Private bytes of the tabs' processes in MB before background tabs are
+    // discarded, 0 for none, see MemoryMonitor
+    double memoryBudget = 1536;
+    // What new tabs open, a browser page or any URI
+    std::wstring startPage = c_defaultStartPage;
+    // Base URI of the favorites and history sync server, empty to not sync
+    std::wstring syncServer;
+    // Size limits of the tabs' data in MB, 0 for none, see StorageAuditor
+    double cacheQuota = 0;
+    double siteDataQuota = 0;
+    // Origins whose responses are kept in the SharedHttpCache, none by
+    // default
+    std::vector<std::wstring> sharedCacheOrigins;
+    // Where address bar searches go, %s stands for the query
+    std::wstring searchTemplate = AddressClassifier::c_defaultSearchTemplate;
+
+    static constexpr const wchar_t* c_defaultStartPage = L"browser://newtab";
+
+    HRESULT Load(const std::wstring& path);
+    HRESULT Save() const;
+
+    // Apply a (partial) update from the settings page
+    void Update(const web::json::value& update);
+    web::json::value ToJson() const;
+
+    // Effective settings for a document, site overrides first
+    bool AreScriptsEnabledFor(const std::wstring& uri) const;
+    bool ArePopupsBlockedFor(const std::wstring& uri) const;
+    bool AreImagesEnabledFor(const std::wstring& uri) const;
+    // False while images are allowed on every site
+    bool BlocksImagesAnywhere() const;
+
+    static std::wstring GetHostFromUri(const std::wstring& uri);
+
+protected:
+    std::wstring m_path;
+    std::map<std::wstring, SiteSettings> m_siteOverrides;  // By host
+
+    // Override for the host of |uri| or its closest parent domain
+    const SiteSettings* FindOverride(const std::wstring& uri) const;
+    static bool Resolve(SiteSetting setting, bool allowedByDefault);
+};
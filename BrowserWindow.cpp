@@ -12,6 +12,16 @@ using namespace Microsoft::WRL;
 WCHAR BrowserWindow::s_windowClass[] = { 0 };
 WCHAR BrowserWindow::s_title[] = { 0 };
 
+// Pages in wvbrowser_ui\content_ui that can be opened as browser://<page>
+const std::vector<std::wstring> BrowserWindow::s_browserPages = {
+    L"favorites",
+    L"settings",
+    L"history",
+    L"network",
+    L"downloads",
+    L"newtab"
+};
+
 //
 //  FUNCTION: RegisterClass()
 //
@@ -106,22 +116,81 @@ LRESULT CALLBACK BrowserWindow::WndProc(HWND hWnd, UINT message, WPARAM wParam,
         jsonObj[L"message"] = web::json::value(MG_CLOSE_WINDOW);
         jsonObj[L"args"] = web::json::value::parse(L"{}");
 
-        CheckFailure(PostJsonToWebView(jsonObj, m_controlsWebView.Get()), L"Try again.");
+        CheckFailure(PostJsonToControls(jsonObj), L"Try again.");
     }
     break;
     case WM_NCDESTROY:
     {
+        // Responses stored since the last timer
+        KillTimer(hWnd, SharedHttpCache::c_timerId);
+        m_sharedCache->Flush();
         SetWindowLongPtr(hWnd, GWLP_USERDATA, NULL);
         delete this;
         PostQuitMessage(0);
     }
+    break;
     case WM_PAINT:
     {
         PAINTSTRUCT ps;
         HDC hdc = BeginPaint(hWnd, &ps);
+        // The controls WebView is transparent until its page has painted
+        if (!m_controlsReady && m_controlsSnapshot.IsLoaded())
+        {
+            RECT bar;
+            GetClientRect(hWnd, &bar);
+            bar.bottom = bar.top + GetDPIAwareBound(c_uiBarHeight);
+            m_controlsSnapshot.Paint(hdc, bar, static_cast<double>(GetDpiForWindow(hWnd)) / DEFAULT_DPI);
+            if (!m_snapshotPainted)
+            {
+                m_snapshotPainted = true;
+                MarkStartup(L"snapshotPainted");
+            }
+        }
         EndPaint(hWnd, &ps);
     }
     break;
+    case WM_TIMER:
+    {
+        if (wParam == MemoryMonitor::c_timerId)
+        {
+            CheckFailure(EnforceMemoryBudget(), L"");
+        }
+        else if (wParam == c_throttleTimerId)
+        {
+            CheckFailure(ThrottleBackgroundTabs(), L"");
+        }
+        else if (wParam == c_watchdogTimerId)
+        {
+            CheckFailure(CheckTabResponsive(), L"");
+        }
+        else if (wParam == DownloadManager::c_timerId)
+        {
+            m_downloadManager.FlushProgress();
+        }
+        else if (wParam == StorageAuditor::c_timerId)
+        {
+            AuditStorage();
+        }
+        else if (wParam == BrowsingDataCleaner::c_timerId)
+        {
+            m_browsingDataCleaner.HandleStepTimeout();
+        }
+        else if (wParam == SharedHttpCache::c_timerId && m_sharedCache->StartFlush())
+        {
+            std::shared_ptr<SharedHttpCache> sharedCache = m_sharedCache;
+            RunAsync([sharedCache]()
+            {
+                sharedCache->Flush();
+            }, []() {});
+        }
+    }
+    break;
+    case WM_APP_RUN_ON_UI_THREAD:
+    {
+        std::unique_ptr<std::function<void()>> callback(reinterpret_cast<std::function<void()>*>(lParam));
+        (*callback)();
+    }
+    break;
     default:
     {
         return DefWindowProc(hWnd, message, wParam, lParam);
@@ -160,6 +229,15 @@ BOOL BrowserWindow::InitInstance(HINSTANCE hInstance, int nCmdShow)
     m_hInst = hInstance; // Store app instance handle
     LoadStringW(m_hInst, IDS_APP_TITLE, s_title, MAX_LOADSTRING);
 
+    FILETIME created, exited, kernelTime, userTime;
+    if (GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernelTime, &userTime))
+    {
+        m_processCreated = Stopwatch::EpochMilliseconds(created);
+    }
+
+    // Read before the window is shown, its first paint has the controls bar
+    m_controlsSnapshot.Load(GetAppDataDirectory() + L"\\controls_snapshot.json");
+
     SetUIMessageBroker();
 
     m_hWnd = CreateWindowW(s_windowClass, s_title, WS_OVERLAPPEDWINDOW,
@@ -176,6 +254,20 @@ BOOL BrowserWindow::InitInstance(HINSTANCE hInstance, int nCmdShow)
     UpdateMinWindowSize();
     ShowWindow(m_hWnd, nCmdShow);
     UpdateWindow(m_hWnd);
+    MarkStartup(L"windowShown");
+
+    // Content settings have to be in place before the first tab navigates
+    m_settings.Load(GetAppDataDirectory() + L"\\settings.json");
+    m_addressClassifier.SetSearchTemplate(m_settings.searchTemplate);
+    m_memoryMonitor.SetBudget(static_cast<uint64_t>(m_settings.memoryBudget * 1024 * 1024));
+    m_sharedCache->Init(GetAppDataDirectory() + L"\\Shared Cache");
+    m_sharedCache->SetOrigins(m_settings.sharedCacheOrigins);
+    SetTimer(m_hWnd, SharedHttpCache::c_timerId, SharedHttpCache::c_flushInterval, nullptr);
+    PrewarmSharedCache(m_sharedCache->TakePrewarmManifest(), nullptr);
+    m_snapshotStore->Init(GetAppDataDirectory() + L"\\Snapshots");
+    m_thumbnailCache.Init(m_hWnd, GetAppDataDirectory() + L"\\Thumbnails");
+    m_browsingDataCleaner.Init(m_hWnd);
+    StartAutomationServer();
 
     // Get directory for user data. This will be kept separated from the
     // directory for the browser UI data.
@@ -192,7 +284,20 @@ BOOL BrowserWindow::InitInstance(HINSTANCE hInstance, int nCmdShow)
     {
         RETURN_IF_FAILED(result);
 
+        MarkStartup(L"contentEnvironment");
         m_contentEnv = env;
+        m_controllerPool.Init(m_hWnd, env);
+        m_navigationPredictor.Init(m_hWnd, &m_controllerPool);
+        m_memoryMonitor.Init(m_hWnd, env);
+        m_storageAuditor.Init(m_hWnd, GetAppDataDirectory() + L"\\User Data", GetAppDataDirectory() + L"\\Browser Data");
+        SetTimer(m_hWnd, c_throttleTimerId, c_throttleInterval, nullptr);
+        SetTimer(m_hWnd, c_watchdogTimerId, c_heartbeatInterval, nullptr);
+        m_downloadManager.Init(m_hWnd, GetAppDataDirectory() + L"\\downloads.json",
+            [this](const web::json::value& downloads)
+        {
+            return PostDownloadProgress(downloads);
+        });
+        LoadContentFilter();
         HRESULT hr = InitUIWebViews();
 
         if (!SUCCEEDED(hr))
@@ -225,6 +330,7 @@ HRESULT BrowserWindow::InitUIWebViews()
             [this](HRESULT result, ICoreWebView2Environment* env) -> HRESULT
     {
         // Environment is ready, create the WebView
+        MarkStartup(L"uiEnvironment");
         m_uiEnv = env;
 
         RETURN_IF_FAILED(CreateBrowserControlsWebView());
@@ -245,8 +351,17 @@ HRESULT BrowserWindow::CreateBrowserControlsWebView()
             return result;
         }
         // WebView created
+        MarkStartup(L"controlsCreated");
         m_controlsController = host;
         CheckFailure(m_controlsController->get_CoreWebView2(&m_controlsWebView), L"");
+        m_controlsQueue.SetTarget(m_controlsWebView.Get());
+
+        // The snapshot of the bar shows through until the page has painted
+        ComPtr<ICoreWebView2Controller2> controller2;
+        if (m_controlsSnapshot.IsLoaded() && SUCCEEDED(m_controlsController.As(&controller2)))
+        {
+            RETURN_IF_FAILED(controller2->put_DefaultBackgroundColor({ 0, 255, 255, 255 }));
+        }
 
         wil::com_ptr<ICoreWebView2Settings> settings;
         RETURN_IF_FAILED(m_controlsWebView->get_Settings(&settings));
@@ -261,6 +376,17 @@ HRESULT BrowserWindow::CreateBrowserControlsWebView()
         ).Get(), &m_controlsZoomToken));
 
         RETURN_IF_FAILED(m_controlsWebView->add_WebMessageReceived(m_uiMessageBroker.Get(), &m_controlsUIMessageBrokerToken));
+        // Messages wait for the page to load again, see SetUIMessageBroker
+        RETURN_IF_FAILED(m_controlsWebView->add_NavigationStarting(Callback<ICoreWebView2NavigationStartingEventHandler>(
+            [this](ICoreWebView2* webview, ICoreWebView2NavigationStartingEventArgs* args) -> HRESULT
+        {
+            return m_controlsQueue.SetReady(false);
+        }).Get(), &m_controlsNavigationStartingToken));
+        RETURN_IF_FAILED(m_controlsController->add_AcceleratorKeyPressed(Callback<ICoreWebView2AcceleratorKeyPressedEventHandler>(
+            [this](ICoreWebView2Controller* sender, ICoreWebView2AcceleratorKeyPressedEventArgs* args) -> HRESULT
+        {
+            return HandleAcceleratorKeyPressed(sender, args);
+        }).Get(), &m_controlsAcceleratorToken));
         RETURN_IF_FAILED(ResizeUIWebViews());
 
         std::wstring controlsPath = GetFullPathFor(L"wvbrowser_ui\\controls_ui\\default.html");
@@ -299,6 +425,11 @@ HRESULT BrowserWindow::CreateBrowserOptionsWebView()
         // Hide by default
         RETURN_IF_FAILED(m_optionsController->put_IsVisible(FALSE));
         RETURN_IF_FAILED(m_optionsWebView->add_WebMessageReceived(m_uiMessageBroker.Get(), &m_optionsUIMessageBrokerToken));
+        RETURN_IF_FAILED(m_optionsController->add_AcceleratorKeyPressed(Callback<ICoreWebView2AcceleratorKeyPressedEventHandler>(
+            [this](ICoreWebView2Controller* sender, ICoreWebView2AcceleratorKeyPressedEventArgs* args) -> HRESULT
+        {
+            return HandleAcceleratorKeyPressed(sender, args);
+        }).Get(), &m_optionsAcceleratorToken));
 
         // Hide menu when focus is lost
         RETURN_IF_FAILED(m_optionsController->add_LostFocus(Callback<ICoreWebView2FocusChangedEventHandler>(
@@ -308,7 +439,7 @@ HRESULT BrowserWindow::CreateBrowserOptionsWebView()
             jsonObj[L"message"] = web::json::value(MG_OPTIONS_LOST_FOCUS);
             jsonObj[L"args"] = web::json::value::parse(L"{}");
 
-            PostJsonToWebView(jsonObj, m_controlsWebView.Get());
+            PostJsonToControls(jsonObj);
 
             return S_OK;
         }).Get(), &m_lostOptionsFocus));
@@ -348,13 +479,50 @@ void BrowserWindow::SetUIMessageBroker()
         int message = jsonObj.at(L"message").as_integer();
         web::json::value args = jsonObj.at(L"args");
 
+        // The controls UI listens before it sends anything
+        if (webview == m_controlsWebView.Get() && !m_controlsQueue.IsReady())
+        {
+            CheckFailure(m_controlsQueue.SetReady(true), L"");
+        }
+
+        // First message after a shortcut left to the controls UI
+        if (m_controlsShortcutPending)
+        {
+            m_controlsShortcutPending = false;
+            double milliseconds = m_controlsShortcutStopwatch.ElapsedMilliseconds();
+            if (milliseconds < c_shortcutMessageTimeout)
+            {
+                RecordShortcut(m_controlsShortcutStats, milliseconds);
+            }
+        }
+
         switch (message)
         {
         case MG_CREATE_TAB:
         {
             size_t id = args.at(L"tabId").as_number().to_uint32();
             bool shouldBeActive = args.at(L"active").as_bool();
-            std::unique_ptr<Tab> newTab = Tab::CreateNewTab(m_hWnd, m_contentEnv.Get(), id, shouldBeActive);
+            bool reopen = args.has_field(L"reopen") && args.at(L"reopen").as_bool() && !m_reopeningTabs.empty();
+
+            std::unique_ptr<Tab> newTab;
+            if (reopen)
+            {
+                NavigationEntry entry = m_reopeningTabs.front();
+                m_reopeningTabs.erase(m_reopeningTabs.begin());
+
+                newTab = Tab::CreateNewTab(m_hWnd, m_controllerPool, id, shouldBeActive, entry.uri);
+                newTab->Reopen(entry);
+            }
+            else
+            {
+                // Automation may ask for a page, otherwise it's the start page
+                std::wstring uri;
+                if (args.has_field(L"uri") && args.at(L"uri").is_string())
+                {
+                    uri = ResolveBrowserPageUri(args.at(L"uri").as_string());
+                }
+                newTab = Tab::CreateNewTab(m_hWnd, m_controllerPool, id, shouldBeActive, uri.empty() ? GetStartPageUri() : uri);
+            }
 
             std::map<size_t, std::unique_ptr<Tab>>::iterator it = m_tabs.find(id);
             if (it == m_tabs.end())
@@ -363,59 +531,143 @@ void BrowserWindow::SetUIMessageBroker()
             }
             else
             {
-                m_tabs.at(id)->m_contentController->Close();
+                std::unique_ptr<Tab> replacedTab = std::move(it->second);
                 it->second = std::move(newTab);
+                RetireTab(std::move(replacedTab), false);
+            }
+
+            if (args.has_field(L"automationRequest"))
+            {
+                auto request = m_automationTabRequests.find(args.at(L"automationRequest").as_number().to_uint64());
+                if (request != m_automationTabRequests.end())
+                {
+                    web::json::value result = web::json::value::object();
+                    result[L"tabId"] = web::json::value::number(id);
+                    request->second(S_OK, result);
+                    m_automationTabRequests.erase(request);
+                }
+            }
+        }
+        break;
+        case MG_REOPEN_CLOSED_TAB:
+        {
+            if (m_closedTabs.empty())
+            {
+                break;
+            }
+
+            // The controls UI shows the tab right away and asks for it with
+            // MG_CREATE_TAB, which takes the entry from m_reopeningTabs
+            NavigationEntry entry = m_closedTabs.back();
+            m_closedTabs.pop_back();
+            m_reopeningTabs.push_back(entry);
+
+            web::json::value reopenObj = web::json::value::parse(L"{}");
+            reopenObj[L"message"] = web::json::value(MG_REOPEN_CLOSED_TAB);
+            reopenObj[L"args"] = web::json::value::parse(L"{}");
+            reopenObj[L"args"][L"uri"] = web::json::value(entry.uri);
+            reopenObj[L"args"][L"title"] = web::json::value(entry.title);
+            reopenObj[L"args"][L"favicon"] = web::json::value(entry.favicon);
+
+            std::wstring uriToShow = GetUriToShow(entry.uri);
+            if (!uriToShow.empty())
+            {
+                reopenObj[L"args"][L"uriToShow"] = web::json::value(uriToShow);
             }
+
+            CheckFailure(PostJsonToControls(reopenObj), L"Can't reopen tab.");
         }
         break;
         case MG_NAVIGATE:
         {
-            std::wstring uri(args.at(L"uri").as_string());
+            // Address bar text is classified here, history entries and
+            // links come as URIs
+            std::wstring uri = args.has_field(L"text") ?
+                m_addressClassifier.Classify(args.at(L"text").as_string()).uri : args.at(L"uri").as_string();
+            if (uri.empty() || m_tabs.find(m_activeTabId) == m_tabs.end())
+            {
+                break;
+            }
             std::wstring browserScheme(L"browser://");
-
             if (uri.substr(0, browserScheme.size()).compare(browserScheme) == 0)
             {
                 // No encoded search URI
                 std::wstring path = uri.substr(browserScheme.size());
-                if (path.compare(L"favorites") == 0 ||
-                    path.compare(L"settings") == 0 ||
-                    path.compare(L"history") == 0)
-                {
-                    std::wstring filePath(L"wvbrowser_ui\\content_ui\\");
-                    filePath.append(path);
-                    filePath.append(L".html");
-                    std::wstring fullPath = GetFullPathFor(filePath.c_str());
-                    CheckFailure(m_tabs.at(m_activeTabId)->m_contentWebView->Navigate(fullPath.c_str()), L"Can't navigate to browser page.");
-                }
-                else
+                if (std::find(s_browserPages.begin(), s_browserPages.end(), path) == s_browserPages.end())
                 {
                     OutputDebugString(L"Requested unknown browser page\n");
+                    break;
                 }
             }
-            else if (!SUCCEEDED(m_tabs.at(m_activeTabId)->m_contentWebView->Navigate(uri.c_str())))
+
+            // The active tab has no WebView while it's recreated, see
+            // RecoverTab and SwitchToTab; it loads this once it has one
+            Tab* tab = m_tabs.at(m_activeTabId).get();
+            if (!tab->m_contentWebView)
+            {
+                bool isBrowserPage = uri.substr(0, browserScheme.size()).compare(browserScheme) == 0;
+                tab->SetPendingNavigation(isBrowserPage ? GetBrowserPagePath(uri.substr(browserScheme.size())) : uri);
+                break;
+            }
+
+            std::unique_ptr<Tab> prerenderedTab = m_navigationPredictor.TakePrerenderedTab(uri, CanSwapInPrerenderedTab());
+            if (prerenderedTab)
+            {
+                CheckFailure(SwapInPrerenderedTab(std::move(prerenderedTab)), L"Can't show prerendered page.");
+            }
+            else if (uri.substr(0, browserScheme.size()).compare(browserScheme) == 0)
             {
-                CheckFailure(m_tabs.at(m_activeTabId)->m_contentWebView->Navigate(args.at(L"encodedSearchURI").as_string().c_str()), L"Can't navigate to requested page.");
+                std::wstring fullPath = GetBrowserPagePath(uri.substr(browserScheme.size()));
+                CheckFailure(tab->m_contentWebView->Navigate(fullPath.c_str()), L"Can't navigate to browser page.");
             }
+            else if (!SUCCEEDED(tab->m_contentWebView->Navigate(uri.c_str())))
+            {
+                CheckFailure(tab->m_contentWebView->Navigate(m_addressClassifier.GetSearchUri(uri).c_str()), L"Can't navigate to requested page.");
+            }
+        }
+        break;
+        case MG_PREDICT_NAVIGATION:
+        {
+            std::wstring uri = args.has_field(L"text") ?
+                m_addressClassifier.Classify(args.at(L"text").as_string()).uri : args.at(L"uri").as_string();
+            CheckFailure(m_navigationPredictor.HandlePrediction(uri, args.at(L"confidence").as_double(),
+                m_settings.preloadMode), L"");
         }
         break;
         case MG_GO_FORWARD:
         {
-            CheckFailure(m_tabs.at(m_activeTabId)->m_contentWebView->GoForward(), L"");
+            // The controls UI shows the entry already, keep the list in step
+            CheckFailure(GoBackOrForward(1), L"");
         }
         break;
         case MG_GO_BACK:
         {
-            CheckFailure(m_tabs.at(m_activeTabId)->m_contentWebView->GoBack(), L"");
+            CheckFailure(GoBackOrForward(-1), L"");
+        }
+        break;
+        case MG_SHOW_HISTORY_MENU:
+        {
+            POINT position = { args.at(L"x").as_integer(), args.at(L"y").as_integer() };
+            CheckFailure(ShowNavigationHistoryMenu(args.at(L"forward").as_bool(), position), L"Can't show history menu.");
         }
         break;
         case MG_RELOAD:
         {
-            CheckFailure(m_tabs.at(m_activeTabId)->m_contentWebView->Reload(), L"");
+            // Without a WebView the tab is about to load its entry anyway
+            auto tab = m_tabs.find(m_activeTabId);
+            if (tab != m_tabs.end() && tab->second->m_contentWebView)
+            {
+                CheckFailure(tab->second->m_contentWebView->Reload(), L"");
+            }
         }
         break;
         case MG_CANCEL:
         {
-            CheckFailure(m_tabs.at(m_activeTabId)->m_contentWebView->CallDevToolsProtocolMethod(L"Page.stopLoading", L"{}", nullptr), L"");
+            auto tab = m_tabs.find(m_activeTabId);
+            if (tab != m_tabs.end() && tab->second->m_contentWebView)
+            {
+                CheckFailure(tab->second->m_contentWebView->CallDevToolsProtocolMethod(L"Page.stopLoading", L"{}", nullptr), L"");
+            }
         }
         break;
         case MG_SWITCH_TAB:
@@ -428,8 +680,25 @@ void BrowserWindow::SetUIMessageBroker()
         case MG_CLOSE_TAB:
         {
             size_t id = args.at(L"tabId").as_number().to_uint32();
-            m_tabs.at(id)->m_contentController->Close();
+            std::unique_ptr<Tab> closedTab = std::move(m_tabs.at(id));
             m_tabs.erase(id);
+            m_thumbnailCache.Remove(id);
+            RetireTab(std::move(closedTab), true);
+            UpdateNetworkEvents();
+
+            auto requests = m_automationCloseRequests.equal_range(id);
+            for (auto request = requests.first; request != requests.second; ++request)
+            {
+                request->second(S_OK, web::json::value::object());
+            }
+            m_automationCloseRequests.erase(requests.first, requests.second);
+
+            auto loadRequests = m_automationLoadRequests.equal_range(id);
+            for (auto request = loadRequests.first; request != loadRequests.second; ++request)
+            {
+                request->second.respond(E_ABORT, web::json::value(L"The tab was closed"));
+            }
+            m_automationLoadRequests.erase(loadRequests.first, loadRequests.second);
         }
         break;
         case MG_CLOSE_WINDOW:
@@ -448,20 +717,105 @@ void BrowserWindow::SetUIMessageBroker()
             CheckFailure(m_optionsController->put_IsVisible(FALSE), L"Something went wrong when trying to close the options dropdown.");
         }
         break;
+        case MG_FIND:
+        {
+            // Typing in the find bar, always for the active tab
+            std::wstring action = args.at(L"action").as_string();
+            if (action.compare(L"find") == 0 || action.compare(L"next") == 0 ||
+                action.compare(L"previous") == 0 || action.compare(L"stop") == 0)
+            {
+                CheckFailure(m_tabs.at(m_activeTabId)->Find(action, args), L"Can't find in page.");
+            }
+
+            if (args.has_field(L"focusTab") && m_tabs.at(m_activeTabId)->m_contentController)
+            {
+                CheckFailure(m_tabs.at(m_activeTabId)->m_contentController->MoveFocus(COREWEBVIEW2_MOVE_FOCUS_REASON_PROGRAMMATIC), L"");
+            }
+        }
+        break;
+        case MG_CAPTURE_SNAPSHOT:
+        {
+            size_t tabId = args.at(L"tabId").as_number().to_uint32();
+            SnapshotFormat format = args.at(L"format").as_string().compare(L"pdf") == 0 ? SnapshotFormat::Pdf : SnapshotFormat::Mhtml;
+            CheckFailure(CaptureSnapshot(tabId, format), L"Can't save page for offline reading.");
+        }
+        break;
+        case MG_TAB_OVERVIEW:
+        {
+            m_tabOverviewVisible = args.at(L"show").as_bool();
+            CheckFailure(ResizeUIWebViews(), L"");
+            if (m_tabOverviewVisible)
+            {
+                CheckFailure(ShowTabOverview(), L"Can't show tab overview.");
+            }
+            else if (m_tabs.find(m_activeTabId) != m_tabs.end() && m_tabs.at(m_activeTabId)->m_contentController)
+            {
+                m_tabs.at(m_activeTabId)->m_contentController->MoveFocus(COREWEBVIEW2_MOVE_FOCUS_REASON_PROGRAMMATIC);
+            }
+        }
+        break;
+        case MG_DELETE_SNAPSHOT:
+        {
+            // The favorite is gone already, nothing waits on this
+            std::shared_ptr<SnapshotStore> snapshotStore = m_snapshotStore;
+            std::wstring id = args.at(L"id").as_string();
+            RunAsync([snapshotStore, id]()
+            {
+                if (FAILED(snapshotStore->Delete(id)))
+                {
+                    OutputDebugString(L"Snapshot deletion failed\n");
+                }
+            }, []() {});
+        }
+        break;
         case MG_OPTION_SELECTED:
         {
-            m_tabs.at(m_activeTabId)->m_contentController->MoveFocus(COREWEBVIEW2_MOVE_FOCUS_REASON_PROGRAMMATIC);
+            auto tab = m_tabs.find(m_activeTabId);
+            if (tab != m_tabs.end() && tab->second->m_contentController)
+            {
+                tab->second->m_contentController->MoveFocus(COREWEBVIEW2_MOVE_FOCUS_REASON_PROGRAMMATIC);
+            }
+        }
+        break;
+        case MG_SYNC_CONFIG:
+        {
+            // The controls UI asks once it's loaded, changes are pushed
+            CheckFailure(PostSyncConfig(), L"Can't configure sync.");
+        }
+        break;
+        case MG_CONTROLS_READY:
+        {
+            if (webview == m_controlsWebView.Get())
+            {
+                CheckFailure(HandleControlsReady(args), L"");
+            }
         }
         break;
         case MG_GET_FAVORITES:
-        case MG_GET_SETTINGS:
         case MG_GET_HISTORY:
+        case MG_GET_TOP_SITES:
         {
             // Forward back to requesting tab
             size_t tabId = args.at(L"tabId").as_number().to_uint32();
             jsonObj[L"args"].erase(L"tabId");
+            ICoreWebView2* tabWebView = m_tabs.at(tabId)->m_contentWebView.Get();
+
+            // Lists can be large, send them through the bulk data channel
+            HRESULT hr = S_OK;
+            if (message == MG_GET_FAVORITES)
+            {
+                hr = PostListToWebView(jsonObj, L"favorites", BulkDataChannel::FavoritesColumns(), tabWebView);
+            }
+            else if (message == MG_GET_HISTORY)
+            {
+                hr = PostListToWebView(jsonObj, L"items", BulkDataChannel::HistoryColumns(), tabWebView);
+            }
+            else
+            {
+                hr = PostJsonToWebView(jsonObj, tabWebView);
+            }
 
-            CheckFailure(PostJsonToWebView(jsonObj, m_tabs.at(tabId)->m_contentWebView.Get()), L"Requesting history failed.");
+            CheckFailure(hr, L"Requesting history failed.");
         }
         break;
         default:
@@ -478,11 +832,68 @@ void BrowserWindow::SetUIMessageBroker()
 HRESULT BrowserWindow::SwitchToTab(size_t tabId)
 {
     size_t previousActiveTab = m_activeTabId;
+    Tab* tab = m_tabs.at(tabId).get();
+
+    // The previous tab stays up until this one has a WebView again,
+    // HandleTabCreated switches to it then. Switching to a tab still
+    // restoring only makes sure it's the one shown.
+    if (tab->m_memoryState == TabMemoryState::Discarded || !tab->m_contentController)
+    {
+        if (tab->m_memoryState == TabMemoryState::Discarded)
+        {
+            tab->Restore(m_controllerPool);
+        }
+        m_restoringTabId = tabId;
+        return PostTabState(tabId);
+    }
 
-    RETURN_IF_FAILED(m_tabs.at(tabId)->ResizeWebView());
-    RETURN_IF_FAILED(m_tabs.at(tabId)->m_contentController->put_IsVisible(TRUE));
+    // Or the user went on to another tab meanwhile
+    m_restoringTabId = INVALID_TAB_ID;
+
+    RETURN_IF_FAILED(tab->ResizeWebView());
+    // Showing a suspended WebView resumes it
+    RETURN_IF_FAILED(tab->m_contentController->put_IsVisible(TRUE));
     m_activeTabId = tabId;
 
+    // The controls UI gets the back/forward list it wasn't sent while the
+    // tab was in the background
+    if (!tab->IsForeground())
+    {
+        RETURN_IF_FAILED(tab->SetForeground(true));
+        RETURN_IF_FAILED(HandleTabHistoryUpdate(tabId, tab->m_contentWebView.Get()));
+    }
+
+    if (tab->m_memoryState == TabMemoryState::Suspended || tab->m_throttled)
+    {
+        tab->m_memoryState = TabMemoryState::Active;
+        RETURN_IF_FAILED(tab->Unthrottle());
+        RETURN_IF_FAILED(PostTabState(tabId));
+    }
+
+    if (previousActiveTab != INVALID_TAB_ID && previousActiveTab != m_activeTabId)
+    {
+        m_lastActiveTabId = previousActiveTab;
+
+        auto previousTab = m_tabs.find(previousActiveTab);
+        if (previousTab != m_tabs.end())
+        {
+            previousTab->second->m_inactiveStopwatch.Restart();
+            CheckFailure(previousTab->second->SetForeground(false), L"");
+            // Still showing its last frame, the preview goes stale from here
+            if (previousTab->second->m_contentWebView &&
+                FAILED(m_thumbnailCache.Capture(previousActiveTab, previousTab->second->m_contentWebView.Get())))
+            {
+                OutputDebugString(L"Can't capture tab thumbnail\n");
+            }
+            // The find bar closes on a tab switch
+            CheckFailure(previousTab->second->Find(L"stop", web::json::value::object()), L"");
+            if (m_settings.throttleBackgroundTabs)
+            {
+                CheckFailure(previousTab->second->HandleHidden(), L"");
+            }
+        }
+    }
+
     if (previousActiveTab != INVALID_TAB_ID && previousActiveTab != m_activeTabId) {
         auto previousTabIterator = m_tabs.find(previousActiveTab);
         if (previousTabIterator != m_tabs.end() && previousTabIterator->second &&
@@ -490,12 +901,10 @@ HRESULT BrowserWindow::SwitchToTab(size_t tabId)
         {
             auto hr = m_tabs.at(previousActiveTab)->m_contentController->put_IsVisible(FALSE);
             if (hr == HRESULT_FROM_WIN32(ERROR_INVALID_STATE)) {
-                web::json::value jsonObj = web::json::value::parse(L"{}");
-                jsonObj[L"message"] = web::json::value(MG_CLOSE_TAB);
-                jsonObj[L"args"] = web::json::value::parse(L"{}");
-                jsonObj[L"args"][L"tabId"] = web::json::value::number(previousActiveTab);
-
-                PostJsonToWebView(jsonObj, m_controlsWebView.Get());
+                // The WebView is gone without a ProcessFailed, the tab gets
+                // a new one when it's shown again
+                m_tabs.at(previousActiveTab)->m_recoveryStopwatch.Restart();
+                return RecoverTab(previousActiveTab);
             }
             RETURN_IF_FAILED(hr);
         }
@@ -504,88 +913,1205 @@ HRESULT BrowserWindow::SwitchToTab(size_t tabId)
     return S_OK;
 }
 
-HRESULT BrowserWindow::HandleTabURIUpdate(size_t tabId, ICoreWebView2* webview)
+HRESULT BrowserWindow::GoBackOrForward(int offset, bool notifyControls)
 {
-    wil::unique_cotaskmem_string source;
-    RETURN_IF_FAILED(webview->get_Source(&source));
+    Tab* tab = m_tabs.at(m_activeTabId).get();
+    if (!tab->m_contentWebView)
+    {
+        return S_OK;
+    }
+
+    tab->m_navigationHistory.Go(offset);
+    RETURN_IF_FAILED(offset < 0 ? tab->m_contentWebView->GoBack() : tab->m_contentWebView->GoForward());
+
+    if (!notifyControls)
+    {
+        return S_OK;
+    }
 
+    // The controls UI shows the entry as if its button was pressed
     web::json::value jsonObj = web::json::value::parse(L"{}");
-    jsonObj[L"message"] = web::json::value(MG_UPDATE_URI);
+    jsonObj[L"message"] = web::json::value(offset < 0 ? MG_GO_BACK : MG_GO_FORWARD);
     jsonObj[L"args"] = web::json::value::parse(L"{}");
-    jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
-    jsonObj[L"args"][L"uri"] = web::json::value(source.get());
 
-    std::wstring uri(source.get());
-    std::wstring favoritesURI = GetFilePathAsURI(GetFullPathFor(L"wvbrowser_ui\\content_ui\\favorites.html"));
-    std::wstring settingsURI = GetFilePathAsURI(GetFullPathFor(L"wvbrowser_ui\\content_ui\\settings.html"));
-    std::wstring historyURI = GetFilePathAsURI(GetFullPathFor(L"wvbrowser_ui\\content_ui\\history.html"));
+    return PostJsonToControls(jsonObj);
+}
+
+HRESULT BrowserWindow::HandleAcceleratorKeyPressed(ICoreWebView2Controller* sender, ICoreWebView2AcceleratorKeyPressedEventArgs* args)
+{
+    Stopwatch stopwatch;
 
-    if (uri.compare(favoritesURI) == 0)
+    COREWEBVIEW2_KEY_EVENT_KIND kind;
+    RETURN_IF_FAILED(args->get_KeyEventKind(&kind));
+    if (kind != COREWEBVIEW2_KEY_EVENT_KIND_KEY_DOWN && kind != COREWEBVIEW2_KEY_EVENT_KIND_SYSTEM_KEY_DOWN)
     {
-        jsonObj[L"args"][L"uriToShow"] = web::json::value(L"browser://favorites");
+        return S_OK;
     }
-    else if (uri.compare(settingsURI) == 0)
+
+    UINT key;
+    RETURN_IF_FAILED(args->get_VirtualKey(&key));
+    COREWEBVIEW2_PHYSICAL_KEY_STATUS status;
+    RETURN_IF_FAILED(args->get_PhysicalKeyStatus(&status));
+
+    bool control = GetKeyState(VK_CONTROL) < 0;
+    bool shift = GetKeyState(VK_SHIFT) < 0;
+    bool alt = GetKeyState(VK_MENU) < 0;
+
+    if (RunShortcut(key, control, shift, alt, status.WasKeyDown))
     {
-        jsonObj[L"args"][L"uriToShow"] = web::json::value(L"browser://settings");
+        // The WebView doesn't see the key, so neither the page nor the
+        // controls UI handle it a second time
+        RETURN_IF_FAILED(args->put_Handled(TRUE));
+        RecordShortcut(m_nativeShortcutStats, stopwatch.ElapsedMilliseconds());
     }
-    else if (uri.compare(historyURI) == 0)
+    else if (control && !alt && !status.WasKeyDown && sender == m_controlsController.Get() &&
+        (key == 'S' || (shift && (key == 'T' || key == 'A'))))
     {
-        jsonObj[L"args"][L"uriToShow"] = web::json::value(L"browser://history");
+        // Shortcuts the controls UI still handles itself and sends on to the
+        // browser, timed until their message gets here
+        m_controlsShortcutStopwatch.Restart();
+        m_controlsShortcutPending = true;
     }
 
-    RETURN_IF_FAILED(PostJsonToWebView(jsonObj, m_controlsWebView.Get()));
-
     return S_OK;
 }
 
-HRESULT BrowserWindow::HandleTabHistoryUpdate(size_t tabId, ICoreWebView2* webview)
+bool BrowserWindow::RunShortcut(UINT key, bool control, bool shift, bool alt, bool repeat)
 {
-    wil::unique_cotaskmem_string source;
-    RETURN_IF_FAILED(webview->get_Source(&source));
-    
+    if (m_activeTabId == INVALID_TAB_ID || m_tabs.find(m_activeTabId) == m_tabs.end())
+    {
+        return false;
+    }
+
+    // The tab strip is the controls UI's, tabs are created and closed there
+    // and it's told about switches made here
     web::json::value jsonObj = web::json::value::parse(L"{}");
-    jsonObj[L"message"] = web::json::value(MG_UPDATE_URI);
     jsonObj[L"args"] = web::json::value::parse(L"{}");
-    jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
-    jsonObj[L"args"][L"uri"] = web::json::value(source.get());
+    Tab* tab = m_tabs.at(m_activeTabId).get();
+
+    // Ctrl+L, Alt+D and F6 focus the address bar
+    if ((control && !alt && key == 'L') || (alt && !control && key == 'D') || (!control && !alt && !shift && key == VK_F6))
+    {
+        CheckFailure(m_controlsController->MoveFocus(COREWEBVIEW2_MOVE_FOCUS_REASON_PROGRAMMATIC), L"");
+        jsonObj[L"message"] = web::json::value(MG_FOCUS_ADDRESS_BAR);
+        CheckFailure(PostJsonToControls(jsonObj), L"");
+        return true;
+    }
 
-    BOOL canGoForward = FALSE;
-    RETURN_IF_FAILED(webview->get_CanGoForward(&canGoForward));
-    jsonObj[L"args"][L"canGoForward"] = web::json::value::boolean(canGoForward);
+    if ((key == 'R' && control && !alt) || (key == VK_F5 && !alt))
+    {
+        if (tab->m_contentWebView)
+        {
+            CheckFailure(tab->m_contentWebView->Reload(), L"Can't reload.");
+        }
+        return true;
+    }
 
-    BOOL canGoBack = FALSE;
-    RETURN_IF_FAILED(webview->get_CanGoBack(&canGoBack));
-    jsonObj[L"args"][L"canGoBack"] = web::json::value::boolean(canGoBack);
+    if (control && !alt)
+    {
+        switch (key)
+        {
+        case 'T':
+            if (shift)
+            {
+                return false;  // Reopen closed tab, in the controls UI
+            }
+            if (!repeat)
+            {
+                jsonObj[L"message"] = web::json::value(MG_CREATE_TAB);
+                CheckFailure(PostJsonToControls(jsonObj), L"Can't create tab.");
+            }
+            return true;
+        case 'W':
+        case VK_F4:
+            if (!repeat)
+            {
+                jsonObj[L"message"] = web::json::value(MG_CLOSE_TAB);
+                jsonObj[L"args"][L"tabId"] = web::json::value::number(m_activeTabId);
+                CheckFailure(PostJsonToControls(jsonObj), L"Can't close tab.");
+            }
+            return true;
+        case VK_TAB:
+            CheckFailure(SwitchToTabInOrder(shift ? -1 : 1), L"Can't switch tab.");
+            return true;
+        case VK_NEXT:
+        case VK_PRIOR:
+            CheckFailure(SwitchToTabInOrder(key == VK_NEXT ? 1 : -1), L"Can't switch tab.");
+            return true;
+        default:
+            // Ctrl+1 to Ctrl+8 select a tab, Ctrl+9 the last one
+            if (key >= '1' && key <= '9' && !shift)
+            {
+                CheckFailure(SwitchToTabInOrder(0, key == '9' ? INT_MAX : key - '1'), L"Can't switch tab.");
+                return true;
+            }
+            return false;
+        }
+    }
+    else if (alt && !control && !shift && (key == VK_LEFT || key == VK_RIGHT))
+    {
+        int offset = key == VK_LEFT ? -1 : 1;
+        if (offset < 0 ? !tab->m_navigationHistory.CanGoBack() : !tab->m_navigationHistory.CanGoForward())
+        {
+            return true;
+        }
 
-    RETURN_IF_FAILED(PostJsonToWebView(jsonObj, m_controlsWebView.Get()));
+        CheckFailure(GoBackOrForward(offset, true), L"Can't go back or forward.");
+        return true;
+    }
 
-    return S_OK;
+    return false;
 }
 
-HRESULT BrowserWindow::HandleTabNavStarting(size_t tabId, ICoreWebView2* webview)
+HRESULT BrowserWindow::SwitchToTabInOrder(int offset, int index)
+{
+    // Tab IDs grow in the order the strip shows the tabs. Tabs still
+    // waiting for a WebView are skipped.
+    std::vector<size_t> tabIds;
+    int activeIndex = 0;
+    for (auto& entry : m_tabs)
+    {
+        Tab* tab = entry.second.get();
+        if (!tab->m_contentController && tab->m_memoryState != TabMemoryState::Discarded)
+        {
+            continue;
+        }
+        if (entry.first == m_activeTabId)
+        {
+            activeIndex = static_cast<int>(tabIds.size());
+        }
+        tabIds.push_back(entry.first);
+    }
+
+    if (tabIds.empty())
+    {
+        return S_OK;
+    }
+
+    int count = static_cast<int>(tabIds.size());
+    int target = offset ? ((activeIndex + offset) % count + count) % count : (std::min)(index, count - 1);
+
+    return SwitchToTabFromHost(tabIds[target]);
+}
+
+HRESULT BrowserWindow::SwitchToTabFromHost(size_t tabId)
 {
+    if (tabId == m_activeTabId)
+    {
+        return S_OK;
+    }
+
+    RETURN_IF_FAILED(SwitchToTab(tabId));
+
     web::json::value jsonObj = web::json::value::parse(L"{}");
-    jsonObj[L"message"] = web::json::value(MG_NAV_STARTING);
+    jsonObj[L"message"] = web::json::value(MG_SWITCH_TAB);
     jsonObj[L"args"] = web::json::value::parse(L"{}");
     jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
 
-    return PostJsonToWebView(jsonObj, m_controlsWebView.Get());
+    return PostJsonToControls(jsonObj);
 }
 
-HRESULT BrowserWindow::HandleTabNavCompleted(size_t tabId, ICoreWebView2* webview, ICoreWebView2NavigationCompletedEventArgs* args)
+void BrowserWindow::RecordShortcut(LatencyStats& stats, double milliseconds)
 {
-    std::wstring getTitleScript(
-        // Look for a title tag
-        L"(() => {"
-        L"    const titleTag = document.getElementsByTagName('title')[0];"
-        L"    if (titleTag) {"
-        L"        return titleTag.innerHTML;"
-        L"    }"
-        // No title tag, look for the file name
-        L"    pathname = window.location.pathname;"
-        L"    var filename = pathname.split('/').pop();"
-        L"    if (filename) {"
-        L"        return filename;"
+    ++stats.count;
+    stats.totalMilliseconds += milliseconds;
+
+    WCHAR log[256];
+    StringCchPrintf(log, ARRAYSIZE(log),
+        L"Shortcut key press to action: native %llu at %.2f ms avg, through the controls UI %llu at %.2f ms avg\n",
+        m_nativeShortcutStats.count, m_nativeShortcutStats.count ? m_nativeShortcutStats.totalMilliseconds / m_nativeShortcutStats.count : 0.0,
+        m_controlsShortcutStats.count, m_controlsShortcutStats.count ? m_controlsShortcutStats.totalMilliseconds / m_controlsShortcutStats.count : 0.0);
+    OutputDebugString(log);
+}
+
+void BrowserWindow::StartAutomationServer()
+{
+    // --automation[=<pipe name>], off unless given
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (!argv)
+    {
+        return;
+    }
+
+    std::wstring pipeName;
+    const std::wstring flag(L"--automation");
+    for (int i = 1; i < argc; i++)
+    {
+        std::wstring arg(argv[i]);
+        if (arg == flag)
+        {
+            pipeName = AutomationServer::c_defaultPipeName;
+        }
+        else if (arg.compare(0, flag.size() + 1, flag + L"=") == 0)
+        {
+            pipeName = arg.substr(flag.size() + 1);
+            if (pipeName.find(L'\\') == std::wstring::npos)
+            {
+                pipeName = L"\\\\.\\pipe\\" + pipeName;
+            }
+        }
+    }
+    LocalFree(argv);
+
+    if (pipeName.empty())
+    {
+        return;
+    }
+
+    CheckFailure(m_automationServer.Start(m_hWnd, pipeName,
+        [this](const std::wstring& command, const web::json::value& args, AutomationServer::Responder respond)
+    {
+        HandleAutomationRequest(command, args, respond);
+    }), L"Can't start the automation server.");
+}
+
+void BrowserWindow::HandleAutomationRequest(const std::wstring& command, const web::json::value& args, AutomationServer::Responder respond)
+{
+    // Tabs are created and closed by the controls UI, it has to be up
+    if (!m_controlsWebView)
+    {
+        respond(HRESULT_FROM_WIN32(ERROR_NOT_READY), web::json::value(L"The browser is still starting"));
+        return;
+    }
+
+    if (command == L"getState")
+    {
+        respond(S_OK, GetAutomationState());
+        return;
+    }
+
+    if (command == L"getTelemetry")
+    {
+        respond(S_OK, GetTelemetry());
+        return;
+    }
+
+    // Answered once the URIs are fetched, with how many were stored
+    if (command == L"prewarmSharedCache")
+    {
+        std::vector<std::wstring> uris;
+        if (args.has_field(L"uris") && args.at(L"uris").is_array())
+        {
+            for (const auto& uri : args.at(L"uris").as_array())
+            {
+                if (uri.is_string())
+                {
+                    uris.push_back(uri.as_string());
+                }
+            }
+        }
+
+        PrewarmSharedCache(uris, [respond](size_t stored)
+        {
+            web::json::value result = web::json::value::object();
+            result[L"stored"] = web::json::value::number(stored);
+            respond(S_OK, result);
+        });
+        return;
+    }
+
+    // Reads every tab's preview like the tab overview does, answered with
+    // how many there were and how long it took
+    if (command == L"getThumbnails")
+    {
+        std::vector<size_t> tabIds;
+        for (const auto& entry : m_tabs)
+        {
+            tabIds.push_back(entry.first);
+        }
+
+        std::shared_ptr<Stopwatch> stopwatch = std::make_shared<Stopwatch>();
+        m_thumbnailCache.GetThumbnails(tabIds, [respond, stopwatch](const web::json::value& thumbnails)
+        {
+            size_t bytes = 0;
+            for (const auto& thumbnail : thumbnails.as_array())
+            {
+                bytes += thumbnail.at(L"image").as_string().size();
+            }
+
+            web::json::value result = web::json::value::object();
+            result[L"thumbnails"] = web::json::value::number(static_cast<uint64_t>(thumbnails.size()));
+            result[L"dataUriBytes"] = web::json::value::number(static_cast<uint64_t>(bytes));
+            result[L"milliseconds"] = web::json::value::number(stopwatch->ElapsedMilliseconds());
+            respond(S_OK, result);
+        });
+        return;
+    }
+
+    // What the address bar would open for |text|; with |iterations|, also
+    // how long classifying it takes
+    if (command == L"classifyAddress")
+    {
+        if (!args.has_field(L"text") || !args.at(L"text").is_string())
+        {
+            respond(E_INVALIDARG, web::json::value(L"No text to classify"));
+            return;
+        }
+
+        const std::wstring& text = args.at(L"text").as_string();
+        AddressClassifier::Result target = m_addressClassifier.Classify(text);
+        web::json::value result = web::json::value::object();
+        result[L"uri"] = web::json::value(target.uri);
+        result[L"isSearch"] = web::json::value::boolean(target.isSearch);
+
+        if (args.has_field(L"iterations") && args.at(L"iterations").is_number())
+        {
+            int iterations = (std::max)(1, (std::min)(1000000, args.at(L"iterations").as_integer()));
+            Stopwatch stopwatch;
+            size_t length = 0;
+            for (int i = 0; i < iterations; ++i)
+            {
+                length += m_addressClassifier.Classify(text).uri.size();
+            }
+            result[L"nanoseconds"] = web::json::value::number(stopwatch.ElapsedMilliseconds() * 1e6 / iterations);
+            result[L"checksum"] = web::json::value::number(static_cast<uint64_t>(length));
+        }
+
+        respond(S_OK, result);
+        return;
+    }
+
+    std::wstring uri;
+    if (args.has_field(L"uri") && args.at(L"uri").is_string())
+    {
+        uri = args.at(L"uri").as_string();
+    }
+
+    web::json::value jsonObj = web::json::value::parse(L"{}");
+    jsonObj[L"args"] = web::json::value::parse(L"{}");
+
+    if (command == L"createTab")
+    {
+        // Answered when MG_CREATE_TAB comes back with the tab's ID
+        uint64_t request = ++m_automationTabRequestCount;
+        m_automationTabRequests[request] = respond;
+
+        bool active = !args.has_field(L"active") || !args.at(L"active").is_boolean() || args.at(L"active").as_bool();
+        jsonObj[L"message"] = web::json::value(MG_CREATE_TAB);
+        jsonObj[L"args"][L"active"] = web::json::value::boolean(active);
+        jsonObj[L"args"][L"automationRequest"] = web::json::value::number(request);
+        if (!uri.empty())
+        {
+            jsonObj[L"args"][L"uri"] = web::json::value(uri);
+        }
+
+        HRESULT hr = PostJsonToControls(jsonObj);
+        if (FAILED(hr))
+        {
+            m_automationTabRequests.erase(request);
+            respond(hr, web::json::value(L"Can't reach the controls UI"));
+        }
+        return;
+    }
+
+    size_t tabId = m_activeTabId;
+    if (args.has_field(L"tabId") && args.at(L"tabId").is_number())
+    {
+        tabId = args.at(L"tabId").as_number().to_uint32();
+    }
+
+    auto tabEntry = m_tabs.find(tabId);
+    if (tabEntry == m_tabs.end())
+    {
+        respond(E_INVALIDARG, web::json::value(L"No such tab"));
+        return;
+    }
+    Tab* tab = tabEntry->second.get();
+
+    if (command == L"switchTab")
+    {
+        respond(SwitchToTabFromHost(tabId), web::json::value::object());
+    }
+    else if (command == L"closeTab")
+    {
+        // Answered when the controls UI has closed it, see MG_CLOSE_TAB
+        auto request = m_automationCloseRequests.emplace(tabId, respond);
+        jsonObj[L"message"] = web::json::value(MG_CLOSE_TAB);
+        jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
+
+        HRESULT hr = PostJsonToControls(jsonObj);
+        if (FAILED(hr))
+        {
+            m_automationCloseRequests.erase(request);
+            respond(hr, web::json::value(L"Can't reach the controls UI"));
+        }
+    }
+    else if (command == L"navigate")
+    {
+        std::wstring target = ResolveBrowserPageUri(uri);
+        if (target.empty() || !tab->m_contentWebView)
+        {
+            respond(E_INVALIDARG, web::json::value(L"Nothing to navigate to, or the tab has no WebView"));
+            return;
+        }
+
+        HRESULT hr = tab->m_contentWebView->Navigate(target.c_str());
+        bool waitForLoad = args.has_field(L"waitForLoad") && args.at(L"waitForLoad").is_boolean() && args.at(L"waitForLoad").as_bool();
+        if (SUCCEEDED(hr) && waitForLoad)
+        {
+            // The navigation is told apart from the one it may have replaced
+            // in HandleTabNavStarting, and answered from HandleTabNavCompleted
+            AutomationLoadRequest request;
+            request.respond = respond;
+            request.previousNavigationId = tab->m_navigationId;
+            m_automationLoadRequests.emplace(tabId, request);
+        }
+        else
+        {
+            respond(hr, web::json::value::object());
+        }
+    }
+    else if (command == L"reload")
+    {
+        respond(tab->m_contentWebView ? tab->m_contentWebView->Reload() : HRESULT_FROM_WIN32(ERROR_INVALID_STATE),
+            web::json::value::object());
+    }
+    else if (command == L"goBack" || command == L"goForward")
+    {
+        // The controls UI shows the active tab's entries only
+        int offset = command == L"goBack" ? -1 : 1;
+        if (tabId != m_activeTabId)
+        {
+            respond(E_INVALIDARG, web::json::value(L"Only the active tab can go back or forward"));
+        }
+        else if (offset < 0 ? !tab->m_navigationHistory.CanGoBack() : !tab->m_navigationHistory.CanGoForward())
+        {
+            respond(HRESULT_FROM_WIN32(ERROR_INVALID_OPERATION), web::json::value(L"No entry to go to"));
+        }
+        else
+        {
+            respond(GoBackOrForward(offset, true), web::json::value::object());
+        }
+    }
+    else
+    {
+        respond(E_NOTIMPL, web::json::value(L"Unknown command"));
+    }
+}
+
+web::json::value BrowserWindow::GetAutomationState()
+{
+    web::json::value state = web::json::value::object();
+    state[L"activeTabId"] = web::json::value::number(m_activeTabId);
+
+    web::json::value tabs = web::json::value::array();
+    size_t index = 0;
+    for (auto& entry : m_tabs)
+    {
+        Tab* tab = entry.second.get();
+        web::json::value tabObj = web::json::value::object();
+        tabObj[L"tabId"] = web::json::value::number(entry.first);
+        tabObj[L"uri"] = web::json::value(tab->m_documentUri);
+        tabObj[L"title"] = web::json::value(tab->m_navigationHistory.GetCurrentEntry().title);
+        tabObj[L"loading"] = web::json::value::boolean(tab->IsLoading());
+        tabObj[L"state"] = web::json::value(tab->m_memoryState == TabMemoryState::Suspended ? L"suspended" :
+            tab->m_memoryState == TabMemoryState::Discarded ? L"discarded" : L"active");
+        tabObj[L"foreground"] = web::json::value::boolean(tab->IsForeground());
+        tabObj[L"throttled"] = web::json::value::boolean(tab->m_throttled);
+        tabObj[L"memory"] = web::json::value::number(tab->m_jsHeapBytes);
+        tabs[index++] = tabObj;
+    }
+    state[L"tabs"] = tabs;
+
+    return state;
+}
+
+web::json::value BrowserWindow::GetTelemetry()
+{
+    auto latency = [](const LatencyStats& stats)
+    {
+        web::json::value statsObj = web::json::value::object();
+        statsObj[L"count"] = web::json::value::number(stats.count);
+        statsObj[L"averageMilliseconds"] = web::json::value::number(stats.count ? stats.totalMilliseconds / stats.count : 0.0);
+        return statsObj;
+    };
+
+    web::json::value telemetry = web::json::value::object();
+    telemetry[L"tabs"] = web::json::value::number(m_tabs.size());
+    telemetry[L"memoryBytes"] = web::json::value::number(m_memoryMonitor.GetTotalBytes());
+    telemetry[L"newTabOpen"] = latency(m_newTabStats);
+    telemetry[L"reopenedTabOpen"] = latency(m_reopenedTabStats);
+    telemetry[L"nativeShortcuts"] = latency(m_nativeShortcutStats);
+    telemetry[L"controlsShortcuts"] = latency(m_controlsShortcutStats);
+    telemetry[L"controllerPoolHits"] = web::json::value::number(m_controllerPool.GetHits());
+    telemetry[L"controllerPoolMisses"] = web::json::value::number(m_controllerPool.GetMisses());
+    telemetry[L"controllerPoolRecycled"] = web::json::value::number(m_controllerPool.GetRecycled());
+    telemetry[L"automationRequests"] = web::json::value::number(m_automationServer.GetRequestCount());
+    telemetry[L"tabRecovery"] = latency(m_recoveryStats);
+    telemetry[L"deferredTabRecoveries"] = web::json::value::number(m_deferredRecoveries);
+    telemetry[L"tabHangs"] = web::json::value::number(m_tabHangs);
+    telemetry[L"rendererExits"] = web::json::value::number(m_rendererExits);
+    telemetry[L"gpuProcessExits"] = web::json::value::number(m_gpuProcessExits);
+    telemetry[L"startup"] = web::json::value::object();
+    for (const auto& milestone : m_startupTimeline)
+    {
+        telemetry[L"startup"][milestone.first] = web::json::value::number(milestone.second);
+    }
+    telemetry[L"contentStorageBytes"] = web::json::value::number(m_storageAuditor.GetContentUsage().totalBytes);
+    telemetry[L"browserUIStorageBytes"] = web::json::value::number(m_storageAuditor.GetUIUsage().totalBytes);
+    telemetry[L"storageAuditMilliseconds"] = web::json::value::number(m_storageAuditor.GetAuditMilliseconds());
+    telemetry[L"evictedOrigins"] = web::json::value::number(m_storageAuditor.GetEvictedOrigins());
+    telemetry[L"cacheEvictions"] = web::json::value::number(m_storageAuditor.GetCacheEvictions());
+    telemetry[L"controlsMessageQueue"] = m_controlsQueue.ToJson();
+    telemetry[L"sharedCache"] = m_sharedCache->GetStats();
+    telemetry[L"thumbnails"] = m_thumbnailCache.GetStats();
+    telemetry[L"messagesWithoutWebView"] = web::json::value::number(m_messagesWithoutWebView);
+
+    return telemetry;
+}
+
+bool BrowserWindow::CanSwapInPrerenderedTab()
+{
+    // A WebView's back/forward list can't be moved to another one, so only
+    // a tab with nothing worth going back to is replaced. Anywhere else the
+    // active tab navigates as usual, on the connections and cache entries
+    // the prerender warmed up.
+    const NavigationHistory& history = m_tabs.at(m_activeTabId)->m_navigationHistory;
+    if (history.CanGoBack() || history.CanGoForward())
+    {
+        return false;
+    }
+
+    std::wstring uri = history.GetCurrentEntry().uri;
+    return uri.empty() || uri.compare(L"about:blank") == 0 || !GetUriToShow(uri).empty();
+}
+
+HRESULT BrowserWindow::SwapInPrerenderedTab(std::unique_ptr<Tab> prerenderedTab)
+{
+    // The prerendered WebView takes over the active tab, see
+    // CanSwapInPrerenderedTab; the one it replaces goes back to the
+    // controller pool.
+    size_t tabId = m_activeTabId;
+    prerenderedTab->SetId(tabId);
+
+    std::unique_ptr<Tab>& activeTab = m_tabs.at(tabId);
+    std::unique_ptr<Tab> replacedTab = std::move(activeTab);
+    activeTab = std::move(prerenderedTab);
+
+    RETURN_IF_FAILED(activeTab->ResizeWebView());
+    RETURN_IF_FAILED(activeTab->SetWebResourceFilters(GetWebResourceFilters()));
+    RETURN_IF_FAILED(activeTab->m_contentController->put_IsVisible(TRUE));
+    RETURN_IF_FAILED(activeTab->SetForeground(true));
+    RetireTab(std::move(replacedTab), false);
+
+    // Events so far went out under the prerender ID, bring the controls
+    // UI up to date
+    ICoreWebView2* webview = activeTab->m_contentWebView.Get();
+    RETURN_IF_FAILED(HandleTabURIUpdate(tabId, webview));
+    RETURN_IF_FAILED(HandleTabHistoryUpdate(tabId, webview));
+    if (activeTab->IsLoading())
+    {
+        RETURN_IF_FAILED(HandleTabNavStarting(tabId, webview));
+    }
+    else
+    {
+        RETURN_IF_FAILED(HandleTabNavCompleted(tabId, webview, nullptr));
+    }
+
+    return activeTab->m_contentController->MoveFocus(COREWEBVIEW2_MOVE_FOCUS_REASON_PROGRAMMATIC);
+}
+
+void BrowserWindow::RetireTab(std::unique_ptr<Tab> tab, bool canReopen)
+{
+    NavigationEntry entry = tab->m_navigationHistory.GetCurrentEntry();
+    if (canReopen && !entry.uri.empty() && entry.uri.compare(L"about:blank") != 0)
+    {
+        m_closedTabs.push_back(entry);
+        if (m_closedTabs.size() > c_maxClosedTabs)
+        {
+            m_closedTabs.erase(m_closedTabs.begin());
+        }
+    }
+
+    ComPtr<ICoreWebView2Controller> controller = tab->ReleaseController();
+    if (controller)
+    {
+        m_controllerPool.Recycle(controller.Get());
+    }
+}
+
+void BrowserWindow::RecordTabOpen(Tab* tab)
+{
+    LatencyStats& stats = tab->m_reopened ? m_reopenedTabStats : m_newTabStats;
+    ++stats.count;
+    stats.totalMilliseconds += tab->m_openStopwatch.ElapsedMilliseconds();
+    tab->m_measureOpen = false;
+
+    WCHAR log[256];
+    StringCchPrintf(log, ARRAYSIZE(log),
+        L"Tab open to first load: new %llu at %.0f ms avg, reopened %llu at %.0f ms avg; pool %llu hits / %llu misses / %llu recycled\n",
+        m_newTabStats.count, m_newTabStats.count ? m_newTabStats.totalMilliseconds / m_newTabStats.count : 0.0,
+        m_reopenedTabStats.count, m_reopenedTabStats.count ? m_reopenedTabStats.totalMilliseconds / m_reopenedTabStats.count : 0.0,
+        m_controllerPool.GetHits(), m_controllerPool.GetMisses(), m_controllerPool.GetRecycled());
+    OutputDebugString(log);
+}
+
+HRESULT BrowserWindow::EnforceMemoryBudget()
+{
+    RETURN_IF_FAILED(m_memoryMonitor.Sample());
+    bool overBudget = m_memoryMonitor.IsOverBudget();
+
+    // Background tabs that may give memory back, least recently used first.
+    // Tabs playing audio or still loading are left alone.
+    std::vector<std::pair<double, size_t>> candidates;
+    size_t suspendedTabs = 0;
+    size_t discardedTabs = 0;
+    for (auto& entry : m_tabs)
+    {
+        size_t tabId = entry.first;
+        Tab* tab = entry.second.get();
+        if (tab->m_memoryState == TabMemoryState::Discarded)
+        {
+            ++discardedTabs;
+            continue;
+        }
+
+        if (!tab->m_contentWebView)
+        {
+            continue;
+        }
+
+        // Keeps the memory shown in the tab strip current. A suspended
+        // renderer wouldn't answer, and its heap doesn't change anyway.
+        if (tab->m_memoryState == TabMemoryState::Suspended)
+        {
+            ++suspendedTabs;
+        }
+        else
+        {
+            CheckFailure(tab->UpdateHeapUsage([this, tabId]()
+            {
+                CheckFailure(PostTabState(tabId), L"");
+            }), L"");
+        }
+
+        if (tabId != m_activeTabId && !tab->IsLoading() && !tab->IsPlayingAudio())
+        {
+            candidates.push_back(std::make_pair(tab->m_inactiveStopwatch.ElapsedMilliseconds(), tabId));
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end(), std::greater<std::pair<double, size_t>>());
+
+    for (const auto& candidate : candidates)
+    {
+        Tab* tab = m_tabs.at(candidate.second).get();
+        if (tab->m_memoryState == TabMemoryState::Active && (overBudget || candidate.first >= MemoryMonitor::c_suspendAfter))
+        {
+            size_t tabId = candidate.second;
+            CheckFailure(tab->Suspend([this, tabId](bool suspended)
+            {
+                if (suspended)
+                {
+                    CheckFailure(PostTabState(tabId), L"");
+                }
+            }), L"Can't suspend tab.");
+        }
+    }
+
+    // Suspending frees little, over budget the least recently used tab goes.
+    // One per sample, the next one shows what that gave back.
+    if (overBudget && !candidates.empty())
+    {
+        size_t tabId = candidates.front().second;
+        m_tabs.at(tabId)->Discard();
+        ++discardedTabs;
+        RETURN_IF_FAILED(PostTabState(tabId));
+    }
+
+    m_memoryMonitor.LogStats(suspendedTabs, discardedTabs);
+    return S_OK;
+}
+
+HRESULT BrowserWindow::ThrottleBackgroundTabs()
+{
+    // Hidden WebViews already get Chromium's background timer throttling,
+    // this slows the rest of their main thread down as well. Tabs playing
+    // audio or holding a WebSocket would break if slowed, so they aren't.
+    double delay = m_settings.backgroundThrottleDelay * 1000;
+    for (auto& entry : m_tabs)
+    {
+        size_t tabId = entry.first;
+        Tab* tab = entry.second.get();
+        if (tabId == m_activeTabId || !tab->m_contentWebView || tab->m_memoryState != TabMemoryState::Active)
+        {
+            continue;
+        }
+
+        // A tab failing is left for the next pass, the others still get
+        // theirs
+        bool exempt = !m_settings.throttleBackgroundTabs || tab->IsPlayingAudio() || tab->HasOpenWebSockets();
+        if (tab->m_throttled && exempt)
+        {
+            CheckFailure(tab->Unthrottle(), L"Can't unthrottle tab.");
+            CheckFailure(PostTabState(tabId), L"");
+        }
+        else if (tab->m_throttled && !exempt)
+        {
+            // Picks up a changed rate
+            CheckFailure(tab->Throttle(m_settings.backgroundThrottleRate), L"Can't throttle tab.");
+        }
+        else if (!tab->m_throttled && !exempt && tab->m_inactiveStopwatch.ElapsedMilliseconds() >= delay)
+        {
+            CheckFailure(tab->Throttle(m_settings.backgroundThrottleRate), L"Can't throttle tab.");
+            CheckFailure(PostTabState(tabId), L"");
+        }
+    }
+
+    return S_OK;
+}
+
+HRESULT BrowserWindow::PostTabState(size_t tabId)
+{
+    Tab* tab = FindTab(tabId);
+    if (!tab)
+    {
+        return S_OK;
+    }
+
+    web::json::value jsonObj = web::json::value::parse(L"{}");
+    jsonObj[L"message"] = web::json::value(MG_TAB_STATE);
+    jsonObj[L"args"] = web::json::value::parse(L"{}");
+    jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
+    jsonObj[L"args"][L"state"] = web::json::value(tab->m_memoryState == TabMemoryState::Suspended ? L"suspended" :
+        tab->m_memoryState == TabMemoryState::Discarded ? L"discarded" : L"active");
+    jsonObj[L"args"][L"memory"] = web::json::value::number(tab->m_jsHeapBytes);
+    jsonObj[L"args"][L"throttled"] = web::json::value::boolean(tab->m_throttled);
+    jsonObj[L"args"][L"cpuSaved"] = web::json::value::number(tab->m_cpuSaved);
+
+    return PostJsonToControls(jsonObj);
+}
+
+HRESULT BrowserWindow::CheckTabResponsive()
+{
+    // Only the shown tab is watched, hidden ones may be suspended or
+    // throttled on purpose
+    Tab* tab = FindTab(m_activeTabId);
+    if (!tab || !tab->m_contentWebView || tab->m_scriptDialogOpen || m_tabOverviewVisible)
+    {
+        return S_OK;
+    }
+
+    if (tab->m_hangReported)
+    {
+        // The renderer didn't go down, replace the WebView anyway
+        return tab->m_recoveryStopwatch.ElapsedMilliseconds() > c_hangTimeout ? RecoverTab(m_activeTabId) : S_OK;
+    }
+
+    double unansweredMilliseconds = 0;
+    RETURN_IF_FAILED(tab->Heartbeat(unansweredMilliseconds));
+
+    return unansweredMilliseconds > c_hangTimeout ? HandleTabHang(m_activeTabId) : S_OK;
+}
+
+HRESULT BrowserWindow::HandleTabHang(size_t tabId)
+{
+    Tab* tab = FindTab(tabId);
+    if (!tab || !tab->m_contentWebView || tab->m_hangReported)
+    {
+        return S_OK;
+    }
+
+    ++m_tabHangs;
+    tab->m_hangReported = true;
+    tab->m_recoveryStopwatch.Restart();
+    OutputDebugString(L"Tab stopped responding, crashing its renderer\n");
+
+    // Crashes the renderer from its IO thread, which a busy main thread
+    // doesn't hold up. Tabs sharing the renderer go with it, every one of
+    // them is told through ProcessFailed.
+    return tab->m_contentWebView->CallDevToolsProtocolMethod(L"Page.crash", L"{}", nullptr);
+}
+
+HRESULT BrowserWindow::HandleTabProcessFailed(size_t tabId, ICoreWebView2ProcessFailedEventArgs* args)
+{
+    COREWEBVIEW2_PROCESS_FAILED_KIND kind;
+    RETURN_IF_FAILED(args->get_ProcessFailedKind(&kind));
+
+    switch (kind)
+    {
+    case COREWEBVIEW2_PROCESS_FAILED_KIND_RENDER_PROCESS_UNRESPONSIVE:
+    {
+        // The runtime noticed before the heartbeat did
+        return HandleTabHang(tabId);
+    }
+    case COREWEBVIEW2_PROCESS_FAILED_KIND_RENDER_PROCESS_EXITED:
+    {
+        ++m_rendererExits;
+        Tab* tab = FindTab(tabId);
+        if (tab && !tab->m_hangReported)
+        {
+            tab->m_recoveryStopwatch.Restart();
+        }
+
+        // Not from within the WebView's own event
+        PostToUIThread(m_hWnd, [this, tabId]()
+        {
+            if (tabId == NavigationPredictor::c_prerenderTabId)
+            {
+                m_navigationPredictor.Discard();
+                return;
+            }
+
+            CheckFailure(RecoverTab(tabId), L"Can't recover tab.");
+        });
+    }
+    break;
+    case COREWEBVIEW2_PROCESS_FAILED_KIND_GPU_PROCESS_EXITED:
+    {
+        // The runtime starts a new one, every WebView is told; count it once
+        if (tabId == m_activeTabId)
+        {
+            ++m_gpuProcessExits;
+            OutputDebugString(L"GPU process exited\n");
+        }
+    }
+    break;
+    case COREWEBVIEW2_PROCESS_FAILED_KIND_BROWSER_PROCESS_EXITED:
+    {
+        // Every content WebView, the pooled ones too, would have to be
+        // created again in a new environment
+        if (!m_browserProcessExited)
+        {
+            m_browserProcessExited = true;
+            CheckFailure(E_FAIL, L"The browser process exited, restart the browser to continue.");
+        }
+    }
+    break;
+    default:
+    {
+        // Subframe renderers and helper processes, the tab carries on
+        OutputDebugString(L"A WebView helper process failed\n");
+    }
+    break;
+    }
+
+    return S_OK;
+}
+
+HRESULT BrowserWindow::RecoverTab(size_t tabId)
+{
+    // Discarded tabs, and tabs waiting for their new WebView, have nothing
+    // to recover
+    auto tabEntry = m_tabs.find(tabId);
+    if (tabEntry == m_tabs.end() || !tabEntry->second->m_contentController)
+    {
+        return S_OK;
+    }
+
+    // A failed WebView can't go back to the controller pool. Discarding
+    // keeps the tab's entry, scroll position included.
+    Tab* tab = tabEntry->second.get();
+    tab->m_hangReported = false;
+    tab->Discard();
+
+    if (tabId != m_activeTabId)
+    {
+        ++m_deferredRecoveries;
+        return PostTabState(tabId);
+    }
+
+    // HandleTabCreated shows it again once it has a WebView
+    tab->m_recovering = true;
+    m_restoringTabId = tabId;
+    tab->Restore(m_controllerPool);
+    return PostTabState(tabId);
+}
+
+void BrowserWindow::RecordRecovery(Tab* tab)
+{
+    ++m_recoveryStats.count;
+    m_recoveryStats.totalMilliseconds += tab->m_recoveryStopwatch.ElapsedMilliseconds();
+    tab->m_recovering = false;
+
+    WCHAR log[256];
+    StringCchPrintf(log, ARRAYSIZE(log),
+        L"Tab recovered: %llu shown at %.0f ms avg, %llu hidden left to reload; %llu hangs, %llu renderer exits, %llu GPU process exits\n",
+        m_recoveryStats.count, m_recoveryStats.totalMilliseconds / m_recoveryStats.count, m_deferredRecoveries,
+        m_tabHangs, m_rendererExits, m_gpuProcessExits);
+    OutputDebugString(log);
+}
+
+Tab* BrowserWindow::FindTab(size_t tabId)
+{
+    if (tabId == NavigationPredictor::c_prerenderTabId)
+    {
+        return m_navigationPredictor.GetPrerenderedTab();
+    }
+
+    auto tab = m_tabs.find(tabId);
+    return tab != m_tabs.end() ? tab->second.get() : nullptr;
+}
+
+HRESULT BrowserWindow::HandleTabURIUpdate(size_t tabId, ICoreWebView2* webview)
+{
+    wil::unique_cotaskmem_string source;
+    RETURN_IF_FAILED(webview->get_Source(&source));
+
+    // Background tabs don't follow their back/forward list, just the URI
+    // goes out until they are shown
+    UpdateNetworkEvents();
+
+    Tab* tab = FindTab(tabId);
+    return PostNavigationState(tabId, source.get(), tab && tab->IsForeground());
+}
+
+void BrowserWindow::UpdateNetworkEvents()
+{
+    std::wstring networkUri = GetFilePathAsURI(GetBrowserPagePath(L"network"));
+    m_networkLogShown = std::any_of(m_tabs.begin(), m_tabs.end(), [&networkUri](const std::pair<const size_t, std::unique_ptr<Tab>>& tab)
+    {
+        return tab.second->m_documentUri.compare(networkUri) == 0;
+    });
+
+    for (auto& tab : m_tabs)
+    {
+        CheckFailure(tab.second->UpdateNetworkEvents(m_networkLogShown, m_settings.throttleBackgroundTabs), L"");
+    }
+
+    Tab* prerenderedTab = m_navigationPredictor.GetPrerenderedTab();
+    if (prerenderedTab)
+    {
+        CheckFailure(prerenderedTab->UpdateNetworkEvents(m_networkLogShown, m_settings.throttleBackgroundTabs), L"");
+    }
+}
+
+HRESULT BrowserWindow::HandleTabHistoryUpdate(size_t tabId, ICoreWebView2* webview)
+{
+    // Refresh the tab's copy of the back/forward list; the controls UI
+    // answers back/forward and the history menu from it until the next change
+    ComPtr<ICoreWebView2> historyWebView = webview;
+    return webview->CallDevToolsProtocolMethod(L"Page.getNavigationHistory", L"{}",
+        Callback<ICoreWebView2CallDevToolsProtocolMethodCompletedHandler>(
+            [this, tabId, historyWebView](HRESULT error, PCWSTR resultJson) -> HRESULT
+    {
+        RETURN_IF_FAILED(error);
+
+        // The tab may have been discarded or recovered meanwhile, the list
+        // is of a WebView it no longer has
+        Tab* tab = FindTab(tabId);
+        if (!tab || tab->m_contentWebView.Get() != historyWebView.Get())
+        {
+            return S_OK;
+        }
+
+        tab->m_navigationHistory.Update(web::json::value::parse(resultJson));
+
+        wil::unique_cotaskmem_string source;
+        RETURN_IF_FAILED(historyWebView->get_Source(&source));
+
+        CheckFailure(PostNavigationState(tabId, source.get()), L"Can't update go back/forward buttons.");
+        return S_OK;
+    }).Get());
+}
+
+HRESULT BrowserWindow::PostNavigationState(size_t tabId, const std::wstring& uri, bool withEntries)
+{
+    web::json::value jsonObj = web::json::value::parse(L"{}");
+    jsonObj[L"message"] = web::json::value(MG_UPDATE_URI);
+    jsonObj[L"args"] = web::json::value::parse(L"{}");
+    jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
+    jsonObj[L"args"][L"uri"] = web::json::value(uri);
+
+    std::wstring uriToShow = GetUriToShow(uri);
+    if (!uriToShow.empty())
+    {
+        jsonObj[L"args"][L"uriToShow"] = web::json::value(uriToShow);
+    }
+
+    Tab* tab = FindTab(tabId);
+    if (!tab || !withEntries)
+    {
+        return PostJsonToControls(jsonObj);
+    }
+
+    const NavigationHistory& history = tab->m_navigationHistory;
+    jsonObj[L"args"][L"canGoBack"] = web::json::value::boolean(history.CanGoBack());
+    jsonObj[L"args"][L"canGoForward"] = web::json::value::boolean(history.CanGoForward());
+
+    // The whole list goes along so back/forward can be shown without
+    // asking, Chromium keeps at most 50 entries
+    web::json::value entries = web::json::value::array();
+    for (const NavigationEntry& entry : history.GetEntries())
+    {
+        web::json::value entryObj = web::json::value::object();
+        entryObj[L"uri"] = web::json::value(entry.uri);
+        entryObj[L"title"] = web::json::value(entry.title);
+        entryObj[L"favicon"] = web::json::value(entry.favicon);
+        entryObj[L"securityState"] = web::json::value(entry.securityState);
+
+        uriToShow = GetUriToShow(entry.uri);
+        if (!uriToShow.empty())
+        {
+            entryObj[L"uriToShow"] = web::json::value(uriToShow);
+        }
+
+        entries[entries.size()] = entryObj;
+    }
+    jsonObj[L"args"][L"entries"] = entries;
+    jsonObj[L"args"][L"currentEntry"] = web::json::value::number(history.GetCurrentIndex());
+
+    return PostJsonToControls(jsonObj);
+}
+
+HRESULT BrowserWindow::ShowNavigationHistoryMenu(bool forward, POINT position)
+{
+    auto activeTab = m_tabs.find(m_activeTabId);
+    if (activeTab == m_tabs.end() || !activeTab->second->m_contentWebView)
+    {
+        return S_OK;
+    }
+
+    const NavigationHistory& history = activeTab->second->m_navigationHistory;
+    const std::vector<NavigationEntry>& entries = history.GetEntries();
+
+    wil::unique_hmenu menu(CreatePopupMenu());
+    RETURN_LAST_ERROR_IF_NULL(menu.get());
+
+    // Nearest entry first, the command ID is the entry index plus one
+    size_t index = history.GetCurrentIndex();
+    for (size_t count = 0; count < NavigationHistory::c_maxMenuItems; ++count)
+    {
+        if (forward ? index + 1 >= entries.size() : index == 0)
+        {
+            break;
+        }
+
+        index = forward ? index + 1 : index - 1;
+        const NavigationEntry& entry = entries[index];
+
+        std::wstring label;
+        for (wchar_t c : entry.title.empty() ? entry.uri : entry.title)
+        {
+            // Keep '&' from being taken as a mnemonic
+            label.append(c == L'&' ? L"&&" : std::wstring(1, c));
+        }
+
+        if (label.size() > 60)
+        {
+            label = label.substr(0, 57) + L"...";
+        }
+
+        RETURN_IF_WIN32_BOOL_FALSE(AppendMenu(menu.get(), MF_STRING, index + 1, label.c_str()));
+    }
+
+    if (GetMenuItemCount(menu.get()) <= 0)
+    {
+        return S_OK;
+    }
+
+    // |position| is in the controls WebView, which sits at the client origin
+    ClientToScreen(m_hWnd, &position);
+    int command = TrackPopupMenu(menu.get(), TPM_RETURNCMD | TPM_LEFTALIGN | TPM_TOPALIGN | TPM_RIGHTBUTTON,
+        position.x, position.y, 0, m_hWnd, nullptr);
+
+    if (command <= 0)
+    {
+        return S_OK;
+    }
+
+    return GoToNavigationEntry(m_activeTabId, static_cast<size_t>(command - 1));
+}
+
+HRESULT BrowserWindow::GoToNavigationEntry(size_t tabId, size_t index)
+{
+    Tab* tab = FindTab(tabId);
+    if (!tab)
+    {
+        return E_INVALIDARG;
+    }
+
+    const NavigationEntry* entry = tab->m_navigationHistory.GoToIndex(index);
+    if (!entry)
+    {
+        return E_INVALIDARG;
+    }
+
+    std::wstring params = L"{\"entryId\":" + std::to_wstring(entry->id) + L"}";
+    RETURN_IF_FAILED(tab->m_contentWebView->CallDevToolsProtocolMethod(L"Page.navigateToHistoryEntry", params.c_str(), nullptr));
+
+    // Show the entry right away, the WebView confirms it when it commits
+    return PostNavigationState(tabId, entry->uri);
+}
+
+HRESULT BrowserWindow::HandleTabNavStarting(size_t tabId, ICoreWebView2* webview)
+{
+    // The first navigation to start after Navigate is the one it asked for,
+    // redirects of the navigation before it keep that one's ID
+    Tab* tab = FindTab(tabId);
+    auto loadRequests = m_automationLoadRequests.equal_range(tabId);
+    for (auto request = loadRequests.first; tab && request != loadRequests.second; ++request)
+    {
+        if (!request->second.navigationId && tab->m_navigationId != request->second.previousNavigationId)
+        {
+            request->second.navigationId = tab->m_navigationId;
+        }
+    }
+
+    web::json::value jsonObj = web::json::value::parse(L"{}");
+    jsonObj[L"message"] = web::json::value(MG_NAV_STARTING);
+    jsonObj[L"args"] = web::json::value::parse(L"{}");
+    jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
+
+    return PostJsonToControls(jsonObj);
+}
+
+HRESULT BrowserWindow::HandleTabNavCompleted(size_t tabId, ICoreWebView2* webview, ICoreWebView2NavigationCompletedEventArgs* args)
+{
+    // Nothing to show for a prerender until it is swapped in
+    if (tabId == NavigationPredictor::c_prerenderTabId)
+    {
+        m_navigationPredictor.HandlePrerenderCompleted();
+        return S_OK;
+    }
+
+    Tab* tab = FindTab(tabId);
+    UINT64 navigationId = 0;
+    if (args && SUCCEEDED(args->get_NavigationId(&navigationId)))
+    {
+        BOOL success = FALSE;
+        args->get_IsSuccess(&success);
+        web::json::value result = web::json::value::object();
+        result[L"isSuccess"] = web::json::value::boolean(success != FALSE);
+
+        auto loadRequests = m_automationLoadRequests.equal_range(tabId);
+        for (auto request = loadRequests.first; request != loadRequests.second;)
+        {
+            if (request->second.navigationId == navigationId)
+            {
+                request->second.respond(S_OK, result);
+                request = m_automationLoadRequests.erase(request);
+            }
+            else
+            {
+                ++request;
+            }
+        }
+    }
+
+    if (tab && tab->m_measureOpen)
+    {
+        RecordTabOpen(tab);
+    }
+
+    if (tab && tab->m_recovering)
+    {
+        RecordRecovery(tab);
+    }
+
+    std::wstring getTitleScript(
+        // Look for a title tag
+        L"(() => {"
+        L"    const titleTag = document.getElementsByTagName('title')[0];"
+        L"    if (titleTag) {"
+        L"        return titleTag.innerHTML;"
+        L"    }"
+        // No title tag, look for the file name
+        L"    pathname = window.location.pathname;"
+        L"    var filename = pathname.split('/').pop();"
+        L"    if (filename) {"
+        L"        return filename;"
         L"    }"
         // No file name, look for the hostname
         L"    const hostname =  window.location.hostname;"
@@ -597,235 +2123,1130 @@ HRESULT BrowserWindow::HandleTabNavCompleted(size_t tabId, ICoreWebView2* webvie
         L"})();"
     );
 
-    std::wstring getFaviconURI(
-        L"(() => {"
-        // Let the UI use a fallback favicon
-        L"    let faviconURI = '';"
-        L"    let links = document.getElementsByTagName('link');"
-        // Test each link for a favicon
-        L"    Array.from(links).map(element => {"
-        L"        let rel = element.rel;"
-        // Favicon is declared, try to get the href
-        L"        if (rel && (rel == 'shortcut icon' || rel == 'icon')) {"
-        L"            if (!element.href) {"
-        L"                return;"
-        L"            }"
-        // href to icon found, check it's full URI
-        L"            try {"
-        L"                let urlParser = new URL(element.href);"
-        L"                faviconURI = urlParser.href;"
-        L"            } catch(e) {"
-        // Try prepending origin
-        L"                let origin = window.location.origin;"
-        L"                let faviconLocation = `${origin}/${element.href}`;"
-        L"                try {"
-        L"                    urlParser = new URL(faviconLocation);"
-        L"                    faviconURI = urlParser.href;"
-        L"                } catch (e2) {"
-        L"                    return;"
-        L"                }"
-        L"            }"
-        L"        }"
-        L"    });"
-        L"    return faviconURI;"
-        L"})();"
-    );
+    std::wstring getFaviconURI(
+        L"(() => {"
+        // Let the UI use a fallback favicon
+        L"    let faviconURI = '';"
+        L"    let links = document.getElementsByTagName('link');"
+        // Test each link for a favicon
+        L"    Array.from(links).map(element => {"
+        L"        let rel = element.rel;"
+        // Favicon is declared, try to get the href
+        L"        if (rel && (rel == 'shortcut icon' || rel == 'icon')) {"
+        L"            if (!element.href) {"
+        L"                return;"
+        L"            }"
+        // href to icon found, check it's full URI
+        L"            try {"
+        L"                let urlParser = new URL(element.href);"
+        L"                faviconURI = urlParser.href;"
+        L"            } catch(e) {"
+        // Try prepending origin
+        L"                let origin = window.location.origin;"
+        L"                let faviconLocation = `${origin}/${element.href}`;"
+        L"                try {"
+        L"                    urlParser = new URL(faviconLocation);"
+        L"                    faviconURI = urlParser.href;"
+        L"                } catch (e2) {"
+        L"                    return;"
+        L"                }"
+        L"            }"
+        L"        }"
+        L"    });"
+        L"    return faviconURI;"
+        L"})();"
+    );
+
+    CheckFailure(webview->ExecuteScript(getTitleScript.c_str(), Callback<ICoreWebView2ExecuteScriptCompletedHandler>(
+        [this, tabId](HRESULT error, PCWSTR result) -> HRESULT
+    {
+        RETURN_IF_FAILED(error);
+
+        web::json::value jsonObj = web::json::value::parse(L"{}");
+        jsonObj[L"message"] = web::json::value(MG_UPDATE_TAB);
+        jsonObj[L"args"] = web::json::value::parse(L"{}");
+        jsonObj[L"args"][L"title"] = web::json::value::parse(result);
+        jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
+
+        Tab* tab = FindTab(tabId);
+        if (tab && jsonObj[L"args"][L"title"].is_string())
+        {
+            tab->m_navigationHistory.SetTitle(jsonObj[L"args"][L"title"].as_string());
+        }
+
+        CheckFailure(PostJsonToControls(jsonObj), L"Can't update title.");
+        return S_OK;
+    }).Get()), L"Can't update title.");
+
+    CheckFailure(webview->ExecuteScript(getFaviconURI.c_str(), Callback<ICoreWebView2ExecuteScriptCompletedHandler>(
+        [this, tabId](HRESULT error, PCWSTR result) -> HRESULT
+    {
+        RETURN_IF_FAILED(error);
+
+        web::json::value jsonObj = web::json::value::parse(L"{}");
+        jsonObj[L"message"] = web::json::value(MG_UPDATE_FAVICON);
+        jsonObj[L"args"] = web::json::value::parse(L"{}");
+        jsonObj[L"args"][L"uri"] = web::json::value::parse(result);
+        jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
+
+        Tab* tab = FindTab(tabId);
+        if (tab && jsonObj[L"args"][L"uri"].is_string())
+        {
+            tab->m_navigationHistory.SetFavicon(jsonObj[L"args"][L"uri"].as_string());
+        }
+
+        CheckFailure(PostJsonToControls(jsonObj), L"Can't update favicon.");
+        return S_OK;
+    }).Get()), L"Can't update favicon");
+
+    web::json::value jsonObj = web::json::value::parse(L"{}");
+    jsonObj[L"message"] = web::json::value(MG_NAV_COMPLETED);
+    jsonObj[L"args"] = web::json::value::parse(L"{}");
+    jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
+
+    BOOL navigationSucceeded = FALSE;
+    if (args && SUCCEEDED(args->get_IsSuccess(&navigationSucceeded)))
+    {
+        jsonObj[L"args"][L"isError"] = web::json::value::boolean(!navigationSucceeded);
+
+        // A back/forward that didn't go through leaves the list ahead of
+        // the WebView
+        if (!navigationSucceeded)
+        {
+            CheckFailure(HandleTabHistoryUpdate(tabId, webview), L"Can't update go back/forward buttons.");
+        }
+    }
+
+    return PostJsonToControls(jsonObj);
+}
+
+HRESULT BrowserWindow::HandleTabSecurityUpdate(size_t tabId, ICoreWebView2* webview, ICoreWebView2DevToolsProtocolEventReceivedEventArgs* args)
+{
+    wil::unique_cotaskmem_string jsonArgs;
+    RETURN_IF_FAILED(args->get_ParameterObjectAsJson(&jsonArgs));
+    web::json::value securityEvent = web::json::value::parse(jsonArgs.get());
+
+    web::json::value jsonObj = web::json::value::parse(L"{}");
+    jsonObj[L"message"] = web::json::value(MG_SECURITY_UPDATE);
+    jsonObj[L"args"] = web::json::value::parse(L"{}");
+    jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
+    jsonObj[L"args"][L"state"] = securityEvent.at(L"securityState");
+
+    Tab* tab = FindTab(tabId);
+    if (tab && securityEvent.at(L"securityState").is_string())
+    {
+        tab->m_navigationHistory.SetSecurityState(securityEvent.at(L"securityState").as_string());
+    }
+
+    return PostJsonToControls(jsonObj);
+}
+
+void BrowserWindow::HandleTabCreated(size_t tabId, bool shouldBeActive)
+{
+    if (shouldBeActive || tabId == m_restoringTabId)
+    {
+        CheckFailure(SwitchToTab(tabId), L"");
+    }
+}
+
+HRESULT BrowserWindow::HandleTabMessageReceived(size_t tabId, ICoreWebView2* webview, ICoreWebView2WebMessageReceivedEventArgs* eventArgs)
+{
+    wil::unique_cotaskmem_string jsonString;
+    RETURN_IF_FAILED(eventArgs->get_WebMessageAsJson(&jsonString));
+    web::json::value jsonObj = web::json::value::parse(jsonString.get());
+
+    wil::unique_cotaskmem_string uri;
+    RETURN_IF_FAILED(webview->get_Source(&uri));
+
+    int message = jsonObj.at(L"message").as_integer();
+    web::json::value args = jsonObj.at(L"args");
+
+    wil::unique_cotaskmem_string source;
+    RETURN_IF_FAILED(webview->get_Source(&source));
+
+    switch (message)
+    {
+    case MG_GET_FAVORITES:
+    case MG_REMOVE_FAVORITE:
+    {
+        std::wstring fileURI = GetFilePathAsURI(GetFullPathFor(L"wvbrowser_ui\\content_ui\\favorites.html"));
+        // Only the favorites UI can request favorites
+        if (fileURI.compare(source.get()) == 0)
+        {
+            jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
+            CheckFailure(PostJsonToControls(jsonObj), L"Couldn't perform favorites operation.");
+        }
+    }
+    break;
+    case MG_GET_TOP_SITES:
+    {
+        std::wstring fileURI = GetFilePathAsURI(GetBrowserPagePath(L"newtab"));
+        // Only the new tab page gets the top sites, from the controls UI
+        if (fileURI.compare(source.get()) == 0)
+        {
+            jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
+            CheckFailure(PostJsonToControls(jsonObj), L"Couldn't retrieve top sites.");
+        }
+    }
+    break;
+    case MG_OPEN_SNAPSHOT:
+    {
+        std::wstring fileURI = GetFilePathAsURI(GetBrowserPagePath(L"favorites"));
+        // Only the favorites UI can open offline copies
+        if (fileURI.compare(source.get()) == 0)
+        {
+            OpenSnapshot(tabId, args.at(L"id").as_string());
+        }
+    }
+    break;
+    case MG_GET_SETTINGS:
+    {
+        std::wstring fileURI = GetFilePathAsURI(GetFullPathFor(L"wvbrowser_ui\\content_ui\\settings.html"));
+        // Only the settings UI can request settings
+        if (fileURI.compare(source.get()) == 0)
+        {
+            jsonObj[L"args"][L"settings"] = m_settings.ToJson();
+            CheckFailure(PostJsonToWebView(jsonObj, m_tabs.at(tabId)->m_contentWebView.Get()), L"Couldn't retrieve settings.");
+        }
+    }
+    break;
+    case MG_GET_DOWNLOADS:
+    {
+        std::wstring fileURI = GetFilePathAsURI(GetBrowserPagePath(L"downloads"));
+        // Only the downloads UI can request downloads
+        if (fileURI.compare(source.get()) == 0)
+        {
+            jsonObj[L"args"][L"downloads"] = m_downloadManager.GetDownloadsAsJson();
+            CheckFailure(PostJsonToWebView(jsonObj, webview), L"Couldn't retrieve downloads.");
+        }
+    }
+    break;
+    case MG_DOWNLOAD_ACTION:
+    {
+        std::wstring fileURI = GetFilePathAsURI(GetBrowserPagePath(L"downloads"));
+        // Only the downloads UI can control downloads
+        if (fileURI.compare(source.get()) == 0)
+        {
+            uint64_t id = args.at(L"id").as_number().to_uint64();
+            std::wstring action = args.at(L"action").as_string();
+            if (action.compare(L"pause") == 0)
+            {
+                CheckFailure(m_downloadManager.Pause(id), L"Can't pause download.");
+            }
+            else if (action.compare(L"resume") == 0)
+            {
+                CheckFailure(m_downloadManager.Resume(id), L"Can't resume download.");
+            }
+            else if (action.compare(L"cancel") == 0)
+            {
+                CheckFailure(m_downloadManager.Cancel(id), L"Can't cancel download.");
+            }
+            else if (action.compare(L"open") == 0 || action.compare(L"show") == 0)
+            {
+                CheckFailure(m_downloadManager.Open(id, action.compare(L"show") == 0), L"Can't open download.");
+            }
+            else if (action.compare(L"remove") == 0)
+            {
+                m_downloadManager.Remove(id);
+            }
+        }
+    }
+    break;
+    case MG_UPDATE_SETTINGS:
+    {
+        std::wstring fileURI = GetFilePathAsURI(GetBrowserPagePath(L"settings"));
+        // Only the settings UI can change settings
+        if (fileURI.compare(uri.get()) == 0)
+        {
+            CheckFailure(UpdateSettings(tabId, args), L"Couldn't update settings.");
+        }
+    }
+    break;
+    case MG_CLEAR_BROWSING_DATA:
+    {
+        std::wstring fileURI = GetFilePathAsURI(GetBrowserPagePath(L"settings"));
+        // Only the settings UI can clear browsing data
+        if (fileURI.compare(uri.get()) == 0)
+        {
+            web::json::value requestId = args.has_field(L"id") ? args.at(L"id") : web::json::value::null();
+            HRESULT hr = m_browsingDataCleaner.Clear(webview, m_controlsWebView.Get(), args,
+                [this, tabId, requestId](const web::json::value& progress)
+            {
+                web::json::value jsonObj = web::json::value::parse(L"{}");
+                jsonObj[L"message"] = web::json::value(MG_CLEAR_BROWSING_DATA);
+                jsonObj[L"args"] = progress;
+                jsonObj[L"args"][L"id"] = requestId;
+                CheckFailure(PostJsonToSettingsTab(tabId, jsonObj), L"");
+            });
+
+            if (FAILED(hr))
+            {
+                jsonObj[L"args"][L"done"] = web::json::value::boolean(true);
+                jsonObj[L"args"][L"succeeded"] = web::json::value::boolean(false);
+                CheckFailure(PostJsonToWebView(jsonObj, webview), L"");
+            }
+        }
+    }
+    break;
+    case MG_GET_STORAGE_USAGE:
+    {
+        std::wstring fileURI = GetFilePathAsURI(GetBrowserPagePath(L"settings"));
+        if (fileURI.compare(uri.get()) == 0)
+        {
+            // Answered when the audit is done if one is needed
+            m_storageUsageRequests.push_back(tabId);
+            bool refresh = args.has_field(L"refresh") && args.at(L"refresh").is_boolean() && args.at(L"refresh").as_bool();
+            if (refresh || !m_storageAuditor.HasAudited())
+            {
+                AuditStorage();
+            }
+            else if (!m_storageAuditor.IsAuditing())
+            {
+                PostStorageUsage();
+            }
+        }
+    }
+    break;
+    case MG_GET_HISTORY:
+    case MG_REMOVE_HISTORY_ITEM:
+    case MG_CLEAR_HISTORY:
+    {
+        std::wstring fileURI = GetFilePathAsURI(GetFullPathFor(L"wvbrowser_ui\\content_ui\\history.html"));
+        // Only the history UI can request history
+        if (fileURI.compare(uri.get()) == 0)
+        {
+            jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
+            CheckFailure(PostJsonToControls(jsonObj), L"Couldn't perform history operation");
+        }
+    }
+    break;
+    case MG_GET_NETWORK_LOG:
+    {
+        std::wstring fileURI = GetFilePathAsURI(GetBrowserPagePath(L"network"));
+        // Only the network UI can request network logs
+        if (fileURI.compare(uri.get()) == 0)
+        {
+            CheckFailure(SendNetworkLog(tabId, args), L"Couldn't retrieve network log.");
+        }
+    }
+    break;
+    case MG_FIND:
+    {
+        // Ctrl+F or F3 pressed in the page, the find bar takes the focus
+        if (tabId == m_activeTabId)
+        {
+            CheckFailure(PostJsonToControls(jsonObj), L"");
+            CheckFailure(m_controlsController->MoveFocus(COREWEBVIEW2_MOVE_FOCUS_REASON_PROGRAMMATIC), L"");
+        }
+    }
+    break;
+    case MG_FIND_RESULT:
+    {
+        // Counts come in while the page is still being searched
+        if (tabId == m_activeTabId)
+        {
+            jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
+            CheckFailure(PostJsonToControls(jsonObj), L"");
+        }
+    }
+    break;
+    case MG_SCRIPT_DIALOG:
+    {
+        // Reported by every top level document, see Tab::TrackScriptDialogs
+        Tab* tab = FindTab(tabId);
+        if (tab && args.has_field(L"open") && args.at(L"open").is_boolean())
+        {
+            tab->HandleScriptDialog(args.at(L"open").as_bool());
+        }
+    }
+    break;
+    case MG_SCROLL_POSITION:
+    {
+        // Reported by every top level document, see Tab::TrackScrollPosition.
+        // A report from a page that is being left may arrive after the next
+        // one committed, those are dropped.
+        Tab* tab = FindTab(tabId);
+        if (tab && args.has_field(L"uri") && args.at(L"uri").is_string() &&
+            args.has_field(L"x") && args.at(L"x").is_number() && args.has_field(L"y") && args.at(L"y").is_number())
+        {
+            tab->m_navigationHistory.SetScrollPosition(args.at(L"uri").as_string(), args.at(L"x").as_double(), args.at(L"y").as_double());
+        }
+    }
+    break;
+    default:
+    {
+        OutputDebugString(L"Unexpected message\n");
+    }
+    break;
+    }
+
+    return S_OK;
+}
 
-    CheckFailure(webview->ExecuteScript(getTitleScript.c_str(), Callback<ICoreWebView2ExecuteScriptCompletedHandler>(
-        [this, tabId](HRESULT error, PCWSTR result) -> HRESULT
+HRESULT BrowserWindow::HandleTabWebResourceRequested(size_t tabId, ICoreWebView2* webview, ICoreWebView2WebResourceRequestedEventArgs* args)
+{
+    Tab* tab = FindTab(tabId);
+    if (!tab)
     {
-        RETURN_IF_FAILED(error);
+        return S_OK;
+    }
 
-        web::json::value jsonObj = web::json::value::parse(L"{}");
-        jsonObj[L"message"] = web::json::value(MG_UPDATE_TAB);
-        jsonObj[L"args"] = web::json::value::parse(L"{}");
-        jsonObj[L"args"][L"title"] = web::json::value::parse(result);
-        jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
+    wil::com_ptr<ICoreWebView2WebResourceRequest> request;
+    wil::unique_cotaskmem_string uri;
+    COREWEBVIEW2_WEB_RESOURCE_CONTEXT context;
+    RETURN_IF_FAILED(args->get_Request(&request));
+    RETURN_IF_FAILED(request->get_Uri(&uri));
+    RETURN_IF_FAILED(args->get_ResourceContext(&context));
+
+    // The navigation the user asked for is only blocked by $document rules
+    bool isTopLevelDocument = context == COREWEBVIEW2_WEB_RESOURCE_CONTEXT_DOCUMENT &&
+        tab->m_pendingNavigationUri.compare(uri.get()) == 0;
+    const std::wstring& documentUri = isTopLevelDocument ? tab->m_pendingNavigationUri : tab->m_documentUri;
+
+    bool block = context == COREWEBVIEW2_WEB_RESOURCE_CONTEXT_IMAGE && !m_settings.AreImagesEnabledFor(documentUri);
+    if (!block && m_contentFilter.IsLoaded())
+    {
+        block = m_contentFilter.ShouldBlock(ContentFilter::MakeRequest(uri.get(), documentUri, context, isTopLevelDocument));
+    }
 
-        CheckFailure(PostJsonToWebView(jsonObj, m_controlsWebView.Get()), L"Can't update title.");
+    if (block)
+    {
+        wil::com_ptr<ICoreWebView2WebResourceResponse> response;
+        RETURN_IF_FAILED(m_contentEnv->CreateWebResourceResponse(nullptr, 403, L"Blocked", L"", &response));
+        RETURN_IF_FAILED(args->put_Response(response.get()));
         return S_OK;
-    }).Get()), L"Can't update title.");
+    }
 
-    CheckFailure(webview->ExecuteScript(getFaviconURI.c_str(), Callback<ICoreWebView2ExecuteScriptCompletedHandler>(
-        [this, tabId](HRESULT error, PCWSTR result) -> HRESULT
+    if (!m_sharedCache->IsCachedOrigin(uri.get()))
     {
-        RETURN_IF_FAILED(error);
+        return S_OK;
+    }
 
-        web::json::value jsonObj = web::json::value::parse(L"{}");
-        jsonObj[L"message"] = web::json::value(MG_UPDATE_FAVICON);
-        jsonObj[L"args"] = web::json::value::parse(L"{}");
-        jsonObj[L"args"][L"uri"] = web::json::value::parse(result);
-        jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
+    // Range requests want part of a body, the page gets all of it or none
+    wil::unique_cotaskmem_string method;
+    wil::com_ptr<ICoreWebView2HttpRequestHeaders> headers;
+    RETURN_IF_FAILED(request->get_Method(&method));
+    RETURN_IF_FAILED(request->get_Headers(&headers));
+    BOOL hasRange = FALSE;
+    BOOL hasCredentials = FALSE;
+    RETURN_IF_FAILED(headers->Contains(L"Range", &hasRange));
+    RETURN_IF_FAILED(headers->Contains(L"Authorization", &hasCredentials));
+    if (wcscmp(method.get(), L"GET") != 0 || hasRange)
+    {
+        return S_OK;
+    }
+
+    // A hard reload, or a page's own fetch, may ask to skip caches
+    auto getHeader = [&headers](LPCWSTR name)
+    {
+        BOOL contains = FALSE;
+        wil::unique_cotaskmem_string value;
+        if (SUCCEEDED(headers->Contains(name, &contains)) && contains && SUCCEEDED(headers->GetHeader(name, &value)))
+        {
+            return std::wstring(value.get());
+        }
+        return std::wstring();
+    };
+    if (SharedHttpCache::BypassesCache(getHeader(L"Cache-Control"), getHeader(L"Pragma")))
+    {
+        return S_OK;
+    }
+
+    CachedResponse cached;
+    wil::com_ptr<IStream> body;
+    if (m_sharedCache->Lookup(uri.get(), hasCredentials, cached, &body) == S_OK)
+    {
+        wil::com_ptr<ICoreWebView2WebResourceResponse> response;
+        RETURN_IF_FAILED(m_contentEnv->CreateWebResourceResponse(body.get(), cached.statusCode,
+            cached.reasonPhrase.c_str(), cached.headers.c_str(), &response));
+        RETURN_IF_FAILED(args->put_Response(response.get()));
+    }
+
+    return S_OK;
+}
+
+HRESULT BrowserWindow::HandleTabWebResourceResponseReceived(size_t tabId, ICoreWebView2* webview, ICoreWebView2WebResourceResponseReceivedEventArgs* args)
+{
+    wil::com_ptr<ICoreWebView2WebResourceRequest> request;
+    wil::unique_cotaskmem_string uri;
+    wil::unique_cotaskmem_string method;
+    RETURN_IF_FAILED(args->get_Request(&request));
+    RETURN_IF_FAILED(request->get_Uri(&uri));
+    RETURN_IF_FAILED(request->get_Method(&method));
+    if (wcscmp(method.get(), L"GET") != 0 || !m_sharedCache->IsCachedOrigin(uri.get()))
+    {
+        return S_OK;
+    }
+
+    wil::com_ptr<ICoreWebView2HttpRequestHeaders> requestHeaders;
+    BOOL hasCredentials = FALSE;
+    RETURN_IF_FAILED(request->get_Headers(&requestHeaders));
+    RETURN_IF_FAILED(requestHeaders->Contains(L"Authorization", &hasCredentials));
+
+    wil::com_ptr<ICoreWebView2WebResourceResponseView> response;
+    wil::com_ptr<ICoreWebView2HttpResponseHeaders> responseHeaders;
+    wil::com_ptr<ICoreWebView2HttpHeadersCollectionIterator> iterator;
+    int statusCode = 0;
+    wil::unique_cotaskmem_string reasonPhrase;
+    RETURN_IF_FAILED(args->get_Response(&response));
+    RETURN_IF_FAILED(response->get_StatusCode(&statusCode));
+    RETURN_IF_FAILED(response->get_ReasonPhrase(&reasonPhrase));
+    RETURN_IF_FAILED(response->get_Headers(&responseHeaders));
+    RETURN_IF_FAILED(responseHeaders->GetIterator(&iterator));
+
+    HttpHeaders headers;
+    BOOL hasHeader = FALSE;
+    while (SUCCEEDED(iterator->get_HasCurrentHeader(&hasHeader)) && hasHeader)
+    {
+        wil::unique_cotaskmem_string name;
+        wil::unique_cotaskmem_string value;
+        RETURN_IF_FAILED(iterator->GetCurrentHeader(&name, &value));
+        headers.emplace_back(name.get(), value.get());
+
+        BOOL hasNext = FALSE;
+        RETURN_IF_FAILED(iterator->MoveNext(&hasNext));
+    }
+
+    // Answers from the shared cache carry its header and aren't stored again
+    std::shared_ptr<CachedResponse> cached = std::make_shared<CachedResponse>();
+    cached->uri = uri.get();
+    cached->reasonPhrase = reasonPhrase.get();
+    if (!SharedHttpCache::IsStorable(statusCode, headers, hasCredentials, *cached))
+    {
+        return S_OK;
+    }
+
+    // The body comes decoded
+    return response->GetContent(Callback<ICoreWebView2WebResourceResponseViewGetContentCompletedHandler>(
+        [this, cached](HRESULT error, IStream* content) -> HRESULT
+    {
+        if (FAILED(error) || !content)
+        {
+            return S_OK;
+        }
+
+        std::shared_ptr<std::string> body = std::make_shared<std::string>();
+        char buffer[64 * 1024];
+        ULONG read = 0;
+        while (SUCCEEDED(content->Read(buffer, sizeof(buffer), &read)) && read > 0)
+        {
+            body->append(buffer, read);
+            if (body->size() > SharedHttpCache::c_maxResponseBytes)
+            {
+                return S_OK;
+            }
+        }
+
+        std::shared_ptr<SharedHttpCache> sharedCache = m_sharedCache;
+        RunAsync([sharedCache, cached, body]()
+        {
+            sharedCache->Store(*cached, *body);
+        }, []() {});
+
+        return S_OK;
+    }).Get());
+}
+
+// Fetches on a worker thread, |done| gets how many responses were stored
+void BrowserWindow::PrewarmSharedCache(std::vector<std::wstring> uris, std::function<void(size_t)> done)
+{
+    if (uris.empty())
+    {
+        if (done)
+        {
+            done(0);
+        }
+        return;
+    }
+
+    std::shared_ptr<SharedHttpCache> sharedCache = m_sharedCache;
+    std::shared_ptr<size_t> stored = std::make_shared<size_t>(0);
+    RunAsync([sharedCache, uris, stored]()
+    {
+        *stored = sharedCache->Prewarm(uris);
+    }, [done, stored]()
+    {
+        if (done)
+        {
+            done(*stored);
+        }
+    });
+}
+
+HRESULT BrowserWindow::SendNetworkLog(size_t requestingTabId, web::json::value args)
+{
+    // Show the requested tab, otherwise the one the user was on before
+    // opening the network page.
+    size_t targetTabId = INVALID_TAB_ID;
+    if (args.has_field(L"tabId") && args.at(L"tabId").is_number())
+    {
+        targetTabId = args.at(L"tabId").as_number().to_uint32();
+    }
+
+    if (m_tabs.find(targetTabId) == m_tabs.end())
+    {
+        targetTabId = m_tabs.find(m_lastActiveTabId) != m_tabs.end() ? m_lastActiveTabId : requestingTabId;
+    }
+
+    NetworkLog& networkLog = m_tabs.at(targetTabId)->m_networkLog;
+    if (args.has_field(L"clear") && args.at(L"clear").as_bool())
+    {
+        networkLog.Clear();
+    }
+
+    web::json::value jsonObj = web::json::value::parse(L"{}");
+    jsonObj[L"message"] = web::json::value(MG_GET_NETWORK_LOG);
+    jsonObj[L"args"] = web::json::value::parse(L"{}");
+    jsonObj[L"args"][L"tabId"] = web::json::value::number(targetTabId);
+
+    web::json::value tabs = web::json::value::array();
+    size_t index = 0;
+    for (auto& tab : m_tabs)
+    {
+        wil::unique_cotaskmem_string source;
+        if (!tab.second->m_contentWebView || FAILED(tab.second->m_contentWebView->get_Source(&source)))
+        {
+            continue;
+        }
+
+        web::json::value entry = web::json::value::object();
+        entry[L"tabId"] = web::json::value::number(tab.first);
+        entry[L"uri"] = web::json::value(source.get());
+        tabs[index++] = entry;
+    }
+
+    jsonObj[L"args"][L"tabs"] = tabs;
+    jsonObj[L"args"][L"origins"] = networkLog.GetOriginSummaryAsJson();
+    jsonObj[L"args"][L"requests"] = networkLog.GetRequestsAsJson();
+
+    return PostListToWebView(jsonObj, L"requests", NetworkLog::Columns(), m_tabs.at(requestingTabId)->m_contentWebView.Get());
+}
+
+HRESULT BrowserWindow::HandleTabNewWindowRequested(size_t tabId, ICoreWebView2* webview, ICoreWebView2NewWindowRequestedEventArgs* args)
+{
+    BOOL isUserInitiated = FALSE;
+    RETURN_IF_FAILED(args->get_IsUserInitiated(&isUserInitiated));
+
+    wil::unique_cotaskmem_string source;
+    RETURN_IF_FAILED(webview->get_Source(&source));
+
+    // Windows opened from a click still go through, the default handling
+    // shows them in a popup window. A prerendered page gets none at all.
+    if (tabId == NavigationPredictor::c_prerenderTabId ||
+        (!isUserInitiated && m_settings.ArePopupsBlockedFor(source.get())))
+    {
+        RETURN_IF_FAILED(args->put_Handled(TRUE));
+        OutputDebugString(L"Blocked a pop-up window\n");
+    }
+
+    return S_OK;
+}
+
+HRESULT BrowserWindow::HandleTabDownloadStarting(size_t tabId, ICoreWebView2* webview, ICoreWebView2DownloadStartingEventArgs* args)
+{
+    // A prerendered page doesn't get to download anything
+    if (tabId == NavigationPredictor::c_prerenderTabId)
+    {
+        return args->put_Cancel(TRUE);
+    }
+
+    return m_downloadManager.HandleDownloadStarting(args);
+}
+
+bool BrowserWindow::PostDownloadProgress(const web::json::value& downloads)
+{
+    if (m_controlsQueue.IsBackedUp())
+    {
+        return false;
+    }
+
+    web::json::value jsonObj = web::json::value::parse(L"{}");
+    jsonObj[L"message"] = web::json::value(MG_DOWNLOAD_PROGRESS);
+    jsonObj[L"args"] = web::json::value::parse(L"{}");
+    jsonObj[L"args"][L"downloads"] = downloads;
+
+    CheckFailure(PostJsonToControls(jsonObj), L"");
+
+    std::wstring downloadsURI = GetFilePathAsURI(GetBrowserPagePath(L"downloads"));
+    for (auto& tab : m_tabs)
+    {
+        ICoreWebView2* webview = tab.second->m_contentWebView.Get();
+        wil::unique_cotaskmem_string source;
+        if (webview && SUCCEEDED(webview->get_Source(&source)) && downloadsURI.compare(source.get()) == 0)
+        {
+            CheckFailure(PostJsonToWebView(jsonObj, webview), L"");
+        }
+    }
+
+    return true;
+}
+
+HRESULT BrowserWindow::CaptureSnapshot(size_t tabId, SnapshotFormat format)
+{
+    Tab* tab = FindTab(tabId);
+    if (!tab || !tab->m_contentWebView)
+    {
+        return E_INVALIDARG;
+    }
+
+    ICoreWebView2* webview = tab->m_contentWebView.Get();
+    std::shared_ptr<SnapshotInfo> info = std::make_shared<SnapshotInfo>();
+    wil::unique_cotaskmem_string source;
+    RETURN_IF_FAILED(webview->get_Source(&source));
+    info->uri = source.get();
+    wil::unique_cotaskmem_string title;
+    RETURN_IF_FAILED(webview->get_DocumentTitle(&title));
+    info->title = title.get();
+
+    // Browser pages are always there
+    if (IsBrowserPageUri(info->uri))
+    {
+        return S_OK;
+    }
+
+    std::shared_ptr<Stopwatch> stopwatch = std::make_shared<Stopwatch>();
+    std::shared_ptr<SnapshotStore> snapshotStore = m_snapshotStore;
+    std::shared_ptr<HRESULT> storeResult = std::make_shared<HRESULT>(E_PENDING);
+    auto postResult = [this, tabId, info, storeResult, stopwatch]()
+    {
+        PostSnapshotResult(tabId, *info, *storeResult, stopwatch->ElapsedMilliseconds());
+    };
+
+    if (format == SnapshotFormat::Pdf)
+    {
+        wil::com_ptr<ICoreWebView2_7> webview7;
+        RETURN_IF_FAILED(webview->QueryInterface(IID_PPV_ARGS(&webview7)));
+
+        std::wstring pdfPath = snapshotStore->GetTemporaryPath(L".pdf");
+        return webview7->PrintToPdf(pdfPath.c_str(), nullptr, Callback<ICoreWebView2PrintToPdfCompletedHandler>(
+            [this, snapshotStore, pdfPath, info, storeResult, postResult](HRESULT errorCode, BOOL isSuccessful) -> HRESULT
+        {
+            if (FAILED(errorCode) || !isSuccessful)
+            {
+                *storeResult = FAILED(errorCode) ? errorCode : E_FAIL;
+                postResult();
+                return S_OK;
+            }
+
+            RunAsync([snapshotStore, pdfPath, info, storeResult]()
+            {
+                *storeResult = snapshotStore->StorePdf(pdfPath, *info);
+            }, postResult);
+
+            return S_OK;
+        }).Get());
+    }
+
+    return webview->CallDevToolsProtocolMethod(L"Page.captureSnapshot", L"{\"format\":\"mhtml\"}",
+        Callback<ICoreWebView2CallDevToolsProtocolMethodCompletedHandler>(
+            [this, snapshotStore, info, storeResult, postResult](HRESULT errorCode, LPCWSTR resultJson) -> HRESULT
+    {
+        if (FAILED(errorCode))
+        {
+            *storeResult = errorCode;
+            postResult();
+            return S_OK;
+        }
+
+        // The whole page comes in this one string, parsing it is left to
+        // the worker thread along with the rest
+        std::shared_ptr<std::wstring> captureResult = std::make_shared<std::wstring>(resultJson);
+        RunAsync([snapshotStore, captureResult, info, storeResult]()
+        {
+            *storeResult = snapshotStore->StoreMhtml(*captureResult, *info);
+        }, postResult);
 
-        CheckFailure(PostJsonToWebView(jsonObj, m_controlsWebView.Get()), L"Can't update favicon.");
         return S_OK;
-    }).Get()), L"Can't update favicon");
+    }).Get());
+}
+
+void BrowserWindow::PostSnapshotResult(size_t tabId, const SnapshotInfo& info, HRESULT hr, double milliseconds)
+{
+    if (FAILED(hr))
+    {
+        WCHAR log[128];
+        StringCchPrintf(log, ARRAYSIZE(log), L"Snapshot failed: 0x%08X\n", hr);
+        OutputDebugString(log);
+        return;
+    }
+
+    WCHAR log[256];
+    StringCchPrintf(log, ARRAYSIZE(log),
+        L"Snapshot: %llu bytes captured, %zu of %zu parts new, %llu bytes stored, %.1f ms\n",
+        info.bytes, info.newParts, info.parts, info.storedBytes, milliseconds);
+    OutputDebugString(log);
 
     web::json::value jsonObj = web::json::value::parse(L"{}");
-    jsonObj[L"message"] = web::json::value(MG_NAV_COMPLETED);
+    jsonObj[L"message"] = web::json::value(MG_CAPTURE_SNAPSHOT);
     jsonObj[L"args"] = web::json::value::parse(L"{}");
     jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
+    jsonObj[L"args"][L"uri"] = web::json::value(info.uri);
+    jsonObj[L"args"][L"snapshotId"] = web::json::value(info.id);
+    jsonObj[L"args"][L"format"] = web::json::value(info.format == SnapshotFormat::Pdf ? L"pdf" : L"mhtml");
 
-    BOOL navigationSucceeded = FALSE;
-    if (SUCCEEDED(args->get_IsSuccess(&navigationSucceeded)))
+    CheckFailure(PostJsonToControls(jsonObj), L"");
+}
+
+HRESULT BrowserWindow::ShowTabOverview()
+{
+    auto postThumbnails = [this]()
     {
-        jsonObj[L"args"][L"isError"] = web::json::value::boolean(!navigationSucceeded);
+        std::vector<size_t> tabIds;
+        for (auto& tab : m_tabs)
+        {
+            tabIds.push_back(tab.first);
+        }
+
+        m_thumbnailCache.GetThumbnails(tabIds, [this](const web::json::value& thumbnails)
+        {
+            web::json::value jsonObj = web::json::value::parse(L"{}");
+            jsonObj[L"message"] = web::json::value(MG_TAB_OVERVIEW);
+            jsonObj[L"args"] = web::json::value::parse(L"{}");
+            jsonObj[L"args"][L"thumbnails"] = thumbnails;
+
+            CheckFailure(PostJsonToControls(jsonObj), L"");
+        });
+    };
+
+    Tab* activeTab = FindTab(m_activeTabId);
+    if (!activeTab || !activeTab->m_contentWebView ||
+        FAILED(m_thumbnailCache.Capture(m_activeTabId, activeTab->m_contentWebView.Get(), postThumbnails)))
+    {
+        postThumbnails();
     }
 
-    return PostJsonToWebView(jsonObj, m_controlsWebView.Get());
+    return S_OK;
 }
 
-HRESULT BrowserWindow::HandleTabSecurityUpdate(size_t tabId, ICoreWebView2* webview, ICoreWebView2DevToolsProtocolEventReceivedEventArgs* args)
+void BrowserWindow::OpenSnapshot(size_t tabId, const std::wstring& id)
 {
-    wil::unique_cotaskmem_string jsonArgs;
-    RETURN_IF_FAILED(args->get_ParameterObjectAsJson(&jsonArgs));
-    web::json::value securityEvent = web::json::value::parse(jsonArgs.get());
+    // Reassembling the parts is file work as well
+    std::shared_ptr<SnapshotStore> snapshotStore = m_snapshotStore;
+    std::shared_ptr<std::wstring> path = std::make_shared<std::wstring>();
+    std::shared_ptr<HRESULT> openResult = std::make_shared<HRESULT>(E_PENDING);
 
-    web::json::value jsonObj = web::json::value::parse(L"{}");
-    jsonObj[L"message"] = web::json::value(MG_SECURITY_UPDATE);
-    jsonObj[L"args"] = web::json::value::parse(L"{}");
-    jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
-    jsonObj[L"args"][L"state"] = securityEvent.at(L"securityState");
+    RunAsync([snapshotStore, id, path, openResult]()
+    {
+        *openResult = snapshotStore->Open(id, *path);
+    }, [this, tabId, path, openResult]()
+    {
+        Tab* tab = FindTab(tabId);
+        if (FAILED(*openResult) || !tab || !tab->m_contentWebView)
+        {
+            OutputDebugString(L"Can't open snapshot\n");
+            return;
+        }
 
-    return PostJsonToWebView(jsonObj, m_controlsWebView.Get());
+        CheckFailure(tab->m_contentWebView->Navigate(GetFilePathAsURI(*path).c_str()), L"Can't open offline copy.");
+    });
 }
 
-void BrowserWindow::HandleTabCreated(size_t tabId, bool shouldBeActive)
+HRESULT BrowserWindow::ApplyContentSettings(ICoreWebView2* webview, const std::wstring& uri)
 {
-    if (shouldBeActive)
+    wil::com_ptr<ICoreWebView2Settings> settings;
+    RETURN_IF_FAILED(webview->get_Settings(&settings));
+
+    // Browser pages are scripts themselves
+    bool scriptsEnabled = IsBrowserPageUri(uri) || m_settings.AreScriptsEnabledFor(uri);
+    BOOL currentlyEnabled = FALSE;
+    RETURN_IF_FAILED(settings->get_IsScriptEnabled(&currentlyEnabled));
+    if (!!currentlyEnabled != scriptsEnabled)
     {
-        CheckFailure(SwitchToTab(tabId), L"");
+        RETURN_IF_FAILED(settings->put_IsScriptEnabled(scriptsEnabled ? TRUE : FALSE));
     }
+
+    return S_OK;
 }
 
-HRESULT BrowserWindow::HandleTabMessageReceived(size_t tabId, ICoreWebView2* webview, ICoreWebView2WebMessageReceivedEventArgs* eventArgs)
+HRESULT BrowserWindow::UpdateSettings(size_t tabId, web::json::value args)
 {
-    wil::unique_cotaskmem_string jsonString;
-    RETURN_IF_FAILED(eventArgs->get_WebMessageAsJson(&jsonString));
-    web::json::value jsonObj = web::json::value::parse(jsonString.get());
+    BrowserSettings previous = m_settings;
+    m_settings.Update(args);
+    CheckFailure(m_settings.Save(), L"Couldn't save settings.");
+    m_addressClassifier.SetSearchTemplate(m_settings.searchTemplate);
+    m_sharedCache->SetOrigins(m_settings.sharedCacheOrigins);
+    RETURN_IF_FAILED(UpdateWebResourceFilters());
+
+    // Apply to every open tab in one pass. Script and image changes only
+    // take effect on a new document, so tabs affected by them are reloaded.
+    for (auto& tab : m_tabs)
+    {
+        ICoreWebView2* webview = tab.second->m_contentWebView.Get();
+        wil::unique_cotaskmem_string source;
+        if (!webview || FAILED(webview->get_Source(&source)) || IsBrowserPageUri(source.get()))
+        {
+            continue;
+        }
 
-    wil::unique_cotaskmem_string uri;
-    RETURN_IF_FAILED(webview->get_Source(&uri));
+        bool scriptsChanged = previous.AreScriptsEnabledFor(source.get()) != m_settings.AreScriptsEnabledFor(source.get());
+        bool imagesChanged = previous.AreImagesEnabledFor(source.get()) != m_settings.AreImagesEnabledFor(source.get());
+        if (scriptsChanged || imagesChanged)
+        {
+            RETURN_IF_FAILED(ApplyContentSettings(webview, source.get()));
+            RETURN_IF_FAILED(webview->Reload());
+        }
+    }
 
-    int message = jsonObj.at(L"message").as_integer();
-    web::json::value args = jsonObj.at(L"args");
+    // Turning throttling off lifts it right away, and WebSockets are no
+    // longer followed
+    RETURN_IF_FAILED(ThrottleBackgroundTabs());
+    UpdateNetworkEvents();
 
-    wil::unique_cotaskmem_string source;
-    RETURN_IF_FAILED(webview->get_Source(&source));
+    if (previous.syncServer.compare(m_settings.syncServer) != 0)
+    {
+        RETURN_IF_FAILED(PostSyncConfig());
+    }
 
-    switch (message)
+    // Lowered budgets and quotas are enforced right away
+    if (m_settings.memoryBudget != previous.memoryBudget)
     {
-    case MG_GET_FAVORITES:
-    case MG_REMOVE_FAVORITE:
+        m_memoryMonitor.SetBudget(static_cast<uint64_t>(m_settings.memoryBudget * 1024 * 1024));
+        RETURN_IF_FAILED(EnforceMemoryBudget());
+    }
+
+    if (m_settings.cacheQuota != previous.cacheQuota || m_settings.siteDataQuota != previous.siteDataQuota)
     {
-        std::wstring fileURI = GetFilePathAsURI(GetFullPathFor(L"wvbrowser_ui\\content_ui\\favorites.html"));
-        // Only the favorites UI can request favorites
-        if (fileURI.compare(source.get()) == 0)
-        {
-            jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
-            CheckFailure(PostJsonToWebView(jsonObj, m_controlsWebView.Get()), L"Couldn't perform favorites operation.");
-        }
+        AuditStorage();
     }
-    break;
-    case MG_GET_SETTINGS:
+
+    web::json::value jsonObj = web::json::value::parse(L"{}");
+    jsonObj[L"message"] = web::json::value(MG_GET_SETTINGS);
+    jsonObj[L"args"] = web::json::value::parse(L"{}");
+    jsonObj[L"args"][L"settings"] = m_settings.ToJson();
+
+    return PostJsonToWebView(jsonObj, m_tabs.at(tabId)->m_contentWebView.Get());
+}
+
+HRESULT BrowserWindow::HandleControlsReady(const web::json::value& args)
+{
+    if (m_controlsReady)
     {
-        std::wstring fileURI = GetFilePathAsURI(GetFullPathFor(L"wvbrowser_ui\\content_ui\\settings.html"));
-        // Only the settings UI can request settings
-        if (fileURI.compare(source.get()) == 0)
+        return S_OK;
+    }
+
+    m_controlsReady = true;
+    MarkStartup(L"controlsReady");
+
+    double controlsReady = m_startupTimeline.back().second;
+    for (const auto& milestone : m_startupTimeline)
+    {
+        if (milestone.first.compare(L"snapshotPainted") == 0)
         {
-            jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
-            CheckFailure(PostJsonToWebView(jsonObj, m_controlsWebView.Get()), L"Couldn't retrieve settings.");
+            WCHAR log[128];
+            StringCchPrintf(log, ARRAYSIZE(log), L"Startup: controls bar painted from the snapshot %.0f ms before its WebView\n",
+                controlsReady - milestone.second);
+            OutputDebugString(log);
         }
     }
-    break;
-    case MG_CLEAR_CACHE:
+
+    ComPtr<ICoreWebView2Controller2> controller2;
+    if (SUCCEEDED(m_controlsController.As(&controller2)))
     {
-        std::wstring fileURI = GetFilePathAsURI(GetFullPathFor(L"wvbrowser_ui\\content_ui\\settings.html"));
-        // Only the settings UI can request cache clearing
-        if (fileURI.compare(uri.get()) == 0)
-        {
-            jsonObj[L"args"][L"content"] = web::json::value::boolean(false);
-            jsonObj[L"args"][L"controls"] = web::json::value::boolean(false);
+        RETURN_IF_FAILED(controller2->put_DefaultBackgroundColor({ 255, 255, 255, 255 }));
+    }
 
-            if (SUCCEEDED(ClearContentCache()))
-            {
-                jsonObj[L"args"][L"content"] = web::json::value::boolean(true);
-            }
+    // Kept for the next start, which shows the same bar
+    if (args.has_field(L"snapshot"))
+    {
+        CheckFailure(m_controlsSnapshot.Update(args.at(L"snapshot")), L"");
+    }
 
-            if (SUCCEEDED(ClearControlsCache()))
-            {
-                jsonObj[L"args"][L"controls"] = web::json::value::boolean(true);
-            }
+    return S_OK;
+}
 
-            CheckFailure(PostJsonToWebView(jsonObj, m_tabs.at(tabId)->m_contentWebView.Get()), L"");
-        }
-    }
-    break;
-    case MG_CLEAR_COOKIES:
-    {
-        std::wstring fileURI = GetFilePathAsURI(GetFullPathFor(L"wvbrowser_ui\\content_ui\\settings.html"));
-        // Only the settings UI can request cookies clearing
-        if (fileURI.compare(uri.get()) == 0)
-        {
-            jsonObj[L"args"][L"content"] = web::json::value::boolean(false);
-            jsonObj[L"args"][L"controls"] = web::json::value::boolean(false);
+void BrowserWindow::MarkStartup(const wchar_t* milestone)
+{
+    double milliseconds = Stopwatch::EpochMilliseconds() - m_processCreated;
+    m_startupTimeline.push_back(std::make_pair(std::wstring(milestone), milliseconds));
 
-            if (SUCCEEDED(ClearContentCookies()))
-            {
-                jsonObj[L"args"][L"content"] = web::json::value::boolean(true);
-            }
+    WCHAR log[128];
+    StringCchPrintf(log, ARRAYSIZE(log), L"Startup: %s at %.0f ms\n", milestone, milliseconds);
+    OutputDebugString(log);
+}
 
+HRESULT BrowserWindow::PostSyncConfig()
+{
+    web::json::value jsonObj = web::json::value::parse(L"{}");
+    jsonObj[L"message"] = web::json::value(MG_SYNC_CONFIG);
+    jsonObj[L"args"] = web::json::value::parse(L"{}");
+    jsonObj[L"args"][L"server"] = web::json::value(m_settings.syncServer);
 
-            if (SUCCEEDED(ClearControlsCookies()))
-            {
-                jsonObj[L"args"][L"controls"] = web::json::value::boolean(true);
-            }
+    return PostJsonToControls(jsonObj);
+}
 
-            CheckFailure(PostJsonToWebView(jsonObj, m_tabs.at(tabId)->m_contentWebView.Get()), L"");
-        }
+void BrowserWindow::AuditStorage()
+{
+    if (!m_storageAuditor.BeginAudit())
+    {
+        return;
     }
-    break;
-    case MG_GET_HISTORY:
-    case MG_REMOVE_HISTORY_ITEM:
-    case MG_CLEAR_HISTORY:
+
+    // Tens of thousands of cache files may be walked, off the UI thread
+    std::wstring contentDirectory = m_storageAuditor.GetContentDirectory();
+    std::wstring uiDirectory = m_storageAuditor.GetUIDirectory();
+    std::shared_ptr<StorageUsage> contentUsage = std::make_shared<StorageUsage>();
+    std::shared_ptr<StorageUsage> uiUsage = std::make_shared<StorageUsage>();
+    std::shared_ptr<double> milliseconds = std::make_shared<double>(0);
+
+    RunAsync([contentDirectory, uiDirectory, contentUsage, uiUsage, milliseconds]()
     {
-        std::wstring fileURI = GetFilePathAsURI(GetFullPathFor(L"wvbrowser_ui\\content_ui\\history.html"));
-        // Only the history UI can request history
-        if (fileURI.compare(uri.get()) == 0)
+        Stopwatch stopwatch;
+        *contentUsage = StorageAuditor::Measure(contentDirectory);
+        *uiUsage = StorageAuditor::Measure(uiDirectory);
+        *milliseconds = stopwatch.ElapsedMilliseconds();
+    }, [this, contentUsage, uiUsage, milliseconds]()
+    {
+        m_storageAuditor.CompleteAudit(std::move(*contentUsage), std::move(*uiUsage), *milliseconds);
+        CheckFailure(EnforceStorageQuotas(), L"");
+        PostStorageUsage();
+    });
+}
+
+HRESULT BrowserWindow::EnforceStorageQuotas()
+{
+    // Data is cleared through the profile all tabs share, any WebView of it
+    // will do; sites open in a tab keep theirs
+    ICoreWebView2* webview = nullptr;
+    std::set<std::wstring> openOrigins;
+    for (auto& tab : m_tabs)
+    {
+        wil::unique_cotaskmem_string source;
+        if (!tab.second->m_contentWebView || FAILED(tab.second->m_contentWebView->get_Source(&source)))
         {
-            jsonObj[L"args"][L"tabId"] = web::json::value::number(tabId);
-            CheckFailure(PostJsonToWebView(jsonObj, m_controlsWebView.Get()), L"Couldn't perform history operation");
+            continue;
         }
+
+        webview = tab.second->m_contentWebView.Get();
+        openOrigins.insert(StorageAuditor::GetOrigin(source.get()));
     }
-    break;
-    default:
+
+    if (!webview)
     {
-        OutputDebugString(L"Unexpected message\n");
+        return S_OK;
     }
-    break;
+
+    const uint64_t megabyte = 1024 * 1024;
+    std::vector<std::wstring> origins = m_storageAuditor.PickOriginsToEvict(
+        static_cast<uint64_t>(m_settings.siteDataQuota * megabyte), openOrigins);
+    if (!origins.empty())
+    {
+        web::json::value request = web::json::value::object();
+        request[L"kinds"] = web::json::value::array();
+        request[L"kinds"][0] = web::json::value(L"siteData");
+        request[L"origins"] = web::json::value::array();
+        for (size_t i = 0; i < origins.size(); ++i)
+        {
+            request[L"origins"][i] = web::json::value(origins[i]);
+        }
+
+        WCHAR log[128];
+        StringCchPrintf(log, ARRAYSIZE(log), L"Site data over quota, evicting %zu sites\n", origins.size());
+        OutputDebugString(log);
+        RETURN_IF_FAILED(m_browsingDataCleaner.Clear(webview, nullptr, request, [](const web::json::value&) {}));
+    }
+
+    double until = 0;
+    if (m_storageAuditor.PickCacheEviction(static_cast<uint64_t>(m_settings.cacheQuota * megabyte), until))
+    {
+        web::json::value request = web::json::value::object();
+        request[L"kinds"] = web::json::value::array();
+        request[L"kinds"][0] = web::json::value(L"cache");
+        request[L"until"] = web::json::value::number(until);
+
+        OutputDebugString(until > 0 ? L"Cache over quota, evicting entries older than an hour\n" :
+            L"Cache over quota, evicting all of it\n");
+        RETURN_IF_FAILED(m_browsingDataCleaner.Clear(webview, nullptr, request, [](const web::json::value&) {}));
     }
 
     return S_OK;
 }
 
-HRESULT BrowserWindow::ClearContentCache()
+void BrowserWindow::PostStorageUsage()
+{
+    web::json::value jsonObj = web::json::value::parse(L"{}");
+    jsonObj[L"message"] = web::json::value(MG_GET_STORAGE_USAGE);
+    jsonObj[L"args"] = m_storageAuditor.ToJson();
+
+    for (size_t tabId : m_storageUsageRequests)
+    {
+        CheckFailure(PostJsonToSettingsTab(tabId, jsonObj), L"");
+    }
+    m_storageUsageRequests.clear();
+}
+
+HRESULT BrowserWindow::PostJsonToSettingsTab(size_t tabId, web::json::value jsonObj)
 {
-    return m_tabs.at(m_activeTabId)->m_contentWebView->CallDevToolsProtocolMethod(L"Network.clearBrowserCache", L"{}", nullptr);
+    Tab* tab = FindTab(tabId);
+    wil::unique_cotaskmem_string source;
+    if (!tab || !tab->m_contentWebView || FAILED(tab->m_contentWebView->get_Source(&source)) ||
+        GetFilePathAsURI(GetBrowserPagePath(L"settings")).compare(source.get()) != 0)
+    {
+        return S_OK;
+    }
+
+    return PostJsonToWebView(jsonObj, tab->m_contentWebView.Get());
 }
 
-HRESULT BrowserWindow::ClearControlsCache()
+void BrowserWindow::LoadContentFilter()
 {
-    return m_controlsWebView->CallDevToolsProtocolMethod(L"Network.clearBrowserCache", L"{}", nullptr);
+    // Lists are compiled on a worker thread, tabs created meanwhile just
+    // aren't filtered until the compiled file is mapped.
+    std::wstring filtersDirectory = ContentFilter::GetFiltersDirectory();
+    std::shared_ptr<HRESULT> compileResult = std::make_shared<HRESULT>(E_PENDING);
+
+    RunAsync([filtersDirectory, compileResult]()
+    {
+        *compileResult = ContentFilter::CompileIfNeeded(filtersDirectory);
+    }, [this, filtersDirectory, compileResult]()
+    {
+        if (FAILED(*compileResult))
+        {
+            OutputDebugString(L"No content filter lists to load\n");
+            return;
+        }
+
+        if (FAILED(m_contentFilter.Load(filtersDirectory + L"\\filters.dat")))
+        {
+            OutputDebugString(L"Content filter load failed\n");
+            return;
+        }
+
+        CheckFailure(UpdateWebResourceFilters(), L"Can't filter tab requests.");
+    });
 }
 
-HRESULT BrowserWindow::ClearContentCookies()
+std::vector<WebResourceFilter> BrowserWindow::GetWebResourceFilters() const
 {
-    return m_tabs.at(m_activeTabId)->m_contentWebView->CallDevToolsProtocolMethod(L"Network.clearBrowserCookies", L"{}", nullptr);
+    // The content filter looks at everything
+    std::vector<WebResourceFilter> filters;
+    if (m_contentFilter.IsLoaded())
+    {
+        filters.emplace_back(L"*", COREWEBVIEW2_WEB_RESOURCE_CONTEXT_ALL);
+        return filters;
+    }
+
+    if (m_settings.BlocksImagesAnywhere())
+    {
+        filters.emplace_back(L"*", COREWEBVIEW2_WEB_RESOURCE_CONTEXT_IMAGE);
+    }
+
+    for (const std::wstring& origin : m_settings.sharedCacheOrigins)
+    {
+        filters.emplace_back(origin + L"/*", COREWEBVIEW2_WEB_RESOURCE_CONTEXT_ALL);
+    }
+
+    return filters;
 }
 
-HRESULT BrowserWindow::ClearControlsCookies()
+HRESULT BrowserWindow::UpdateWebResourceFilters()
 {
-    return m_controlsWebView->CallDevToolsProtocolMethod(L"Network.clearBrowserCookies", L"{}", nullptr);
+    std::vector<WebResourceFilter> filters = GetWebResourceFilters();
+    for (auto& tab : m_tabs)
+    {
+        RETURN_IF_FAILED(tab.second->SetWebResourceFilters(filters));
+    }
+
+    return S_OK;
 }
 
 HRESULT BrowserWindow::ResizeUIWebViews()
@@ -834,8 +3255,11 @@ HRESULT BrowserWindow::ResizeUIWebViews()
     {
         RECT bounds;
         GetClientRect(m_hWnd, &bounds);
-        bounds.bottom = bounds.top + GetDPIAwareBound(c_uiBarHeight);
-        bounds.bottom += 1;
+        if (!m_tabOverviewVisible)
+        {
+            bounds.bottom = bounds.top + GetDPIAwareBound(c_uiBarHeight);
+            bounds.bottom += 1;
+        }
 
         RETURN_IF_FAILED(m_controlsController->put_Bounds(bounds));
     }
@@ -895,6 +3319,27 @@ void BrowserWindow::CheckFailure(HRESULT hr, LPCWSTR errorMessage)
     }
 }
 
+void BrowserWindow::RunAsync(std::function<void()> work, std::function<void()> done)
+{
+    HWND hWnd = m_hWnd;
+    std::thread([hWnd, work, done]()
+    {
+        work();
+
+        PostToUIThread(hWnd, done);
+    }).detach();
+}
+
+void BrowserWindow::PostToUIThread(HWND hWnd, std::function<void()> callback)
+{
+    // Ownership passes to the WM_APP_RUN_ON_UI_THREAD handler
+    std::function<void()>* message = new std::function<void()>(callback);
+    if (!PostMessage(hWnd, WM_APP_RUN_ON_UI_THREAD, 0, reinterpret_cast<LPARAM>(message)))
+    {
+        delete message;
+    }
+}
+
 int BrowserWindow::GetDPIAwareBound(int bound)
 {
     // Remove the GetDpiForWindow call when using Windows 7 or any version
@@ -934,6 +3379,66 @@ std::wstring BrowserWindow::GetFullPathFor(LPCWSTR relativePath)
     return pathName;
 }
 
+std::wstring BrowserWindow::GetBrowserPagePath(const std::wstring& page)
+{
+    std::wstring filePath(L"wvbrowser_ui\\content_ui\\");
+    filePath.append(page);
+    filePath.append(L".html");
+
+    return GetFullPathFor(filePath.c_str());
+}
+
+std::wstring BrowserWindow::GetStartPageUri()
+{
+    // A browser page loads from the UI files, which works offline and
+    // doesn't wait on the network
+    std::wstring uri = ResolveBrowserPageUri(m_settings.startPage);
+    return uri.empty() ? ResolveBrowserPageUri(BrowserSettings::c_defaultStartPage) : uri;
+}
+
+std::wstring BrowserWindow::ResolveBrowserPageUri(const std::wstring& uri)
+{
+    std::wstring browserScheme(L"browser://");
+    if (uri.compare(0, browserScheme.size(), browserScheme) != 0)
+    {
+        return uri;
+    }
+
+    std::wstring page = uri.substr(browserScheme.size());
+    if (std::find(s_browserPages.begin(), s_browserPages.end(), page) == s_browserPages.end())
+    {
+        return L"";
+    }
+
+    return GetFilePathAsURI(GetBrowserPagePath(page));
+}
+
+bool BrowserWindow::IsBrowserPageUri(const std::wstring& uri)
+{
+    for (const std::wstring& page : s_browserPages)
+    {
+        if (uri.compare(GetFilePathAsURI(GetBrowserPagePath(page))) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::wstring BrowserWindow::GetUriToShow(const std::wstring& uri)
+{
+    for (const std::wstring& page : s_browserPages)
+    {
+        if (uri.compare(GetFilePathAsURI(GetBrowserPagePath(page))) == 0)
+        {
+            return L"browser://" + page;
+        }
+    }
+
+    return std::wstring();
+}
+
 std::wstring BrowserWindow::GetFilePathAsURI(std::wstring fullPath)
 {
     std::wstring fileURI;
@@ -951,10 +3456,55 @@ std::wstring BrowserWindow::GetFilePathAsURI(std::wstring fullPath)
     return fileURI;
 }
 
+HRESULT BrowserWindow::PostJsonToControls(web::json::value jsonObj)
+{
+    return m_controlsQueue.Post(jsonObj);
+}
+
 HRESULT BrowserWindow::PostJsonToWebView(web::json::value jsonObj, ICoreWebView2* webview)
 {
+    // A tab being recreated has no WebView, its new page won't expect
+    // answers meant for the old one
+    if (!webview)
+    {
+        ++m_messagesWithoutWebView;
+        OutputDebugString(L"No WebView to post to, dropping message\n");
+        return S_FALSE;
+    }
+
     utility::stringstream_t stream;
     jsonObj.serialize(stream);
 
     return webview->PostWebMessageAsJson(stream.str().c_str());
 }
+
+HRESULT BrowserWindow::PostListToWebView(web::json::value jsonObj, const std::wstring& listField,
+    const std::vector<BulkColumn>& columns, ICoreWebView2* webview)
+{
+    Stopwatch stopwatch;
+    web::json::value& args = jsonObj[L"args"];
+    size_t rowCount = args.has_field(listField) ? args.at(listField).size() : 0;
+
+    // Lets the page report the end to end transfer latency
+    args[L"sentAt"] = web::json::value::number(Stopwatch::EpochMilliseconds());
+
+    HRESULT hr = E_NOINTERFACE;
+    LPCWSTR transport = L"shared buffer";
+    if (rowCount >= BulkDataChannel::c_minRowsForSharedBuffer)
+    {
+        hr = BulkDataChannel::PostRows(m_contentEnv.Get(), webview, jsonObj, listField, columns);
+    }
+
+    if (FAILED(hr))
+    {
+        // Runtime without shared buffers or a short list
+        transport = L"JSON";
+        hr = PostJsonToWebView(jsonObj, webview);
+    }
+
+    WCHAR log[128];
+    StringCchPrintf(log, ARRAYSIZE(log), L"Posted %zu rows via %s in %.3f ms\n", rowCount, transport, stopwatch.ElapsedMilliseconds());
+    OutputDebugString(log);
+
+    return hr;
+}
@@ -5,20 +5,45 @@
 #pragma once
 
 #include "framework.h"
+#include "AddressClassifier.h"
+#include "AutomationServer.h"
+#include "BrowserSettings.h"
+#include "BrowsingDataCleaner.h"
+#include "BulkDataChannel.h"
+#include "ContentFilter.h"
+#include "ControlsSnapshot.h"
+#include "ControllerPool.h"
+#include "DownloadManager.h"
+#include "MemoryMonitor.h"
+#include "MessageQueue.h"
+#include "NavigationPredictor.h"
+#include "SharedHttpCache.h"
+#include "SnapshotStore.h"
+#include "Stopwatch.h"
+#include "StorageAuditor.h"
 #include "Tab.h"
+#include "ThumbnailCache.h"
 
 class BrowserWindow
 {
 public:
     static const int c_uiBarHeight = 70;
-    static const int c_optionsDropdownHeight = 108;
+    static const int c_optionsDropdownHeight = 143;
     static const int c_optionsDropdownWidth = 200;
+    static const size_t c_maxClosedTabs = 10;
+    static const UINT_PTR c_throttleTimerId = 2;  // MemoryMonitor::c_timerId is 1, DownloadManager's 3, StorageAuditor's 5, SharedHttpCache's 6, BrowsingDataCleaner's 7
+    static const UINT c_throttleInterval = 5000;  // ms between background throttling passes
+    static const UINT_PTR c_watchdogTimerId = 4;
+    static const UINT c_heartbeatInterval = 2000;  // ms between heartbeats of the shown tab
+    static constexpr double c_hangTimeout = 10000;  // ms a heartbeat or a crash request may take
+    static constexpr double c_shortcutMessageTimeout = 1000;  // ms a shortcut may take to reach the host
 
     static ATOM RegisterClass(_In_ HINSTANCE hInstance);
     static LRESULT CALLBACK WndProcStatic(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
     LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
 
     static BOOL LaunchWindow(_In_ HINSTANCE hInstance, _In_ int nCmdShow);
+    static const std::vector<std::wstring> s_browserPages;
     static std::wstring GetAppDataDirectory();
     std::wstring GetFullPathFor(LPCWSTR relativePath);
     HRESULT HandleTabURIUpdate(size_t tabId, ICoreWebView2* webview);
@@ -28,8 +53,27 @@ public:
     HRESULT HandleTabSecurityUpdate(size_t tabId, ICoreWebView2* webview, ICoreWebView2DevToolsProtocolEventReceivedEventArgs* args);
     void HandleTabCreated(size_t tabId, bool shouldBeActive);
     HRESULT HandleTabMessageReceived(size_t tabId, ICoreWebView2* webview, ICoreWebView2WebMessageReceivedEventArgs* eventArgs);
+    HRESULT HandleTabWebResourceRequested(size_t tabId, ICoreWebView2* webview, ICoreWebView2WebResourceRequestedEventArgs* args);
+    HRESULT HandleTabWebResourceResponseReceived(size_t tabId, ICoreWebView2* webview, ICoreWebView2WebResourceResponseReceivedEventArgs* args);
+    HRESULT HandleTabNewWindowRequested(size_t tabId, ICoreWebView2* webview, ICoreWebView2NewWindowRequestedEventArgs* args);
+    HRESULT HandleTabDownloadStarting(size_t tabId, ICoreWebView2* webview, ICoreWebView2DownloadStartingEventArgs* args);
+    // Browser shortcuts, raised by every WebView of the window before the
+    // page gets the key
+    HRESULT HandleAcceleratorKeyPressed(ICoreWebView2Controller* sender, ICoreWebView2AcceleratorKeyPressedEventArgs* args);
+    HRESULT HandleTabProcessFailed(size_t tabId, ICoreWebView2ProcessFailedEventArgs* args);
+    HRESULT ApplyContentSettings(ICoreWebView2* webview, const std::wstring& uri);
+    // The requests HandleTabWebResourceRequested has something to do for
+    std::vector<WebResourceFilter> GetWebResourceFilters() const;
+    // What the tabs follow of the Network domain, see Tab::UpdateNetworkEvents
+    bool IsNetworkLogShown() const { return m_networkLogShown; }
+    bool ThrottlesBackgroundTabs() const { return m_settings.throttleBackgroundTabs; }
     int GetDPIAwareBound(int bound);
     static void CheckFailure(HRESULT hr, LPCWSTR errorMessage);
+    // Run |work| on a worker thread, then |done| back on the UI thread.
+    // |done| is dropped if the window is gone by then.
+    void RunAsync(std::function<void()> work, std::function<void()> done);
+    // Queue |callback| behind the messages already posted to |hWnd|
+    static void PostToUIThread(HWND hWnd, std::function<void()> callback);
 protected:
     HINSTANCE m_hInst = nullptr;  // Current app instance
     HWND m_hWnd = nullptr;
@@ -48,27 +92,168 @@ protected:
     Microsoft::WRL::ComPtr<ICoreWebView2> m_optionsWebView;
     std::map<size_t,std::unique_ptr<Tab>> m_tabs;
     size_t m_activeTabId = 0;
+    size_t m_lastActiveTabId = 0;  // Tab that was active before the current one
+    size_t m_restoringTabId = INVALID_TAB_ID;  // Shown once it has a WebView again, see SwitchToTab
+    ContentFilter m_contentFilter;
+    BrowserSettings m_settings;
+    ControllerPool m_controllerPool;
+    NavigationPredictor m_navigationPredictor;
+    AddressClassifier m_addressClassifier;
+    MemoryMonitor m_memoryMonitor;
+    DownloadManager m_downloadManager;
+    // Shared with the worker threads doing its file work
+    std::shared_ptr<SnapshotStore> m_snapshotStore = std::make_shared<SnapshotStore>();
+    ThumbnailCache m_thumbnailCache;
+    std::shared_ptr<SharedHttpCache> m_sharedCache = SharedHttpCache::GetInstance();
+    BrowsingDataCleaner m_browsingDataCleaner;
+    StorageAuditor m_storageAuditor;
+    std::vector<size_t> m_storageUsageRequests;  // Settings tabs waiting for the running audit
+    bool m_tabOverviewVisible = false;  // The controls WebView covers the window meanwhile
+    bool m_networkLogShown = false;  // A tab is on the network page
+    // Only with --automation, see AutomationServer. Requests waiting on the
+    // controls UI or a navigation are answered when it's done.
+    AutomationServer m_automationServer;
+    std::map<uint64_t, AutomationServer::Responder> m_automationTabRequests;  // createTab
+    uint64_t m_automationTabRequestCount = 0;
+    std::multimap<size_t, AutomationServer::Responder> m_automationCloseRequests;  // closeTab by tab
+    // navigate with waitForLoad, answered when the navigation it started
+    // completes
+    struct AutomationLoadRequest
+    {
+        AutomationServer::Responder respond;
+        uint64_t previousNavigationId = 0;  // The tab's when Navigate was called
+        uint64_t navigationId = 0;  // 0 until its NavigationStarting
+    };
+    std::multimap<size_t, AutomationLoadRequest> m_automationLoadRequests;  // By tab
+    std::vector<NavigationEntry> m_closedTabs;  // Most recent last
+    std::vector<NavigationEntry> m_reopeningTabs;  // Waiting for MG_CREATE_TAB from the controls UI
+
+    struct LatencyStats
+    {
+        uint64_t count = 0;
+        double totalMilliseconds = 0;
+    };
+    LatencyStats m_newTabStats;
+    LatencyStats m_reopenedTabStats;
+    // Key press to action for the shortcuts run here, and for those the
+    // controls UI still handles, see HandleAcceleratorKeyPressed
+    LatencyStats m_nativeShortcutStats;
+    LatencyStats m_controlsShortcutStats;
+    Stopwatch m_controlsShortcutStopwatch;
+    bool m_controlsShortcutPending = false;
+    // Hang or crash to the first load of the recreated WebView, for the
+    // shown tab; hidden tabs are recreated when they are shown next
+    LatencyStats m_recoveryStats;
+    uint64_t m_deferredRecoveries = 0;
+    uint64_t m_tabHangs = 0;
+    uint64_t m_rendererExits = 0;
+    uint64_t m_gpuProcessExits = 0;
+    bool m_browserProcessExited = false;
+
+    // Painted in place of the controls WebView until its page is ready
+    ControlsSnapshot m_controlsSnapshot;
+    bool m_controlsReady = false;
+    MessageQueue m_controlsQueue{ { MG_UPDATE_URI, MG_NAV_STARTING, MG_NAV_COMPLETED, MG_UPDATE_TAB,
+        MG_UPDATE_FAVICON, MG_SECURITY_UPDATE, MG_TAB_STATE, MG_SYNC_CONFIG } };
+    uint64_t m_messagesWithoutWebView = 0;
+    bool m_snapshotPainted = false;
+    // Milestones of this start, ms since the process was created
+    std::vector<std::pair<std::wstring, double>> m_startupTimeline;
+    double m_processCreated = 0;  // ms since the epoch
 
     EventRegistrationToken m_controlsUIMessageBrokerToken = {};  // Token for the UI message handler in controls WebView
     EventRegistrationToken m_controlsZoomToken = {};
     EventRegistrationToken m_optionsUIMessageBrokerToken = {};  // Token for the UI message handler in options WebView
     EventRegistrationToken m_optionsZoomToken = {};
     EventRegistrationToken m_lostOptionsFocus = {};  // Token for the lost focus handler in options WebView
+    EventRegistrationToken m_controlsAcceleratorToken = {};
+    EventRegistrationToken m_controlsNavigationStartingToken = {};
+    EventRegistrationToken m_optionsAcceleratorToken = {};
     Microsoft::WRL::ComPtr<ICoreWebView2WebMessageReceivedEventHandler> m_uiMessageBroker;
 
     BOOL InitInstance(HINSTANCE hInstance, int nCmdShow);
     HRESULT InitUIWebViews();
     HRESULT CreateBrowserControlsWebView();
     HRESULT CreateBrowserOptionsWebView();
-    HRESULT ClearContentCache();
-    HRESULT ClearControlsCache();
-    HRESULT ClearContentCookies();
-    HRESULT ClearControlsCookies();
+    HRESULT SendNetworkLog(size_t requestingTabId, web::json::value args);
+    void LoadContentFilter();
+    HRESULT UpdateWebResourceFilters();
+    HRESULT UpdateSettings(size_t tabId, web::json::value args);
+    HRESULT PostSyncConfig();
+    HRESULT HandleControlsReady(const web::json::value& args);
+    void MarkStartup(const wchar_t* milestone);
+    void AuditStorage();
+    HRESULT EnforceStorageQuotas();
+    void PostStorageUsage();
+    // Tabs log requests only while a network page is open
+    void UpdateNetworkEvents();
+    void PrewarmSharedCache(std::vector<std::wstring> uris, std::function<void(size_t)> done);
+    // Drops |jsonObj| if the tab has navigated away from the settings page
+    HRESULT PostJsonToSettingsTab(size_t tabId, web::json::value jsonObj);
 
     void SetUIMessageBroker();
     HRESULT ResizeUIWebViews();
     void UpdateMinWindowSize();
+    // Queued until the controls UI listens, see MessageQueue
+    HRESULT PostJsonToControls(web::json::value jsonObj);
     HRESULT PostJsonToWebView(web::json::value jsonObj, ICoreWebView2* webview);
+    HRESULT PostListToWebView(web::json::value jsonObj, const std::wstring& listField,
+        const std::vector<BulkColumn>& columns, ICoreWebView2* webview);
     HRESULT SwitchToTab(size_t tabId);
+    bool CanSwapInPrerenderedTab();
+    HRESULT SwapInPrerenderedTab(std::unique_ptr<Tab> prerenderedTab);
+    // Remember a tab being closed for reopening and recycle its controller
+    void RetireTab(std::unique_ptr<Tab> tab, bool canReopen);
+    void RecordTabOpen(Tab* tab);
+    // Runs the shortcut for |key| with the modifiers held, false if it isn't
+    // one handled here
+    bool RunShortcut(UINT key, bool control, bool shift, bool alt, bool repeat);
+    // Switch to the tab |offset| places from the active one in the strip,
+    // wrapping around, or to the tab at |index| if |offset| is 0
+    HRESULT SwitchToTabInOrder(int offset, int index = -1);
+    // |notifyControls| for a navigation the controls UI didn't ask for
+    HRESULT GoBackOrForward(int offset, bool notifyControls = false);
+    // SwitchToTab, then update the strip
+    HRESULT SwitchToTabFromHost(size_t tabId);
+    void StartAutomationServer();
+    void HandleAutomationRequest(const std::wstring& command, const web::json::value& args, AutomationServer::Responder respond);
+    web::json::value GetAutomationState();
+    web::json::value GetTelemetry();
+    void RecordShortcut(LatencyStats& stats, double milliseconds);
+    HRESULT EnforceMemoryBudget();
+    // Throttle hidden tabs past the grace period, lift it from exempt ones
+    HRESULT ThrottleBackgroundTabs();
+    HRESULT CheckTabResponsive();
+    HRESULT HandleTabHang(size_t tabId);
+    HRESULT RecoverTab(size_t tabId);
+    void RecordRecovery(Tab* tab);
+    HRESULT PostTabState(size_t tabId);
+    // MG_DOWNLOAD_PROGRESS to the controls UI and any open downloads page
+    // False to have the batch sent again later, while the controls UI is
+    // behind
+    bool PostDownloadProgress(const web::json::value& downloads);
+    // Save the page in |tabId| to the snapshot store, MG_CAPTURE_SNAPSHOT
+    // goes to the controls UI once it's stored
+    HRESULT CaptureSnapshot(size_t tabId, SnapshotFormat format);
+    void PostSnapshotResult(size_t tabId, const SnapshotInfo& info, HRESULT hr, double milliseconds);
+    void OpenSnapshot(size_t tabId, const std::wstring& id);
+    // The active tab is captured again first, the others were as they were
+    // hidden
+    HRESULT ShowTabOverview();
+    // MG_UPDATE_URI for |tabId| showing |uri|, with the tab's navigation
+    // entries unless |withEntries| is false
+    HRESULT PostNavigationState(size_t tabId, const std::wstring& uri, bool withEntries = true);
+    HRESULT ShowNavigationHistoryMenu(bool forward, POINT position);
+    HRESULT GoToNavigationEntry(size_t tabId, size_t index);
+    Tab* FindTab(size_t tabId);
+    std::wstring GetBrowserPagePath(const std::wstring& page);
+    // What a new tab navigates to, from the startPage setting
+    std::wstring GetStartPageUri();
+    // The file URI for browser://<page>, empty for an unknown page, any other
+    // URI as it is
+    std::wstring ResolveBrowserPageUri(const std::wstring& uri);
+    bool IsBrowserPageUri(const std::wstring& uri);
+    // browser://<page> for a browser page URI, empty for anything else
+    std::wstring GetUriToShow(const std::wstring& uri);
     std::wstring GetFilePathAsURI(std::wstring fullPath);
 };
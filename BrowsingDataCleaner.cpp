@@ -0,0 +1,331 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "BrowsingDataCleaner.h"
+#include <set>
+
+using namespace Microsoft::WRL;
+
+namespace
+{
+    struct DataKind
+    {
+        const wchar_t* name;
+        UINT32 profileKinds;
+        // For Storage.clearDataForOrigin, null if there's no per site clearing
+        const wchar_t* storageTypes;
+        UINT32 controlsKinds;  // Cleared in the browser UI's profile as well
+    };
+
+    const DataKind c_dataKinds[] =
+    {
+        { L"cache", COREWEBVIEW2_BROWSING_DATA_KINDS_DISK_CACHE, nullptr, COREWEBVIEW2_BROWSING_DATA_KINDS_DISK_CACHE },
+        { L"cookies", COREWEBVIEW2_BROWSING_DATA_KINDS_COOKIES, L"cookies", COREWEBVIEW2_BROWSING_DATA_KINDS_COOKIES },
+        { L"siteData", COREWEBVIEW2_BROWSING_DATA_KINDS_ALL_DOM_STORAGE,
+            L"file_systems,indexeddb,local_storage,websql,cache_storage,service_workers", 0 },
+        { L"autofill", COREWEBVIEW2_BROWSING_DATA_KINDS_GENERAL_AUTOFILL | COREWEBVIEW2_BROWSING_DATA_KINDS_PASSWORD_AUTOSAVE,
+            nullptr, 0 },
+    };
+}
+
+void BrowsingDataCleaner::Init(HWND hWnd)
+{
+    m_hWnd = hWnd;
+}
+
+HRESULT BrowsingDataCleaner::Clear(ICoreWebView2* contentWebView, ICoreWebView2* controlsWebView,
+    const web::json::value& request, ProgressHandler progress)
+{
+    if (!contentWebView || !request.is_object() || !request.has_field(L"kinds") || !request.at(L"kinds").is_array())
+    {
+        return E_INVALIDARG;
+    }
+
+    std::set<std::wstring> kinds;
+    for (const auto& kind : request.at(L"kinds").as_array())
+    {
+        if (kind.is_string())
+        {
+            kinds.insert(kind.as_string());
+        }
+    }
+
+    double since = request.has_field(L"since") && request.at(L"since").is_number() ? request.at(L"since").as_double() : 0;
+    double until = request.has_field(L"until") && request.at(L"until").is_number() ? request.at(L"until").as_double() : 0;
+
+    bool perSite = request.has_field(L"origins") && request.at(L"origins").is_array() &&
+        request.at(L"origins").size() > 0;
+    std::vector<std::wstring> origins;
+    if (perSite)
+    {
+        for (const auto& origin : request.at(L"origins").as_array())
+        {
+            if (origin.is_string())
+            {
+                std::vector<std::wstring> normalized = NormalizeOrigin(origin.as_string());
+                origins.insert(origins.end(), normalized.begin(), normalized.end());
+            }
+        }
+
+        if (origins.empty())
+        {
+            return E_INVALIDARG;
+        }
+    }
+
+    Job job;
+    job.progress = progress;
+    std::wstring storageTypes;
+    UINT32 controlsKinds = 0;
+    for (const DataKind& kind : c_dataKinds)
+    {
+        if (kinds.find(kind.name) == kinds.end())
+        {
+            continue;
+        }
+
+        if (!perSite)
+        {
+            job.steps.push_back(ProfileStep(kind.name, contentWebView, kind.profileKinds, since, until));
+            controlsKinds |= kind.controlsKinds;
+        }
+        else if (kind.storageTypes)
+        {
+            storageTypes += (storageTypes.empty() ? L"" : L",") + std::wstring(kind.storageTypes);
+        }
+        else
+        {
+            job.skipped.push_back(kind.name);
+        }
+    }
+
+    // One call per site clears every kind asked for
+    if (!storageTypes.empty())
+    {
+        for (const std::wstring& origin : origins)
+        {
+            job.steps.push_back(OriginStep(contentWebView, origin, storageTypes));
+        }
+    }
+
+    if (controlsKinds && controlsWebView)
+    {
+        job.steps.push_back(ProfileStep(L"browserUI", controlsWebView, controlsKinds, since, until));
+    }
+
+    if (job.steps.empty() && job.skipped.empty())
+    {
+        return E_INVALIDARG;
+    }
+
+    // Only kinds that can't be cleared per site were asked for, there is
+    // nothing to run but the caller still hears what was skipped
+    if (job.steps.empty())
+    {
+        progress(MakeDoneProgress(job, 0));
+        return S_OK;
+    }
+
+    m_jobs.push_back(std::move(job));
+    if (m_jobs.size() == 1)
+    {
+        m_jobs.front().stopwatch.Restart();
+        RunNextStep();
+    }
+
+    return S_OK;
+}
+
+web::json::value BrowsingDataCleaner::MakeDoneProgress(const Job& job, double milliseconds)
+{
+    web::json::value done = web::json::value::object();
+    done[L"done"] = web::json::value::boolean(true);
+    done[L"succeeded"] = web::json::value::boolean(job.succeeded);
+    done[L"milliseconds"] = web::json::value::number(milliseconds);
+    done[L"skipped"] = web::json::value::array();
+    for (size_t i = 0; i < job.skipped.size(); ++i)
+    {
+        done[L"skipped"][i] = web::json::value(job.skipped[i]);
+    }
+
+    return done;
+}
+
+void BrowsingDataCleaner::RunNextStep()
+{
+    Job& job = m_jobs.front();
+    job.stepStopwatch.Restart();
+    uint64_t step = ++m_stepCount;
+    SetTimer(m_hWnd, c_timerId, c_stepTimeout, nullptr);
+
+    HRESULT hr = job.steps[job.next].run([this, step](HRESULT result)
+    {
+        if (step == m_stepCount)
+        {
+            CompleteStep(result);
+        }
+    });
+
+    // The completion handler only runs if the call went out
+    if (FAILED(hr))
+    {
+        CompleteStep(hr);
+    }
+}
+
+void BrowsingDataCleaner::HandleStepTimeout()
+{
+    KillTimer(m_hWnd, c_timerId);
+    if (!m_jobs.empty())
+    {
+        CompleteStep(HRESULT_FROM_WIN32(ERROR_TIMEOUT));
+    }
+}
+
+void BrowsingDataCleaner::CompleteStep(HRESULT hr)
+{
+    KillTimer(m_hWnd, c_timerId);
+    ++m_stepCount;
+
+    Job& job = m_jobs.front();
+    const std::wstring& name = job.steps[job.next].name;
+    double milliseconds = job.stepStopwatch.ElapsedMilliseconds();
+    job.succeeded = job.succeeded && SUCCEEDED(hr);
+    ++job.next;
+
+    WCHAR log[256];
+    StringCchPrintf(log, ARRAYSIZE(log), L"Clearing %s took %.0f ms (0x%08X), step %zu of %zu\n",
+        name.c_str(), milliseconds, static_cast<unsigned int>(hr), job.next, job.steps.size());
+    OutputDebugString(log);
+
+    web::json::value progress = web::json::value::object();
+    progress[L"step"] = web::json::value::number(job.next);
+    progress[L"steps"] = web::json::value::number(job.steps.size());
+    progress[L"name"] = web::json::value(name);
+    progress[L"milliseconds"] = web::json::value::number(milliseconds);
+    if (FAILED(hr))
+    {
+        WCHAR code[16];
+        StringCchPrintf(code, ARRAYSIZE(code), L"0x%08X", static_cast<unsigned int>(hr));
+        progress[L"error"] = web::json::value(code);
+    }
+    job.progress(progress);
+
+    if (job.next < job.steps.size())
+    {
+        RunNextStep();
+        return;
+    }
+
+    double totalMilliseconds = job.stopwatch.ElapsedMilliseconds();
+    StringCchPrintf(log, ARRAYSIZE(log), L"Browsing data cleared in %.0f ms, %zu steps\n", totalMilliseconds, job.steps.size());
+    OutputDebugString(log);
+
+    web::json::value done = MakeDoneProgress(job, totalMilliseconds);
+    ProgressHandler handler = job.progress;
+    m_jobs.pop_front();
+    handler(done);
+
+    if (!m_jobs.empty())
+    {
+        m_jobs.front().stopwatch.Restart();
+        RunNextStep();
+    }
+}
+
+BrowsingDataCleaner::Step BrowsingDataCleaner::ProfileStep(const std::wstring& name, ICoreWebView2* webview, UINT32 kinds,
+    double since, double until)
+{
+    ComPtr<ICoreWebView2> target = webview;
+
+    Step step;
+    step.name = name;
+    step.run = [target, kinds, since, until](std::function<void(HRESULT)> done) -> HRESULT
+    {
+        ComPtr<ICoreWebView2_13> webview13;
+        RETURN_IF_FAILED(target.As(&webview13));
+        ComPtr<ICoreWebView2Profile> profile;
+        RETURN_IF_FAILED(webview13->get_Profile(&profile));
+        ComPtr<ICoreWebView2Profile2> profile2;
+        RETURN_IF_FAILED(profile.As(&profile2));
+
+        auto handler = Callback<ICoreWebView2ClearBrowsingDataCompletedHandler>(
+            [done](HRESULT error) -> HRESULT
+        {
+            done(error);
+            return S_OK;
+        });
+
+        COREWEBVIEW2_BROWSING_DATA_KINDS dataKinds = static_cast<COREWEBVIEW2_BROWSING_DATA_KINDS>(kinds);
+        if (since <= 0 && until <= 0)
+        {
+            return profile2->ClearBrowsingData(dataKinds, handler.Get());
+        }
+
+        // The range is in seconds since the epoch
+        return profile2->ClearBrowsingDataInTimeRange(dataKinds, since / 1000,
+            until > 0 ? until / 1000 : Stopwatch::EpochMilliseconds() / 1000 + 1, handler.Get());
+    };
+
+    return step;
+}
+
+BrowsingDataCleaner::Step BrowsingDataCleaner::OriginStep(ICoreWebView2* webview, const std::wstring& origin, const std::wstring& storageTypes)
+{
+    ComPtr<ICoreWebView2> target = webview;
+
+    web::json::value params = web::json::value::object();
+    params[L"origin"] = web::json::value(origin);
+    params[L"storageTypes"] = web::json::value(storageTypes);
+    std::wstring paramsJson = params.serialize();
+
+    Step step;
+    step.name = origin;
+    step.run = [target, paramsJson](std::function<void(HRESULT)> done) -> HRESULT
+    {
+        return target->CallDevToolsProtocolMethod(L"Storage.clearDataForOrigin", paramsJson.c_str(),
+            Callback<ICoreWebView2CallDevToolsProtocolMethodCompletedHandler>(
+                [done](HRESULT error, PCWSTR resultJson) -> HRESULT
+        {
+            done(error);
+            return S_OK;
+        }).Get());
+    };
+
+    return step;
+}
+
+std::vector<std::wstring> BrowsingDataCleaner::NormalizeOrigin(std::wstring origin)
+{
+    origin.erase(0, origin.find_first_not_of(L" \t"));
+    origin.erase(origin.find_last_not_of(L" \t") + 1);
+    std::transform(origin.begin(), origin.end(), origin.begin(), towlower);
+
+    // A bare host stands for both of its origins
+    std::wstring scheme;
+    size_t schemeEnd = origin.find(L"://");
+    if (schemeEnd != std::wstring::npos)
+    {
+        scheme = origin.substr(0, schemeEnd);
+        origin.erase(0, schemeEnd + 3);
+    }
+
+    std::wstring host = origin.substr(0, origin.find_first_of(L"/?#"));
+    if (host.empty() || host.find_first_not_of(L"abcdefghijklmnopqrstuvwxyz0123456789.-:[]") != std::wstring::npos)
+    {
+        return {};
+    }
+
+    if (scheme.empty())
+    {
+        return { L"https://" + host, L"http://" + host };
+    }
+
+    if (scheme.compare(L"http") != 0 && scheme.compare(L"https") != 0)
+    {
+        return {};
+    }
+
+    return { scheme + L"://" + host };
+}
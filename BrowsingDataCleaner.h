@@ -0,0 +1,73 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+#include "Stopwatch.h"
+#include <deque>
+
+// Clears browsing data through the profile of the content WebViews, which
+// all tabs share. A request names the kinds of data to clear ("cache",
+// "cookies", "siteData", "autofill") and either a time range or the sites
+// to clear them for:
+//
+//   {"kinds": ["cache", "cookies"], "since": <ms since the epoch, 0 for all time>}
+//   {"kinds": ["cache"], "until": <ms since the epoch>}
+//   {"kinds": ["cookies", "siteData"], "origins": ["https://example.com", "example.org"]}
+//
+// Every kind, or every site, is one asynchronous step. Requests are queued
+// and run one step at a time on the UI thread; the caller hears about each
+// step as it completes and about the request once it's done, with the time
+// they took. A step that hasn't completed after c_stepTimeout, say because
+// its WebView went away, fails and the next one runs. Cache and cookies of
+// the browser UI's own profile go too when everything is cleared, its site
+// data holds favorites and history.
+class BrowsingDataCleaner
+{
+public:
+    static const UINT_PTR c_timerId = 7;  // Runs only while a step does
+    static const UINT c_stepTimeout = 60 * 1000;  // ms
+
+    // Gets {"step", "steps", "name", "error", "milliseconds"} for every
+    // step, then {"done": true, "succeeded", "milliseconds", "skipped"}
+    typedef std::function<void(const web::json::value& progress)> ProgressHandler;
+
+    void Init(HWND hWnd);
+    HRESULT Clear(ICoreWebView2* contentWebView, ICoreWebView2* controlsWebView,
+        const web::json::value& request, ProgressHandler progress);
+    // Called on c_timerId, fails the step still running
+    void HandleStepTimeout();
+
+protected:
+    struct Step
+    {
+        std::wstring name;
+        std::function<HRESULT(std::function<void(HRESULT)> done)> run;
+    };
+
+    struct Job
+    {
+        std::vector<Step> steps;
+        size_t next = 0;
+        std::vector<std::wstring> skipped;  // Kinds that can't be cleared per site
+        ProgressHandler progress;
+        Stopwatch stopwatch;
+        Stopwatch stepStopwatch;
+        bool succeeded = true;
+    };
+
+    HWND m_hWnd = nullptr;
+    std::deque<Job> m_jobs;  // The first one is running
+    // Bumped as a step starts and ends, a completion that comes after its
+    // step timed out is dropped
+    uint64_t m_stepCount = 0;
+
+    void RunNextStep();
+    void CompleteStep(HRESULT hr);
+    static Step ProfileStep(const std::wstring& name, ICoreWebView2* webview, UINT32 kinds, double since, double until);
+    static Step OriginStep(ICoreWebView2* webview, const std::wstring& origin, const std::wstring& storageTypes);
+    static std::vector<std::wstring> NormalizeOrigin(std::wstring origin);
+    static web::json::value MakeDoneProgress(const Job& job, double milliseconds);
+};
@@ -0,0 +1,225 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "BulkDataChannel.h"
+
+using namespace Microsoft::WRL;
+
+namespace
+{
+    struct BulkHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t rowCount;
+        uint32_t columnCount;
+    };
+
+    struct BulkColumnDescriptor
+    {
+        uint32_t type;
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        uint32_t dataOffset;
+    };
+
+    size_t AlignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    // Resolve a dotted column name ("item.uri") against a row
+    const web::json::value* FindField(const web::json::value& row, const std::wstring& name)
+    {
+        const web::json::value* current = &row;
+        size_t start = 0;
+        while (start <= name.size())
+        {
+            size_t end = name.find(L'.', start);
+            if (end == std::wstring::npos)
+            {
+                end = name.size();
+            }
+
+            std::wstring key = name.substr(start, end - start);
+            if (!current->is_object() || !current->has_field(key))
+            {
+                return nullptr;
+            }
+
+            current = &current->at(key);
+            start = end + 1;
+        }
+
+        return current;
+    }
+}
+
+const std::vector<BulkColumn>& BulkDataChannel::HistoryColumns()
+{
+    static const std::vector<BulkColumn> columns = {
+        { L"id", BulkColumnType::Number },
+        { L"item.uri", BulkColumnType::String },
+        { L"item.title", BulkColumnType::String },
+        { L"item.favicon", BulkColumnType::String },
+        { L"item.timestamp", BulkColumnType::String }
+    };
+
+    return columns;
+}
+
+const std::vector<BulkColumn>& BulkDataChannel::FavoritesColumns()
+{
+    static const std::vector<BulkColumn> columns = {
+        { L"uri", BulkColumnType::String },
+        { L"uriToShow", BulkColumnType::String },
+        { L"title", BulkColumnType::String },
+        { L"favicon", BulkColumnType::String },
+        { L"snapshotId", BulkColumnType::String },
+        { L"snapshotFormat", BulkColumnType::String }
+    };
+
+    return columns;
+}
+
+std::vector<BYTE> BulkDataChannel::Encode(const web::json::value& rows, const std::vector<BulkColumn>& columns)
+{
+    const size_t rowCount = rows.size();
+    const size_t columnCount = columns.size();
+
+    // First pass: resolve every cell once and size the buffer
+    std::vector<std::vector<const web::json::value*>> cells(columnCount, std::vector<const web::json::value*>(rowCount));
+    std::vector<size_t> heapLengths(columnCount, 0);
+
+    for (size_t row = 0; row < rowCount; ++row)
+    {
+        const web::json::value& rowValue = rows.at(row);
+        for (size_t column = 0; column < columnCount; ++column)
+        {
+            const web::json::value* cell = FindField(rowValue, columns[column].name);
+            cells[column][row] = cell;
+
+            if (columns[column].type == BulkColumnType::String && cell && cell->is_string())
+            {
+                heapLengths[column] += cell->as_string().size();
+            }
+        }
+    }
+
+    size_t size = sizeof(BulkHeader) + columnCount * sizeof(BulkColumnDescriptor);
+    std::vector<size_t> nameOffsets(columnCount);
+    for (size_t column = 0; column < columnCount; ++column)
+    {
+        nameOffsets[column] = size;
+        size += columns[column].name.size() * sizeof(wchar_t);
+    }
+
+    std::vector<size_t> dataOffsets(columnCount);
+    for (size_t column = 0; column < columnCount; ++column)
+    {
+        if (columns[column].type == BulkColumnType::Number)
+        {
+            size = AlignUp(size, sizeof(double));
+            dataOffsets[column] = size;
+            size += rowCount * sizeof(double);
+        }
+        else
+        {
+            size = AlignUp(size, sizeof(uint32_t));
+            dataOffsets[column] = size;
+            size += (rowCount + 1) * sizeof(uint32_t) + heapLengths[column] * sizeof(wchar_t);
+        }
+    }
+
+    // Second pass: write
+    std::vector<BYTE> buffer(size, 0);
+    BulkHeader* header = reinterpret_cast<BulkHeader*>(buffer.data());
+    header->magic = BULK_DATA_MAGIC;
+    header->version = BULK_DATA_VERSION;
+    header->rowCount = static_cast<uint32_t>(rowCount);
+    header->columnCount = static_cast<uint32_t>(columnCount);
+
+    BulkColumnDescriptor* descriptors = reinterpret_cast<BulkColumnDescriptor*>(buffer.data() + sizeof(BulkHeader));
+    for (size_t column = 0; column < columnCount; ++column)
+    {
+        const BulkColumn& spec = columns[column];
+        descriptors[column].type = static_cast<uint32_t>(spec.type);
+        descriptors[column].nameOffset = static_cast<uint32_t>(nameOffsets[column]);
+        descriptors[column].nameLength = static_cast<uint32_t>(spec.name.size());
+        descriptors[column].dataOffset = static_cast<uint32_t>(dataOffsets[column]);
+        memcpy(buffer.data() + nameOffsets[column], spec.name.c_str(), spec.name.size() * sizeof(wchar_t));
+
+        if (spec.type == BulkColumnType::Number)
+        {
+            double* values = reinterpret_cast<double*>(buffer.data() + dataOffsets[column]);
+            for (size_t row = 0; row < rowCount; ++row)
+            {
+                const web::json::value* cell = cells[column][row];
+                values[row] = (cell && cell->is_number()) ? cell->as_double() : std::numeric_limits<double>::quiet_NaN();
+            }
+        }
+        else
+        {
+            uint32_t* offsets = reinterpret_cast<uint32_t*>(buffer.data() + dataOffsets[column]);
+            wchar_t* heap = reinterpret_cast<wchar_t*>(offsets + rowCount + 1);
+            uint32_t heapPosition = 0;
+            for (size_t row = 0; row < rowCount; ++row)
+            {
+                offsets[row] = heapPosition;
+                const web::json::value* cell = cells[column][row];
+                if (cell && cell->is_string())
+                {
+                    const utility::string_t& text = cell->as_string();
+                    memcpy(heap + heapPosition, text.c_str(), text.size() * sizeof(wchar_t));
+                    heapPosition += static_cast<uint32_t>(text.size());
+                }
+            }
+            offsets[rowCount] = heapPosition;
+        }
+    }
+
+    return buffer;
+}
+
+HRESULT BulkDataChannel::PostRows(ICoreWebView2Environment* env, ICoreWebView2* webview, web::json::value jsonObj,
+    const std::wstring& listField, const std::vector<BulkColumn>& columns)
+{
+    wil::com_ptr<ICoreWebView2Environment12> sharedBufferEnv;
+    wil::com_ptr<ICoreWebView2_17> sharedBufferWebView;
+    if (FAILED(env->QueryInterface(IID_PPV_ARGS(&sharedBufferEnv))) ||
+        FAILED(webview->QueryInterface(IID_PPV_ARGS(&sharedBufferWebView))))
+    {
+        return E_NOINTERFACE;
+    }
+
+    web::json::value& args = jsonObj[L"args"];
+    if (!args.has_field(listField) || !args.at(listField).is_array())
+    {
+        return E_INVALIDARG;
+    }
+
+    std::vector<BYTE> payload = Encode(args.at(listField), columns);
+
+    // The page fills args[bulkField] back in from the buffer
+    args.erase(listField);
+    args[L"bulkField"] = web::json::value(listField);
+
+    wil::com_ptr<ICoreWebView2SharedBuffer> sharedBuffer;
+    RETURN_IF_FAILED(sharedBufferEnv->CreateSharedBuffer(payload.size(), &sharedBuffer));
+
+    BYTE* bufferData = nullptr;
+    RETURN_IF_FAILED(sharedBuffer->get_Buffer(&bufferData));
+    memcpy(bufferData, payload.data(), payload.size());
+
+    utility::stringstream_t stream;
+    jsonObj.serialize(stream);
+
+    HRESULT hr = sharedBufferWebView->PostSharedBufferToScript(sharedBuffer.get(),
+        COREWEBVIEW2_SHARED_BUFFER_ACCESS_READ_ONLY, stream.str().c_str());
+
+    // The script keeps its own view of the memory until it releases it
+    sharedBuffer->Close();
+
+    return hr;
+}
@@ -0,0 +1,51 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+
+// Layout of the columnar payload, see wvbrowser_ui/bulk_data.js for the reader.
+//
+//   header       uint32 magic, version, rowCount, columnCount
+//   columns      uint32 type, nameOffset, nameLength, dataOffset (per column)
+//   names        UTF-16 column names, dotted for nested fields ("item.uri")
+//   string data  uint32 offsets[rowCount + 1] followed by the UTF-16 heap
+//   number data  double values[rowCount], 8-byte aligned
+//
+// Offsets are in bytes from the start of the buffer except string offsets,
+// which are in UTF-16 code units from the start of the column heap.
+#define BULK_DATA_MAGIC 0x44425657  // 'WVBD'
+#define BULK_DATA_VERSION 1
+
+enum class BulkColumnType : uint32_t
+{
+    String = 0,
+    Number = 1
+};
+
+struct BulkColumn
+{
+    std::wstring name;
+    BulkColumnType type;
+};
+
+class BulkDataChannel
+{
+public:
+    // Lists shorter than this are cheaper to send as plain JSON
+    static const size_t c_minRowsForSharedBuffer = 64;
+
+    static const std::vector<BulkColumn>& HistoryColumns();
+    static const std::vector<BulkColumn>& FavoritesColumns();
+
+    static std::vector<BYTE> Encode(const web::json::value& rows, const std::vector<BulkColumn>& columns);
+
+    // Moves the array in args[listField] of |jsonObj| into a shared buffer
+    // and posts it to |webview|, with the rest of |jsonObj| as additional
+    // data. Returns E_NOINTERFACE when the runtime doesn't support shared
+    // buffers so the caller can fall back to PostWebMessageAsJson.
+    static HRESULT PostRows(ICoreWebView2Environment* env, ICoreWebView2* webview, web::json::value jsonObj,
+        const std::wstring& listField, const std::vector<BulkColumn>& columns);
+};
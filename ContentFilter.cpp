@@ -0,0 +1,260 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "BrowserWindow.h"
+#include "ContentFilter.h"
+#include "Stopwatch.h"
+#include <fstream>
+
+namespace
+{
+    static_assert(FILTER_RESOURCE_DOCUMENT == COREWEBVIEW2_WEB_RESOURCE_CONTEXT_DOCUMENT &&
+        FILTER_RESOURCE_STYLESHEET == COREWEBVIEW2_WEB_RESOURCE_CONTEXT_STYLESHEET &&
+        FILTER_RESOURCE_IMAGE == COREWEBVIEW2_WEB_RESOURCE_CONTEXT_IMAGE &&
+        FILTER_RESOURCE_MEDIA == COREWEBVIEW2_WEB_RESOURCE_CONTEXT_MEDIA &&
+        FILTER_RESOURCE_FONT == COREWEBVIEW2_WEB_RESOURCE_CONTEXT_FONT &&
+        FILTER_RESOURCE_SCRIPT == COREWEBVIEW2_WEB_RESOURCE_CONTEXT_SCRIPT &&
+        FILTER_RESOURCE_XML_HTTP_REQUEST == COREWEBVIEW2_WEB_RESOURCE_CONTEXT_XML_HTTP_REQUEST &&
+        FILTER_RESOURCE_FETCH == COREWEBVIEW2_WEB_RESOURCE_CONTEXT_FETCH &&
+        FILTER_RESOURCE_WEBSOCKET == COREWEBVIEW2_WEB_RESOURCE_CONTEXT_WEBSOCKET &&
+        FILTER_RESOURCE_PING == COREWEBVIEW2_WEB_RESOURCE_CONTEXT_PING &&
+        FILTER_RESOURCE_OTHER == COREWEBVIEW2_WEB_RESOURCE_CONTEXT_OTHER,
+        "Filter resource types are numbered like the WebView2 resource contexts");
+
+    std::string ToLowerUrl(const wchar_t* uri)
+    {
+        // URLs from WebView2 are already punycode and percent encoded, so
+        // anything outside ASCII can't match a rule anyway.
+        std::string url;
+        for (const wchar_t* c = uri; *c; ++c)
+        {
+            wchar_t ch = *c;
+            if (ch >= L'A' && ch <= L'Z')
+            {
+                ch = ch - L'A' + L'a';
+            }
+
+            url.push_back(ch < 0x80 ? static_cast<char>(ch) : '?');
+        }
+
+        return url;
+    }
+
+    bool GetLastWriteTime(const std::wstring& path, ULARGE_INTEGER& time)
+    {
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+        if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &attributes))
+        {
+            return false;
+        }
+
+        time.LowPart = attributes.ftLastWriteTime.dwLowDateTime;
+        time.HighPart = attributes.ftLastWriteTime.dwHighDateTime;
+        return true;
+    }
+}
+
+ContentFilter::~ContentFilter()
+{
+    Unload();
+}
+
+std::wstring ContentFilter::GetFiltersDirectory()
+{
+    std::wstring directory = BrowserWindow::GetAppDataDirectory();
+    directory.append(L"\\Filters");
+
+    return directory;
+}
+
+HRESULT ContentFilter::CompileIfNeeded(const std::wstring& directory)
+{
+    std::wstring compiledPath = directory + L"\\filters.dat";
+    ULARGE_INTEGER compiledTime = {};
+    bool hasCompiled = GetLastWriteTime(compiledPath, compiledTime);
+    bool isStale = false;
+
+    std::vector<std::wstring> listPaths;
+    WIN32_FIND_DATAW findData;
+    HANDLE find = FindFirstFileW((directory + L"\\*.txt").c_str(), &findData);
+    if (find == INVALID_HANDLE_VALUE)
+    {
+        return hasCompiled ? S_OK : HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    }
+
+    do
+    {
+        listPaths.push_back(directory + L"\\" + findData.cFileName);
+
+        ULARGE_INTEGER listTime;
+        listTime.LowPart = findData.ftLastWriteTime.dwLowDateTime;
+        listTime.HighPart = findData.ftLastWriteTime.dwHighDateTime;
+        isStale = isStale || listTime.QuadPart > compiledTime.QuadPart;
+    } while (FindNextFileW(find, &findData));
+    FindClose(find);
+
+    if (hasCompiled && !isStale)
+    {
+        return S_OK;
+    }
+
+    return Compile(listPaths, compiledPath);
+}
+
+HRESULT ContentFilter::Compile(const std::vector<std::wstring>& listPaths, const std::wstring& outputPath)
+{
+    Stopwatch stopwatch;
+    std::vector<std::string> lines;
+
+    for (const std::wstring& listPath : listPaths)
+    {
+        std::ifstream list(listPath);
+        std::string line;
+        while (std::getline(list, line))
+        {
+            lines.push_back(std::move(line));
+        }
+    }
+
+    uint32_t ruleCount = 0;
+    std::vector<uint8_t> file = FilterMatcher::Compile(lines, ruleCount);
+
+    // Write next to the target and swap, a mapped filters.dat stays valid
+    // until it is unloaded.
+    std::wstring temporaryPath = outputPath + L".tmp";
+    {
+        std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+        output.write(reinterpret_cast<const char*>(file.data()), file.size());
+        if (!output)
+        {
+            return E_FAIL;
+        }
+    }
+
+    if (!MoveFileExW(temporaryPath.c_str(), outputPath.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    WCHAR log[160];
+    StringCchPrintf(log, ARRAYSIZE(log), L"Compiled %zu filter rules from %zu lines (%zu bytes) in %.1f ms\n",
+        static_cast<size_t>(ruleCount), lines.size(), file.size(), stopwatch.ElapsedMilliseconds());
+    OutputDebugString(log);
+
+    return S_OK;
+}
+
+HRESULT ContentFilter::Load(const std::wstring& compiledPath)
+{
+    Unload();
+
+    m_file = CreateFileW(compiledPath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(FilterFileHeader)))
+    {
+        Unload();
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Unload();
+        return hr;
+    }
+
+    m_view = static_cast<const BYTE*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    m_viewSize = static_cast<size_t>(fileSize.QuadPart);
+    if (!m_view)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Unload();
+        return hr;
+    }
+
+    if (!m_matcher.Attach(m_view, m_viewSize))
+    {
+        Unload();
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    return S_OK;
+}
+
+void ContentFilter::Unload()
+{
+    m_matcher.Detach();
+
+    if (m_view)
+    {
+        UnmapViewOfFile(m_view);
+        m_view = nullptr;
+    }
+
+    if (m_mapping)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+}
+
+FilterRequest ContentFilter::MakeRequest(LPCWSTR uri, const std::wstring& documentUri, COREWEBVIEW2_WEB_RESOURCE_CONTEXT context, bool isTopLevelDocument)
+{
+    return FilterMatcher::MakeRequest(ToLowerUrl(uri), ToLowerUrl(documentUri.c_str()), static_cast<uint32_t>(context), isTopLevelDocument);
+}
+
+bool ContentFilter::ShouldBlock(const FilterRequest& request)
+{
+    if (!IsLoaded() || request.host.empty())
+    {
+        return false;
+    }
+
+    Stopwatch stopwatch;
+    bool block = m_matcher.ShouldBlock(request);
+
+    double elapsed = stopwatch.ElapsedMilliseconds() * 1000;
+    ++m_requestCount;
+    m_totalMatchMicroseconds += elapsed;
+    m_maxMatchMicroseconds = (std::max)(m_maxMatchMicroseconds, elapsed);
+    if (block)
+    {
+        ++m_blockedCount;
+    }
+
+    if (m_requestCount % 1000 == 0)
+    {
+        WCHAR log[160];
+        StringCchPrintf(log, ARRAYSIZE(log), L"Content filter: %llu requests, %llu blocked, %.2f us average, %.2f us max\n",
+            m_requestCount, m_blockedCount, m_totalMatchMicroseconds / m_requestCount, m_maxMatchMicroseconds);
+        OutputDebugString(log);
+    }
+
+    return block;
+}
+
+web::json::value ContentFilter::GetStats() const
+{
+    web::json::value stats = web::json::value::object();
+    stats[L"rules"] = web::json::value::number(m_matcher.GetRuleCount());
+    stats[L"requests"] = web::json::value::number(m_requestCount);
+    stats[L"blocked"] = web::json::value::number(m_blockedCount);
+    stats[L"averageMicroseconds"] = web::json::value::number(m_requestCount ? m_totalMatchMicroseconds / m_requestCount : 0);
+    stats[L"maxMicroseconds"] = web::json::value::number(m_maxMatchMicroseconds);
+
+    return stats;
+}
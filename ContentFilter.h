@@ -0,0 +1,46 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+#include "FilterMatcher.h"
+
+// Request filtering engine for EasyList style network rules. Lists in
+// <app data>\Filters\*.txt are compiled into filters.dat, which is memory
+// mapped and matched against directly by a FilterMatcher.
+class ContentFilter
+{
+public:
+    ~ContentFilter();
+
+    static std::wstring GetFiltersDirectory();
+    // Compile the lists in |directory| if filters.dat is missing or older
+    // than any of them. Safe to call off the UI thread.
+    static HRESULT CompileIfNeeded(const std::wstring& directory);
+    static HRESULT Compile(const std::vector<std::wstring>& listPaths, const std::wstring& outputPath);
+
+    HRESULT Load(const std::wstring& compiledPath);
+    void Unload();
+    bool IsLoaded() const { return m_matcher.IsAttached(); }
+
+    bool ShouldBlock(const FilterRequest& request);
+    static FilterRequest MakeRequest(LPCWSTR uri, const std::wstring& documentUri, COREWEBVIEW2_WEB_RESOURCE_CONTEXT context, bool isTopLevelDocument);
+
+    web::json::value GetStats() const;
+
+protected:
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+    const BYTE* m_view = nullptr;
+    size_t m_viewSize = 0;
+
+    FilterMatcher m_matcher;
+
+    // Matching statistics
+    uint64_t m_requestCount = 0;
+    uint64_t m_blockedCount = 0;
+    double m_totalMatchMicroseconds = 0;
+    double m_maxMatchMicroseconds = 0;
+};
@@ -0,0 +1,159 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "BrowserWindow.h"
+#include "ControllerPool.h"
+
+using namespace Microsoft::WRL;
+
+void ControllerPool::Init(HWND hWnd, ICoreWebView2Environment* env)
+{
+    m_hWnd = hWnd;
+    m_env = env;
+    Refill();
+}
+
+void ControllerPool::Acquire(AcquireCallback callback)
+{
+    if (!m_idle.empty())
+    {
+        ++m_hits;
+        ComPtr<ICoreWebView2Controller> controller = m_idle.back();
+        m_idle.pop_back();
+
+        BrowserWindow::PostToUIThread(m_hWnd, [this, controller, callback]()
+        {
+            callback(S_OK, controller.Get());
+            Refill();
+        });
+        return;
+    }
+
+    ++m_misses;
+    HRESULT hr = CreateController([this, callback](HRESULT result, ICoreWebView2Controller* controller)
+    {
+        callback(result, controller);
+        Refill();
+    });
+
+    if (FAILED(hr))
+    {
+        BrowserWindow::PostToUIThread(m_hWnd, [callback, hr]()
+        {
+            callback(hr, nullptr);
+        });
+    }
+}
+
+void ControllerPool::Refill()
+{
+    while (m_env && m_idle.size() + m_pendingCreations < c_targetIdleCount)
+    {
+        ++m_pendingCreations;
+        HRESULT hr = CreateController([this](HRESULT result, ICoreWebView2Controller* controller)
+        {
+            --m_pendingCreations;
+            if (SUCCEEDED(result))
+            {
+                m_idle.push_back(controller);
+            }
+        });
+
+        if (FAILED(hr))
+        {
+            --m_pendingCreations;
+            break;
+        }
+    }
+}
+
+void ControllerPool::Recycle(ICoreWebView2Controller* controller)
+{
+    ComPtr<ICoreWebView2Controller> recycled = controller;
+    ComPtr<ICoreWebView2> webview;
+    if (m_idle.size() + m_pendingRecycles >= c_maxIdleCount ||
+        FAILED(recycled->put_IsVisible(FALSE)) || FAILED(recycled->get_CoreWebView2(&webview)))
+    {
+        recycled->Close();
+        return;
+    }
+
+    // The closed page goes first, then the back/forward list, so nothing of
+    // it can be reached from the next tab
+    ++m_pendingRecycles;
+    std::shared_ptr<EventRegistrationToken> token = std::make_shared<EventRegistrationToken>();
+    HRESULT hr = webview->add_NavigationCompleted(Callback<ICoreWebView2NavigationCompletedEventHandler>(
+        [this, recycled, token](ICoreWebView2* webview, ICoreWebView2NavigationCompletedEventArgs* args) -> HRESULT
+    {
+        // A load the closed tab left running completes first
+        wil::unique_cotaskmem_string source;
+        if (SUCCEEDED(webview->get_Source(&source)) && wcscmp(source.get(), L"about:blank") != 0)
+        {
+            return S_OK;
+        }
+
+        webview->remove_NavigationCompleted(*token);
+
+        HRESULT hr = webview->CallDevToolsProtocolMethod(L"Page.resetNavigationHistory", L"{}",
+            Callback<ICoreWebView2CallDevToolsProtocolMethodCompletedHandler>(
+                [this, recycled](HRESULT error, PCWSTR resultJson) -> HRESULT
+        {
+            --m_pendingRecycles;
+            if (FAILED(error) || m_idle.size() >= c_maxIdleCount)
+            {
+                recycled->Close();
+                return S_OK;
+            }
+
+            ++m_recycled;
+            m_idle.push_back(recycled);
+            return S_OK;
+        }).Get());
+
+        if (FAILED(hr))
+        {
+            --m_pendingRecycles;
+            recycled->Close();
+        }
+
+        return S_OK;
+    }).Get(), token.get());
+
+    if (FAILED(hr) || FAILED(webview->Navigate(L"about:blank")))
+    {
+        webview->remove_NavigationCompleted(*token);
+        --m_pendingRecycles;
+        recycled->Close();
+    }
+}
+
+void ControllerPool::Clear()
+{
+    for (auto& controller : m_idle)
+    {
+        controller->Close();
+    }
+
+    m_idle.clear();
+}
+
+HRESULT ControllerPool::CreateController(std::function<void(HRESULT, ICoreWebView2Controller*)> completed)
+{
+    return m_env->CreateCoreWebView2Controller(m_hWnd, Callback<ICoreWebView2CreateCoreWebView2ControllerCompletedHandler>(
+        [completed](HRESULT result, ICoreWebView2Controller* controller) -> HRESULT
+    {
+        if (SUCCEEDED(result))
+        {
+            // Pooled controllers stay out of sight until a tab shows them
+            controller->put_IsVisible(FALSE);
+        }
+        else
+        {
+            OutputDebugString(L"Pooled WebView creation failed\n");
+        }
+
+        completed(result, controller);
+        return S_OK;
+    }).Get());
+}
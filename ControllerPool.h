@@ -0,0 +1,49 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+
+// Keeps a few hidden content controllers created ahead of time, so opening
+// a tab or starting a prerender doesn't wait for controller creation.
+// Controllers of closed tabs are taken back while the pool is below its
+// budget, instead of being torn down and created again.
+class ControllerPool
+{
+public:
+    typedef std::function<void(HRESULT, ICoreWebView2Controller*)> AcquireCallback;
+
+    static const size_t c_targetIdleCount = 1;
+    static const size_t c_maxIdleCount = 2;
+
+    void Init(HWND hWnd, ICoreWebView2Environment* env);
+    // Hand out an idle controller, or create one if there is none. The
+    // callback always runs asynchronously on the UI thread.
+    void Acquire(AcquireCallback callback);
+    // Start creating controllers until c_targetIdleCount are idle
+    void Refill();
+    // Take back the controller of a closed tab, whose handlers must already
+    // be removed. It goes idle once its page and history are cleared, or is
+    // closed if the pool is full.
+    void Recycle(ICoreWebView2Controller* controller);
+    void Clear();
+
+    uint64_t GetHits() const { return m_hits; }
+    uint64_t GetMisses() const { return m_misses; }
+    uint64_t GetRecycled() const { return m_recycled; }
+
+protected:
+    HWND m_hWnd = nullptr;
+    Microsoft::WRL::ComPtr<ICoreWebView2Environment> m_env;
+    std::vector<Microsoft::WRL::ComPtr<ICoreWebView2Controller>> m_idle;
+    size_t m_pendingCreations = 0;
+    size_t m_pendingRecycles = 0;
+
+    uint64_t m_hits = 0;
+    uint64_t m_misses = 0;
+    uint64_t m_recycled = 0;
+
+    HRESULT CreateController(std::function<void(HRESULT, ICoreWebView2Controller*)> completed);
+};
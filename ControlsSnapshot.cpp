@@ -0,0 +1,226 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "ControlsSnapshot.h"
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    double NumberFromJson(const web::json::value& object, const wchar_t* key)
+    {
+        if (!object.has_field(key) || !object.at(key).is_number())
+        {
+            return 0;
+        }
+
+        return object.at(key).as_double();
+    }
+
+    // [r, g, b, a] with a from 0 to 1, false if missing or transparent
+    bool ColorFromJson(const web::json::value& object, const wchar_t* key, COLORREF& color)
+    {
+        if (!object.has_field(key) || !object.at(key).is_array() || object.at(key).size() != 4)
+        {
+            return false;
+        }
+
+        const web::json::value& rgba = object.at(key);
+        for (size_t i = 0; i < 4; ++i)
+        {
+            if (!rgba.at(i).is_number())
+            {
+                return false;
+            }
+        }
+
+        auto channel = [&rgba](size_t i)
+        {
+            return static_cast<BYTE>((std::max)(0.0, (std::min)(255.0, rgba.at(i).as_double())));
+        };
+        color = RGB(channel(0), channel(1), channel(2));
+        return rgba.at(3).as_double() > 0;
+    }
+}
+
+HRESULT ControlsSnapshot::Load(const std::wstring& path)
+{
+    m_path = path;
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        // First run, the window is blank until the controls UI is ready
+        return S_FALSE;
+    }
+
+    std::stringstream contents;
+    contents << file.rdbuf();
+
+    try
+    {
+        m_json = utility::conversions::to_string_t(contents.str());
+        if (!Parse(web::json::value::parse(m_json), m_width, m_elements))
+        {
+            m_elements.clear();
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+    }
+    catch (const web::json::json_exception&)
+    {
+        OutputDebugString(L"Ignoring malformed controls snapshot\n");
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    return S_OK;
+}
+
+HRESULT ControlsSnapshot::Update(const web::json::value& snapshot)
+{
+    double width = 0;
+    std::vector<Element> elements;
+    if (!Parse(snapshot, width, elements))
+    {
+        return E_INVALIDARG;
+    }
+
+    std::wstring json = snapshot.serialize();
+    if (json.compare(m_json) == 0 || m_path.empty())
+    {
+        return S_OK;
+    }
+
+    m_json = json;
+    m_width = width;
+    m_elements = std::move(elements);
+
+    std::ofstream file(m_path, std::ios::binary | std::ios::trunc);
+    file << utility::conversions::to_utf8string(m_json);
+
+    return file ? S_OK : E_FAIL;
+}
+
+bool ControlsSnapshot::Parse(const web::json::value& snapshot, double& width, std::vector<Element>& elements)
+{
+    if (!snapshot.is_object() || !snapshot.has_field(L"elements") || !snapshot.at(L"elements").is_array())
+    {
+        return false;
+    }
+
+    width = NumberFromJson(snapshot, L"width");
+    if (width <= 0)
+    {
+        return false;
+    }
+
+    for (const auto& item : snapshot.at(L"elements").as_array())
+    {
+        if (!item.is_object())
+        {
+            continue;
+        }
+
+        Element element;
+        element.box = { NumberFromJson(item, L"x"), NumberFromJson(item, L"y"),
+            NumberFromJson(item, L"width"), NumberFromJson(item, L"height") };
+        if (element.box.width <= 0 || element.box.height <= 0)
+        {
+            continue;
+        }
+
+        std::wstring anchor = item.has_field(L"anchor") && item.at(L"anchor").is_string() ? item.at(L"anchor").as_string() : L"";
+        element.anchor = anchor.compare(L"right") == 0 ? Anchor::Right :
+            anchor.compare(L"stretch") == 0 ? Anchor::Stretch : Anchor::Left;
+        element.hasBackground = ColorFromJson(item, L"background", element.background);
+        if (ColorFromJson(item, L"border", element.border))
+        {
+            element.borderWidth = NumberFromJson(item, L"borderWidth");
+        }
+        element.radius = NumberFromJson(item, L"radius");
+
+        if (item.has_field(L"text") && item.at(L"text").is_string() && ColorFromJson(item, L"color", element.color))
+        {
+            element.text = item.at(L"text").as_string();
+            element.textBox = { NumberFromJson(item, L"textX"), NumberFromJson(item, L"textY"),
+                NumberFromJson(item, L"textWidth"), NumberFromJson(item, L"textHeight") };
+            element.fontSize = NumberFromJson(item, L"fontSize");
+            element.fontFamily = item.has_field(L"fontFamily") && item.at(L"fontFamily").is_string() ?
+                item.at(L"fontFamily").as_string() : L"Segoe UI";
+            element.centered = item.has_field(L"align") && item.at(L"align").is_string() &&
+                item.at(L"align").as_string().compare(L"center") == 0;
+        }
+
+        elements.push_back(std::move(element));
+    }
+
+    return !elements.empty();
+}
+
+RECT ControlsSnapshot::Place(const Box& box, Anchor anchor, const RECT& bar, double scale) const
+{
+    double growth = (bar.right - bar.left) / scale - m_width;
+    double x = box.x + (anchor == Anchor::Right ? growth : 0);
+    double width = (std::max)(0.0, box.width + (anchor == Anchor::Stretch ? growth : 0));
+
+    RECT rect;
+    rect.left = bar.left + static_cast<LONG>(x * scale + 0.5);
+    rect.top = bar.top + static_cast<LONG>(box.y * scale + 0.5);
+    rect.right = bar.left + static_cast<LONG>((x + width) * scale + 0.5);
+    rect.bottom = bar.top + static_cast<LONG>((box.y + box.height) * scale + 0.5);
+    return rect;
+}
+
+void ControlsSnapshot::Paint(HDC hdc, const RECT& bar, double scale) const
+{
+    int savedState = SaveDC(hdc);
+    IntersectClipRect(hdc, bar.left, bar.top, bar.right, bar.bottom);
+    SetBkMode(hdc, TRANSPARENT);
+
+    // In document order, later elements are on top
+    for (const Element& element : m_elements)
+    {
+        RECT rect = Place(element.box, element.anchor, bar, scale);
+
+        if (element.hasBackground || element.borderWidth > 0)
+        {
+            int borderWidth = static_cast<int>(element.borderWidth * scale + 0.5);
+            HPEN pen = borderWidth > 0 ? CreatePen(PS_INSIDEFRAME, borderWidth, element.border) : nullptr;
+            HBRUSH brush = element.hasBackground ? CreateSolidBrush(element.background) : nullptr;
+            HGDIOBJ oldPen = SelectObject(hdc, pen ? pen : GetStockObject(NULL_PEN));
+            HGDIOBJ oldBrush = SelectObject(hdc, brush ? brush : GetStockObject(NULL_BRUSH));
+
+            // Without a pen the right and bottom edges aren't filled
+            int diameter = static_cast<int>(element.radius * 2 * scale + 0.5);
+            int penless = pen ? 0 : 1;
+            RoundRect(hdc, rect.left, rect.top, rect.right + penless, rect.bottom + penless, diameter, diameter);
+
+            SelectObject(hdc, oldPen);
+            SelectObject(hdc, oldBrush);
+            if (pen)
+            {
+                DeleteObject(pen);
+            }
+            if (brush)
+            {
+                DeleteObject(brush);
+            }
+        }
+
+        if (!element.text.empty() && element.fontSize > 0)
+        {
+            RECT textRect = Place(element.textBox, element.anchor, bar, scale);
+            HFONT font = CreateFont(-static_cast<int>(element.fontSize * scale + 0.5), 0, 0, 0, FW_NORMAL, FALSE, FALSE,
+                FALSE, DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY,
+                DEFAULT_PITCH | FF_DONTCARE, element.fontFamily.c_str());
+            HGDIOBJ oldFont = SelectObject(hdc, font);
+            SetTextColor(hdc, element.color);
+            DrawText(hdc, element.text.c_str(), static_cast<int>(element.text.size()), &textRect,
+                DT_SINGLELINE | DT_VCENTER | DT_END_ELLIPSIS | DT_NOPREFIX | (element.centered ? DT_CENTER : 0));
+            SelectObject(hdc, oldFont);
+            DeleteObject(font);
+        }
+    }
+
+    RestoreDC(hdc, savedState);
+}
@@ -0,0 +1,67 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+
+// The controls bar as the controls UI rendered it at the last start: boxes
+// with their colors and text, in CSS pixels. The browser window paints it
+// natively as soon as it's shown, behind the controls WebView, which has a
+// transparent background until its page has painted. The browser starts
+// with a new tab every time, so the bar looks the same at every start but
+// for the window's width: elements keep their distance to the edge they're
+// anchored to, and stretching ones grow with the window.
+class ControlsSnapshot
+{
+public:
+    HRESULT Load(const std::wstring& path);
+    // Takes the snapshot from the controls UI, the file is rewritten only
+    // if it changed
+    HRESULT Update(const web::json::value& snapshot);
+    bool IsLoaded() const { return !m_elements.empty(); }
+    // |bar| is the controls WebView's area, |scale| the DPI scale
+    void Paint(HDC hdc, const RECT& bar, double scale) const;
+
+protected:
+    enum class Anchor
+    {
+        Left,
+        Right,
+        Stretch
+    };
+
+    struct Box
+    {
+        double x = 0;
+        double y = 0;
+        double width = 0;
+        double height = 0;
+    };
+
+    struct Element
+    {
+        Box box;
+        Anchor anchor = Anchor::Left;
+        COLORREF background = 0;
+        bool hasBackground = false;
+        COLORREF border = 0;
+        double borderWidth = 0;
+        double radius = 0;
+        std::wstring text;
+        Box textBox;
+        COLORREF color = 0;
+        double fontSize = 0;
+        std::wstring fontFamily;
+        bool centered = false;
+    };
+
+    std::wstring m_path;
+    std::wstring m_json;  // As saved
+    double m_width = 0;  // Of the bar when the snapshot was taken
+    std::vector<Element> m_elements;
+
+    static bool Parse(const web::json::value& snapshot, double& width, std::vector<Element>& elements);
+    RECT Place(const Box& box, Anchor anchor, const RECT& bar, double scale) const;
+};
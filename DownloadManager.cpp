@@ -0,0 +1,559 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "BrowserWindow.h"
+#include "DownloadManager.h"
+#include <fstream>
+#include <shellapi.h>
+#include <sstream>
+
+using namespace Microsoft::WRL;
+
+namespace
+{
+    const wchar_t* StateToString(DownloadState state)
+    {
+        switch (state)
+        {
+        case DownloadState::Queued: return L"queued";
+        case DownloadState::Paused: return L"paused";
+        case DownloadState::Completed: return L"completed";
+        case DownloadState::Interrupted: return L"interrupted";
+        case DownloadState::Cancelled: return L"cancelled";
+        default: return L"inProgress";
+        }
+    }
+
+    std::wstring StringField(const web::json::value& object, const wchar_t* key)
+    {
+        return object.has_field(key) && object.at(key).is_string() ? object.at(key).as_string() : std::wstring();
+    }
+
+    double NumberField(const web::json::value& object, const wchar_t* key, double fallback)
+    {
+        return object.has_field(key) && object.at(key).is_number() ? object.at(key).as_double() : fallback;
+    }
+}
+
+void DownloadManager::Init(HWND hWnd, const std::wstring& path, std::function<bool(const web::json::value&)> postProgress)
+{
+    m_hWnd = hWnd;
+    m_path = path;
+    m_postProgress = postProgress;
+
+    BrowserWindow::CheckFailure(Load(), L"Couldn't load the downloads list.");
+}
+
+HRESULT DownloadManager::HandleDownloadStarting(ICoreWebView2DownloadStartingEventArgs* args)
+{
+    // Progress shows in the controls UI and browser://downloads instead of
+    // the default download dialog
+    RETURN_IF_FAILED(args->put_Handled(TRUE));
+
+    wil::com_ptr<ICoreWebView2DownloadOperation> operation;
+    RETURN_IF_FAILED(args->get_DownloadOperation(&operation));
+
+    std::unique_ptr<Download> download = std::make_unique<Download>();
+    download->id = m_nextId++;
+    download->operation = operation;
+    download->startTime = Stopwatch::EpochMilliseconds();
+
+    wil::unique_cotaskmem_string uri;
+    RETURN_IF_FAILED(operation->get_Uri(&uri));
+    download->uri = uri.get();
+
+    wil::unique_cotaskmem_string resultFilePath;
+    RETURN_IF_FAILED(args->get_ResultFilePath(&resultFilePath));
+    download->path = resultFilePath.get();
+
+    wil::unique_cotaskmem_string mimeType;
+    RETURN_IF_FAILED(operation->get_MimeType(&mimeType));
+    download->mimeType = mimeType.get();
+
+    INT64 totalBytes = -1;
+    RETURN_IF_FAILED(operation->get_TotalBytesToReceive(&totalBytes));
+    download->totalBytes = totalBytes;
+
+    uint64_t id = download->id;
+    RETURN_IF_FAILED(operation->add_BytesReceivedChanged(Callback<ICoreWebView2BytesReceivedChangedEventHandler>(
+        [this, id](ICoreWebView2DownloadOperation* operation, IUnknown* args) -> HRESULT
+    {
+        Download* download = Find(id);
+        if (!download)
+        {
+            return S_OK;
+        }
+
+        // Only recorded here, the next batch sends it
+        ++m_progressEvents;
+        INT64 receivedBytes = 0;
+        RETURN_IF_FAILED(operation->get_BytesReceived(&receivedBytes));
+        download->receivedBytes = receivedBytes;
+        MarkDirty(download);
+
+        return S_OK;
+    }).Get(), &download->bytesReceivedToken));
+
+    RETURN_IF_FAILED(operation->add_StateChanged(Callback<ICoreWebView2StateChangedEventHandler>(
+        [this, id](ICoreWebView2DownloadOperation* operation, IUnknown* args) -> HRESULT
+    {
+        Download* download = Find(id);
+        return download ? HandleStateChanged(download) : S_OK;
+    }).Get(), &download->stateChangedToken));
+
+    // Over the limit the download still starts; it is paused once this
+    // handler has returned and resumed when a slot frees up
+    if (CountActive() >= c_maxActiveDownloads)
+    {
+        download->state = DownloadState::Queued;
+        BrowserWindow::PostToUIThread(m_hWnd, [this, id]()
+        {
+            Download* download = Find(id);
+            if (download && download->operation && download->state == DownloadState::Queued)
+            {
+                BrowserWindow::CheckFailure(download->operation->Pause(), L"Can't queue download.");
+            }
+        });
+    }
+
+    m_downloads.push_back(std::move(download));
+    MarkDirty(m_downloads.back().get());
+
+    return S_OK;
+}
+
+HRESULT DownloadManager::Pause(uint64_t id)
+{
+    Download* download = Find(id);
+    if (!download || !download->operation)
+    {
+        return S_OK;
+    }
+
+    if (download->state == DownloadState::InProgress)
+    {
+        RETURN_IF_FAILED(download->operation->Pause());
+        download->state = DownloadState::Paused;
+        StartQueued();
+    }
+    else if (download->state == DownloadState::Queued)
+    {
+        // Already paused, it just won't be picked up anymore
+        download->state = DownloadState::Paused;
+    }
+
+    MarkDirty(download);
+    return S_OK;
+}
+
+HRESULT DownloadManager::Resume(uint64_t id)
+{
+    Download* download = Find(id);
+    if (!download || !download->operation || download->state == DownloadState::InProgress)
+    {
+        return S_OK;
+    }
+
+    BOOL canResume = FALSE;
+    RETURN_IF_FAILED(download->operation->get_CanResume(&canResume));
+    if (!canResume)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_STATE);
+    }
+
+    download->interruptReason.clear();
+    if (CountActive() >= c_maxActiveDownloads)
+    {
+        download->state = DownloadState::Queued;
+    }
+    else
+    {
+        RETURN_IF_FAILED(download->operation->Resume());
+        download->state = DownloadState::InProgress;
+    }
+
+    MarkDirty(download);
+    return S_OK;
+}
+
+HRESULT DownloadManager::Cancel(uint64_t id)
+{
+    Download* download = Find(id);
+    if (!download || !download->operation)
+    {
+        return S_OK;
+    }
+
+    RETURN_IF_FAILED(download->operation->Cancel());
+    download->state = DownloadState::Cancelled;
+    Finish(download);
+    MarkDirty(download);
+
+    return S_OK;
+}
+
+HRESULT DownloadManager::Open(uint64_t id, bool showInFolder)
+{
+    Download* download = Find(id);
+    if (!download || download->state != DownloadState::Completed)
+    {
+        return S_OK;
+    }
+
+    HINSTANCE result = nullptr;
+    if (showInFolder)
+    {
+        std::wstring parameters = L"/select,\"" + download->path + L"\"";
+        result = ShellExecute(m_hWnd, L"open", L"explorer.exe", parameters.c_str(), nullptr, SW_SHOWNORMAL);
+    }
+    else
+    {
+        result = ShellExecute(m_hWnd, L"open", download->path.c_str(), nullptr, nullptr, SW_SHOWNORMAL);
+    }
+
+    // ShellExecute returns an error code below 32 on failure
+    return reinterpret_cast<INT_PTR>(result) > 32 ? S_OK : E_FAIL;
+}
+
+void DownloadManager::Remove(uint64_t id)
+{
+    auto download = std::find_if(m_downloads.begin(), m_downloads.end(),
+        [id](const std::unique_ptr<Download>& download) { return download->id == id; });
+
+    // Transfers are cancelled first, not dropped from under the runtime
+    if (download == m_downloads.end() || (*download)->operation)
+    {
+        return;
+    }
+
+    m_downloads.erase(download);
+    BrowserWindow::CheckFailure(Save(), L"Couldn't save the downloads list.");
+}
+
+void DownloadManager::FlushProgress()
+{
+    double seconds = m_batchStopwatch.ElapsedMilliseconds() / 1000;
+    m_batchStopwatch.Restart();
+
+    web::json::value batch = web::json::value::array();
+    std::vector<Download*> batched;
+    for (auto& download : m_downloads)
+    {
+        double bytesPerSecond = 0;
+        if (download->state == DownloadState::InProgress && seconds > 0)
+        {
+            bytesPerSecond = (download->receivedBytes - download->batchReceivedBytes) / seconds;
+        }
+
+        if (bytesPerSecond != download->bytesPerSecond)
+        {
+            download->bytesPerSecond = bytesPerSecond;
+            download->dirty = true;
+        }
+        download->batchReceivedBytes = download->receivedBytes;
+
+        if (download->dirty)
+        {
+            download->dirty = false;
+            batch[batched.size()] = ToJson(*download);
+            batched.push_back(download.get());
+        }
+    }
+
+    if (!batched.empty())
+    {
+        if (m_postProgress(batch))
+        {
+            ++m_progressBatches;
+        }
+        else
+        {
+            for (Download* download : batched)
+            {
+                download->dirty = true;
+            }
+        }
+    }
+
+    // Nothing left that could change on its own
+    if (batched.empty() && CountActive() == 0)
+    {
+        KillTimer(m_hWnd, c_timerId);
+        m_timerRunning = false;
+
+        WCHAR log[160];
+        StringCchPrintf(log, ARRAYSIZE(log), L"Downloads: %llu progress events sent in %llu batches\n",
+            m_progressEvents, m_progressBatches);
+        OutputDebugString(log);
+    }
+}
+
+web::json::value DownloadManager::GetDownloadsAsJson() const
+{
+    web::json::value downloads = web::json::value::array();
+    size_t index = 0;
+    for (const auto& download : m_downloads)
+    {
+        downloads[index++] = ToJson(*download);
+    }
+
+    return downloads;
+}
+
+Download* DownloadManager::Find(uint64_t id)
+{
+    for (auto& download : m_downloads)
+    {
+        if (download->id == id)
+        {
+            return download.get();
+        }
+    }
+
+    return nullptr;
+}
+
+size_t DownloadManager::CountActive() const
+{
+    return static_cast<size_t>(std::count_if(m_downloads.begin(), m_downloads.end(),
+        [](const std::unique_ptr<Download>& download) { return download->state == DownloadState::InProgress; }));
+}
+
+void DownloadManager::MarkDirty(Download* download)
+{
+    download->dirty = true;
+    if (!m_timerRunning)
+    {
+        SetTimer(m_hWnd, c_timerId, c_progressInterval, nullptr);
+        m_timerRunning = true;
+        m_batchStopwatch.Restart();
+    }
+}
+
+HRESULT DownloadManager::HandleStateChanged(Download* download)
+{
+    if (!download->operation)
+    {
+        return S_OK;
+    }
+
+    COREWEBVIEW2_DOWNLOAD_STATE state = COREWEBVIEW2_DOWNLOAD_STATE_IN_PROGRESS;
+    RETURN_IF_FAILED(download->operation->get_State(&state));
+    INT64 receivedBytes = 0;
+    RETURN_IF_FAILED(download->operation->get_BytesReceived(&receivedBytes));
+    download->receivedBytes = receivedBytes;
+
+    switch (state)
+    {
+    case COREWEBVIEW2_DOWNLOAD_STATE_COMPLETED:
+    {
+        download->state = DownloadState::Completed;
+        Finish(download);
+    }
+    break;
+    case COREWEBVIEW2_DOWNLOAD_STATE_INTERRUPTED:
+    {
+        // Pausing is reported as an interruption too
+        if (download->state == DownloadState::Paused || download->state == DownloadState::Queued)
+        {
+            break;
+        }
+
+        COREWEBVIEW2_DOWNLOAD_INTERRUPT_REASON reason = COREWEBVIEW2_DOWNLOAD_INTERRUPT_REASON_NONE;
+        RETURN_IF_FAILED(download->operation->get_InterruptReason(&reason));
+        BOOL canResume = FALSE;
+        RETURN_IF_FAILED(download->operation->get_CanResume(&canResume));
+
+        if (reason == COREWEBVIEW2_DOWNLOAD_INTERRUPT_REASON_USER_CANCELED)
+        {
+            download->state = DownloadState::Cancelled;
+        }
+        else
+        {
+            download->state = DownloadState::Interrupted;
+            download->interruptReason = GetInterruptReasonText(reason);
+        }
+
+        // A resumable download keeps its operation so the user can retry
+        if (download->state == DownloadState::Cancelled || !canResume)
+        {
+            Finish(download);
+        }
+        else
+        {
+            StartQueued();
+        }
+    }
+    break;
+    case COREWEBVIEW2_DOWNLOAD_STATE_IN_PROGRESS:
+    {
+        if (download->state != DownloadState::Paused && download->state != DownloadState::Queued)
+        {
+            download->state = DownloadState::InProgress;
+        }
+    }
+    break;
+    }
+
+    MarkDirty(download);
+    return S_OK;
+}
+
+void DownloadManager::Finish(Download* download)
+{
+    download->operation->remove_BytesReceivedChanged(download->bytesReceivedToken);
+    download->operation->remove_StateChanged(download->stateChangedToken);
+    download->operation.reset();
+
+    BrowserWindow::CheckFailure(Save(), L"Couldn't save the downloads list.");
+    StartQueued();
+}
+
+void DownloadManager::StartQueued()
+{
+    for (auto& download : m_downloads)
+    {
+        if (CountActive() >= c_maxActiveDownloads)
+        {
+            break;
+        }
+
+        if (download->state == DownloadState::Queued && download->operation)
+        {
+            if (SUCCEEDED(download->operation->Resume()))
+            {
+                download->state = DownloadState::InProgress;
+                MarkDirty(download.get());
+            }
+        }
+    }
+}
+
+HRESULT DownloadManager::Load()
+{
+    std::ifstream file(m_path, std::ios::binary);
+    if (!file)
+    {
+        return S_FALSE;
+    }
+
+    std::stringstream contents;
+    contents << file.rdbuf();
+
+    try
+    {
+        web::json::value downloads = web::json::value::parse(utility::conversions::to_string_t(contents.str()));
+        if (!downloads.is_array())
+        {
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+
+        for (const web::json::value& entry : downloads.as_array())
+        {
+            std::unique_ptr<Download> download = std::make_unique<Download>();
+            download->id = m_nextId++;
+            download->uri = StringField(entry, L"uri");
+            download->path = StringField(entry, L"path");
+            download->mimeType = StringField(entry, L"mimeType");
+            download->totalBytes = static_cast<int64_t>(NumberField(entry, L"totalBytes", -1));
+            download->receivedBytes = static_cast<int64_t>(NumberField(entry, L"receivedBytes", 0));
+            download->startTime = NumberField(entry, L"startTime", 0);
+            download->interruptReason = StringField(entry, L"interruptReason");
+            download->dirty = false;
+
+            // Anything unfinished was cut off when the browser closed
+            std::wstring state = StringField(entry, L"state");
+            if (state.compare(L"completed") == 0)
+            {
+                download->state = DownloadState::Completed;
+            }
+            else if (state.compare(L"cancelled") == 0)
+            {
+                download->state = DownloadState::Cancelled;
+            }
+            else
+            {
+                download->state = DownloadState::Interrupted;
+                if (download->interruptReason.empty())
+                {
+                    download->interruptReason = L"Browser closed";
+                }
+            }
+
+            m_downloads.push_back(std::move(download));
+        }
+    }
+    catch (const web::json::json_exception&)
+    {
+        OutputDebugString(L"Ignoring malformed downloads file\n");
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    return S_OK;
+}
+
+HRESULT DownloadManager::Save() const
+{
+    if (m_path.empty())
+    {
+        return E_UNEXPECTED;
+    }
+
+    // The most recent ones only
+    web::json::value downloads = web::json::value::array();
+    size_t first = m_downloads.size() > c_maxStoredDownloads ? m_downloads.size() - c_maxStoredDownloads : 0;
+    size_t index = 0;
+    for (size_t i = first; i < m_downloads.size(); ++i)
+    {
+        downloads[index++] = ToJson(*m_downloads[i]);
+    }
+
+    std::ofstream file(m_path, std::ios::binary | std::ios::trunc);
+    file << utility::conversions::to_utf8string(downloads.serialize());
+
+    return file ? S_OK : E_FAIL;
+}
+
+web::json::value DownloadManager::ToJson(const Download& download)
+{
+    size_t nameStart = download.path.find_last_of(L"\\/");
+
+    web::json::value json = web::json::value::object();
+    json[L"id"] = web::json::value::number(download.id);
+    json[L"uri"] = web::json::value(download.uri);
+    json[L"path"] = web::json::value(download.path);
+    json[L"name"] = web::json::value(nameStart == std::wstring::npos ? download.path : download.path.substr(nameStart + 1));
+    json[L"mimeType"] = web::json::value(download.mimeType);
+    json[L"totalBytes"] = web::json::value::number(download.totalBytes);
+    json[L"receivedBytes"] = web::json::value::number(download.receivedBytes);
+    json[L"state"] = web::json::value(StateToString(download.state));
+    json[L"interruptReason"] = web::json::value(download.interruptReason);
+    json[L"startTime"] = web::json::value::number(download.startTime);
+    json[L"bytesPerSecond"] = web::json::value::number(download.bytesPerSecond);
+    json[L"canResume"] = web::json::value::boolean(download.operation && download.state != DownloadState::InProgress);
+
+    return json;
+}
+
+std::wstring DownloadManager::GetInterruptReasonText(COREWEBVIEW2_DOWNLOAD_INTERRUPT_REASON reason)
+{
+    switch (reason)
+    {
+    case COREWEBVIEW2_DOWNLOAD_INTERRUPT_REASON_FILE_NO_SPACE:
+        return L"Disk full";
+    case COREWEBVIEW2_DOWNLOAD_INTERRUPT_REASON_FILE_ACCESS_DENIED:
+        return L"Access denied";
+    case COREWEBVIEW2_DOWNLOAD_INTERRUPT_REASON_NETWORK_FAILED:
+    case COREWEBVIEW2_DOWNLOAD_INTERRUPT_REASON_NETWORK_TIMEOUT:
+    case COREWEBVIEW2_DOWNLOAD_INTERRUPT_REASON_NETWORK_DISCONNECTED:
+        return L"Network error";
+    case COREWEBVIEW2_DOWNLOAD_INTERRUPT_REASON_NETWORK_SERVER_DOWN:
+    case COREWEBVIEW2_DOWNLOAD_INTERRUPT_REASON_SERVER_FAILED:
+        return L"Server error";
+    case COREWEBVIEW2_DOWNLOAD_INTERRUPT_REASON_USER_SHUTDOWN:
+        return L"Browser closed";
+    default:
+        return L"Failed";
+    }
+}
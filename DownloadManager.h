@@ -0,0 +1,99 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+#include "Stopwatch.h"
+
+enum class DownloadState
+{
+    Queued,  // Paused by the manager until a transfer slot frees up
+    InProgress,
+    Paused,  // Paused by the user
+    Completed,
+    Interrupted,
+    Cancelled
+};
+
+struct Download
+{
+    uint64_t id = 0;
+    // Null once the download is finished, or if it was loaded from disk
+    wil::com_ptr<ICoreWebView2DownloadOperation> operation;
+    EventRegistrationToken bytesReceivedToken = {};
+    EventRegistrationToken stateChangedToken = {};
+
+    std::wstring uri;
+    std::wstring path;
+    std::wstring mimeType;
+    int64_t totalBytes = -1;  // -1 if the server didn't send a length
+    int64_t receivedBytes = 0;
+    DownloadState state = DownloadState::InProgress;
+    std::wstring interruptReason;
+    double startTime = 0;  // ms since the Unix epoch
+
+    bool dirty = true;  // Changed since the last progress batch
+    int64_t batchReceivedBytes = 0;  // receivedBytes at the last batch
+    double bytesPerSecond = 0;
+};
+
+// Host side store of the tabs' downloads. Every download goes through
+// DownloadStarting, where the default download dialog is replaced by
+// browser://downloads. At most c_maxActiveDownloads transfer at the same
+// time, the rest wait paused. Progress is sent every c_progressInterval
+// for the downloads that changed, not for each BytesReceivedChanged.
+// Finished downloads are kept in downloads.json in the app data directory.
+class DownloadManager
+{
+public:
+    static const UINT_PTR c_timerId = 3;  // Runs only while something changes
+    static const UINT c_progressInterval = 500;  // ms
+    static const size_t c_maxActiveDownloads = 3;
+    static const size_t c_maxStoredDownloads = 100;
+
+    // |postProgress| is handed each batch, an array of the downloads that
+    // changed since the last one; when it returns false, they're in the next
+    // batch again
+    void Init(HWND hWnd, const std::wstring& path, std::function<bool(const web::json::value&)> postProgress);
+    HRESULT HandleDownloadStarting(ICoreWebView2DownloadStartingEventArgs* args);
+
+    HRESULT Pause(uint64_t id);
+    HRESULT Resume(uint64_t id);
+    HRESULT Cancel(uint64_t id);
+    // Opens the downloaded file, or the folder it is in with it selected
+    HRESULT Open(uint64_t id, bool showInFolder);
+    // Removes a finished download from the list, the file stays
+    void Remove(uint64_t id);
+
+    // Called on c_timerId
+    void FlushProgress();
+    web::json::value GetDownloadsAsJson() const;
+
+protected:
+    HWND m_hWnd = nullptr;
+    std::wstring m_path;
+    std::function<bool(const web::json::value&)> m_postProgress;
+    std::vector<std::unique_ptr<Download>> m_downloads;  // Oldest first
+    uint64_t m_nextId = 1;
+    bool m_timerRunning = false;
+    Stopwatch m_batchStopwatch;
+
+    // Report
+    uint64_t m_progressEvents = 0;
+    uint64_t m_progressBatches = 0;
+
+    Download* Find(uint64_t id);
+    size_t CountActive() const;
+    void MarkDirty(Download* download);
+    HRESULT HandleStateChanged(Download* download);
+    void Finish(Download* download);
+    // Resume queued downloads while there are free slots
+    void StartQueued();
+    HRESULT Load();
+    HRESULT Save() const;
+
+    static web::json::value ToJson(const Download& download);
+    static std::wstring GetInterruptReasonText(COREWEBVIEW2_DOWNLOAD_INTERRUPT_REASON reason);
+};
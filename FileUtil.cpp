@@ -0,0 +1,71 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "FileUtil.h"
+#include <bcrypt.h>
+#include <fstream>
+#include <sstream>
+#pragma comment (lib, "bcrypt.lib")
+
+bool ReadFileContents(const std::wstring& path, std::string& contents)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    std::stringstream stream;
+    stream << file.rdbuf();
+    contents = stream.str();
+
+    return true;
+}
+
+HRESULT WriteFileAtomically(const std::wstring& path, const void* data, size_t size)
+{
+    // Unique per writer, two of them never share a temporary file
+    std::wstring temporaryPath = path + L"." + std::to_wstring(GetCurrentProcessId()) + L"." +
+        std::to_wstring(GetCurrentThreadId()) + L".tmp";
+    {
+        std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+        output.write(reinterpret_cast<const char*>(data), size);
+        if (!output)
+        {
+            output.close();
+            DeleteFileW(temporaryPath.c_str());
+            return E_FAIL;
+        }
+    }
+
+    if (!MoveFileExW(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        DeleteFileW(temporaryPath.c_str());
+        return hr;
+    }
+
+    return S_OK;
+}
+
+HRESULT Sha256(const std::string& data, std::wstring& hash)
+{
+    BYTE digest[32];
+    NTSTATUS status = BCryptHash(BCRYPT_SHA256_ALG_HANDLE, nullptr, 0,
+        reinterpret_cast<PUCHAR>(const_cast<char*>(data.data())), static_cast<ULONG>(data.size()), digest, sizeof(digest));
+    if (!BCRYPT_SUCCESS(status))
+    {
+        return HRESULT_FROM_NT(status);
+    }
+
+    static const wchar_t hexDigits[] = L"0123456789abcdef";
+    hash.clear();
+    for (BYTE byte : digest)
+    {
+        hash.push_back(hexDigits[byte >> 4]);
+        hash.push_back(hexDigits[byte & 0xF]);
+    }
+
+    return S_OK;
+}
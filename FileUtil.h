@@ -0,0 +1,17 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+
+// File helpers shared by the on-disk stores (SharedHttpCache, SnapshotStore).
+
+// False if |path| can't be opened
+bool ReadFileContents(const std::wstring& path, std::string& contents);
+// Written next to |path| and swapped in, so neither this process nor another
+// picks up a half written file
+HRESULT WriteFileAtomically(const std::wstring& path, const void* data, size_t size);
+// Lowercase hex SHA-256 of |data|
+HRESULT Sha256(const std::string& data, std::wstring& hash);
@@ -0,0 +1,790 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "FilterMatcher.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+namespace
+{
+    const uint32_t c_allContexts = 0xFFFFFFFF;
+
+    struct CompiledRule
+    {
+        FilterRule rule;
+        std::string pattern;
+        uint64_t key;  // Domain hash for domain rules, token hash otherwise, 0 if untokenized
+        bool isDomainRule;
+    };
+
+    uint64_t HashString(const char* begin, size_t length)
+    {
+        // FNV-1a, 0 is reserved for empty buckets
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < length; ++i)
+        {
+            hash ^= static_cast<unsigned char>(begin[i]);
+            hash *= 1099511628211ULL;
+        }
+
+        return hash == 0 ? 1 : hash;
+    }
+
+    bool IsTokenChar(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '%';
+    }
+
+    bool IsSeparator(char c)
+    {
+        // ABP '^': anything but a letter, a digit or one of _-.%
+        return !IsTokenChar(c) && !(c >= 'A' && c <= 'Z') && c != '_' && c != '-' && c != '.';
+    }
+
+    bool IsDomainChar(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '.';
+    }
+
+    uint32_t ContextBit(uint32_t resourceType)
+    {
+        return 1u << resourceType;
+    }
+
+    // Maps a $type option onto WebView2 resource contexts, 0 if unknown
+    uint32_t ContextMaskForOption(const std::string& option)
+    {
+        if (option == "script") return ContextBit(FILTER_RESOURCE_SCRIPT);
+        if (option == "image") return ContextBit(FILTER_RESOURCE_IMAGE);
+        if (option == "stylesheet") return ContextBit(FILTER_RESOURCE_STYLESHEET);
+        if (option == "font") return ContextBit(FILTER_RESOURCE_FONT);
+        if (option == "media") return ContextBit(FILTER_RESOURCE_MEDIA);
+        if (option == "websocket") return ContextBit(FILTER_RESOURCE_WEBSOCKET);
+        if (option == "ping") return ContextBit(FILTER_RESOURCE_PING);
+        if (option == "subdocument") return ContextBit(FILTER_RESOURCE_DOCUMENT);
+        if (option == "other") return ContextBit(FILTER_RESOURCE_OTHER);
+        if (option == "xmlhttprequest" || option == "xhr")
+        {
+            return ContextBit(FILTER_RESOURCE_XML_HTTP_REQUEST) |
+                ContextBit(FILTER_RESOURCE_FETCH);
+        }
+
+        return 0;
+    }
+
+    std::string Trim(const std::string& text)
+    {
+        size_t start = text.find_first_not_of(" \t\r\n");
+        if (start == std::string::npos)
+        {
+            return std::string();
+        }
+
+        size_t end = text.find_last_not_of(" \t\r\n");
+        return text.substr(start, end - start + 1);
+    }
+
+    std::string ToLowerAscii(std::string text)
+    {
+        for (char& c : text)
+        {
+            if (c >= 'A' && c <= 'Z')
+            {
+                c = static_cast<char>(c - 'A' + 'a');
+            }
+        }
+
+        return text;
+    }
+
+    // Picks the longest alphanumeric run that is bounded on both sides in
+    // the pattern, so it is guaranteed to appear as a whole token in any URL
+    // the rule matches.
+    uint64_t SelectToken(const std::string& pattern, uint16_t flags)
+    {
+        size_t bestStart = 0;
+        size_t bestLength = 0;
+
+        size_t i = 0;
+        while (i < pattern.size())
+        {
+            if (!IsTokenChar(pattern[i]))
+            {
+                ++i;
+                continue;
+            }
+
+            size_t start = i;
+            while (i < pattern.size() && IsTokenChar(pattern[i]))
+            {
+                ++i;
+            }
+
+            bool boundedStart = start > 0 ? pattern[start - 1] != '*' :
+                (flags & (FILTER_RULE_ANCHOR_START | FILTER_RULE_ANCHOR_DOMAIN)) != 0;
+            bool boundedEnd = i < pattern.size() ? pattern[i] != '*' :
+                (flags & FILTER_RULE_ANCHOR_END) != 0;
+
+            if (boundedStart && boundedEnd && i - start > bestLength && i - start >= 2)
+            {
+                bestStart = start;
+                bestLength = i - start;
+            }
+        }
+
+        return bestLength ? HashString(pattern.c_str() + bestStart, bestLength) : 0;
+    }
+
+    // Parses one list line. Returns false for comments, cosmetic rules and
+    // rules using options the compact format can't express.
+    bool ParseRule(const std::string& line, CompiledRule& compiled)
+    {
+        std::string text = Trim(line);
+        if (text.empty() || text[0] == '!' || text[0] == '[')
+        {
+            return false;
+        }
+
+        // Element hiding and scriptlets are not network rules
+        if (text.find("##") != std::string::npos || text.find("#@#") != std::string::npos ||
+            text.find("#?#") != std::string::npos || text.find("#$#") != std::string::npos)
+        {
+            return false;
+        }
+
+        uint16_t flags = 0;
+        if (text.compare(0, 2, "@@") == 0)
+        {
+            flags |= FILTER_RULE_EXCEPTION;
+            text = text.substr(2);
+        }
+
+        // Regular expression rules are not supported
+        if (text.size() > 1 && text.front() == '/' && text.back() == '/')
+        {
+            return false;
+        }
+
+        uint32_t includeMask = 0;
+        uint32_t excludeMask = 0;
+        size_t optionsStart = text.rfind('$');
+        if (optionsStart != std::string::npos)
+        {
+            std::string options = ToLowerAscii(text.substr(optionsStart + 1));
+            text = text.substr(0, optionsStart);
+
+            size_t position = 0;
+            while (position <= options.size())
+            {
+                size_t comma = options.find(',', position);
+                if (comma == std::string::npos)
+                {
+                    comma = options.size();
+                }
+
+                std::string option = options.substr(position, comma - position);
+                position = comma + 1;
+
+                bool negated = !option.empty() && option[0] == '~';
+                std::string name = negated ? option.substr(1) : option;
+
+                if (name == "third-party" || name == "3p")
+                {
+                    flags |= negated ? FILTER_RULE_FIRST_PARTY : FILTER_RULE_THIRD_PARTY;
+                }
+                else if (name == "first-party" || name == "1p")
+                {
+                    flags |= negated ? FILTER_RULE_THIRD_PARTY : FILTER_RULE_FIRST_PARTY;
+                }
+                else if (name == "document" && !negated)
+                {
+                    flags |= FILTER_RULE_DOCUMENT;
+                    includeMask |= ContextBit(FILTER_RESOURCE_DOCUMENT);
+                }
+                else if (name == "match-case" || name.empty())
+                {
+                    // Matching is case insensitive anyway
+                }
+                else if (uint32_t mask = ContextMaskForOption(name))
+                {
+                    (negated ? excludeMask : includeMask) |= mask;
+                }
+                else
+                {
+                    // domain=, redirect=, csp= and friends
+                    return false;
+                }
+            }
+        }
+
+        uint32_t contextMask = includeMask ? includeMask : c_allContexts;
+        contextMask &= ~excludeMask;
+
+        std::string pattern = ToLowerAscii(text);
+        if (pattern.compare(0, 2, "||") == 0)
+        {
+            flags |= FILTER_RULE_ANCHOR_DOMAIN;
+            pattern = pattern.substr(2);
+        }
+        else if (!pattern.empty() && pattern[0] == '|')
+        {
+            flags |= FILTER_RULE_ANCHOR_START;
+            pattern = pattern.substr(1);
+        }
+
+        if (!pattern.empty() && pattern.back() == '|')
+        {
+            flags |= FILTER_RULE_ANCHOR_END;
+            pattern.pop_back();
+        }
+
+        // Leading and trailing wildcards don't change what an unanchored
+        // pattern matches
+        if (!(flags & (FILTER_RULE_ANCHOR_START | FILTER_RULE_ANCHOR_DOMAIN)))
+        {
+            pattern.erase(0, pattern.find_first_not_of('*'));
+        }
+        if (!(flags & FILTER_RULE_ANCHOR_END))
+        {
+            size_t last = pattern.find_last_not_of('*');
+            pattern.erase(last == std::string::npos ? 0 : last + 1);
+        }
+
+        if (pattern.empty() || pattern.size() > UINT16_MAX)
+        {
+            return false;
+        }
+
+        compiled.rule = FilterRule{ 0, 0, flags, contextMask };
+
+        // ||example.com^ rules go in the domain table and need no pattern
+        std::string domain = pattern;
+        if (domain.back() == '^')
+        {
+            domain.pop_back();
+        }
+
+        compiled.isDomainRule = (flags & FILTER_RULE_ANCHOR_DOMAIN) && !(flags & FILTER_RULE_ANCHOR_END) &&
+            pattern.back() == '^' && !domain.empty() && std::all_of(domain.begin(), domain.end(), IsDomainChar);
+
+        if (compiled.isDomainRule)
+        {
+            compiled.key = HashString(domain.c_str(), domain.size());
+        }
+        else
+        {
+            compiled.pattern = pattern;
+            compiled.key = SelectToken(pattern, flags);
+        }
+
+        return true;
+    }
+
+    uint32_t TableSize(size_t keyCount)
+    {
+        // Power of two with a load factor of at most 0.5
+        uint32_t size = 16;
+        while (size < keyCount * 2)
+        {
+            size <<= 1;
+        }
+
+        return size;
+    }
+
+    void BuildTable(const std::map<uint64_t, std::vector<uint32_t>>& groups, std::vector<FilterBucket>& table, std::vector<uint32_t>& postings)
+    {
+        table.assign(TableSize(groups.size()), FilterBucket{ 0, 0, 0 });
+        uint32_t mask = static_cast<uint32_t>(table.size() - 1);
+
+        for (const auto& group : groups)
+        {
+            uint32_t slot = static_cast<uint32_t>(group.first) & mask;
+            while (table[slot].key != 0)
+            {
+                slot = (slot + 1) & mask;
+            }
+
+            table[slot].key = group.first;
+            table[slot].first = static_cast<uint32_t>(postings.size());
+            table[slot].count = static_cast<uint32_t>(group.second.size());
+            postings.insert(postings.end(), group.second.begin(), group.second.end());
+        }
+    }
+
+    // ABP pattern match of |pattern| against |url| starting at |position|.
+    // Each '*' is first taken to match nothing and grown one character at a
+    // time when the rest fails; only the last '*' seen needs retrying, since
+    // anything an earlier one could take, the later one can too. At most
+    // the pattern times the URL, however many wildcards there are.
+    bool MatchPatternAt(const char* pattern, const char* patternEnd, const std::string& url, size_t position, bool anchorEnd)
+    {
+        const char* afterStar = nullptr;
+        size_t starPosition = 0;
+
+        while (true)
+        {
+            if (pattern == patternEnd)
+            {
+                if (!anchorEnd || position == url.size())
+                {
+                    return true;
+                }
+            }
+            else if (*pattern == '*')
+            {
+                afterStar = ++pattern;
+                starPosition = position;
+                if (pattern == patternEnd)
+                {
+                    return true;
+                }
+                continue;
+            }
+            else if (*pattern == '^' && position == url.size())
+            {
+                // The separator placeholder also matches the end of the URL
+                ++pattern;
+                continue;
+            }
+            else if (position < url.size() && (*pattern == '^' ? IsSeparator(url[position]) : url[position] == *pattern))
+            {
+                ++pattern;
+                ++position;
+                continue;
+            }
+
+            if (!afterStar || starPosition == url.size())
+            {
+                return false;
+            }
+
+            pattern = afterStar;
+            position = ++starPosition;
+        }
+    }
+
+    // Approximates the registrable domain (eTLD+1) for third-party checks
+    std::string GetSiteForHost(const std::string& host)
+    {
+        size_t last = host.rfind('.');
+        if (last == std::string::npos || last == 0)
+        {
+            return host;
+        }
+
+        size_t secondLast = host.rfind('.', last - 1);
+        std::string secondLevel = host.substr(secondLast == std::string::npos ? 0 : secondLast + 1, last - (secondLast == std::string::npos ? 0 : secondLast + 1));
+
+        // example.co.uk style suffixes
+        bool isCountrySuffix = host.size() - last - 1 == 2 &&
+            (secondLevel == "co" || secondLevel == "com" || secondLevel == "net" || secondLevel == "org" ||
+             secondLevel == "gov" || secondLevel == "ac" || secondLevel == "edu");
+
+        size_t start = secondLast;
+        if (isCountrySuffix && secondLast != std::string::npos && secondLast > 0)
+        {
+            start = host.rfind('.', secondLast - 1);
+        }
+
+        return start == std::string::npos ? host : host.substr(start + 1);
+    }
+
+    std::string GetHost(const std::string& url)
+    {
+        size_t schemeEnd = url.find("://");
+        if (schemeEnd == std::string::npos)
+        {
+            return std::string();
+        }
+
+        size_t hostStart = schemeEnd + 3;
+        size_t hostEnd = url.find_first_of("/?#", hostStart);
+        std::string authority = url.substr(hostStart, hostEnd == std::string::npos ? std::string::npos : hostEnd - hostStart);
+
+        size_t at = authority.rfind('@');
+        if (at != std::string::npos)
+        {
+            authority = authority.substr(at + 1);
+        }
+
+        if (!authority.empty() && authority[0] == '[')
+        {
+            return authority.substr(0, authority.find(']') + 1);
+        }
+
+        return authority.substr(0, authority.find(':'));
+    }
+
+    bool AreBucketsValid(const FilterBucket* table, uint32_t bucketCount, uint32_t postingCount)
+    {
+        for (uint32_t i = 0; i < bucketCount; ++i)
+        {
+            if (table[i].key != 0 && static_cast<uint64_t>(table[i].first) + table[i].count > postingCount)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+std::vector<uint8_t> FilterMatcher::Compile(const std::vector<std::string>& lines, uint32_t& ruleCount)
+{
+    std::vector<CompiledRule> rules;
+    for (const std::string& line : lines)
+    {
+        CompiledRule compiled;
+        if (ParseRule(line, compiled))
+        {
+            rules.push_back(std::move(compiled));
+        }
+    }
+
+    std::string stringPool;
+    std::map<uint64_t, std::vector<uint32_t>> domainGroups;
+    std::map<uint64_t, std::vector<uint32_t>> tokenGroups;
+    std::vector<uint32_t> untokenized;
+    std::vector<FilterRule> fileRules;
+    fileRules.reserve(rules.size());
+
+    for (CompiledRule& compiled : rules)
+    {
+        uint32_t index = static_cast<uint32_t>(fileRules.size());
+        compiled.rule.patternOffset = static_cast<uint32_t>(stringPool.size());
+        compiled.rule.patternLength = static_cast<uint16_t>(compiled.pattern.size());
+        stringPool.append(compiled.pattern);
+        fileRules.push_back(compiled.rule);
+
+        if (compiled.isDomainRule)
+        {
+            domainGroups[compiled.key].push_back(index);
+        }
+        else if (compiled.key != 0)
+        {
+            tokenGroups[compiled.key].push_back(index);
+        }
+        else
+        {
+            untokenized.push_back(index);
+        }
+    }
+
+    std::vector<uint32_t> postings;
+    std::vector<FilterBucket> domainTable;
+    std::vector<FilterBucket> tokenTable;
+    BuildTable(domainGroups, domainTable, postings);
+    BuildTable(tokenGroups, tokenTable, postings);
+
+    FilterFileHeader header = {};
+    header.magic = FILTER_FILE_MAGIC;
+    header.version = FILTER_FILE_VERSION;
+    header.ruleCount = static_cast<uint32_t>(fileRules.size());
+    header.domainBucketCount = static_cast<uint32_t>(domainTable.size());
+    header.tokenBucketCount = static_cast<uint32_t>(tokenTable.size());
+    header.untokenizedFirst = static_cast<uint32_t>(postings.size());
+    header.untokenizedCount = static_cast<uint32_t>(untokenized.size());
+    postings.insert(postings.end(), untokenized.begin(), untokenized.end());
+    header.postingCount = static_cast<uint32_t>(postings.size());
+    header.stringPoolSize = static_cast<uint32_t>(stringPool.size());
+
+    header.rulesOffset = sizeof(FilterFileHeader);
+    header.domainTableOffset = header.rulesOffset + header.ruleCount * sizeof(FilterRule);
+    header.domainTableOffset = (header.domainTableOffset + 7) & ~7u;
+    header.tokenTableOffset = header.domainTableOffset + header.domainBucketCount * sizeof(FilterBucket);
+    header.postingsOffset = header.tokenTableOffset + header.tokenBucketCount * sizeof(FilterBucket);
+    header.stringPoolOffset = header.postingsOffset + header.postingCount * sizeof(uint32_t);
+
+    std::vector<uint8_t> file(header.stringPoolOffset + header.stringPoolSize, 0);
+    memcpy(file.data(), &header, sizeof(header));
+    std::copy(fileRules.begin(), fileRules.end(), reinterpret_cast<FilterRule*>(file.data() + header.rulesOffset));
+    std::copy(domainTable.begin(), domainTable.end(), reinterpret_cast<FilterBucket*>(file.data() + header.domainTableOffset));
+    std::copy(tokenTable.begin(), tokenTable.end(), reinterpret_cast<FilterBucket*>(file.data() + header.tokenTableOffset));
+    std::copy(postings.begin(), postings.end(), reinterpret_cast<uint32_t*>(file.data() + header.postingsOffset));
+    std::copy(stringPool.begin(), stringPool.end(), file.data() + header.stringPoolOffset);
+
+    ruleCount = header.ruleCount;
+    return file;
+}
+
+FilterRequest FilterMatcher::MakeRequest(const std::string& url, const std::string& documentUrl, uint32_t resourceType, bool isTopLevelDocument)
+{
+    FilterRequest request;
+    request.url = url;
+    request.host = GetHost(url);
+    request.documentHost = GetHost(documentUrl);
+    request.resourceType = resourceType;
+    request.isTopLevelDocument = isTopLevelDocument;
+
+    return request;
+}
+
+bool FilterMatcher::Attach(const uint8_t* data, size_t size)
+{
+    Detach();
+    if (size < sizeof(FilterFileHeader))
+    {
+        return false;
+    }
+
+    const FilterFileHeader* header = reinterpret_cast<const FilterFileHeader*>(data);
+    bool isValid = header->magic == FILTER_FILE_MAGIC && header->version == FILTER_FILE_VERSION &&
+        (header->domainBucketCount & (header->domainBucketCount - 1)) == 0 &&
+        (header->tokenBucketCount & (header->tokenBucketCount - 1)) == 0 &&
+        header->rulesOffset % alignof(FilterRule) == 0 && header->postingsOffset % alignof(uint32_t) == 0 &&
+        header->domainTableOffset % alignof(FilterBucket) == 0 && header->tokenTableOffset % alignof(FilterBucket) == 0 &&
+        header->rulesOffset + static_cast<uint64_t>(header->ruleCount) * sizeof(FilterRule) <= header->domainTableOffset &&
+        header->domainTableOffset + static_cast<uint64_t>(header->domainBucketCount) * sizeof(FilterBucket) <= header->tokenTableOffset &&
+        header->tokenTableOffset + static_cast<uint64_t>(header->tokenBucketCount) * sizeof(FilterBucket) <= header->postingsOffset &&
+        header->postingsOffset + static_cast<uint64_t>(header->postingCount) * sizeof(uint32_t) <= header->stringPoolOffset &&
+        header->stringPoolOffset + static_cast<uint64_t>(header->stringPoolSize) <= size &&
+        static_cast<uint64_t>(header->untokenizedFirst) + header->untokenizedCount <= header->postingCount;
+
+    if (!isValid)
+    {
+        return false;
+    }
+
+    // Then everything the sections point at, a truncated or corrupt file
+    // mustn't send matching outside the mapping
+    const FilterRule* rules = reinterpret_cast<const FilterRule*>(data + header->rulesOffset);
+    const FilterBucket* domainTable = reinterpret_cast<const FilterBucket*>(data + header->domainTableOffset);
+    const FilterBucket* tokenTable = reinterpret_cast<const FilterBucket*>(data + header->tokenTableOffset);
+    const uint32_t* postings = reinterpret_cast<const uint32_t*>(data + header->postingsOffset);
+
+    for (uint32_t i = 0; i < header->ruleCount; ++i)
+    {
+        if (static_cast<uint64_t>(rules[i].patternOffset) + rules[i].patternLength > header->stringPoolSize)
+        {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < header->postingCount; ++i)
+    {
+        if (postings[i] >= header->ruleCount)
+        {
+            return false;
+        }
+    }
+
+    if (!AreBucketsValid(domainTable, header->domainBucketCount, header->postingCount) ||
+        !AreBucketsValid(tokenTable, header->tokenBucketCount, header->postingCount))
+    {
+        return false;
+    }
+
+    m_header = header;
+    m_rules = rules;
+    m_domainTable = domainTable;
+    m_tokenTable = tokenTable;
+    m_postings = postings;
+    m_stringPool = reinterpret_cast<const char*>(data + header->stringPoolOffset);
+
+    return true;
+}
+
+void FilterMatcher::Detach()
+{
+    m_header = nullptr;
+    m_rules = nullptr;
+    m_domainTable = nullptr;
+    m_tokenTable = nullptr;
+    m_postings = nullptr;
+    m_stringPool = nullptr;
+}
+
+bool FilterMatcher::ShouldBlock(const FilterRequest& request) const
+{
+    if (!IsAttached() || request.host.empty())
+    {
+        return false;
+    }
+
+    // Unique token hashes of the URL
+    std::vector<uint64_t> tokens;
+    size_t i = 0;
+    while (i < request.url.size())
+    {
+        if (!IsTokenChar(request.url[i]))
+        {
+            ++i;
+            continue;
+        }
+
+        size_t start = i;
+        while (i < request.url.size() && IsTokenChar(request.url[i]))
+        {
+            ++i;
+        }
+
+        if (i - start >= 2)
+        {
+            uint64_t token = HashString(request.url.c_str() + start, i - start);
+            if (std::find(tokens.begin(), tokens.end(), token) == tokens.end())
+            {
+                tokens.push_back(token);
+            }
+        }
+    }
+
+    return MatchAny(request, tokens, false) && !MatchAny(request, tokens, true);
+}
+const FilterBucket* FilterMatcher::FindBucket(const FilterBucket* table, uint32_t bucketCount, uint64_t key) const
+{
+    uint32_t mask = bucketCount - 1;
+    uint32_t slot = static_cast<uint32_t>(key) & mask;
+    for (uint32_t probes = 0; probes < bucketCount; ++probes)
+    {
+        const FilterBucket& bucket = table[slot];
+        if (bucket.key == key)
+        {
+            return &bucket;
+        }
+
+        if (bucket.key == 0)
+        {
+            return nullptr;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    return nullptr;
+}
+
+bool FilterMatcher::MatchPostings(uint32_t first, uint32_t count, const FilterRequest& request, bool exceptions) const
+{
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+        const FilterRule& rule = m_rules[m_postings[i]];
+        if (((rule.flags & FILTER_RULE_EXCEPTION) != 0) == exceptions && MatchRule(rule, request))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool FilterMatcher::MatchRule(const FilterRule& rule, const FilterRequest& request) const
+{
+    if (!(rule.contextMask & ContextBit(request.resourceType)))
+    {
+        return false;
+    }
+
+    // Generic rules never block the page the user navigated to
+    if (request.isTopLevelDocument && !(rule.flags & FILTER_RULE_DOCUMENT))
+    {
+        return false;
+    }
+
+    if (rule.flags & (FILTER_RULE_THIRD_PARTY | FILTER_RULE_FIRST_PARTY))
+    {
+        bool isThirdParty = !request.documentHost.empty() &&
+            GetSiteForHost(request.host) != GetSiteForHost(request.documentHost);
+        if ((rule.flags & FILTER_RULE_THIRD_PARTY) && !isThirdParty)
+        {
+            return false;
+        }
+
+        if ((rule.flags & FILTER_RULE_FIRST_PARTY) && isThirdParty)
+        {
+            return false;
+        }
+    }
+
+    // Domain table rules matched on the host already
+    if (rule.patternLength == 0)
+    {
+        return true;
+    }
+
+    if (rule.patternOffset + static_cast<uint64_t>(rule.patternLength) > m_header->stringPoolSize)
+    {
+        return false;
+    }
+
+    const char* pattern = m_stringPool + rule.patternOffset;
+    const char* patternEnd = pattern + rule.patternLength;
+    bool anchorEnd = (rule.flags & FILTER_RULE_ANCHOR_END) != 0;
+
+    if (rule.flags & FILTER_RULE_ANCHOR_START)
+    {
+        return MatchPatternAt(pattern, patternEnd, request.url, 0, anchorEnd);
+    }
+
+    if (rule.flags & FILTER_RULE_ANCHOR_DOMAIN)
+    {
+        // Start of the host or of any of its labels
+        size_t hostStart = request.url.find(request.host, request.url.find("://") + 3);
+        if (hostStart == std::string::npos)
+        {
+            return false;
+        }
+
+        size_t hostEnd = hostStart + request.host.size();
+        for (size_t position = hostStart; position < hostEnd; ++position)
+        {
+            if ((position == hostStart || request.url[position - 1] == '.') &&
+                MatchPatternAt(pattern, patternEnd, request.url, position, anchorEnd))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Unanchored: only try positions where the first literal character
+    // occurs, and the end for a separator placeholder
+    char first = *pattern;
+    for (size_t position = 0; position <= request.url.size(); ++position)
+    {
+        if ((first == '^' || (position < request.url.size() && request.url[position] == first)) &&
+            MatchPatternAt(pattern, patternEnd, request.url, position, anchorEnd))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool FilterMatcher::MatchAny(const FilterRequest& request, const std::vector<uint64_t>& tokens, bool exceptions) const
+{
+    // Host and each parent domain against the ||domain^ table
+    size_t labelStart = 0;
+    while (labelStart < request.host.size())
+    {
+        uint64_t key = HashString(request.host.c_str() + labelStart, request.host.size() - labelStart);
+        const FilterBucket* bucket = FindBucket(m_domainTable, m_header->domainBucketCount, key);
+        if (bucket && MatchPostings(bucket->first, bucket->count, request, exceptions))
+        {
+            return true;
+        }
+
+        size_t dot = request.host.find('.', labelStart);
+        if (dot == std::string::npos)
+        {
+            break;
+        }
+
+        labelStart = dot + 1;
+    }
+
+    for (uint64_t token : tokens)
+    {
+        const FilterBucket* bucket = FindBucket(m_tokenTable, m_header->tokenBucketCount, token);
+        if (bucket && MatchPostings(bucket->first, bucket->count, request, exceptions))
+        {
+            return true;
+        }
+    }
+
+    return MatchPostings(m_header->untokenizedFirst, m_header->untokenizedCount, request, exceptions);
+}
@@ -0,0 +1,128 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+// Standard library only, so the matcher also builds for the benchmark in
+// tools/native
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Compiled filter list layout. Everything is addressed by offsets from the
+// start of the file so it can be used straight from a mapped view.
+//
+//   FilterFileHeader
+//   FilterRule     rules[ruleCount]
+//   FilterBucket   domainTable[domainBucketCount]   ||domain^ rules by host hash
+//   FilterBucket   tokenTable[tokenBucketCount]     other rules by token hash
+//   uint32_t       postings[postingCount]           rule indices for the buckets
+//   char           stringPool[stringPoolSize]       lowercase patterns
+#define FILTER_FILE_MAGIC 0x4C465657  // 'WVFL'
+#define FILTER_FILE_VERSION 1
+
+#define FILTER_RULE_EXCEPTION 0x01
+#define FILTER_RULE_THIRD_PARTY 0x02
+#define FILTER_RULE_FIRST_PARTY 0x04
+#define FILTER_RULE_ANCHOR_START 0x08
+#define FILTER_RULE_ANCHOR_END 0x10
+#define FILTER_RULE_ANCHOR_DOMAIN 0x20
+#define FILTER_RULE_DOCUMENT 0x40  // Rule explicitly applies to top level documents
+
+// Resource types rules can be limited to, numbered like
+// COREWEBVIEW2_WEB_RESOURCE_CONTEXT
+enum FilterResourceType : uint32_t
+{
+    FILTER_RESOURCE_DOCUMENT = 1,
+    FILTER_RESOURCE_STYLESHEET = 2,
+    FILTER_RESOURCE_IMAGE = 3,
+    FILTER_RESOURCE_MEDIA = 4,
+    FILTER_RESOURCE_FONT = 5,
+    FILTER_RESOURCE_SCRIPT = 6,
+    FILTER_RESOURCE_XML_HTTP_REQUEST = 7,
+    FILTER_RESOURCE_FETCH = 8,
+    FILTER_RESOURCE_WEBSOCKET = 11,
+    FILTER_RESOURCE_PING = 14,
+    FILTER_RESOURCE_OTHER = 16
+};
+
+struct FilterFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ruleCount;
+    uint32_t domainBucketCount;
+    uint32_t tokenBucketCount;
+    uint32_t postingCount;
+    uint32_t stringPoolSize;
+    uint32_t untokenizedFirst;  // Rules without a usable token, checked for every URL
+    uint32_t untokenizedCount;
+    uint32_t rulesOffset;
+    uint32_t domainTableOffset;
+    uint32_t tokenTableOffset;
+    uint32_t postingsOffset;
+    uint32_t stringPoolOffset;
+};
+
+struct FilterRule
+{
+    uint32_t patternOffset;
+    uint16_t patternLength;
+    uint16_t flags;
+    uint32_t contextMask;  // Bit per FilterResourceType
+};
+
+struct FilterBucket
+{
+    uint64_t key;  // 0 marks an empty bucket
+    uint32_t first;
+    uint32_t count;
+};
+
+struct FilterRequest
+{
+    std::string url;  // Lowercase
+    std::string host;
+    std::string documentHost;
+    uint32_t resourceType;
+    bool isTopLevelDocument;
+};
+
+// Matches requests against a compiled filter list in memory: host suffixes
+// are looked up in the domain table and the URL's alphanumeric tokens in the
+// token table, so only a handful of patterns are ever compared per request.
+// The memory belongs to the caller, see ContentFilter for the mapped file.
+class FilterMatcher
+{
+public:
+    // Compiles EasyList style rules into the layout above. Comments,
+    // cosmetic rules and rules with options the layout can't express are
+    // skipped.
+    static std::vector<uint8_t> Compile(const std::vector<std::string>& lines, uint32_t& ruleCount);
+    // |url| and |documentUrl| in lowercase ASCII
+    static FilterRequest MakeRequest(const std::string& url, const std::string& documentUrl, uint32_t resourceType, bool isTopLevelDocument);
+
+    // Validates the layout once so matching needs no bounds checks
+    bool Attach(const uint8_t* data, size_t size);
+    void Detach();
+    bool IsAttached() const { return m_header != nullptr; }
+    uint32_t GetRuleCount() const { return m_header ? m_header->ruleCount : 0; }
+
+    // True if a block rule matches and no exception rule does
+    bool ShouldBlock(const FilterRequest& request) const;
+
+protected:
+    const FilterFileHeader* m_header = nullptr;
+    const FilterRule* m_rules = nullptr;
+    const FilterBucket* m_domainTable = nullptr;
+    const FilterBucket* m_tokenTable = nullptr;
+    const uint32_t* m_postings = nullptr;
+    const char* m_stringPool = nullptr;
+
+    const FilterBucket* FindBucket(const FilterBucket* table, uint32_t bucketCount, uint64_t key) const;
+    bool MatchPostings(uint32_t first, uint32_t count, const FilterRequest& request, bool exceptions) const;
+    bool MatchRule(const FilterRule& rule, const FilterRequest& request) const;
+    // True if any block rule (or exception rule, if |exceptions|) matches
+    bool MatchAny(const FilterRequest& request, const std::vector<uint64_t>& tokens, bool exceptions) const;
+};
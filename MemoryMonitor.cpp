@@ -0,0 +1,87 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "MemoryMonitor.h"
+#include <psapi.h>
+
+void MemoryMonitor::Init(HWND hWnd, ICoreWebView2Environment* env)
+{
+    // Process info needs a newer runtime, without it nothing is measured
+    // and the budget is never exceeded
+    if (FAILED(env->QueryInterface(IID_PPV_ARGS(&m_env))))
+    {
+        OutputDebugString(L"Process info not available, memory budget disabled\n");
+        return;
+    }
+
+    SetTimer(hWnd, c_timerId, c_sampleInterval, nullptr);
+}
+
+HRESULT MemoryMonitor::Sample()
+{
+    if (!m_env)
+    {
+        return S_OK;
+    }
+
+    Microsoft::WRL::ComPtr<ICoreWebView2ProcessInfoCollection> processInfos;
+    RETURN_IF_FAILED(m_env->GetProcessInfos(&processInfos));
+
+    UINT32 count = 0;
+    RETURN_IF_FAILED(processInfos->get_Count(&count));
+
+    std::vector<ProcessMemoryUsage> processes;
+    uint64_t totalBytes = 0;
+    for (UINT32 i = 0; i < count; ++i)
+    {
+        Microsoft::WRL::ComPtr<ICoreWebView2ProcessInfo> processInfo;
+        INT32 processId = 0;
+        ProcessMemoryUsage usage;
+        if (FAILED(processInfos->GetValueAtIndex(i, &processInfo)) ||
+            FAILED(processInfo->get_ProcessId(&processId)) || FAILED(processInfo->get_Kind(&usage.kind)))
+        {
+            continue;
+        }
+
+        // The process may be gone already
+        wil::unique_handle process(OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, static_cast<DWORD>(processId)));
+        PROCESS_MEMORY_COUNTERS_EX counters = {};
+        if (!process || !GetProcessMemoryInfo(process.get(),
+            reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters)))
+        {
+            continue;
+        }
+
+        usage.processId = static_cast<uint32_t>(processId);
+        usage.privateBytes = counters.PrivateUsage;
+        totalBytes += usage.privateBytes;
+        processes.push_back(usage);
+    }
+
+    m_processes.swap(processes);
+    m_totalBytes = totalBytes;
+
+    return S_OK;
+}
+
+void MemoryMonitor::LogStats(size_t suspendedTabs, size_t discardedTabs) const
+{
+    uint64_t renderers = 0;
+    uint64_t rendererBytes = 0;
+    for (const ProcessMemoryUsage& process : m_processes)
+    {
+        if (process.kind == COREWEBVIEW2_PROCESS_KIND_RENDERER)
+        {
+            ++renderers;
+            rendererBytes += process.privateBytes;
+        }
+    }
+
+    WCHAR log[256];
+    StringCchPrintf(log, ARRAYSIZE(log),
+        L"Memory: %llu MB of %llu MB budget in %llu processes (%llu MB in %llu renderers), %llu tabs suspended, %llu discarded\n",
+        m_totalBytes >> 20, m_budgetBytes >> 20, static_cast<uint64_t>(m_processes.size()), rendererBytes >> 20, renderers,
+        static_cast<uint64_t>(suspendedTabs), static_cast<uint64_t>(discardedTabs));
+    OutputDebugString(log);
+}
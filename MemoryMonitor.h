@@ -0,0 +1,45 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+
+struct ProcessMemoryUsage
+{
+    uint32_t processId = 0;
+    COREWEBVIEW2_PROCESS_KIND kind = COREWEBVIEW2_PROCESS_KIND_BROWSER;
+    uint64_t privateBytes = 0;
+};
+
+// Periodically measures the processes of the tabs' WebView2 environment
+// against a memory budget, BrowserSettings::memoryBudget. The browser window
+// decides what to give back
+// when it is exceeded: background tabs are suspended, and the least
+// recently used one is discarded.
+class MemoryMonitor
+{
+public:
+    static const UINT_PTR c_timerId = 1;
+    static const UINT c_sampleInterval = 15 * 1000;  // ms
+    // Background tabs are suspended after this long even under budget
+    static constexpr double c_suspendAfter = 5 * 60 * 1000;  // ms
+
+    // Starts a WM_TIMER with c_timerId on |hWnd|
+    void Init(HWND hWnd, ICoreWebView2Environment* env);
+    HRESULT Sample();
+    // 0 for no budget
+    void SetBudget(uint64_t budgetBytes) { m_budgetBytes = budgetBytes; }
+
+    uint64_t GetTotalBytes() const { return m_totalBytes; }
+    bool IsOverBudget() const { return m_budgetBytes && m_totalBytes > m_budgetBytes; }
+    const std::vector<ProcessMemoryUsage>& GetProcesses() const { return m_processes; }
+    void LogStats(size_t suspendedTabs, size_t discardedTabs) const;
+
+protected:
+    Microsoft::WRL::ComPtr<ICoreWebView2Environment8> m_env;
+    std::vector<ProcessMemoryUsage> m_processes;
+    uint64_t m_totalBytes = 0;
+    uint64_t m_budgetBytes = 0;
+};
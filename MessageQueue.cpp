@@ -0,0 +1,159 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "MessageQueue.h"
+
+void MessageQueue::SetTarget(ICoreWebView2* webview)
+{
+    m_target = webview;
+    m_ready = false;
+}
+
+HRESULT MessageQueue::SetReady(bool ready)
+{
+    m_ready = ready;
+    return IsReady() ? Flush() : S_OK;
+}
+
+HRESULT MessageQueue::Post(const web::json::value& jsonObj)
+{
+    if (IsReady())
+    {
+        // Anything still waiting goes first
+        HRESULT hr = Flush();
+        HRESULT postHr = m_target->PostWebMessageAsJson(jsonObj.serialize().c_str());
+        if (FAILED(postHr))
+        {
+            ++m_failed;
+        }
+        return FAILED(postHr) ? postHr : hr;
+    }
+
+    Message message = MakeMessage(jsonObj);
+    if (m_messages.size() >= c_capacity)
+    {
+        m_messages.push_back(std::move(message));
+        Collapse();
+        if (m_messages.size() > c_capacity)
+        {
+            // Nothing superseded the new one
+            m_messages.pop_back();
+            ++m_dropped;
+
+            WCHAR log[128];
+            StringCchPrintf(log, ARRAYSIZE(log), L"Message queue full, dropped a message (%llu so far)\n", m_dropped);
+            OutputDebugString(log);
+            return S_FALSE;
+        }
+    }
+    else
+    {
+        m_messages.push_back(std::move(message));
+    }
+
+    ++m_queued;
+    m_peakDepth = (std::max)(m_peakDepth, m_messages.size());
+    return S_FALSE;
+}
+
+web::json::value MessageQueue::ToJson() const
+{
+    web::json::value queue = web::json::value::object();
+    queue[L"ready"] = web::json::value::boolean(IsReady());
+    queue[L"depth"] = web::json::value::number(m_messages.size());
+    queue[L"peakDepth"] = web::json::value::number(m_peakDepth);
+    queue[L"queued"] = web::json::value::number(m_queued);
+    queue[L"collapsed"] = web::json::value::number(m_collapsed);
+    queue[L"dropped"] = web::json::value::number(m_dropped);
+    queue[L"failed"] = web::json::value::number(m_failed);
+    return queue;
+}
+
+MessageQueue::Message MessageQueue::MakeMessage(const web::json::value& jsonObj) const
+{
+    Message message;
+    message.json = jsonObj.serialize();
+
+    if (!jsonObj.has_field(L"message") || !jsonObj.at(L"message").is_integer() ||
+        m_stateMessages.count(jsonObj.at(L"message").as_integer()) == 0)
+    {
+        return message;
+    }
+
+    message.stateKey = std::to_wstring(jsonObj.at(L"message").as_integer());
+    if (jsonObj.has_field(L"args") && jsonObj.at(L"args").is_object())
+    {
+        const web::json::value& args = jsonObj.at(L"args");
+        if (args.has_field(L"tabId"))
+        {
+            message.stateKey += L":" + args.at(L"tabId").serialize();
+        }
+
+        for (const auto& field : args.as_object())
+        {
+            message.fields.push_back(field.first);
+        }
+        std::sort(message.fields.begin(), message.fields.end());
+    }
+
+    return message;
+}
+
+void MessageQueue::Collapse()
+{
+    // Newest first, so each message meets the latest of its kind before
+    // the ones it supersedes. One with fewer fields, like a URI update
+    // without the history entries, doesn't supersede a fuller one.
+    std::map<std::wstring, const std::vector<std::wstring>*> latest;
+    std::deque<Message> kept;
+    for (auto message = m_messages.rbegin(); message != m_messages.rend(); ++message)
+    {
+        if (!message->stateKey.empty())
+        {
+            auto newer = latest.find(message->stateKey);
+            if (newer != latest.end() && std::includes(newer->second->begin(), newer->second->end(),
+                message->fields.begin(), message->fields.end()))
+            {
+                ++m_collapsed;
+                continue;
+            }
+        }
+
+        kept.push_front(std::move(*message));
+        if (!kept.front().stateKey.empty())
+        {
+            latest[kept.front().stateKey] = &kept.front().fields;
+        }
+    }
+
+    m_messages.swap(kept);
+}
+
+HRESULT MessageQueue::Flush()
+{
+    if (m_messages.empty())
+    {
+        return S_OK;
+    }
+
+    WCHAR log[96];
+    StringCchPrintf(log, ARRAYSIZE(log), L"Posting %llu queued messages\n", static_cast<uint64_t>(m_messages.size()));
+    OutputDebugString(log);
+
+    // A message the WebView won't take is counted and dropped, left at the
+    // head it would hold up everything after it
+    HRESULT result = S_OK;
+    while (!m_messages.empty())
+    {
+        HRESULT hr = m_target->PostWebMessageAsJson(m_messages.front().json.c_str());
+        m_messages.pop_front();
+        if (FAILED(hr))
+        {
+            ++m_failed;
+            result = SUCCEEDED(result) ? hr : result;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,66 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+#include <deque>
+#include <set>
+
+// Messages from the host to one WebView, held back until its page listens.
+// Tabs report their navigations as soon as the content environment is up,
+// which is before the controls WebView exists, and a page that's still
+// loading misses whatever is posted to it; both lose messages otherwise.
+//
+// The queue is bounded. When it's full, older state messages (a tab's URI,
+// title or load state, say) are dropped for the newest of the same kind and
+// tab, which carries everything they did; what still doesn't fit is dropped.
+// Producers of periodic updates hold theirs back while IsBackedUp.
+class MessageQueue
+{
+public:
+    static const size_t c_capacity = 512;
+    static const size_t c_backedUpDepth = c_capacity * 3 / 4;
+
+    // |stateMessages| are the message codes where only the latest per tab
+    // matters
+    explicit MessageQueue(std::set<int> stateMessages) : m_stateMessages(std::move(stateMessages)) {}
+
+    void SetTarget(ICoreWebView2* webview);
+    // Posts what's waiting once ready; the target isn't ready again until
+    // its next page is
+    HRESULT SetReady(bool ready);
+    bool IsReady() const { return m_ready && m_target; }
+    // S_OK if posted, S_FALSE if queued or dropped. Messages still queued
+    // are posted first whenever the target is ready.
+    HRESULT Post(const web::json::value& jsonObj);
+    bool IsBackedUp() const { return m_messages.size() >= c_backedUpDepth; }
+
+    size_t GetDepth() const { return m_messages.size(); }
+    uint64_t GetDropped() const { return m_dropped; }
+    web::json::value ToJson() const;
+
+protected:
+    struct Message
+    {
+        std::wstring json;
+        std::wstring stateKey;  // Empty unless a state message
+        std::vector<std::wstring> fields;  // Of its args, sorted
+    };
+
+    std::set<int> m_stateMessages;
+    Microsoft::WRL::ComPtr<ICoreWebView2> m_target;
+    bool m_ready = false;
+    std::deque<Message> m_messages;
+    size_t m_peakDepth = 0;
+    uint64_t m_queued = 0;
+    uint64_t m_collapsed = 0;
+    uint64_t m_dropped = 0;
+    uint64_t m_failed = 0;  // Refused by the WebView
+
+    Message MakeMessage(const web::json::value& jsonObj) const;
+    // Drops the state messages a later one supersedes
+    void Collapse();
+    HRESULT Flush();
+};
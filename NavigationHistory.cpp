@@ -0,0 +1,209 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "NavigationHistory.h"
+
+namespace
+{
+    std::wstring GetString(const web::json::value& object, const wchar_t* key)
+    {
+        if (object.is_object() && object.has_field(key) && object.at(key).is_string())
+        {
+            return object.at(key).as_string();
+        }
+
+        return std::wstring();
+    }
+}
+
+void NavigationHistory::Update(const web::json::value& history)
+{
+    if (!history.has_field(L"entries") || !history.at(L"entries").is_array() ||
+        !history.has_field(L"currentIndex") || !history.at(L"currentIndex").is_integer())
+    {
+        return;
+    }
+
+    std::vector<NavigationEntry> entries;
+    for (const web::json::value& item : history.at(L"entries").as_array())
+    {
+        if (!item.has_field(L"id") || !item.at(L"id").is_integer())
+        {
+            continue;
+        }
+
+        NavigationEntry entry;
+        entry.id = item.at(L"id").as_integer();
+        entry.uri = GetString(item, L"url");
+        entry.title = GetString(item, L"title");
+
+        // Keep what was captured while the entry was current
+        auto known = std::find_if(m_entries.begin(), m_entries.end(), [&entry](const NavigationEntry& knownEntry)
+        {
+            return knownEntry.id == entry.id;
+        });
+        if (known != m_entries.end())
+        {
+            entry.favicon = known->favicon;
+            entry.securityState = known->securityState;
+            entry.scrollX = known->scrollX;
+            entry.scrollY = known->scrollY;
+            if (entry.title.empty())
+            {
+                entry.title = known->title;
+            }
+        }
+
+        entries.push_back(entry);
+    }
+
+    m_entries.swap(entries);
+
+    int currentIndex = history.at(L"currentIndex").as_integer();
+    m_currentIndex = m_entries.empty() || currentIndex < 0 ? 0 :
+        (std::min)(static_cast<size_t>(currentIndex), m_entries.size() - 1);
+
+    NavigationEntry* documentEntry = FindDocumentEntry();
+    if (documentEntry)
+    {
+        MergeDocument(*documentEntry);
+    }
+}
+
+void NavigationHistory::SetDocument(const std::wstring& uri)
+{
+    if (m_document.uri.compare(uri) == 0)
+    {
+        return;
+    }
+
+    m_document = NavigationEntry();
+    m_document.uri = uri;
+}
+
+void NavigationHistory::SetTitle(const std::wstring& title)
+{
+    m_document.title = title;
+
+    NavigationEntry* documentEntry = FindDocumentEntry();
+    if (documentEntry)
+    {
+        documentEntry->title = title;
+    }
+}
+
+void NavigationHistory::SetFavicon(const std::wstring& favicon)
+{
+    m_document.favicon = favicon;
+
+    NavigationEntry* documentEntry = FindDocumentEntry();
+    if (documentEntry)
+    {
+        documentEntry->favicon = favicon;
+    }
+}
+
+void NavigationHistory::SetSecurityState(const std::wstring& securityState)
+{
+    m_document.securityState = securityState;
+
+    NavigationEntry* documentEntry = FindDocumentEntry();
+    if (documentEntry)
+    {
+        documentEntry->securityState = securityState;
+    }
+}
+
+void NavigationHistory::SetScrollPosition(const std::wstring& uri, double x, double y)
+{
+    if (m_document.uri.compare(uri) != 0)
+    {
+        return;
+    }
+
+    m_document.scrollX = x;
+    m_document.scrollY = y;
+
+    NavigationEntry* documentEntry = FindDocumentEntry();
+    if (documentEntry)
+    {
+        documentEntry->scrollX = x;
+        documentEntry->scrollY = y;
+    }
+}
+
+const NavigationEntry* NavigationHistory::Go(int offset)
+{
+    if (offset < 0 && static_cast<size_t>(-offset) > m_currentIndex)
+    {
+        return nullptr;
+    }
+
+    return GoToIndex(m_currentIndex + offset);
+}
+
+const NavigationEntry* NavigationHistory::GoToIndex(size_t index)
+{
+    if (index >= m_entries.size())
+    {
+        return nullptr;
+    }
+
+    m_currentIndex = index;
+    return &m_entries[index];
+}
+
+NavigationEntry NavigationHistory::GetCurrentEntry() const
+{
+    if (m_currentIndex < m_entries.size() &&
+        (m_document.uri.empty() || m_entries[m_currentIndex].uri.compare(m_document.uri) == 0))
+    {
+        return m_entries[m_currentIndex];
+    }
+
+    return m_document;
+}
+
+void NavigationHistory::RestoreDocument(const NavigationEntry& entry)
+{
+    m_document = entry;
+    m_document.id = 0;
+}
+
+NavigationEntry* NavigationHistory::FindDocumentEntry()
+{
+    if (m_currentIndex >= m_entries.size() || m_document.uri.empty())
+    {
+        return nullptr;
+    }
+
+    NavigationEntry& current = m_entries[m_currentIndex];
+    return current.uri.compare(m_document.uri) == 0 ? &current : nullptr;
+}
+
+void NavigationHistory::MergeDocument(NavigationEntry& entry) const
+{
+    // Only what was captured for this document, an entry revisited keeps
+    // its old state until the page reports again
+    if (!m_document.title.empty())
+    {
+        entry.title = m_document.title;
+    }
+
+    if (!m_document.favicon.empty())
+    {
+        entry.favicon = m_document.favicon;
+    }
+
+    if (!m_document.securityState.empty())
+    {
+        entry.securityState = m_document.securityState;
+    }
+
+    if (m_document.scrollX >= 0 && m_document.scrollY >= 0)
+    {
+        entry.scrollX = m_document.scrollX;
+        entry.scrollY = m_document.scrollY;
+    }
+}
@@ -0,0 +1,69 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+
+struct NavigationEntry
+{
+    int id = 0;  // DevTools navigation entry ID
+    std::wstring uri;
+    std::wstring title;
+    std::wstring favicon;
+    std::wstring securityState;
+    // Last reported scroll offset, -1 until the page reports one
+    double scrollX = -1;
+    double scrollY = -1;
+};
+
+// Host side copy of a tab's back/forward list. Its shape comes from
+// Page.getNavigationHistory whenever the WebView's history changes; the
+// state the WebView doesn't keep per entry (favicon, security state, scroll
+// position) is captured while an entry is current and carried over those
+// refreshes. Back/forward moves it ahead of the WebView so the controls UI
+// can show where the user is going before the navigation commits.
+class NavigationHistory
+{
+public:
+    static const size_t c_maxMenuItems = 15;
+
+    // |history| is the result of Page.getNavigationHistory
+    void Update(const web::json::value& history);
+
+    // A new document committed in the tab
+    void SetDocument(const std::wstring& uri);
+    void SetTitle(const std::wstring& title);
+    void SetFavicon(const std::wstring& favicon);
+    void SetSecurityState(const std::wstring& securityState);
+    // Ignored unless |uri| is still the committed document
+    void SetScrollPosition(const std::wstring& uri, double x, double y);
+
+    // Move the current entry ahead of the WebView. Returns nullptr, and
+    // leaves the list as it is, when there is no such entry.
+    const NavigationEntry* Go(int offset);
+    const NavigationEntry* GoToIndex(size_t index);
+
+    // The current entry, or what is known of the document if the list
+    // doesn't have it yet
+    NavigationEntry GetCurrentEntry() const;
+    // Seed the document state of a reopened tab before it loads |entry|
+    void RestoreDocument(const NavigationEntry& entry);
+
+    const std::vector<NavigationEntry>& GetEntries() const { return m_entries; }
+    size_t GetCurrentIndex() const { return m_currentIndex; }
+    bool CanGoBack() const { return m_currentIndex > 0; }
+    bool CanGoForward() const { return m_currentIndex + 1 < m_entries.size(); }
+
+protected:
+    std::vector<NavigationEntry> m_entries;
+    size_t m_currentIndex = 0;
+    // What has been captured for the committed document. The list may not
+    // have its entry yet, it's merged in on the next update.
+    NavigationEntry m_document;
+
+    // The current entry, if it is the committed document
+    NavigationEntry* FindDocumentEntry();
+    void MergeDocument(NavigationEntry& entry) const;
+};
@@ -0,0 +1,243 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "BrowserWindow.h"
+#include "NavigationPredictor.h"
+
+using namespace Microsoft::WRL;
+
+void NavigationPredictor::Init(HWND hWnd, ControllerPool* pool)
+{
+    m_hWnd = hWnd;
+    m_pool = pool;
+}
+
+HRESULT NavigationPredictor::HandlePrediction(const std::wstring& uri, double confidence, PreloadMode mode)
+{
+    std::wstring origin = GetOrigin(uri);
+    if (mode == PreloadMode::Off || origin.empty())
+    {
+        return S_OK;
+    }
+
+    ++m_predictions;
+
+    if (confidence >= c_preconnectThreshold)
+    {
+        RETURN_IF_FAILED(Preconnect(origin));
+    }
+
+    if (mode == PreloadMode::Prerender && confidence >= c_prerenderThreshold)
+    {
+        Prerender(uri);
+    }
+
+    return S_OK;
+}
+
+std::unique_ptr<Tab> NavigationPredictor::TakePrerenderedTab(const std::wstring& uri, bool canSwapIn)
+{
+    ++m_navigations;
+
+    std::wstring origin = GetOrigin(uri);
+    if (!origin.empty() && std::find(m_preconnectedOrigins.begin(), m_preconnectedOrigins.end(), origin) != m_preconnectedOrigins.end())
+    {
+        ++m_preconnectHits;
+    }
+
+    std::unique_ptr<Tab> prerenderedTab;
+    if (canSwapIn && m_prerenderTab && m_prerenderUri.compare(uri) == 0)
+    {
+        // The user would have waited for the whole load, or for as long as
+        // the prerender has been running if it isn't done yet
+        ++m_prerenderHits;
+        m_timeSaved += m_prerenderLoadTime >= 0 ? m_prerenderLoadTime : m_prerenderStopwatch.ElapsedMilliseconds();
+
+        prerenderedTab = std::move(m_prerenderTab);
+        m_prerenderUri.clear();
+    }
+    else
+    {
+        Discard();
+    }
+
+    LogStats();
+
+    return prerenderedTab;
+}
+
+void NavigationPredictor::HandlePrerenderCompleted()
+{
+    if (m_prerenderLoadTime < 0)
+    {
+        m_prerenderLoadTime = m_prerenderStopwatch.ElapsedMilliseconds();
+    }
+}
+
+void NavigationPredictor::Discard()
+{
+    if (m_prerenderTab)
+    {
+        m_prerenderTab->m_contentController->Close();
+        m_prerenderTab.reset();
+        ++m_prerenderDiscards;
+    }
+    else if (!m_prerenderUri.empty())
+    {
+        // Still waiting for a controller, it is closed when it arrives
+        ++m_prerenderDiscards;
+    }
+
+    m_prerenderUri.clear();
+}
+
+HRESULT NavigationPredictor::Preconnect(const std::wstring& origin)
+{
+    auto existing = std::find(m_preconnectedOrigins.begin(), m_preconnectedOrigins.end(), origin);
+    if (existing != m_preconnectedOrigins.end())
+    {
+        // Already warm, just keep it from being evicted
+        m_preconnectedOrigins.erase(existing);
+        m_preconnectedOrigins.push_back(origin);
+        return S_OK;
+    }
+
+    m_preconnectedOrigins.push_back(origin);
+    if (m_preconnectedOrigins.size() > c_maxPreconnectOrigins)
+    {
+        m_preconnectedOrigins.erase(m_preconnectedOrigins.begin());
+    }
+
+    ++m_preconnects;
+    return UpdatePreconnectDocument();
+}
+
+HRESULT NavigationPredictor::UpdatePreconnectDocument()
+{
+    if (!m_preconnectWebView)
+    {
+        if (!m_preconnectWebViewPending)
+        {
+            m_preconnectWebViewPending = true;
+            m_pool->Acquire([this](HRESULT result, ICoreWebView2Controller* controller)
+            {
+                m_preconnectWebViewPending = false;
+                if (FAILED(result) || FAILED(controller->get_CoreWebView2(&m_preconnectWebView)))
+                {
+                    return;
+                }
+
+                m_preconnectController = controller;
+                BrowserWindow::CheckFailure(UpdatePreconnectDocument(), L"");
+            });
+        }
+
+        return S_OK;
+    }
+
+    // The hidden WebView is in the same environment as the tabs, so the
+    // resolved hosts and open sockets are there for the real navigation.
+    std::wstring html(L"<!DOCTYPE html><html><head>");
+    for (const std::wstring& origin : m_preconnectedOrigins)
+    {
+        std::wstring escapedOrigin;
+        for (wchar_t c : origin)
+        {
+            switch (c)
+            {
+            case L'&': escapedOrigin.append(L"&amp;"); break;
+            case L'"': escapedOrigin.append(L"&quot;"); break;
+            case L'<': escapedOrigin.append(L"&lt;"); break;
+            case L'>': escapedOrigin.append(L"&gt;"); break;
+            default: escapedOrigin.push_back(c); break;
+            }
+        }
+
+        html.append(L"<link rel=\"dns-prefetch\" href=\"" + escapedOrigin + L"\">");
+        html.append(L"<link rel=\"preconnect\" href=\"" + escapedOrigin + L"\">");
+    }
+    html.append(L"</head></html>");
+
+    return m_preconnectWebView->NavigateToString(html.c_str());
+}
+
+void NavigationPredictor::Prerender(const std::wstring& uri)
+{
+    if (m_prerenderUri.compare(uri) == 0)
+    {
+        return;
+    }
+
+    if (m_prerenderTab)
+    {
+        Discard();
+    }
+
+    m_prerenderUri = uri;
+    m_prerenderLoadTime = -1;
+    m_prerenderStopwatch.Restart();
+    ++m_prerenders;
+
+    // A controller on its way is used for the newest candidate
+    if (m_prerenderAcquiring)
+    {
+        return;
+    }
+
+    m_prerenderAcquiring = true;
+    m_pool->Acquire([this](HRESULT result, ICoreWebView2Controller* controller)
+    {
+        m_prerenderAcquiring = false;
+        if (FAILED(result))
+        {
+            m_prerenderUri.clear();
+            return;
+        }
+
+        if (m_prerenderUri.empty())
+        {
+            controller->Close();
+            return;
+        }
+
+        m_prerenderTab = Tab::CreateWithController(m_hWnd, controller, c_prerenderTabId, m_prerenderUri);
+    });
+}
+
+void NavigationPredictor::LogStats() const
+{
+    WCHAR log[320];
+    StringCchPrintf(log, ARRAYSIZE(log),
+        L"Predictor: %llu navigations, %llu predictions, preconnect %llu hits / %llu origins, "
+        L"prerender %llu hits / %llu started (%llu discarded), %.0f ms saved, pool %llu hits / %llu misses\n",
+        m_navigations, m_predictions, m_preconnectHits, m_preconnects, m_prerenderHits, m_prerenders,
+        m_prerenderDiscards, m_timeSaved, m_pool->GetHits(), m_pool->GetMisses());
+    OutputDebugString(log);
+}
+
+std::wstring NavigationPredictor::GetOrigin(const std::wstring& uri)
+{
+    size_t schemeEnd = uri.find(L"://");
+    if (schemeEnd == std::wstring::npos)
+    {
+        return std::wstring();
+    }
+
+    std::wstring scheme = uri.substr(0, schemeEnd);
+    if (scheme.compare(L"http") != 0 && scheme.compare(L"https") != 0)
+    {
+        return std::wstring();
+    }
+
+    size_t hostStart = schemeEnd + 3;
+    size_t hostEnd = uri.find_first_of(L"/?#", hostStart);
+    std::wstring authority = uri.substr(hostStart, hostEnd == std::wstring::npos ? std::wstring::npos : hostEnd - hostStart);
+    size_t userInfoEnd = authority.rfind(L'@');
+    if (userInfoEnd != std::wstring::npos)
+    {
+        authority = authority.substr(userInfoEnd + 1);
+    }
+
+    return authority.empty() ? std::wstring() : scheme + L"://" + authority;
+}
@@ -0,0 +1,68 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+#include "BrowserSettings.h"
+#include "ControllerPool.h"
+#include "Stopwatch.h"
+#include "Tab.h"
+
+// Acts on the navigation predictions the controls UI makes while the user
+// types in the address bar. Likely origins get DNS prefetch and preconnect
+// through a hidden WebView sharing the tabs' network stack; with prerender
+// enabled the top candidate is also loaded in a hidden tab, which replaces
+// the active tab's WebView if the user commits to that URI.
+class NavigationPredictor
+{
+public:
+    // Never used by the controls UI, which counts tab IDs up from 1
+    static const size_t c_prerenderTabId = static_cast<size_t>(-1);
+    static constexpr double c_preconnectThreshold = 0.3;
+    static constexpr double c_prerenderThreshold = 0.7;
+    static const size_t c_maxPreconnectOrigins = 6;
+
+    void Init(HWND hWnd, ControllerPool* pool);
+    HRESULT HandlePrediction(const std::wstring& uri, double confidence, PreloadMode mode);
+    // Called for every committed address bar navigation. Returns the
+    // prerendered tab if it matches |uri| and |canSwapIn|; any other
+    // prerender is dropped.
+    std::unique_ptr<Tab> TakePrerenderedTab(const std::wstring& uri, bool canSwapIn);
+    void HandlePrerenderCompleted();
+    Tab* GetPrerenderedTab() const { return m_prerenderTab.get(); }
+    void Discard();
+
+protected:
+    HWND m_hWnd = nullptr;
+    ControllerPool* m_pool = nullptr;
+
+    Microsoft::WRL::ComPtr<ICoreWebView2Controller> m_preconnectController;
+    Microsoft::WRL::ComPtr<ICoreWebView2> m_preconnectWebView;
+    bool m_preconnectWebViewPending = false;
+    std::vector<std::wstring> m_preconnectedOrigins;  // Most recent last
+
+    std::unique_ptr<Tab> m_prerenderTab;
+    std::wstring m_prerenderUri;  // Also set while the prerender controller is being acquired
+    bool m_prerenderAcquiring = false;
+    Stopwatch m_prerenderStopwatch;
+    double m_prerenderLoadTime = -1;
+
+    // Report
+    uint64_t m_navigations = 0;
+    uint64_t m_predictions = 0;
+    uint64_t m_preconnects = 0;
+    uint64_t m_preconnectHits = 0;
+    uint64_t m_prerenders = 0;
+    uint64_t m_prerenderHits = 0;
+    uint64_t m_prerenderDiscards = 0;
+    double m_timeSaved = 0;
+
+    HRESULT Preconnect(const std::wstring& origin);
+    HRESULT UpdatePreconnectDocument();
+    void Prerender(const std::wstring& uri);
+    void LogStats() const;
+
+    static std::wstring GetOrigin(const std::wstring& uri);
+};
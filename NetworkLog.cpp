@@ -0,0 +1,316 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "NetworkLog.h"
+
+namespace
+{
+    double GetNumber(const web::json::value& object, const wchar_t* key, double fallback = 0)
+    {
+        if (object.is_object() && object.has_field(key) && object.at(key).is_number())
+        {
+            return object.at(key).as_double();
+        }
+
+        return fallback;
+    }
+
+    std::wstring GetString(const web::json::value& object, const wchar_t* key)
+    {
+        if (object.is_object() && object.has_field(key) && object.at(key).is_string())
+        {
+            return object.at(key).as_string();
+        }
+
+        return std::wstring();
+    }
+
+    double GetPhase(const web::json::value& timing, const wchar_t* startKey, const wchar_t* endKey)
+    {
+        double start = GetNumber(timing, startKey, -1);
+        double end = GetNumber(timing, endKey, -1);
+
+        return (start >= 0 && end >= start) ? end - start : -1;
+    }
+}
+
+const std::vector<BulkColumn>& NetworkLog::Columns()
+{
+    static const std::vector<BulkColumn> columns = {
+        { L"url", BulkColumnType::String },
+        { L"origin", BulkColumnType::String },
+        { L"method", BulkColumnType::String },
+        { L"type", BulkColumnType::String },
+        { L"mimeType", BulkColumnType::String },
+        { L"protocol", BulkColumnType::String },
+        { L"cache", BulkColumnType::String },
+        { L"error", BulkColumnType::String },
+        { L"status", BulkColumnType::Number },
+        { L"startTime", BulkColumnType::Number },
+        { L"responseTime", BulkColumnType::Number },
+        { L"endTime", BulkColumnType::Number },
+        { L"wallTime", BulkColumnType::Number },
+        { L"bytes", BulkColumnType::Number },
+        { L"dns", BulkColumnType::Number },
+        { L"connect", BulkColumnType::Number },
+        { L"ssl", BulkColumnType::Number },
+        { L"send", BulkColumnType::Number },
+        { L"wait", BulkColumnType::Number }
+    };
+
+    return columns;
+}
+
+NetworkLog::NetworkLog() : m_records(c_capacity)
+{
+}
+
+void NetworkLog::HandleRequestWillBeSent(const web::json::value& params)
+{
+    std::wstring requestId = GetString(params, L"requestId");
+    double timestamp = GetNumber(params, L"timestamp");
+
+    // A redirect reuses the request ID, close the previous hop first
+    NetworkRequestRecord* previous = FindInFlight(params);
+    if (previous && params.has_field(L"redirectResponse"))
+    {
+        previous->status = static_cast<int>(GetNumber(params.at(L"redirectResponse"), L"status"));
+        FinishRecord(*previous, timestamp);
+    }
+
+    NetworkRequestRecord& record = StartRecord(requestId);
+    if (params.has_field(L"request"))
+    {
+        const web::json::value& request = params.at(L"request");
+        record.url = GetString(request, L"url");
+        record.method = GetString(request, L"method");
+        record.origin = GetOrigin(record.url);
+    }
+
+    record.resourceType = GetString(params, L"type");
+    record.startTime = timestamp;
+    record.wallTime = GetNumber(params, L"wallTime");
+    record.cacheStatus = L"network";
+}
+
+void NetworkLog::HandleResponseReceived(const web::json::value& params)
+{
+    NetworkRequestRecord* record = FindInFlight(params);
+    if (!record || !params.has_field(L"response"))
+    {
+        return;
+    }
+
+    const web::json::value& response = params.at(L"response");
+    record->responseTime = GetNumber(params, L"timestamp");
+    record->status = static_cast<int>(GetNumber(response, L"status"));
+    record->mimeType = GetString(response, L"mimeType");
+    record->protocol = GetString(response, L"protocol");
+    record->encodedBytes = GetNumber(response, L"encodedDataLength");
+
+    if (response.has_field(L"fromServiceWorker") && response.at(L"fromServiceWorker").as_bool())
+    {
+        record->cacheStatus = L"service-worker";
+    }
+    else if (response.has_field(L"fromDiskCache") && response.at(L"fromDiskCache").as_bool())
+    {
+        record->cacheStatus = L"disk";
+    }
+
+    if (response.has_field(L"timing"))
+    {
+        const web::json::value& timing = response.at(L"timing");
+        record->dns = GetPhase(timing, L"dnsStart", L"dnsEnd");
+        record->connect = GetPhase(timing, L"connectStart", L"connectEnd");
+        record->ssl = GetPhase(timing, L"sslStart", L"sslEnd");
+        record->send = GetPhase(timing, L"sendStart", L"sendEnd");
+        record->wait = GetPhase(timing, L"sendEnd", L"receiveHeadersEnd");
+    }
+}
+
+void NetworkLog::HandleRequestServedFromCache(const web::json::value& params)
+{
+    NetworkRequestRecord* record = FindInFlight(params);
+    if (record)
+    {
+        record->cacheStatus = L"memory";
+    }
+}
+
+void NetworkLog::HandleLoadingFinished(const web::json::value& params)
+{
+    NetworkRequestRecord* record = FindInFlight(params);
+    if (!record)
+    {
+        return;
+    }
+
+    record->encodedBytes = GetNumber(params, L"encodedDataLength", record->encodedBytes);
+    FinishRecord(*record, GetNumber(params, L"timestamp"));
+}
+
+void NetworkLog::HandleLoadingFailed(const web::json::value& params)
+{
+    NetworkRequestRecord* record = FindInFlight(params);
+    if (!record)
+    {
+        return;
+    }
+
+    record->failed = true;
+    record->errorText = GetString(params, L"errorText");
+    FinishRecord(*record, GetNumber(params, L"timestamp"));
+}
+
+void NetworkLog::Clear()
+{
+    m_records.assign(c_capacity, NetworkRequestRecord());
+    m_inFlight.clear();
+    m_next = 0;
+    m_count = 0;
+}
+
+web::json::value NetworkLog::GetRequestsAsJson() const
+{
+    web::json::value requests = web::json::value::array(m_count);
+    size_t index = 0;
+
+    ForEachRecord([&](const NetworkRequestRecord& record)
+    {
+        web::json::value entry = web::json::value::object();
+        entry[L"url"] = web::json::value(record.url);
+        entry[L"origin"] = web::json::value(record.origin);
+        entry[L"method"] = web::json::value(record.method);
+        entry[L"type"] = web::json::value(record.resourceType);
+        entry[L"mimeType"] = web::json::value(record.mimeType);
+        entry[L"protocol"] = web::json::value(record.protocol);
+        entry[L"cache"] = web::json::value(record.cacheStatus);
+        entry[L"error"] = web::json::value(record.errorText);
+        entry[L"status"] = web::json::value::number(record.status);
+        entry[L"startTime"] = web::json::value::number(record.startTime);
+        entry[L"responseTime"] = web::json::value::number(record.responseTime);
+        entry[L"endTime"] = web::json::value::number(record.finished ? record.endTime : 0);
+        entry[L"wallTime"] = web::json::value::number(record.wallTime);
+        entry[L"bytes"] = web::json::value::number(record.encodedBytes);
+        entry[L"dns"] = web::json::value::number(record.dns);
+        entry[L"connect"] = web::json::value::number(record.connect);
+        entry[L"ssl"] = web::json::value::number(record.ssl);
+        entry[L"send"] = web::json::value::number(record.send);
+        entry[L"wait"] = web::json::value::number(record.wait);
+
+        requests[index++] = entry;
+    });
+
+    return requests;
+}
+
+web::json::value NetworkLog::GetOriginSummaryAsJson() const
+{
+    struct OriginSummary
+    {
+        size_t requests = 0;
+        size_t cached = 0;
+        size_t failed = 0;
+        size_t timed = 0;  // Finished, so with a duration
+        double bytes = 0;
+        double totalTime = 0;
+    };
+
+    std::map<std::wstring, OriginSummary> origins;
+    ForEachRecord([&](const NetworkRequestRecord& record)
+    {
+        OriginSummary& summary = origins[record.origin];
+        ++summary.requests;
+        summary.bytes += record.encodedBytes;
+
+        if (record.cacheStatus.compare(L"network") != 0)
+        {
+            ++summary.cached;
+        }
+
+        if (record.failed)
+        {
+            ++summary.failed;
+        }
+
+        if (record.finished)
+        {
+            ++summary.timed;
+            summary.totalTime += (record.endTime - record.startTime) * 1000;
+        }
+    });
+
+    web::json::value summaries = web::json::value::array(origins.size());
+    size_t index = 0;
+    for (const auto& origin : origins)
+    {
+        web::json::value entry = web::json::value::object();
+        entry[L"origin"] = web::json::value(origin.first);
+        entry[L"requests"] = web::json::value::number(origin.second.requests);
+        entry[L"cached"] = web::json::value::number(origin.second.cached);
+        entry[L"failed"] = web::json::value::number(origin.second.failed);
+        entry[L"bytes"] = web::json::value::number(origin.second.bytes);
+        entry[L"averageTime"] = web::json::value::number(
+            origin.second.timed ? origin.second.totalTime / origin.second.timed : 0.0);
+
+        summaries[index++] = entry;
+    }
+
+    return summaries;
+}
+
+NetworkRequestRecord* NetworkLog::FindInFlight(const web::json::value& params)
+{
+    auto it = m_inFlight.find(GetString(params, L"requestId"));
+    if (it == m_inFlight.end())
+    {
+        return nullptr;
+    }
+
+    return &m_records[it->second];
+}
+
+NetworkRequestRecord& NetworkLog::StartRecord(const std::wstring& requestId)
+{
+    size_t slot = m_next;
+    m_next = (m_next + 1) % c_capacity;
+    if (m_count < c_capacity)
+    {
+        ++m_count;
+    }
+
+    // Overwriting the oldest record, forget it if it never completed
+    NetworkRequestRecord& record = m_records[slot];
+    auto stale = m_inFlight.find(record.requestId);
+    if (stale != m_inFlight.end() && stale->second == slot)
+    {
+        m_inFlight.erase(stale);
+    }
+
+    record = NetworkRequestRecord();
+    record.requestId = requestId;
+    m_inFlight[requestId] = slot;
+
+    return record;
+}
+
+void NetworkLog::FinishRecord(NetworkRequestRecord& record, double timestamp)
+{
+    record.finished = true;
+    record.endTime = timestamp;
+    m_inFlight.erase(record.requestId);
+}
+
+std::wstring NetworkLog::GetOrigin(const std::wstring& url)
+{
+    size_t schemeEnd = url.find(L"://");
+    if (schemeEnd == std::wstring::npos)
+    {
+        // data:, blob: and similar
+        return url.substr(0, url.find(L':') + 1);
+    }
+
+    size_t pathStart = url.find_first_of(L"/?#", schemeEnd + 3);
+    return url.substr(0, pathStart);
+}
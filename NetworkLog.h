@@ -0,0 +1,89 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+#include "BulkDataChannel.h"
+#include <unordered_map>
+
+struct NetworkRequestRecord
+{
+    std::wstring requestId;
+    std::wstring url;
+    std::wstring origin;
+    std::wstring method;
+    std::wstring resourceType;
+    std::wstring mimeType;
+    std::wstring protocol;
+    std::wstring cacheStatus;  // "network", "disk", "memory" or "service-worker"
+    std::wstring errorText;
+    int status = 0;
+    bool finished = false;
+    bool failed = false;
+
+    // DevTools monotonic timestamps, in seconds
+    double startTime = 0;
+    double responseTime = 0;
+    double endTime = 0;
+    // Wall clock time the request started, in seconds since the epoch
+    double wallTime = 0;
+    double encodedBytes = 0;
+
+    // Connection phases from the response timing, in milliseconds. -1 when
+    // the phase didn't happen (e.g. reused connection).
+    double dns = -1;
+    double connect = -1;
+    double ssl = -1;
+    double send = -1;
+    double wait = -1;
+};
+
+// Fixed size ring buffer of the most recent requests of a tab, fed by the
+// DevTools Network domain events. Events only update records in place; the
+// per-origin summary and the waterfall rows are built when the network page
+// asks for them.
+class NetworkLog
+{
+public:
+    static const size_t c_capacity = 512;
+
+    static const std::vector<BulkColumn>& Columns();
+
+    NetworkLog();
+
+    void HandleRequestWillBeSent(const web::json::value& params);
+    void HandleResponseReceived(const web::json::value& params);
+    void HandleRequestServedFromCache(const web::json::value& params);
+    void HandleLoadingFinished(const web::json::value& params);
+    void HandleLoadingFailed(const web::json::value& params);
+    void Clear();
+
+    size_t GetRecordCount() const { return m_count; }
+    web::json::value GetRequestsAsJson() const;
+    web::json::value GetOriginSummaryAsJson() const;
+
+protected:
+    std::vector<NetworkRequestRecord> m_records;
+    size_t m_next = 0;
+    size_t m_count = 0;
+    std::unordered_map<std::wstring, size_t> m_inFlight;  // Request ID to slot
+
+    NetworkRequestRecord* FindInFlight(const web::json::value& params);
+    NetworkRequestRecord& StartRecord(const std::wstring& requestId);
+    void FinishRecord(NetworkRequestRecord& record, double timestamp);
+
+    template <typename Function>
+    void ForEachRecord(Function function) const
+    {
+        // Oldest to newest
+        size_t first = (m_next + c_capacity - m_count) % c_capacity;
+        for (size_t i = 0; i < m_count; ++i)
+        {
+            function(m_records[(first + i) % c_capacity]);
+        }
+    }
+
+    static std::wstring GetOrigin(const std::wstring& url);
+};
@@ -0,0 +1,933 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "SharedHttpCache.h"
+#include "FileUtil.h"
+#include "StorageAuditor.h"
+#include "Stopwatch.h"
+#include <shlobj.h>
+#include <sstream>
+#include <winhttp.h>
+#pragma comment (lib, "winhttp.lib")
+
+using namespace Microsoft::WRL;
+
+namespace
+{
+    struct InternetHandleCloser
+    {
+        void operator()(HINTERNET handle) const
+        {
+            WinHttpCloseHandle(handle);
+        }
+    };
+    typedef std::unique_ptr<void, InternetHandleCloser> unique_hinternet;
+
+    // Read only view of a body file. The view stays mapped while the WebView
+    // holds the stream, and the file can be deleted meanwhile.
+    class MappedStream : public RuntimeClass<RuntimeClassFlags<ClassicCom>, ChainInterfaces<IStream, ISequentialStream>>
+    {
+    public:
+        HRESULT RuntimeClassInitialize(const std::wstring& path)
+        {
+            wil::unique_hfile file(CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+            if (!file)
+            {
+                return HRESULT_FROM_WIN32(GetLastError());
+            }
+
+            LARGE_INTEGER size;
+            RETURN_IF_WIN32_BOOL_FALSE(GetFileSizeEx(file.get(), &size));
+            m_size = static_cast<uint64_t>(size.QuadPart);
+            if (m_size == 0)
+            {
+                // Empty files can't be mapped
+                return S_OK;
+            }
+
+            wil::unique_handle mapping(CreateFileMappingW(file.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+            if (!mapping)
+            {
+                return HRESULT_FROM_WIN32(GetLastError());
+            }
+
+            m_view = static_cast<const BYTE*>(MapViewOfFile(mapping.get(), FILE_MAP_READ, 0, 0, 0));
+            return m_view ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        ~MappedStream()
+        {
+            if (m_view)
+            {
+                UnmapViewOfFile(m_view);
+            }
+        }
+
+        STDMETHODIMP Read(void* buffer, ULONG count, ULONG* read) override
+        {
+            ULONG available = static_cast<ULONG>((std::min)(static_cast<uint64_t>(count), m_size - m_position));
+            if (available > 0)
+            {
+                memcpy(buffer, m_view + m_position, available);
+                m_position += available;
+            }
+            if (read)
+            {
+                *read = available;
+            }
+
+            return available < count ? S_FALSE : S_OK;
+        }
+
+        STDMETHODIMP Write(const void*, ULONG, ULONG*) override
+        {
+            return STG_E_ACCESSDENIED;
+        }
+
+        STDMETHODIMP Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* position) override
+        {
+            int64_t base = origin == STREAM_SEEK_SET ? 0 : origin == STREAM_SEEK_CUR ?
+                static_cast<int64_t>(m_position) : static_cast<int64_t>(m_size);
+            if (origin > STREAM_SEEK_END || base + move.QuadPart < 0)
+            {
+                return STG_E_INVALIDFUNCTION;
+            }
+
+            m_position = (std::min)(static_cast<uint64_t>(base + move.QuadPart), m_size);
+            if (position)
+            {
+                position->QuadPart = m_position;
+            }
+
+            return S_OK;
+        }
+
+        STDMETHODIMP SetSize(ULARGE_INTEGER) override
+        {
+            return STG_E_ACCESSDENIED;
+        }
+
+        STDMETHODIMP CopyTo(IStream*, ULARGE_INTEGER, ULARGE_INTEGER*, ULARGE_INTEGER*) override
+        {
+            return E_NOTIMPL;
+        }
+
+        STDMETHODIMP Commit(DWORD) override
+        {
+            return S_OK;
+        }
+
+        STDMETHODIMP Revert() override
+        {
+            return S_OK;
+        }
+
+        STDMETHODIMP LockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD) override
+        {
+            return STG_E_INVALIDFUNCTION;
+        }
+
+        STDMETHODIMP UnlockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD) override
+        {
+            return STG_E_INVALIDFUNCTION;
+        }
+
+        STDMETHODIMP Stat(STATSTG* stat, DWORD) override
+        {
+            ZeroMemory(stat, sizeof(*stat));
+            stat->type = STGTY_STREAM;
+            stat->cbSize.QuadPart = m_size;
+            stat->grfMode = STGM_READ;
+            return S_OK;
+        }
+
+        STDMETHODIMP Clone(IStream**) override
+        {
+            return E_NOTIMPL;
+        }
+
+    private:
+        const BYTE* m_view = nullptr;
+        uint64_t m_size = 0;
+        uint64_t m_position = 0;
+    };
+
+    std::wstring Trim(const std::wstring& text)
+    {
+        size_t begin = text.find_first_not_of(L" \t");
+        if (begin == std::wstring::npos)
+        {
+            return std::wstring();
+        }
+
+        return text.substr(begin, text.find_last_not_of(L" \t") - begin + 1);
+    }
+
+    std::wstring ToLower(std::wstring text)
+    {
+        std::transform(text.begin(), text.end(), text.begin(), towlower);
+        return text;
+    }
+
+    // Directive to value, empty for the ones without
+    std::map<std::wstring, std::wstring> ParseCacheControl(const std::wstring& value)
+    {
+        std::map<std::wstring, std::wstring> directives;
+        std::wstringstream stream(value);
+        std::wstring directive;
+        while (std::getline(stream, directive, L','))
+        {
+            size_t equals = directive.find(L'=');
+            std::wstring name = ToLower(Trim(directive.substr(0, equals)));
+            std::wstring argument = equals == std::wstring::npos ? std::wstring() : Trim(directive.substr(equals + 1));
+            argument.erase(std::remove(argument.begin(), argument.end(), L'"'), argument.end());
+            if (!name.empty())
+            {
+                directives[name] = argument;
+            }
+        }
+
+        return directives;
+    }
+
+    // ms since the epoch, false if |value| isn't an HTTP date
+    bool ParseHttpDate(const std::wstring& value, double& time)
+    {
+        SYSTEMTIME systemTime;
+        FILETIME fileTime;
+        if (!WinHttpTimeToSystemTime(value.c_str(), &systemTime) || !SystemTimeToFileTime(&systemTime, &fileTime))
+        {
+            return false;
+        }
+
+        time = Stopwatch::EpochMilliseconds(fileTime);
+        return true;
+    }
+
+    web::json::value EntryToJson(const CachedResponse& response)
+    {
+        web::json::value entry = web::json::value::object();
+        entry[L"uri"] = web::json::value(response.uri);
+        entry[L"hash"] = web::json::value(response.hash);
+        entry[L"status"] = web::json::value::number(response.statusCode);
+        entry[L"reason"] = web::json::value(response.reasonPhrase);
+        entry[L"headers"] = web::json::value(response.headers);
+        entry[L"bytes"] = web::json::value::number(response.bytes);
+        entry[L"storedAt"] = web::json::value::number(response.storedAt);
+        entry[L"expiresAt"] = web::json::value::number(response.expiresAt);
+        entry[L"public"] = web::json::value::boolean(response.isPublic);
+        return entry;
+    }
+
+    bool EntryFromJson(const web::json::value& entry, CachedResponse& response)
+    {
+        if (!entry.is_object() || !entry.has_field(L"uri") || !entry.has_field(L"hash") || !entry.has_field(L"headers") ||
+            !entry.has_field(L"expiresAt"))
+        {
+            return false;
+        }
+
+        response.uri = entry.at(L"uri").as_string();
+        response.hash = entry.at(L"hash").as_string();
+        response.statusCode = entry.has_field(L"status") ? entry.at(L"status").as_integer() : 200;
+        response.reasonPhrase = entry.has_field(L"reason") ? entry.at(L"reason").as_string() : L"OK";
+        response.headers = entry.at(L"headers").as_string();
+        response.bytes = entry.has_field(L"bytes") ? entry.at(L"bytes").as_number().to_uint64() : 0;
+        response.storedAt = entry.has_field(L"storedAt") ? entry.at(L"storedAt").as_double() : 0;
+        response.expiresAt = entry.at(L"expiresAt").as_double();
+        response.isPublic = entry.has_field(L"public") && entry.at(L"public").as_bool();
+        return true;
+    }
+}
+
+std::shared_ptr<SharedHttpCache> SharedHttpCache::GetInstance()
+{
+    static std::shared_ptr<SharedHttpCache> instance = std::make_shared<SharedHttpCache>();
+    return instance;
+}
+
+void SharedHttpCache::Init(const std::wstring& directory)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_directory.empty())
+        {
+            // Another window got here first
+            return;
+        }
+
+        m_directory = directory;
+        SHCreateDirectoryExW(nullptr, m_directory.c_str(), nullptr);
+        CreateDirectoryW((m_directory + L"\\objects").c_str(), nullptr);
+
+        // Guards index.json across the browser's processes
+        m_indexMutex = CreateMutexW(nullptr, FALSE, L"Local\\WebView2Browser.SharedHttpCache");
+    }
+
+    // Before the first tab asks, the rest is up to Flush on the timer
+    std::lock_guard<std::mutex> flushLock(m_flushMutex);
+    if (ReadIndex())
+    {
+        std::map<std::wstring, CachedResponse> entries = m_indexEntries;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.swap(entries);
+    }
+}
+
+void SharedHttpCache::SetOrigins(const std::vector<std::wstring>& origins)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_origins.clear();
+    for (const std::wstring& origin : origins)
+    {
+        m_origins.insert(StorageAuditor::GetOrigin(origin));
+    }
+}
+
+bool SharedHttpCache::IsCachedOrigin(const std::wstring& uri) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_directory.empty() && !m_origins.empty() && m_origins.count(StorageAuditor::GetOrigin(uri)) > 0;
+}
+
+HRESULT SharedHttpCache::Lookup(const std::wstring& uri, bool hasCredentials, CachedResponse& response, IStream** body)
+{
+    double now = Stopwatch::EpochMilliseconds();
+    std::wstring key = GetCacheKey(uri);
+    CachedResponse found;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto entry = m_entries.find(key);
+        if (entry == m_entries.end() || entry->second.expiresAt <= now || (hasCredentials && !entry->second.isPublic))
+        {
+            ++m_misses;
+            return S_FALSE;
+        }
+        found = entry->second;
+    }
+
+    ComPtr<MappedStream> stream;
+    HRESULT hr = MakeAndInitialize<MappedStream>(&stream, GetObjectPath(found.hash));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (FAILED(hr))
+    {
+        // Evicted by another process, unless stored again meanwhile
+        auto entry = m_entries.find(key);
+        if (entry != m_entries.end() && entry->second.hash == found.hash)
+        {
+            m_entries.erase(entry);
+        }
+        ++m_misses;
+        return S_FALSE;
+    }
+
+    response = found;
+    response.headers += L"Age: " + std::to_wstring(static_cast<int64_t>((now - response.storedAt) / 1000)) + L"\r\n";
+    response.headers += std::wstring(c_hitHeader) + L": hit";
+    *body = stream.Detach();
+
+    ++m_hits;
+    m_bytesSaved += response.bytes;
+    return S_OK;
+}
+
+bool SharedHttpCache::BypassesCache(const std::wstring& cacheControl, const std::wstring& pragma)
+{
+    std::map<std::wstring, std::wstring> directives = ParseCacheControl(cacheControl);
+    if (directives.count(L"no-cache") || directives.count(L"no-store"))
+    {
+        return true;
+    }
+
+    // Only for requests without Cache-Control, which takes precedence
+    return cacheControl.empty() && ParseCacheControl(pragma).count(L"no-cache") > 0;
+}
+
+bool SharedHttpCache::IsStorable(int statusCode, const HttpHeaders& headers, bool hasCredentials, CachedResponse& response)
+{
+    if (statusCode != 200)
+    {
+        return false;
+    }
+
+    double now = Stopwatch::EpochMilliseconds();
+    double date = now;
+    double expires = 0;
+    bool hasExpires = false;
+    double age = 0;
+    std::map<std::wstring, std::wstring> cacheControl;
+    std::wstring kept;
+
+    for (const auto& header : headers)
+    {
+        std::wstring name = ToLower(header.first);
+        if (name.compare(L"set-cookie") == 0 || name.compare(L"content-range") == 0 ||
+            name.compare(ToLower(c_hitHeader)) == 0)
+        {
+            return false;
+        }
+
+        if (name.compare(L"cache-control") == 0)
+        {
+            for (const auto& directive : ParseCacheControl(header.second))
+            {
+                cacheControl[directive.first] = directive.second;
+            }
+        }
+        else if (name.compare(L"vary") == 0)
+        {
+            // Requests differing in anything but the encoding, which is
+            // gone from the stored body, would get the same answer
+            std::wstringstream stream(header.second);
+            std::wstring field;
+            while (std::getline(stream, field, L','))
+            {
+                field = ToLower(Trim(field));
+                if (!field.empty() && field.compare(L"accept-encoding") != 0)
+                {
+                    return false;
+                }
+            }
+        }
+        else if (name.compare(L"date") == 0)
+        {
+            ParseHttpDate(header.second, date);
+        }
+        else if (name.compare(L"expires") == 0)
+        {
+            // An invalid date means already expired
+            hasExpires = true;
+            if (!ParseHttpDate(header.second, expires))
+            {
+                expires = 0;
+            }
+        }
+        else if (name.compare(L"age") == 0)
+        {
+            age = _wtof(header.second.c_str());
+        }
+
+        // The body is stored decoded, and the age is worked out when served
+        if (name.compare(L"content-encoding") != 0 && name.compare(L"content-length") != 0 &&
+            name.compare(L"transfer-encoding") != 0 && name.compare(L"connection") != 0 &&
+            name.compare(L"keep-alive") != 0 && name.compare(L"age") != 0)
+        {
+            kept += header.first + L": " + header.second + L"\r\n";
+        }
+    }
+
+    if (cacheControl.count(L"no-store") || cacheControl.count(L"private") || cacheControl.count(L"no-cache"))
+    {
+        return false;
+    }
+
+    response.isPublic = cacheControl.count(L"public") > 0 || cacheControl.count(L"s-maxage") > 0;
+    if (hasCredentials && !response.isPublic)
+    {
+        return false;
+    }
+
+    // A shared cache goes by s-maxage first
+    double lifetime = 0;
+    if (cacheControl.count(L"s-maxage"))
+    {
+        lifetime = _wtof(cacheControl[L"s-maxage"].c_str()) * 1000;
+    }
+    else if (cacheControl.count(L"max-age"))
+    {
+        lifetime = _wtof(cacheControl[L"max-age"].c_str()) * 1000;
+    }
+    else if (hasExpires)
+    {
+        lifetime = expires - date;
+    }
+    lifetime -= age * 1000;
+
+    if (lifetime <= 0)
+    {
+        return false;
+    }
+
+    response.statusCode = statusCode;
+    response.headers = kept;
+    response.storedAt = now;
+    response.expiresAt = now + lifetime;
+    return true;
+}
+
+HRESULT SharedHttpCache::Store(CachedResponse response, const std::string& body)
+{
+    if (body.size() > c_maxResponseBytes)
+    {
+        return HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE);
+    }
+
+    RETURN_IF_FAILED(Sha256(body, response.hash));
+    response.bytes = body.size();
+
+    std::wstring path = GetObjectPath(response.hash);
+    if (GetFileAttributesW(path.c_str()) == INVALID_FILE_ATTRIBUTES)
+    {
+        RETURN_IF_FAILED(WriteFileAtomically(path, body.data(), body.size()));
+    }
+
+    // Served right away, written to index.json with the next Flush
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::wstring key = GetCacheKey(response.uri);
+    m_entries[key] = response;
+    m_pending[key] = response;
+    return S_OK;
+}
+
+size_t SharedHttpCache::Prewarm(const std::vector<std::wstring>& uris)
+{
+    Stopwatch stopwatch;
+    size_t stored = 0;
+    for (const std::wstring& uri : uris)
+    {
+        if (!IsCachedOrigin(uri))
+        {
+            continue;
+        }
+
+        int statusCode = 0;
+        HttpHeaders headers;
+        std::string body;
+        CachedResponse response;
+        response.uri = uri;
+        if (SUCCEEDED(Fetch(uri, statusCode, response.reasonPhrase, headers, body)) &&
+            IsStorable(statusCode, headers, false, response) && SUCCEEDED(Store(response, body)))
+        {
+            ++stored;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_prewarmed += stored;
+    }
+
+    WCHAR log[128];
+    StringCchPrintf(log, ARRAYSIZE(log), L"Shared cache: prewarmed %llu of %llu responses in %.0f ms\n",
+        static_cast<uint64_t>(stored), static_cast<uint64_t>(uris.size()), stopwatch.ElapsedMilliseconds());
+    OutputDebugString(log);
+
+    return stored;
+}
+
+std::vector<std::wstring> SharedHttpCache::TakePrewarmManifest()
+{
+    std::vector<std::wstring> uris;
+    std::wstring path;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_prewarmTaken || m_directory.empty())
+        {
+            return uris;
+        }
+        m_prewarmTaken = true;
+        path = m_directory + L"\\prewarm.json";
+    }
+
+    std::string contents;
+    if (!ReadFileContents(path, contents))
+    {
+        return uris;
+    }
+
+    try
+    {
+        web::json::value manifest = web::json::value::parse(utility::conversions::to_string_t(contents));
+        if (manifest.is_array())
+        {
+            for (const auto& uri : manifest.as_array())
+            {
+                if (uri.is_string())
+                {
+                    uris.push_back(uri.as_string());
+                }
+            }
+        }
+    }
+    catch (const web::json::json_exception&)
+    {
+        OutputDebugString(L"Ignoring malformed prewarm manifest\n");
+    }
+
+    return uris;
+}
+
+bool SharedHttpCache::StartFlush()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ULONGLONG now = GetTickCount64();
+    if (m_flushing || m_directory.empty() || (m_pending.empty() && now - m_flushStartedAt < c_syncInterval))
+    {
+        return false;
+    }
+
+    m_flushing = true;
+    m_flushStartedAt = now;
+    return true;
+}
+
+void SharedHttpCache::Flush()
+{
+    std::lock_guard<std::mutex> flushLock(m_flushMutex);
+    std::map<std::wstring, CachedResponse> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_directory.empty())
+        {
+            m_flushing = false;
+            return;
+        }
+        pending.swap(m_pending);
+    }
+
+    bool changed = false;
+    HRESULT hr = S_OK;
+    if (pending.empty())
+    {
+        // Atomically replaced, so it can be read without the index mutex
+        changed = ReadIndex();
+    }
+    else
+    {
+        DWORD wait = WaitForSingleObject(m_indexMutex, 1000);
+        if (wait == WAIT_OBJECT_0 || wait == WAIT_ABANDONED)
+        {
+            // Whatever other processes stored meanwhile stays
+            ReadIndex();
+            for (const auto& stored : pending)
+            {
+                auto entry = m_indexEntries.find(stored.first);
+                if (entry != m_indexEntries.end() && entry->second.hash != stored.second.hash)
+                {
+                    m_sweepNeeded = true;
+                }
+                m_indexEntries[stored.first] = stored.second;
+            }
+            if (Evict(Stopwatch::EpochMilliseconds()))
+            {
+                m_sweepNeeded = true;
+            }
+            hr = WriteIndex();
+            ReleaseMutex(m_indexMutex);
+            changed = true;
+        }
+        else
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+        }
+    }
+
+    if (m_sweepNeeded && GetTickCount64() - m_sweptAt >= c_sweepInterval)
+    {
+        SweepObjects();
+    }
+
+    // Copied here so the swap is all that happens under the lock
+    std::map<std::wstring, CachedResponse> entries;
+    if (changed)
+    {
+        entries = m_indexEntries;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_flushing = false;
+    if (FAILED(hr))
+    {
+        // Tried again with the next Flush, newer stores of the same URI win
+        for (const auto& stored : m_pending)
+        {
+            pending[stored.first] = stored.second;
+        }
+        m_pending.swap(pending);
+
+        WCHAR log[128];
+        StringCchPrintf(log, ARRAYSIZE(log), L"Shared cache: index not written (0x%08X), %llu responses pending\n",
+            hr, static_cast<uint64_t>(m_pending.size()));
+        OutputDebugString(log);
+    }
+    else
+    {
+        m_stored += pending.size();
+    }
+
+    if (changed)
+    {
+        // Responses stored while this ran aren't in the index yet
+        for (const auto& stored : m_pending)
+        {
+            entries[stored.first] = stored.second;
+        }
+        m_entries.swap(entries);
+    }
+}
+
+web::json::value SharedHttpCache::GetStats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint64_t lookups = m_hits + m_misses;
+    web::json::value stats = web::json::value::object();
+    stats[L"origins"] = web::json::value::number(m_origins.size());
+    stats[L"entries"] = web::json::value::number(m_entries.size());
+    stats[L"hits"] = web::json::value::number(m_hits);
+    stats[L"misses"] = web::json::value::number(m_misses);
+    stats[L"hitRatio"] = web::json::value::number(lookups ? static_cast<double>(m_hits) / lookups : 0.0);
+    stats[L"bytesSaved"] = web::json::value::number(m_bytesSaved);
+    stats[L"stored"] = web::json::value::number(m_stored);
+    stats[L"pending"] = web::json::value::number(m_pending.size());
+    stats[L"prewarmed"] = web::json::value::number(m_prewarmed);
+    return stats;
+}
+
+bool SharedHttpCache::ReadIndex()
+{
+    std::wstring path = m_directory + L"\\index.json";
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &attributes) ||
+        CompareFileTime(&attributes.ftLastWriteTime, &m_indexWriteTime) == 0)
+    {
+        return false;
+    }
+
+    std::string contents;
+    if (!ReadFileContents(path, contents))
+    {
+        return false;
+    }
+
+    try
+    {
+        web::json::value index = web::json::value::parse(utility::conversions::to_string_t(contents));
+        std::map<std::wstring, CachedResponse> entries;
+        if (index.has_field(L"entries") && index.at(L"entries").is_array())
+        {
+            for (const auto& item : index.at(L"entries").as_array())
+            {
+                CachedResponse response;
+                if (EntryFromJson(item, response))
+                {
+                    entries[GetCacheKey(response.uri)] = response;
+                }
+            }
+        }
+
+        m_indexEntries.swap(entries);
+        m_indexWriteTime = attributes.ftLastWriteTime;
+        return true;
+    }
+    catch (const web::json::json_exception&)
+    {
+        OutputDebugString(L"Ignoring malformed shared cache index\n");
+        return false;
+    }
+}
+
+HRESULT SharedHttpCache::WriteIndex()
+{
+    web::json::value entries = web::json::value::array();
+    size_t count = 0;
+    for (const auto& entry : m_indexEntries)
+    {
+        entries[count++] = EntryToJson(entry.second);
+    }
+
+    web::json::value index = web::json::value::object();
+    index[L"entries"] = entries;
+
+    std::wstring path = m_directory + L"\\index.json";
+    std::string contents = utility::conversions::to_utf8string(index.serialize());
+    RETURN_IF_FAILED(WriteFileAtomically(path, contents.data(), contents.size()));
+
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &attributes))
+    {
+        m_indexWriteTime = attributes.ftLastWriteTime;
+    }
+
+    return S_OK;
+}
+
+bool SharedHttpCache::Evict(double now)
+{
+    // Expired responses first, then the oldest ones. Bodies several
+    // responses share are counted for each, which only errs on the small side.
+    size_t count = m_indexEntries.size();
+    uint64_t totalBytes = 0;
+    std::vector<std::pair<double, std::wstring>> byAge;
+    for (auto entry = m_indexEntries.begin(); entry != m_indexEntries.end();)
+    {
+        if (entry->second.expiresAt <= now)
+        {
+            entry = m_indexEntries.erase(entry);
+            continue;
+        }
+
+        totalBytes += entry->second.bytes;
+        byAge.emplace_back(entry->second.storedAt, entry->first);
+        ++entry;
+    }
+
+    std::sort(byAge.begin(), byAge.end());
+    for (const auto& oldest : byAge)
+    {
+        if (totalBytes <= c_maxBytes)
+        {
+            break;
+        }
+
+        totalBytes -= m_indexEntries[oldest.second].bytes;
+        m_indexEntries.erase(oldest.second);
+    }
+
+    return m_indexEntries.size() < count;
+}
+
+void SharedHttpCache::SweepObjects()
+{
+    m_sweptAt = GetTickCount64();
+    m_sweepNeeded = false;
+
+    // Bodies no response uses any more. Recent files are left alone, another
+    // process may be about to index them.
+    std::set<std::wstring> used;
+    for (const auto& entry : m_indexEntries)
+    {
+        used.insert(entry.second.hash);
+    }
+    {
+        // Stored since this Flush started
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& entry : m_pending)
+        {
+            used.insert(entry.second.hash);
+        }
+    }
+
+    FILETIME nowTime;
+    GetSystemTimeAsFileTime(&nowTime);
+    ULARGE_INTEGER cutoff;
+    cutoff.LowPart = nowTime.dwLowDateTime;
+    cutoff.HighPart = nowTime.dwHighDateTime;
+    cutoff.QuadPart -= 60ull * 10000000;  // A minute in 100 ns units
+
+    WIN32_FIND_DATAW findData;
+    HANDLE find = FindFirstFileExW((m_directory + L"\\objects\\*").c_str(), FindExInfoBasic, &findData,
+        FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+    if (find == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    do
+    {
+        ULARGE_INTEGER written;
+        written.LowPart = findData.ftLastWriteTime.dwLowDateTime;
+        written.HighPart = findData.ftLastWriteTime.dwHighDateTime;
+        if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && written.QuadPart < cutoff.QuadPart &&
+            used.count(findData.cFileName) == 0)
+        {
+            DeleteFileW((m_directory + L"\\objects\\" + findData.cFileName).c_str());
+        }
+    } while (FindNextFileW(find, &findData));
+    FindClose(find);
+}
+
+std::wstring SharedHttpCache::GetObjectPath(const std::wstring& hash) const
+{
+    return m_directory + L"\\objects\\" + hash;
+}
+
+std::wstring SharedHttpCache::GetCacheKey(const std::wstring& uri)
+{
+    return uri.substr(0, uri.find(L'#'));
+}
+
+HRESULT SharedHttpCache::Fetch(const std::wstring& uri, int& statusCode, std::wstring& reasonPhrase,
+    HttpHeaders& headers, std::string& body)
+{
+    URL_COMPONENTS parts = {};
+    parts.dwStructSize = sizeof(parts);
+    parts.dwSchemeLength = static_cast<DWORD>(-1);
+    parts.dwHostNameLength = static_cast<DWORD>(-1);
+    parts.dwUrlPathLength = static_cast<DWORD>(-1);
+    parts.dwExtraInfoLength = static_cast<DWORD>(-1);
+    RETURN_IF_WIN32_BOOL_FALSE(WinHttpCrackUrl(uri.c_str(), 0, 0, &parts));
+
+    std::wstring host(parts.lpszHostName, parts.dwHostNameLength);
+    std::wstring path = GetCacheKey(std::wstring(parts.lpszUrlPath, parts.dwUrlPathLength + parts.dwExtraInfoLength));
+
+    unique_hinternet session(WinHttpOpen(L"WebView2Browser", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY,
+        WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0));
+    RETURN_LAST_ERROR_IF(!session);
+    unique_hinternet connection(WinHttpConnect(session.get(), host.c_str(), parts.nPort, 0));
+    RETURN_LAST_ERROR_IF(!connection);
+    unique_hinternet request(WinHttpOpenRequest(connection.get(), L"GET", path.c_str(), nullptr, WINHTTP_NO_REFERER,
+        WINHTTP_DEFAULT_ACCEPT_TYPES, parts.nScheme == INTERNET_SCHEME_HTTPS ? WINHTTP_FLAG_SECURE : 0));
+    RETURN_LAST_ERROR_IF(!request);
+
+    RETURN_IF_WIN32_BOOL_FALSE(WinHttpSendRequest(request.get(), WINHTTP_NO_ADDITIONAL_HEADERS, 0, WINHTTP_NO_REQUEST_DATA, 0, 0, 0));
+    RETURN_IF_WIN32_BOOL_FALSE(WinHttpReceiveResponse(request.get(), nullptr));
+
+    DWORD status = 0;
+    DWORD size = sizeof(status);
+    RETURN_IF_WIN32_BOOL_FALSE(WinHttpQueryHeaders(request.get(), WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+        WINHTTP_HEADER_NAME_BY_INDEX, &status, &size, WINHTTP_NO_HEADER_INDEX));
+    statusCode = static_cast<int>(status);
+
+    // "HTTP/1.1 200 OK\r\nName: value\r\n...", the size comes in bytes
+    size = 0;
+    WinHttpQueryHeaders(request.get(), WINHTTP_QUERY_RAW_HEADERS_CRLF, WINHTTP_HEADER_NAME_BY_INDEX,
+        WINHTTP_NO_OUTPUT_BUFFER, &size, WINHTTP_NO_HEADER_INDEX);
+    std::wstring rawHeaders(size / sizeof(wchar_t), L'\0');
+    RETURN_IF_WIN32_BOOL_FALSE(WinHttpQueryHeaders(request.get(), WINHTTP_QUERY_RAW_HEADERS_CRLF, WINHTTP_HEADER_NAME_BY_INDEX,
+        &rawHeaders[0], &size, WINHTTP_NO_HEADER_INDEX));
+    rawHeaders.resize(size / sizeof(wchar_t));
+
+    std::wstringstream lines(rawHeaders);
+    std::wstring line;
+    bool statusLine = true;
+    while (std::getline(lines, line))
+    {
+        line.erase(line.find_last_not_of(L"\r") + 1);
+        if (statusLine)
+        {
+            size_t reasonStart = line.find(L' ', line.find(L' ') + 1);
+            reasonPhrase = reasonStart == std::wstring::npos ? std::wstring() : line.substr(reasonStart + 1);
+            statusLine = false;
+        }
+        else if (line.find(L':') != std::wstring::npos)
+        {
+            size_t colon = line.find(L':');
+            headers.emplace_back(Trim(line.substr(0, colon)), Trim(line.substr(colon + 1)));
+        }
+    }
+
+    DWORD available = 0;
+    do
+    {
+        RETURN_IF_WIN32_BOOL_FALSE(WinHttpQueryDataAvailable(request.get(), &available));
+        if (body.size() + available > c_maxResponseBytes)
+        {
+            return HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE);
+        }
+
+        size_t offset = body.size();
+        body.resize(offset + available);
+        DWORD read = 0;
+        if (available > 0)
+        {
+            RETURN_IF_WIN32_BOOL_FALSE(WinHttpReadData(request.get(), &body[offset], available, &read));
+        }
+        body.resize(offset + read);
+    } while (available > 0);
+
+    return S_OK;
+}
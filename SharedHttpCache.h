@@ -0,0 +1,130 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+#include <mutex>
+#include <set>
+
+typedef std::vector<std::pair<std::wstring, std::wstring>> HttpHeaders;
+
+struct CachedResponse
+{
+    std::wstring uri;
+    std::wstring hash;  // SHA-256 of the body, the name of its file
+    int statusCode = 200;
+    std::wstring reasonPhrase;
+    std::wstring headers;  // CRLF separated, as CreateWebResourceResponse takes them
+    uint64_t bytes = 0;
+    double storedAt = 0;  // ms since the epoch
+    double expiresAt = 0;
+    bool isPublic = false;  // Can answer requests with credentials
+};
+
+// HTTP responses of the origins set in Settings, kept by the host for every
+// window and every WebView2 profile: the tabs' and browser UI's user data
+// directories each have their own HTTP cache, and so does every browser
+// process. Tabs store GET responses as they come in, and requests for them
+// are answered from here while they're fresh by the shared cache rules:
+// s-maxage over max-age over Expires, nothing private, no-store or no-cache,
+// nothing setting cookies or varying on more than the encoding. Stale ones
+// go to the network, there's no revalidation. Bodies are content addressed
+// and memory-mapped when served, so pages several processes have in common
+// are on disk and in memory once.
+//
+//   Shared Cache\index.json         URI to response, shared by processes
+//   Shared Cache\objects\<hash>     body
+//   Shared Cache\prewarm.json       optional, ["https://...", ...] fetched
+//                                   at the first start of the process
+//
+// Lookups are meant for the UI thread and only read the index in memory.
+// Store writes the body and adds to that index; the responses stored since
+// the last Flush go to index.json together, and eviction happens then too,
+// so a page with hundreds of subresources writes the index once. Store,
+// Prewarm and Flush do file and network work for a worker thread, none of
+// it while holding the lock lookups take.
+class SharedHttpCache
+{
+public:
+    static const uint64_t c_maxBytes = 1024ull * 1024 * 1024;
+    static const uint64_t c_maxResponseBytes = 64ull * 1024 * 1024;
+    static const UINT_PTR c_timerId = 6;
+    static const UINT c_flushInterval = 2000;  // ms between looks for stored responses to write to the index
+    static const ULONGLONG c_syncInterval = 10 * 1000;  // ms between checks for other processes' changes
+    static const ULONGLONG c_sweepInterval = 60 * 1000;  // ms between looks for bodies no response uses
+    static constexpr const wchar_t* c_hitHeader = L"X-Shared-Cache";
+
+    // All windows of the process share one
+    static std::shared_ptr<SharedHttpCache> GetInstance();
+
+    void Init(const std::wstring& directory);
+    void SetOrigins(const std::vector<std::wstring>& origins);
+    bool IsCachedOrigin(const std::wstring& uri) const;
+
+    // A fresh response for a GET of |uri|, its body a stream over the mapped
+    // file. S_FALSE if there's none.
+    HRESULT Lookup(const std::wstring& uri, bool hasCredentials, CachedResponse& response, IStream** body);
+    // True if the request's Cache-Control or Pragma header wants the answer
+    // from the server, as a hard reload does
+    static bool BypassesCache(const std::wstring& cacheControl, const std::wstring& pragma);
+    // Fills in what the headers say about |response|, false if it can't be
+    // stored
+    static bool IsStorable(int statusCode, const HttpHeaders& headers, bool hasCredentials, CachedResponse& response);
+    HRESULT Store(CachedResponse response, const std::string& body);
+    // Fetches and stores the URIs of the cached origins in |uris|, returns
+    // how many were stored
+    size_t Prewarm(const std::vector<std::wstring>& uris);
+    // The URIs in prewarm.json, once per process
+    std::vector<std::wstring> TakePrewarmManifest();
+    // Merges the responses stored since the last call into index.json,
+    // evicts, and picks up other processes' changes.
+    void Flush();
+    // Called on c_timerId: true if a Flush should run now, when responses
+    // are pending or c_syncInterval passed, and none is running already.
+    // That Flush is then counted as running.
+    bool StartFlush();
+
+    web::json::value GetStats();
+
+protected:
+    std::wstring m_directory;
+    std::set<std::wstring> m_origins;
+    // Guards what lookups and stores touch, never held for file work
+    mutable std::mutex m_mutex;
+    // Index changes of other processes are picked up by the write time
+    HANDLE m_indexMutex = nullptr;
+    std::map<std::wstring, CachedResponse> m_entries;
+    // Stored since the last Flush, by cache key
+    std::map<std::wstring, CachedResponse> m_pending;
+    bool m_prewarmTaken = false;
+    bool m_flushing = false;  // Between StartFlush and the end of its Flush
+    ULONGLONG m_flushStartedAt = 0;
+
+    // Only Flush uses these, one at a time
+    std::mutex m_flushMutex;
+    std::map<std::wstring, CachedResponse> m_indexEntries;  // As in index.json
+    FILETIME m_indexWriteTime = {};
+    ULONGLONG m_sweptAt = 0;
+    bool m_sweepNeeded = true;
+
+    uint64_t m_hits = 0;
+    uint64_t m_misses = 0;
+    uint64_t m_bytesSaved = 0;
+    uint64_t m_stored = 0;
+    uint64_t m_prewarmed = 0;
+
+    // True if index.json changed since it was last read or written
+    bool ReadIndex();
+    HRESULT WriteIndex();
+    // False if nothing was evicted
+    bool Evict(double now);
+    void SweepObjects();
+    std::wstring GetObjectPath(const std::wstring& hash) const;
+
+    static std::wstring GetCacheKey(const std::wstring& uri);
+    static HRESULT OpenMappedStream(const std::wstring& path, IStream** stream);
+    static HRESULT Fetch(const std::wstring& uri, int& statusCode, std::wstring& reasonPhrase,
+        HttpHeaders& headers, std::string& body);
+};
@@ -0,0 +1,444 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "SnapshotStore.h"
+#include "FileUtil.h"
+#include "Stopwatch.h"
+#include <compressapi.h>
+#include <fstream>
+#include <shlobj.h>
+#include <set>
+#pragma comment (lib, "Cabinet.lib")
+
+namespace
+{
+    web::json::value ReadManifest(const std::wstring& path)
+    {
+        std::string contents;
+        if (!ReadFileContents(path, contents))
+        {
+            return web::json::value::null();
+        }
+
+        try
+        {
+            return web::json::value::parse(utility::conversions::to_string_t(contents));
+        }
+        catch (const web::json::json_exception&)
+        {
+            return web::json::value::null();
+        }
+    }
+}
+
+void SnapshotStore::Init(const std::wstring& directory)
+{
+    m_directory = directory;
+
+    SHCreateDirectoryExW(nullptr, m_directory.c_str(), nullptr);
+    CreateDirectoryW((m_directory + L"\\objects").c_str(), nullptr);
+    CreateDirectoryW((m_directory + L"\\open").c_str(), nullptr);
+    CreateDirectoryW((m_directory + L"\\tmp").c_str(), nullptr);
+}
+
+HRESULT SnapshotStore::StoreMhtml(const std::wstring& captureResult, SnapshotInfo& info)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::string mhtml;
+    try
+    {
+        web::json::value result = web::json::value::parse(captureResult);
+        if (!result.has_field(L"data") || !result.at(L"data").is_string())
+        {
+            return E_INVALIDARG;
+        }
+
+        mhtml = utility::conversions::to_utf8string(result.at(L"data").as_string());
+    }
+    catch (const web::json::json_exception&)
+    {
+        return E_INVALIDARG;
+    }
+
+    info.bytes = mhtml.size();
+
+    // boundary="..." in the Content-Type of the header
+    size_t headerEnd = mhtml.find("\r\n\r\n");
+    size_t boundaryStart = mhtml.find("boundary=\"");
+    if (headerEnd == std::string::npos || boundaryStart == std::string::npos || boundaryStart > headerEnd)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    boundaryStart += strlen("boundary=\"");
+    size_t boundaryEnd = mhtml.find('"', boundaryStart);
+    if (boundaryEnd == std::string::npos)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    std::string boundary = mhtml.substr(boundaryStart, boundaryEnd - boundaryStart);
+
+    // The header, then what follows each delimiter. The boundary is random
+    // per snapshot, so it is left out of the parts for them to deduplicate.
+    std::string delimiter = "--" + boundary;
+    std::vector<std::wstring> parts;
+    size_t partStart = 0;
+    size_t next = mhtml.find(delimiter);
+    while (true)
+    {
+        size_t partEnd = next == std::string::npos ? mhtml.size() : next;
+        std::wstring hash;
+        RETURN_IF_FAILED(StorePart(mhtml.substr(partStart, partEnd - partStart), hash, info));
+        parts.push_back(hash);
+
+        if (next == std::string::npos)
+        {
+            break;
+        }
+
+        partStart = next + delimiter.size();
+        next = mhtml.find(delimiter, partStart);
+    }
+
+    info.id = CreateId();
+    info.format = SnapshotFormat::Mhtml;
+    info.time = Stopwatch::EpochMilliseconds();
+
+    return WriteManifest(info, boundary, parts);
+}
+
+HRESULT SnapshotStore::StorePdf(const std::wstring& path, SnapshotInfo& info)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::string pdf;
+    bool read = ReadFileContents(path, pdf);
+    DeleteFileW(path.c_str());
+    if (!read)
+    {
+        return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    }
+
+    info.bytes = pdf.size();
+
+    std::wstring hash;
+    RETURN_IF_FAILED(StorePart(pdf, hash, info));
+
+    info.id = CreateId();
+    info.format = SnapshotFormat::Pdf;
+    info.time = Stopwatch::EpochMilliseconds();
+
+    return WriteManifest(info, std::string(), { hash });
+}
+
+HRESULT SnapshotStore::Open(const std::wstring& id, std::wstring& path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!IsValidId(id))
+    {
+        return E_INVALIDARG;
+    }
+
+    web::json::value manifest = ReadManifest(m_directory + L"\\" + id + L".json");
+    if (!manifest.is_object() || !manifest.has_field(L"parts") || !manifest.at(L"parts").is_array())
+    {
+        return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    }
+
+    bool isPdf = manifest.has_field(L"format") && manifest.at(L"format").is_string() &&
+        manifest.at(L"format").as_string().compare(L"pdf") == 0;
+    path = m_directory + L"\\open\\" + id + (isPdf ? L".pdf" : L".mhtml");
+    if (GetFileAttributesW(path.c_str()) != INVALID_FILE_ATTRIBUTES)
+    {
+        return S_OK;
+    }
+
+    std::string delimiter;
+    if (manifest.has_field(L"boundary") && manifest.at(L"boundary").is_string())
+    {
+        delimiter = "--" + utility::conversions::to_utf8string(manifest.at(L"boundary").as_string());
+    }
+
+    // Written part by part, the whole page is never held in memory. Nothing
+    // is left behind if it can't be put together.
+    std::wstring temporaryPath = path + L".tmp";
+    HRESULT hr = S_OK;
+    {
+        std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+        bool isFirst = true;
+        for (const web::json::value& hash : manifest.at(L"parts").as_array())
+        {
+            std::string part;
+            if (!hash.is_string() || FAILED(ReadPart(hash.as_string(), part)))
+            {
+                hr = HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+                break;
+            }
+
+            if (!isFirst)
+            {
+                output.write(delimiter.data(), delimiter.size());
+            }
+            output.write(part.data(), part.size());
+            isFirst = false;
+        }
+
+        if (SUCCEEDED(hr) && !output)
+        {
+            hr = E_FAIL;
+        }
+    }
+
+    if (SUCCEEDED(hr) && !MoveFileExW(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    if (FAILED(hr))
+    {
+        DeleteFileW(temporaryPath.c_str());
+    }
+
+    return hr;
+}
+
+HRESULT SnapshotStore::Delete(const std::wstring& id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!IsValidId(id))
+    {
+        return E_INVALIDARG;
+    }
+
+    DeleteFileW((m_directory + L"\\" + id + L".json").c_str());
+    DeleteFileW((m_directory + L"\\open\\" + id + L".mhtml").c_str());
+    DeleteFileW((m_directory + L"\\open\\" + id + L".pdf").c_str());
+
+    return CollectGarbage();
+}
+
+std::wstring SnapshotStore::GetTemporaryPath(const std::wstring& extension) const
+{
+    return m_directory + L"\\tmp\\" + CreateId() + extension;
+}
+
+HRESULT SnapshotStore::StorePart(const std::string& part, std::wstring& hash, SnapshotInfo& info)
+{
+    RETURN_IF_FAILED(Sha256(part, hash));
+    ++info.parts;
+
+    std::wstring path = GetObjectPath(hash);
+    if (GetFileAttributesW(path.c_str()) != INVALID_FILE_ATTRIBUTES)
+    {
+        return S_OK;
+    }
+
+    std::vector<BYTE> compressed;
+    RETURN_IF_FAILED(CompressPart(part, compressed));
+    RETURN_IF_FAILED(WriteFileAtomically(path, compressed.data(), compressed.size()));
+
+    ++info.newParts;
+    info.storedBytes += compressed.size();
+
+    return S_OK;
+}
+
+HRESULT SnapshotStore::ReadPart(const std::wstring& hash, std::string& part) const
+{
+    std::string contents;
+    if (!ReadFileContents(GetObjectPath(hash), contents))
+    {
+        return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    }
+
+    return DecompressPart(std::vector<BYTE>(contents.begin(), contents.end()), part);
+}
+
+HRESULT SnapshotStore::WriteManifest(const SnapshotInfo& info, const std::string& boundary, const std::vector<std::wstring>& parts)
+{
+    web::json::value manifest = web::json::value::object();
+    manifest[L"id"] = web::json::value(info.id);
+    manifest[L"uri"] = web::json::value(info.uri);
+    manifest[L"title"] = web::json::value(info.title);
+    manifest[L"format"] = web::json::value(info.format == SnapshotFormat::Pdf ? L"pdf" : L"mhtml");
+    manifest[L"time"] = web::json::value::number(info.time);
+    manifest[L"bytes"] = web::json::value::number(info.bytes);
+    manifest[L"boundary"] = web::json::value(utility::conversions::to_string_t(boundary));
+
+    web::json::value hashes = web::json::value::array(parts.size());
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        hashes[i] = web::json::value(parts[i]);
+    }
+    manifest[L"parts"] = hashes;
+
+    std::string contents = utility::conversions::to_utf8string(manifest.serialize());
+    return WriteFileAtomically(m_directory + L"\\" + info.id + L".json", contents.data(), contents.size());
+}
+
+HRESULT SnapshotStore::CollectGarbage()
+{
+    std::set<std::wstring> referenced;
+    WIN32_FIND_DATAW findData;
+    HANDLE find = FindFirstFileW((m_directory + L"\\*.json").c_str(), &findData);
+    if (find != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            web::json::value manifest = ReadManifest(m_directory + L"\\" + findData.cFileName);
+            if (!manifest.is_object() || !manifest.has_field(L"parts") || !manifest.at(L"parts").is_array())
+            {
+                // Parts of an unreadable manifest may still be wanted
+                FindClose(find);
+                return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+            }
+
+            for (const web::json::value& hash : manifest.at(L"parts").as_array())
+            {
+                if (hash.is_string())
+                {
+                    referenced.insert(hash.as_string());
+                }
+            }
+        } while (FindNextFileW(find, &findData));
+        FindClose(find);
+    }
+
+    size_t deleted = 0;
+    find = FindFirstFileW((m_directory + L"\\objects\\*").c_str(), &findData);
+    if (find == INVALID_HANDLE_VALUE)
+    {
+        return S_OK;
+    }
+
+    do
+    {
+        if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && referenced.count(findData.cFileName) == 0)
+        {
+            DeleteFileW((m_directory + L"\\objects\\" + findData.cFileName).c_str());
+            ++deleted;
+        }
+    } while (FindNextFileW(find, &findData));
+    FindClose(find);
+
+    WCHAR log[128];
+    StringCchPrintf(log, ARRAYSIZE(log), L"Snapshots: %zu parts in use, %zu deleted\n", referenced.size(), deleted);
+    OutputDebugString(log);
+
+    return S_OK;
+}
+
+std::wstring SnapshotStore::GetObjectPath(const std::wstring& hash) const
+{
+    return m_directory + L"\\objects\\" + hash;
+}
+
+bool SnapshotStore::IsValidId(const std::wstring& id) const
+{
+    // IDs come from web messages and end up in paths
+    return id.size() == 32 && std::all_of(id.begin(), id.end(), iswxdigit);
+}
+
+std::wstring SnapshotStore::CreateId()
+{
+    GUID guid = {};
+    CoCreateGuid(&guid);
+
+    WCHAR id[33];
+    StringCchPrintf(id, ARRAYSIZE(id), L"%08lx%04hx%04hx%02x%02x%02x%02x%02x%02x%02x%02x",
+        guid.Data1, guid.Data2, guid.Data3, guid.Data4[0], guid.Data4[1], guid.Data4[2], guid.Data4[3],
+        guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7]);
+
+    return id;
+}
+
+    static const wchar_t hexDigits[] = L"0123456789abcdef";
+    hash.clear();
+    for (BYTE byte : digest)
+    {
+        hash.push_back(hexDigits[byte >> 4]);
+        hash.push_back(hexDigits[byte & 0xF]);
+    }
+
+    return S_OK;
+}
+
+HRESULT SnapshotStore::CompressPart(const std::string& data, std::vector<BYTE>& compressed)
+{
+    compressed.clear();
+    if (data.empty())
+    {
+        return S_OK;
+    }
+
+    COMPRESSOR_HANDLE compressor = nullptr;
+    if (!CreateCompressor(COMPRESS_ALGORITHM_XPRESS_HUFF, nullptr, &compressor))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    // Sized by a first call without a buffer
+    SIZE_T compressedSize = 0;
+    HRESULT hr = S_OK;
+    if (!Compress(compressor, data.data(), data.size(), nullptr, 0, &compressedSize) &&
+        GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    else
+    {
+        compressed.resize(compressedSize);
+        if (Compress(compressor, data.data(), data.size(), compressed.data(), compressed.size(), &compressedSize))
+        {
+            compressed.resize(compressedSize);
+        }
+        else
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+
+    CloseCompressor(compressor);
+    return hr;
+}
+
+HRESULT SnapshotStore::DecompressPart(const std::vector<BYTE>& compressed, std::string& data)
+{
+    data.clear();
+    if (compressed.empty())
+    {
+        return S_OK;
+    }
+
+    DECOMPRESSOR_HANDLE decompressor = nullptr;
+    if (!CreateDecompressor(COMPRESS_ALGORITHM_XPRESS_HUFF, nullptr, &decompressor))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    SIZE_T size = 0;
+    HRESULT hr = S_OK;
+    if (!Decompress(decompressor, compressed.data(), compressed.size(), nullptr, 0, &size) &&
+        GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    else
+    {
+        data.resize(size);
+        if (Decompress(decompressor, compressed.data(), compressed.size(), &data[0], data.size(), &size))
+        {
+            data.resize(size);
+        }
+        else
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+
+    CloseDecompressor(decompressor);
+    return hr;
+}
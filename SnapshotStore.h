@@ -0,0 +1,74 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+#include <mutex>
+
+enum class SnapshotFormat
+{
+    Mhtml,  // Page.captureSnapshot
+    Pdf     // PrintToPdf
+};
+
+struct SnapshotInfo
+{
+    std::wstring id;
+    std::wstring uri;
+    std::wstring title;
+    SnapshotFormat format = SnapshotFormat::Mhtml;
+    double time = 0;  // ms since the Unix epoch
+    uint64_t bytes = 0;  // Size of the page as captured
+    uint64_t storedBytes = 0;  // Compressed bytes this snapshot added to the store
+    size_t parts = 0;
+    size_t newParts = 0;
+};
+
+// Offline copies of pages in the Snapshots directory of the app data.
+// Storage is content addressed: an MHTML snapshot is split at its MIME
+// boundaries and every part is compressed and stored once under the
+// SHA-256 of its contents, so the scripts, styles and images pages of a
+// site have in common are shared by all their snapshots. A snapshot is a
+// manifest listing its parts; a PDF is a single part.
+//
+//   Snapshots\<id>.json                  manifest
+//   Snapshots\objects\<hash>             compressed part
+//   Snapshots\open\<id>.mhtml|.pdf       reassembled for viewing
+//
+// The members do file work and are meant for a worker thread; calls are
+// serialized so a capture can't race a deletion collecting its parts.
+class SnapshotStore
+{
+public:
+    void Init(const std::wstring& directory);
+
+    // |captureResult| is the Page.captureSnapshot result JSON, parsed here
+    // rather than on the UI thread. Fills in info.id and the sizes.
+    HRESULT StoreMhtml(const std::wstring& captureResult, SnapshotInfo& info);
+    // Moves the PDF at |path| into the store
+    HRESULT StorePdf(const std::wstring& path, SnapshotInfo& info);
+    // Writes the snapshot out as a file a WebView can open
+    HRESULT Open(const std::wstring& id, std::wstring& path);
+    // Removes the snapshot and the parts no other snapshot uses
+    HRESULT Delete(const std::wstring& id);
+
+    // Where PrintToPdf should write before StorePdf
+    std::wstring GetTemporaryPath(const std::wstring& extension) const;
+
+protected:
+    std::wstring m_directory;
+    std::mutex m_mutex;
+
+    HRESULT StorePart(const std::string& part, std::wstring& hash, SnapshotInfo& info);
+    HRESULT ReadPart(const std::wstring& hash, std::string& part) const;
+    HRESULT WriteManifest(const SnapshotInfo& info, const std::string& boundary, const std::vector<std::wstring>& parts);
+    HRESULT CollectGarbage();
+    std::wstring GetObjectPath(const std::wstring& hash) const;
+    bool IsValidId(const std::wstring& id) const;
+
+    static std::wstring CreateId();
+    static HRESULT CompressPart(const std::string& data, std::vector<BYTE>& compressed);
+    static HRESULT DecompressPart(const std::vector<BYTE>& compressed, std::string& data);
+};
@@ -0,0 +1,67 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+
+// High resolution timer used for the latency numbers the browser reports
+// through OutputDebugString.
+class Stopwatch
+{
+public:
+    Stopwatch()
+    {
+        Restart();
+    }
+
+    void Restart()
+    {
+        QueryPerformanceCounter(&m_start);
+    }
+
+    double ElapsedMilliseconds() const
+    {
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        return static_cast<double>(now.QuadPart - m_start.QuadPart) * 1000.0 / Frequency();
+    }
+
+    // Milliseconds since the Unix epoch, comparable with Date.now() and
+    // performance.timeOrigin + performance.now() in the WebViews.
+    static double EpochMilliseconds()
+    {
+        FILETIME fileTime;
+        GetSystemTimePreciseAsFileTime(&fileTime);
+
+        return EpochMilliseconds(fileTime);
+    }
+
+    static double EpochMilliseconds(const FILETIME& fileTime)
+    {
+        // 100ns intervals between 1601-01-01 and 1970-01-01
+        const ULONGLONG epochOffset = 116444736000000000ULL;
+
+        ULARGE_INTEGER ticks;
+        ticks.LowPart = fileTime.dwLowDateTime;
+        ticks.HighPart = fileTime.dwHighDateTime;
+
+        return ticks.QuadPart > epochOffset ? static_cast<double>(ticks.QuadPart - epochOffset) / 10000.0 : 0;
+    }
+
+private:
+    LARGE_INTEGER m_start = {};
+
+    static double Frequency()
+    {
+        static const double frequency = []()
+        {
+            LARGE_INTEGER value;
+            QueryPerformanceFrequency(&value);
+            return static_cast<double>(value.QuadPart);
+        }();
+
+        return frequency;
+    }
+};
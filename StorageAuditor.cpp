@@ -0,0 +1,404 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "StorageAuditor.h"
+#include "Stopwatch.h"
+
+namespace
+{
+    struct Category
+    {
+        const wchar_t* directory;  // In a profile directory
+        const wchar_t* name;
+    };
+
+    const Category c_categories[] =
+    {
+        { L"Cache", L"httpCache" },
+        { L"Code Cache", L"codeCache" },
+        { L"IndexedDB", L"indexedDb" },
+        { L"Service Worker", L"serviceWorkers" },
+        { L"Local Storage", L"otherSiteData" },
+        { L"Session Storage", L"otherSiteData" },
+        { L"File System", L"otherSiteData" },
+        { L"databases", L"otherSiteData" },
+    };
+
+    const wchar_t* GetCategory(const wchar_t* directory)
+    {
+        for (const Category& category : c_categories)
+        {
+            if (_wcsicmp(directory, category.directory) == 0)
+            {
+                return category.name;
+            }
+        }
+
+        return L"other";
+    }
+
+    uint64_t GetFileSize(const WIN32_FIND_DATA& data)
+    {
+        return (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    }
+
+    bool IsDirectory(const WIN32_FIND_DATA& data)
+    {
+        return (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    }
+
+    // Calls |visit| for the entries of |directory|. Links are skipped, they
+    // may point out of the user data directory.
+    template <typename Visitor>
+    void ForEachEntry(const std::wstring& directory, Visitor visit)
+    {
+        WIN32_FIND_DATA data;
+        HANDLE find = FindFirstFileEx((directory + L"\\*").c_str(), FindExInfoBasic, &data,
+            FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+        if (find == INVALID_HANDLE_VALUE)
+        {
+            return;
+        }
+
+        do
+        {
+            if (wcscmp(data.cFileName, L".") == 0 || wcscmp(data.cFileName, L"..") == 0 ||
+                (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+            {
+                continue;
+            }
+
+            visit(data);
+        } while (FindNextFile(find, &data));
+
+        FindClose(find);
+    }
+}
+
+uint64_t StorageUsage::GetBytes(const wchar_t* category) const
+{
+    auto it = categories.find(category);
+    return it == categories.end() ? 0 : it->second;
+}
+
+uint64_t StorageUsage::GetSiteDataBytes() const
+{
+    return GetBytes(L"indexedDb") + GetBytes(L"serviceWorkers") + GetBytes(L"otherSiteData");
+}
+
+uint64_t StorageUsage::GetCacheBytes() const
+{
+    return GetBytes(L"httpCache") + GetBytes(L"codeCache");
+}
+
+void StorageAuditor::Init(HWND hWnd, const std::wstring& contentDirectory, const std::wstring& uiDirectory)
+{
+    m_contentDirectory = contentDirectory;
+    m_uiDirectory = uiDirectory;
+
+    SetTimer(hWnd, c_timerId, c_auditInterval, nullptr);
+}
+
+bool StorageAuditor::BeginAudit()
+{
+    if (m_auditing || m_contentDirectory.empty())
+    {
+        return false;
+    }
+
+    m_auditing = true;
+    return true;
+}
+
+void StorageAuditor::CompleteAudit(StorageUsage content, StorageUsage ui, double milliseconds)
+{
+    m_content = std::move(content);
+    m_ui = std::move(ui);
+    m_auditing = false;
+    m_audited = Stopwatch::EpochMilliseconds();
+    m_auditMilliseconds = milliseconds;
+
+    WCHAR log[256];
+    StringCchPrintf(log, ARRAYSIZE(log),
+        L"Storage: %llu MB for tabs (%llu MB cache, %llu MB site data), %llu MB for the browser UI, %llu files walked in %.0f ms\n",
+        m_content.totalBytes >> 20, m_content.GetCacheBytes() >> 20, m_content.GetSiteDataBytes() >> 20,
+        m_ui.totalBytes >> 20, m_content.files + m_ui.files, milliseconds);
+    OutputDebugString(log);
+}
+
+StorageUsage StorageAuditor::Measure(const std::wstring& directory)
+{
+    StorageUsage usage;
+
+    // WebView2 keeps its profiles in EBWebView, anything else is counted as
+    // other
+    ForEachEntry(directory, [&](const WIN32_FIND_DATA& entry)
+    {
+        std::wstring path = directory + L"\\" + entry.cFileName;
+        uint64_t bytes = 0;
+        uint64_t files = 0;
+        double lastWrite = 0;
+
+        if (!IsDirectory(entry))
+        {
+            bytes = GetFileSize(entry);
+            files = 1;
+        }
+        else if (_wcsicmp(entry.cFileName, L"EBWebView") != 0)
+        {
+            SumDirectory(path, bytes, files, lastWrite);
+        }
+        else
+        {
+            ForEachEntry(path, [&](const WIN32_FIND_DATA& profile)
+            {
+                bool isProfile = IsDirectory(profile) && (_wcsicmp(profile.cFileName, L"Default") == 0 ||
+                    _wcsnicmp(profile.cFileName, L"Profile ", 8) == 0);
+                if (isProfile)
+                {
+                    MeasureProfile(path + L"\\" + profile.cFileName, usage);
+                }
+                else if (IsDirectory(profile))
+                {
+                    SumDirectory(path + L"\\" + profile.cFileName, bytes, files, lastWrite);
+                }
+                else
+                {
+                    bytes += GetFileSize(profile);
+                    ++files;
+                }
+            });
+        }
+
+        usage.categories[L"other"] += bytes;
+        usage.totalBytes += bytes;
+        usage.files += files;
+    });
+
+    return usage;
+}
+
+void StorageAuditor::MeasureProfile(const std::wstring& directory, StorageUsage& usage)
+{
+    std::map<std::wstring, OriginStorageUsage> origins;
+
+    ForEachEntry(directory, [&](const WIN32_FIND_DATA& entry)
+    {
+        const wchar_t* category = GetCategory(entry.cFileName);
+        std::wstring path = directory + L"\\" + entry.cFileName;
+        uint64_t bytes = 0;
+        uint64_t files = 0;
+        double lastWrite = 0;
+
+        if (!IsDirectory(entry))
+        {
+            bytes = GetFileSize(entry);
+            files = 1;
+        }
+        else if (wcscmp(category, L"indexedDb") != 0)
+        {
+            SumDirectory(path, bytes, files, lastWrite);
+        }
+        else
+        {
+            // A database directory and a blob directory per site
+            ForEachEntry(path, [&](const WIN32_FIND_DATA& database)
+            {
+                uint64_t databaseBytes = IsDirectory(database) ? 0 : GetFileSize(database);
+                uint64_t databaseFiles = IsDirectory(database) ? 0 : 1;
+                double databaseWrite = Stopwatch::EpochMilliseconds(database.ftLastWriteTime);
+                if (IsDirectory(database))
+                {
+                    SumDirectory(path + L"\\" + database.cFileName, databaseBytes, databaseFiles, databaseWrite);
+                }
+
+                std::wstring origin = GetOriginFromIndexedDbDirectory(database.cFileName);
+                if (!origin.empty())
+                {
+                    OriginStorageUsage& site = origins[origin];
+                    site.origin = origin;
+                    site.bytes += databaseBytes;
+                    site.lastUsed = (std::max)(site.lastUsed, databaseWrite);
+                }
+
+                bytes += databaseBytes;
+                files += databaseFiles;
+            });
+        }
+
+        usage.categories[category] += bytes;
+        usage.totalBytes += bytes;
+        usage.files += files;
+    });
+
+    for (auto& site : origins)
+    {
+        usage.origins.push_back(std::move(site.second));
+    }
+}
+
+void StorageAuditor::SumDirectory(const std::wstring& directory, uint64_t& bytes, uint64_t& files, double& lastWrite)
+{
+    ForEachEntry(directory, [&](const WIN32_FIND_DATA& entry)
+    {
+        if (IsDirectory(entry))
+        {
+            SumDirectory(directory + L"\\" + entry.cFileName, bytes, files, lastWrite);
+            return;
+        }
+
+        bytes += GetFileSize(entry);
+        ++files;
+        lastWrite = (std::max)(lastWrite, Stopwatch::EpochMilliseconds(entry.ftLastWriteTime));
+    });
+}
+
+std::vector<std::wstring> StorageAuditor::PickOriginsToEvict(uint64_t quotaBytes, const std::set<std::wstring>& openOrigins)
+{
+    if (quotaBytes == 0)
+    {
+        return {};
+    }
+
+    // Only web sites' data is cleared, browser pages' stays. Service worker
+    // and other site data aren't told apart by site, so only what the
+    // candidates hold is measured against the quota: counting the rest
+    // would clear every site once it alone is over.
+    std::vector<const OriginStorageUsage*> candidates;
+    uint64_t evictableBytes = 0;
+    for (const OriginStorageUsage& site : m_content.origins)
+    {
+        bool isWebOrigin = site.origin.compare(0, 7, L"http://") == 0 || site.origin.compare(0, 8, L"https://") == 0;
+        if (isWebOrigin && openOrigins.find(site.origin) == openOrigins.end())
+        {
+            candidates.push_back(&site);
+            evictableBytes += site.bytes;
+        }
+    }
+
+    if (evictableBytes <= quotaBytes)
+    {
+        return {};
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const OriginStorageUsage* a, const OriginStorageUsage* b)
+    {
+        return a->lastUsed < b->lastUsed;
+    });
+
+    // Their other site data goes too, which the next audit will show
+    uint64_t targetBytes = static_cast<uint64_t>(quotaBytes * c_evictionTarget);
+    std::vector<std::wstring> evicted;
+    for (const OriginStorageUsage* site : candidates)
+    {
+        if (evictableBytes <= targetBytes)
+        {
+            break;
+        }
+
+        evicted.push_back(site->origin);
+        evictableBytes -= site->bytes;
+    }
+
+    m_evictedOrigins += evicted.size();
+    return evicted;
+}
+
+bool StorageAuditor::PickCacheEviction(uint64_t quotaBytes, double& until)
+{
+    if (quotaBytes == 0 || m_content.GetCacheBytes() <= quotaBytes)
+    {
+        m_cacheTrimmed = false;
+        return false;
+    }
+
+    until = m_cacheTrimmed ? 0 : m_audited - c_recentCacheKept;
+    m_cacheTrimmed = !m_cacheTrimmed;
+    ++m_cacheEvictions;
+    return true;
+}
+
+web::json::value StorageAuditor::ToJson() const
+{
+    auto usageToJson = [](const StorageUsage& usage)
+    {
+        web::json::value usageObj = web::json::value::object();
+        usageObj[L"totalBytes"] = web::json::value::number(usage.totalBytes);
+        usageObj[L"files"] = web::json::value::number(usage.files);
+        usageObj[L"categories"] = web::json::value::object();
+        for (const auto& category : usage.categories)
+        {
+            usageObj[L"categories"][category.first] = web::json::value::number(category.second);
+        }
+        return usageObj;
+    };
+
+    web::json::value report = web::json::value::object();
+    report[L"content"] = usageToJson(m_content);
+    report[L"browserUI"] = usageToJson(m_ui);
+    report[L"audited"] = web::json::value::number(m_audited);
+    report[L"auditMilliseconds"] = web::json::value::number(m_auditMilliseconds);
+    report[L"evictedOrigins"] = web::json::value::number(m_evictedOrigins);
+    report[L"cacheEvictions"] = web::json::value::number(m_cacheEvictions);
+
+    // The largest sites only
+    const size_t maxOrigins = 10;
+    std::vector<const OriginStorageUsage*> largest;
+    for (const OriginStorageUsage& site : m_content.origins)
+    {
+        largest.push_back(&site);
+    }
+    std::sort(largest.begin(), largest.end(), [](const OriginStorageUsage* a, const OriginStorageUsage* b)
+    {
+        return a->bytes > b->bytes;
+    });
+
+    report[L"origins"] = web::json::value::array();
+    for (size_t i = 0; i < largest.size() && i < maxOrigins; ++i)
+    {
+        web::json::value site = web::json::value::object();
+        site[L"origin"] = web::json::value(largest[i]->origin);
+        site[L"bytes"] = web::json::value::number(largest[i]->bytes);
+        site[L"lastUsed"] = web::json::value::number(largest[i]->lastUsed);
+        report[L"origins"][i] = site;
+    }
+
+    return report;
+}
+
+std::wstring StorageAuditor::GetOrigin(const std::wstring& uri)
+{
+    size_t schemeEnd = uri.find(L"://");
+    if (schemeEnd == std::wstring::npos)
+    {
+        return std::wstring();
+    }
+
+    std::wstring origin = uri.substr(0, uri.find_first_of(L"/?#", schemeEnd + 3));
+    std::transform(origin.begin(), origin.end(), origin.begin(), towlower);
+    return origin;
+}
+
+std::wstring StorageAuditor::GetOriginFromIndexedDbDirectory(const std::wstring& name)
+{
+    // https_example.com_0.indexeddb.leveldb, the port is 0 for the
+    // scheme's default
+    size_t suffix = name.find(L".indexeddb.");
+    size_t schemeEnd = name.find(L'_');
+    size_t portStart = name.rfind(L'_', suffix);
+    if (suffix == std::wstring::npos || schemeEnd == std::wstring::npos || portStart <= schemeEnd)
+    {
+        return std::wstring();
+    }
+
+    std::wstring origin = name.substr(0, schemeEnd) + L"://" + name.substr(schemeEnd + 1, portStart - schemeEnd - 1);
+    std::wstring port = name.substr(portStart + 1, suffix - portStart - 1);
+    if (port.compare(L"0") != 0)
+    {
+        origin += L":" + port;
+    }
+
+    std::transform(origin.begin(), origin.end(), origin.begin(), towlower);
+    return origin;
+}
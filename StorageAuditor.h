@@ -0,0 +1,93 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+#include <set>
+
+struct OriginStorageUsage
+{
+    std::wstring origin;
+    uint64_t bytes = 0;
+    double lastUsed = 0;  // Newest file write, ms since the epoch
+};
+
+struct StorageUsage
+{
+    // Bytes by category: httpCache, codeCache, indexedDb, serviceWorkers,
+    // otherSiteData (local storage, file systems, Web SQL) and other
+    std::map<std::wstring, uint64_t> categories;
+    uint64_t totalBytes = 0;
+    uint64_t files = 0;
+    // Sites with IndexedDB data, the only per site storage the directory
+    // layout tells apart
+    std::vector<OriginStorageUsage> origins;
+
+    uint64_t GetBytes(const wchar_t* category) const;
+    uint64_t GetSiteDataBytes() const;
+    uint64_t GetCacheBytes() const;
+};
+
+// Periodically measures the user data directories of the WebView2
+// environments against the quotas in the settings. The directories are
+// walked on a worker thread; the browser window clears what's over quota
+// through BrowsingDataCleaner: the least recently used sites' data first,
+// and cache entries from before the last hour, then all of the cache if
+// that wasn't enough by the next audit. Only the tabs' data is evicted, the
+// browser UI's holds favorites and history.
+class StorageAuditor
+{
+public:
+    static const UINT_PTR c_timerId = 5;
+    static const UINT c_auditInterval = 10 * 60 * 1000;  // ms
+    // Eviction goes this far below a quota, so it doesn't run on every audit
+    static constexpr double c_evictionTarget = 0.8;
+    static constexpr double c_recentCacheKept = 60 * 60 * 1000;  // ms
+
+    // Starts a WM_TIMER with c_timerId on |hWnd|
+    void Init(HWND hWnd, const std::wstring& contentDirectory, const std::wstring& uiDirectory);
+
+    // False if an audit is running already
+    bool BeginAudit();
+    void CompleteAudit(StorageUsage content, StorageUsage ui, double milliseconds);
+    // Walks |directory| and its WebView2 profiles, safe on any thread
+    static StorageUsage Measure(const std::wstring& directory);
+
+    // Least recently used sites to clear to get the IndexedDB data of the
+    // sites not in |openOrigins| under |quotaBytes|
+    std::vector<std::wstring> PickOriginsToEvict(uint64_t quotaBytes, const std::set<std::wstring>& openOrigins);
+    // Whether the cache is over |quotaBytes|, and the end of the time range
+    // to clear then, 0 for all of it
+    bool PickCacheEviction(uint64_t quotaBytes, double& until);
+
+    const std::wstring& GetContentDirectory() const { return m_contentDirectory; }
+    const std::wstring& GetUIDirectory() const { return m_uiDirectory; }
+    const StorageUsage& GetContentUsage() const { return m_content; }
+    const StorageUsage& GetUIUsage() const { return m_ui; }
+    bool IsAuditing() const { return m_auditing; }
+    bool HasAudited() const { return m_audited > 0; }
+    uint64_t GetEvictedOrigins() const { return m_evictedOrigins; }
+    uint64_t GetCacheEvictions() const { return m_cacheEvictions; }
+    double GetAuditMilliseconds() const { return m_auditMilliseconds; }
+    web::json::value ToJson() const;
+
+    static std::wstring GetOrigin(const std::wstring& uri);
+
+protected:
+    std::wstring m_contentDirectory;
+    std::wstring m_uiDirectory;
+    StorageUsage m_content;
+    StorageUsage m_ui;
+    bool m_auditing = false;
+    double m_audited = 0;  // ms since the epoch
+    double m_auditMilliseconds = 0;
+    bool m_cacheTrimmed = false;  // Older entries went at the last audit
+    uint64_t m_evictedOrigins = 0;
+    uint64_t m_cacheEvictions = 0;
+
+    static void MeasureProfile(const std::wstring& directory, StorageUsage& usage);
+    static void SumDirectory(const std::wstring& directory, uint64_t& bytes, uint64_t& files, double& lastWrite);
+    static std::wstring GetOriginFromIndexedDbDirectory(const std::wstring& name);
+};
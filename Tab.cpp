@@ -4,102 +4,931 @@
 
 #include "BrowserWindow.h"
 #include "Tab.h"
+#include <fstream>
+#include <sstream>
 
 using namespace Microsoft::WRL;
 
-std::unique_ptr<Tab> Tab::CreateNewTab(HWND hWnd, ICoreWebView2Environment* env, size_t id, bool shouldBeActive)
+std::unique_ptr<Tab> Tab::CreateNewTab(HWND hWnd, ControllerPool& pool, size_t id, bool shouldBeActive, const std::wstring& uri)
 {
     std::unique_ptr<Tab> tab = std::make_unique<Tab>();
 
     tab->m_parentHWnd = hWnd;
     tab->m_tabId = id;
+    tab->m_measureOpen = true;
+    tab->m_navigationHistory.SetDocument(uri);
     tab->SetMessageBroker();
-    tab->Init(env, shouldBeActive);
+    tab->Init(pool, shouldBeActive);
 
     return tab;
 }
 
-HRESULT Tab::Init(ICoreWebView2Environment* env, bool shouldBeActive)
+std::unique_ptr<Tab> Tab::CreateWithController(HWND hWnd, ICoreWebView2Controller* controller, size_t id, const std::wstring& uri)
 {
-    return env->CreateCoreWebView2Controller(m_parentHWnd, Callback<ICoreWebView2CreateCoreWebView2ControllerCompletedHandler>(
-        [this, shouldBeActive](HRESULT result, ICoreWebView2Controller* host) -> HRESULT {
+    std::unique_ptr<Tab> tab = std::make_unique<Tab>();
+
+    tab->m_parentHWnd = hWnd;
+    tab->m_tabId = id;
+    tab->SetMessageBroker();
+    BrowserWindow::CheckFailure(tab->SetUpWebView(controller), L"");
+    BrowserWindow::CheckFailure(tab->m_contentWebView->Navigate(uri.c_str()), L"");
+
+    return tab;
+}
+
+void Tab::Init(ControllerPool& pool, bool shouldBeActive)
+{
+    // The controller may come after the tab is closed or discarded, it goes
+    // back to the pool then
+    m_released = std::make_shared<bool>(false);
+    std::shared_ptr<bool> released = m_released;
+    ControllerPool* controllerPool = &pool;
+    pool.Acquire([this, released, controllerPool, shouldBeActive](HRESULT result, ICoreWebView2Controller* controller)
+    {
+        if (*released)
+        {
+            if (SUCCEEDED(result))
+            {
+                controllerPool->Recycle(controller);
+            }
+            return;
+        }
+
         if (!SUCCEEDED(result))
         {
             OutputDebugString(L"Tab WebView creation failed\n");
-            return result;
+            return;
         }
-        m_contentController = host;
-        BrowserWindow::CheckFailure(m_contentController->get_CoreWebView2(&m_contentWebView), L"");
+
+        // Reopen may have changed the URI since the tab was created
+        std::wstring uri = m_navigationHistory.GetCurrentEntry().uri;
+        BrowserWindow::CheckFailure(SetUpWebView(controller), L"");
+        BrowserWindow::CheckFailure(m_contentWebView->Navigate(uri.c_str()), L"");
+
         BrowserWindow* browserWindow = reinterpret_cast<BrowserWindow*>(GetWindowLongPtr(m_parentHWnd, GWLP_USERDATA));
-        RETURN_IF_FAILED(m_contentWebView->add_WebMessageReceived(m_messageBroker.Get(), &m_messageBrokerToken));
+        browserWindow->HandleTabCreated(m_tabId, shouldBeActive);
+    });
+}
 
-        // Register event handler for history change
-        RETURN_IF_FAILED(m_contentWebView->add_HistoryChanged(Callback<ICoreWebView2HistoryChangedEventHandler>(
-            [this, browserWindow](ICoreWebView2* webview, IUnknown* args) -> HRESULT
+Tab::~Tab()
+{
+    *m_released = true;
+}
+
+HRESULT Tab::SetUpWebView(ICoreWebView2Controller* controller)
+{
+    m_contentController = controller;
+    if (*m_released)
+    {
+        m_released = std::make_shared<bool>(false);
+    }
+    RETURN_IF_FAILED(m_contentController->get_CoreWebView2(&m_contentWebView));
+    RETURN_IF_FAILED(m_contentWebView->get_BrowserProcessId(&m_browserProcessId));
+    BrowserWindow* browserWindow = reinterpret_cast<BrowserWindow*>(GetWindowLongPtr(m_parentHWnd, GWLP_USERDATA));
+    RETURN_IF_FAILED(m_contentWebView->add_WebMessageReceived(m_messageBroker.Get(), &m_messageBrokerToken));
+    m_foreground = false;
+    m_tierStopwatch.Restart();
+
+    // Register event handler for source change. The back/forward list and
+    // the security state are only followed while the tab is in the
+    // foreground, see SetForeground.
+    RETURN_IF_FAILED(m_contentWebView->add_SourceChanged(Callback<ICoreWebView2SourceChangedEventHandler>(
+        [this, browserWindow](ICoreWebView2* webview, ICoreWebView2SourceChangedEventArgs* args) -> HRESULT
+    {
+        CountEvent();
+        wil::unique_cotaskmem_string source;
+        if (SUCCEEDED(webview->get_Source(&source)))
         {
-            BrowserWindow::CheckFailure(browserWindow->HandleTabHistoryUpdate(m_tabId, webview), L"Can't update go back/forward buttons.");
+            m_documentUri = source.get();
+            m_navigationHistory.SetDocument(m_documentUri);
+        }
 
-            return S_OK;
-        }).Get(), &m_historyUpdateForwarderToken));
+        BrowserWindow::CheckFailure(browserWindow->HandleTabURIUpdate(m_tabId, webview), L"Can't update address bar");
+
+        return S_OK;
+    }).Get(), &m_uriUpdateForwarderToken));
+
+    RETURN_IF_FAILED(m_contentWebView->add_NavigationStarting(Callback<ICoreWebView2NavigationStartingEventHandler>(
+        [this, browserWindow](ICoreWebView2* webview, ICoreWebView2NavigationStartingEventArgs* args) -> HRESULT
+    {
+        CountEvent();
+        // Redirects raise NavigationStarting again with the new URI
+        wil::unique_cotaskmem_string uri;
+        if (SUCCEEDED(args->get_Uri(&uri)))
+        {
+            m_pendingNavigationUri = uri.get();
+            BrowserWindow::CheckFailure(browserWindow->ApplyContentSettings(webview, m_pendingNavigationUri), L"Can't apply content settings");
+        }
+        args->get_NavigationId(&m_navigationId);
+
+        BrowserWindow::CheckFailure(browserWindow->HandleTabNavStarting(m_tabId, webview), L"Can't update reload button");
+
+        return S_OK;
+    }).Get(), &m_navStartingToken));
+
+    RETURN_IF_FAILED(m_contentWebView->add_NavigationCompleted(Callback<ICoreWebView2NavigationCompletedEventHandler>(
+        [this, browserWindow](ICoreWebView2* webview, ICoreWebView2NavigationCompletedEventArgs* args) -> HRESULT
+    {
+        CountEvent();
+        m_pendingNavigationUri.clear();
+
+        if (m_restoreScrollX >= 0 && m_restoreScrollY >= 0)
+        {
+            std::wstring script = L"window.scrollTo(" + std::to_wstring(m_restoreScrollX) + L", " + std::to_wstring(m_restoreScrollY) + L");";
+            m_restoreScrollX = m_restoreScrollY = -1;
+            BrowserWindow::CheckFailure(webview->ExecuteScript(script.c_str(), nullptr), L"Can't restore scroll position");
+        }
+
+        BrowserWindow::CheckFailure(browserWindow->HandleTabNavCompleted(m_tabId, webview, args), L"Can't udpate reload button");
+        return S_OK;
+    }).Get(), &m_navCompletedToken));
+
+    // Requests go through the host only while it filters, blocks images or
+    // caches them, see BrowserWindow::GetWebResourceFilters
+    m_webResourceFilters.clear();
+    RETURN_IF_FAILED(SetWebResourceFilters(browserWindow->GetWebResourceFilters()));
+    RETURN_IF_FAILED(m_contentWebView->add_WebResourceRequested(Callback<ICoreWebView2WebResourceRequestedEventHandler>(
+        [this, browserWindow](ICoreWebView2* webview, ICoreWebView2WebResourceRequestedEventArgs* args) -> HRESULT
+    {
+        CountEvent();
+        return browserWindow->HandleTabWebResourceRequested(m_tabId, webview, args);
+    }).Get(), &m_webResourceRequestedToken));
+
+    // Pop-up blocking
+    RETURN_IF_FAILED(m_contentWebView->add_NewWindowRequested(Callback<ICoreWebView2NewWindowRequestedEventHandler>(
+        [this, browserWindow](ICoreWebView2* webview, ICoreWebView2NewWindowRequestedEventArgs* args) -> HRESULT
+    {
+        CountEvent();
+        return browserWindow->HandleTabNewWindowRequested(m_tabId, webview, args);
+    }).Get(), &m_newWindowRequestedToken));
+
+    // Downloads go to the browser's download manager
+    wil::com_ptr<ICoreWebView2_4> webview4;
+    RETURN_IF_FAILED(m_contentWebView->QueryInterface(IID_PPV_ARGS(&webview4)));
+    RETURN_IF_FAILED(webview4->add_DownloadStarting(Callback<ICoreWebView2DownloadStartingEventHandler>(
+        [this, browserWindow](ICoreWebView2* webview, ICoreWebView2DownloadStartingEventArgs* args) -> HRESULT
+    {
+        CountEvent();
+        return browserWindow->HandleTabDownloadStarting(m_tabId, webview, args);
+    }).Get(), &m_downloadStartingToken));
+
+    // Responses of the origins shared between profiles are kept by the host
+    RETURN_IF_FAILED(webview4->add_WebResourceResponseReceived(Callback<ICoreWebView2WebResourceResponseReceivedEventHandler>(
+        [this, browserWindow](ICoreWebView2* webview, ICoreWebView2WebResourceResponseReceivedEventArgs* args) -> HRESULT
+    {
+        CountEvent();
+        return browserWindow->HandleTabWebResourceResponseReceived(m_tabId, webview, args);
+    }).Get(), &m_webResourceResponseReceivedToken));
+
+    // Browser shortcuts are run by the host before the page sees them
+    RETURN_IF_FAILED(m_contentController->add_AcceleratorKeyPressed(Callback<ICoreWebView2AcceleratorKeyPressedEventHandler>(
+        [browserWindow](ICoreWebView2Controller* sender, ICoreWebView2AcceleratorKeyPressedEventArgs* args) -> HRESULT
+    {
+        return browserWindow->HandleAcceleratorKeyPressed(sender, args);
+    }).Get(), &m_acceleratorKeyPressedToken));
+
+    // Renderer and GPU process exits, and renderers the runtime finds
+    // unresponsive
+    RETURN_IF_FAILED(m_contentWebView->add_ProcessFailed(Callback<ICoreWebView2ProcessFailedEventHandler>(
+        [this, browserWindow](ICoreWebView2* webview, ICoreWebView2ProcessFailedEventArgs* args) -> HRESULT
+    {
+        return browserWindow->HandleTabProcessFailed(m_tabId, args);
+    }).Get(), &m_processFailedToken));
+
+    RETURN_IF_FAILED(UpdateNetworkEvents(browserWindow->IsNetworkLogShown(), browserWindow->ThrottlesBackgroundTabs()));
+    RETURN_IF_FAILED(TrackScrollPosition());
+    RETURN_IF_FAILED(InjectFindScript());
+    RETURN_IF_FAILED(TrackScriptDialogs());
+
+    return S_OK;
+}
+
+HRESULT Tab::SetForeground(bool foreground)
+{
+    if (!m_contentWebView || foreground == m_foreground)
+    {
+        return S_OK;
+    }
+
+    (m_foreground ? m_foregroundSeconds : m_backgroundSeconds) += m_tierStopwatch.ElapsedMilliseconds() / 1000.0;
+    m_tierStopwatch.Restart();
+    m_foreground = foreground;
+
+    if (!foreground)
+    {
+        m_contentWebView->remove_HistoryChanged(m_historyUpdateForwarderToken);
+        if (m_securityStateChangedReceiver)
+        {
+            m_securityStateChangedReceiver->remove_DevToolsProtocolEventReceived(m_securityUpdateToken);
+        }
+
+        return m_contentWebView->CallDevToolsProtocolMethod(L"Security.disable", L"{}", nullptr);
+    }
+
+    LogEventVolume();
+
+    BrowserWindow* browserWindow = reinterpret_cast<BrowserWindow*>(GetWindowLongPtr(m_parentHWnd, GWLP_USERDATA));
+    RETURN_IF_FAILED(m_contentWebView->add_HistoryChanged(Callback<ICoreWebView2HistoryChangedEventHandler>(
+        [this, browserWindow](ICoreWebView2* webview, IUnknown* args) -> HRESULT
+    {
+        CountEvent();
+        BrowserWindow::CheckFailure(browserWindow->HandleTabHistoryUpdate(m_tabId, webview), L"Can't update go back/forward buttons.");
+
+        return S_OK;
+    }).Get(), &m_historyUpdateForwarderToken));
+
+    // Enabling the domain reports the current state, which brings the
+    // security icon up to date
+    if (!m_securityStateChangedReceiver)
+    {
+        RETURN_IF_FAILED(m_contentWebView->GetDevToolsProtocolEventReceiver(L"Security.securityStateChanged", &m_securityStateChangedReceiver));
+    }
+
+    RETURN_IF_FAILED(m_securityStateChangedReceiver->add_DevToolsProtocolEventReceived(Callback<ICoreWebView2DevToolsProtocolEventReceivedEventHandler>(
+        [this, browserWindow](ICoreWebView2* webview, ICoreWebView2DevToolsProtocolEventReceivedEventArgs* args) -> HRESULT
+    {
+        CountEvent();
+        BrowserWindow::CheckFailure(browserWindow->HandleTabSecurityUpdate(m_tabId, webview, args), L"Can't udpate security icon");
+        return S_OK;
+    }).Get(), &m_securityUpdateToken));
+
+    return m_contentWebView->CallDevToolsProtocolMethod(L"Security.enable", L"{}", nullptr);
+}
+
+void Tab::LogEventVolume()
+{
+    double foregroundSeconds = m_foregroundSeconds + (m_foreground ? m_tierStopwatch.ElapsedMilliseconds() / 1000.0 : 0);
+    double backgroundSeconds = m_backgroundSeconds + (m_foreground ? 0 : m_tierStopwatch.ElapsedMilliseconds() / 1000.0);
+
+    WCHAR log[256];
+    StringCchPrintf(log, ARRAYSIZE(log),
+        L"Tab %zu events: %llu in foreground (%.1f/s over %.0f s), %llu in background (%.1f/s over %.0f s)\n",
+        m_tabId, m_foregroundEvents, foregroundSeconds > 0 ? m_foregroundEvents / foregroundSeconds : 0, foregroundSeconds,
+        m_backgroundEvents, backgroundSeconds > 0 ? m_backgroundEvents / backgroundSeconds : 0, backgroundSeconds);
+    OutputDebugString(log);
+}
+
+void Tab::SetMessageBroker()
+{
+    m_messageBroker = Callback<ICoreWebView2WebMessageReceivedEventHandler>(
+        [this](ICoreWebView2* webview, ICoreWebView2WebMessageReceivedEventArgs* eventArgs) -> HRESULT
+    {
+        CountEvent();
+        BrowserWindow* browserWindow = reinterpret_cast<BrowserWindow*>(GetWindowLongPtr(m_parentHWnd, GWLP_USERDATA));
+        BrowserWindow::CheckFailure(browserWindow->HandleTabMessageReceived(m_tabId, webview, eventArgs), L"");
+
+        return S_OK;
+    });
+}
+
+HRESULT Tab::UpdateNetworkEvents(bool log, bool webSockets)
+{
+    if (!m_contentWebView)
+    {
+        return S_OK;
+    }
+
+    bool wasEnabled = !m_networkLogSubscriptions.empty() || !m_webSocketSubscriptions.empty();
+    if (log && m_networkLogSubscriptions.empty())
+    {
+        RETURN_IF_FAILED(EnableNetworkLog());
+    }
+    else if (!log && !m_networkLogSubscriptions.empty())
+    {
+        // Requests still in flight would never finish
+        Unsubscribe(m_networkLogSubscriptions);
+        m_networkLog.Clear();
+    }
+
+    if (webSockets && m_webSocketSubscriptions.empty())
+    {
+        RETURN_IF_FAILED(TrackWebSockets());
+    }
+    else if (!webSockets && !m_webSocketSubscriptions.empty())
+    {
+        Unsubscribe(m_webSocketSubscriptions);
+        m_webSockets.clear();
+    }
+
+    bool enabled = log || webSockets;
+    if (enabled == wasEnabled)
+    {
+        return S_OK;
+    }
+
+    // Response bodies are never read, keep DevTools from buffering them so
+    // the Network domain costs the page as little as possible.
+    return m_contentWebView->CallDevToolsProtocolMethod(enabled ? L"Network.enable" : L"Network.disable",
+        enabled ? L"{\"maxTotalBufferSize\":0,\"maxResourceBufferSize\":0,\"maxPostDataSize\":0}" : L"{}", nullptr);
+}
+
+HRESULT Tab::EnableNetworkLog()
+{
+    RETURN_IF_FAILED(SubscribeToDevToolsEvent(m_networkLogSubscriptions, L"Network.requestWillBeSent", [this](const web::json::value& params)
+    {
+        m_networkLog.HandleRequestWillBeSent(params);
+    }));
+
+    RETURN_IF_FAILED(SubscribeToDevToolsEvent(m_networkLogSubscriptions, L"Network.responseReceived", [this](const web::json::value& params)
+    {
+        m_networkLog.HandleResponseReceived(params);
+    }));
+
+    RETURN_IF_FAILED(SubscribeToDevToolsEvent(m_networkLogSubscriptions, L"Network.requestServedFromCache", [this](const web::json::value& params)
+    {
+        m_networkLog.HandleRequestServedFromCache(params);
+    }));
+
+    RETURN_IF_FAILED(SubscribeToDevToolsEvent(m_networkLogSubscriptions, L"Network.loadingFinished", [this](const web::json::value& params)
+    {
+        m_networkLog.HandleLoadingFinished(params);
+    }));
 
-        // Register event handler for source change
-        RETURN_IF_FAILED(m_contentWebView->add_SourceChanged(Callback<ICoreWebView2SourceChangedEventHandler>(
-            [this, browserWindow](ICoreWebView2* webview, ICoreWebView2SourceChangedEventArgs* args) -> HRESULT
+    RETURN_IF_FAILED(SubscribeToDevToolsEvent(m_networkLogSubscriptions, L"Network.loadingFailed", [this](const web::json::value& params)
+    {
+        m_networkLog.HandleLoadingFailed(params);
+    }));
+
+    return S_OK;
+}
+
+HRESULT Tab::TrackScrollPosition()
+{
+    // Top level documents report where they are scrolled to, throttled while
+    // scrolling and once more when they are left, for the navigation entry
+    std::wstring script(
+        L"(() => {"
+        L"    if (window.top !== window) {"
+        L"        return;"
+        L"    }"
+        L"    let timer = 0;"
+        L"    const report = () => {"
+        L"        clearTimeout(timer);"
+        L"        timer = 0;"
+        L"        window.chrome.webview.postMessage({"
+        L"            message: " + std::to_wstring(MG_SCROLL_POSITION) + L","
+        L"            args: { uri: window.location.href, x: window.scrollX, y: window.scrollY }"
+        L"        });"
+        L"    };"
+        L"    window.addEventListener('scroll', () => {"
+        L"        if (!timer) {"
+        L"            timer = setTimeout(report, 250);"
+        L"        }"
+        L"    }, { passive: true });"
+        L"    window.addEventListener('pagehide', report);"
+        L"})();"
+    );
+
+    return AddDocumentScript(script, &Tab::m_scrollScriptId);
+}
+
+HRESULT Tab::InjectFindScript()
+{
+    // Loaded once, every tab gets the same script. It is added to each new
+    // document so typing in the find bar only has to call into it.
+    static std::wstring s_findScript;
+    if (s_findScript.empty())
+    {
+        BrowserWindow* browserWindow = reinterpret_cast<BrowserWindow*>(GetWindowLongPtr(m_parentHWnd, GWLP_USERDATA));
+        std::ifstream file(browserWindow->GetFullPathFor(L"wvbrowser_ui\\find_in_page.js"), std::ios::binary);
+        if (!file)
         {
-            BrowserWindow::CheckFailure(browserWindow->HandleTabURIUpdate(m_tabId, webview), L"Can't update address bar");
+            return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+        }
+
+        std::stringstream contents;
+        contents << file.rdbuf();
+        s_findScript = L"(function(commands) {\n" + utility::conversions::to_string_t(contents.str()) +
+            L"\n})({ MG_FIND: " + std::to_wstring(MG_FIND) + L", MG_FIND_RESULT: " + std::to_wstring(MG_FIND_RESULT) + L" });";
+    }
+
+    return AddDocumentScript(s_findScript, &Tab::m_findScriptId);
+}
+
+HRESULT Tab::Find(const std::wstring& action, const web::json::value& args)
+{
+    if (!m_contentWebView)
+    {
+        return S_OK;
+    }
+
+    // A document loaded before the script was added just doesn't answer
+    std::wstring script = L"window.__wvbrowserFind && window.__wvbrowserFind." + action + L"(" + args.serialize() + L");";
+    return m_contentWebView->ExecuteScript(script.c_str(), nullptr);
+}
 
+HRESULT Tab::TrackScriptDialogs()
+{
+    // A page showing alert(), confirm() or prompt() doesn't run scripts
+    // until it's closed, which the watchdog mustn't take for a hang
+    std::wstring script(
+        L"(() => {"
+        L"    if (window.top !== window) {"
+        L"        return;"
+        L"    }"
+        L"    const report = (open) => window.chrome.webview.postMessage({"
+        L"        message: " + std::to_wstring(MG_SCRIPT_DIALOG) + L","
+        L"        args: { open: open }"
+        L"    });"
+        L"    for (const name of ['alert', 'confirm', 'prompt']) {"
+        L"        const dialog = window[name];"
+        L"        window[name] = function() {"
+        L"            report(true);"
+        L"            try {"
+        L"                return dialog.apply(this, arguments);"
+        L"            } finally {"
+        L"                report(false);"
+        L"            }"
+        L"        };"
+        L"    }"
+        L"})();"
+    );
+
+    return AddDocumentScript(script, &Tab::m_dialogScriptId);
+}
+
+HRESULT Tab::AddDocumentScript(const std::wstring& script, std::wstring Tab::* scriptId)
+{
+    // The ID comes back asynchronously, by which time the tab may have let
+    // go of the WebView, which then goes on to another tab, or be gone. The
+    // script is removed here in that case, ReleaseController couldn't.
+    std::shared_ptr<bool> released = m_released;
+    ComPtr<ICoreWebView2> webview = m_contentWebView;
+    return m_contentWebView->AddScriptToExecuteOnDocumentCreated(script.c_str(),
+        Callback<ICoreWebView2AddScriptToExecuteOnDocumentCreatedCompletedHandler>(
+            [this, released, webview, scriptId](HRESULT error, PCWSTR id) -> HRESULT
+    {
+        if (FAILED(error))
+        {
             return S_OK;
-        }).Get(), &m_uriUpdateForwarderToken));
+        }
 
-        RETURN_IF_FAILED(m_contentWebView->add_NavigationStarting(Callback<ICoreWebView2NavigationStartingEventHandler>(
-            [this, browserWindow](ICoreWebView2* webview, ICoreWebView2NavigationStartingEventArgs* args) -> HRESULT
+        if (*released)
+        {
+            webview->RemoveScriptToExecuteOnDocumentCreated(id);
+        }
+        else
         {
-            BrowserWindow::CheckFailure(browserWindow->HandleTabNavStarting(m_tabId, webview), L"Can't update reload button");
+            this->*scriptId = id;
+        }
+
+        return S_OK;
+    }).Get());
+}
 
+HRESULT Tab::Heartbeat(double& unansweredMilliseconds)
+{
+    unansweredMilliseconds = 0;
+    if (!m_contentWebView)
+    {
+        return S_OK;
+    }
+
+    if (m_heartbeatPending)
+    {
+        unansweredMilliseconds = m_heartbeatStopwatch.ElapsedMilliseconds();
+        return S_OK;
+    }
+
+    // Answered once the renderer's main thread gets to it, if ever. The tab
+    // may be closed or recovered meanwhile.
+    uint64_t heartbeat = ++m_heartbeatCount;
+    m_heartbeatPending = true;
+    m_heartbeatStopwatch.Restart();
+    std::shared_ptr<bool> released = m_released;
+    return m_contentWebView->ExecuteScript(L"0", Callback<ICoreWebView2ExecuteScriptCompletedHandler>(
+        [this, released, heartbeat](HRESULT error, PCWSTR result) -> HRESULT
+    {
+        if (!*released && heartbeat == m_heartbeatCount)
+        {
+            m_heartbeatPending = false;
+        }
+
+        return S_OK;
+    }).Get());
+}
+
+void Tab::HandleScriptDialog(bool open)
+{
+    // A heartbeat sent before the dialog opened has waited on it all along,
+    // and the dialog closing is reported before it's answered. It gets a
+    // full interval from here instead of being taken for a hang.
+    m_scriptDialogOpen = open;
+    if (!open)
+    {
+        m_heartbeatStopwatch.Restart();
+    }
+}
+
+void Tab::Reopen(const NavigationEntry& entry)
+{
+    m_reopened = true;
+    m_navigationHistory.RestoreDocument(entry);
+    m_restoreScrollX = entry.scrollX;
+    m_restoreScrollY = entry.scrollY;
+}
+
+HRESULT Tab::SetWebResourceFilters(const std::vector<WebResourceFilter>& filters)
+{
+    if (!m_contentWebView)
+    {
+        return S_OK;
+    }
+
+    for (const WebResourceFilter& filter : m_webResourceFilters)
+    {
+        if (std::find(filters.begin(), filters.end(), filter) == filters.end())
+        {
+            RETURN_IF_FAILED(m_contentWebView->RemoveWebResourceRequestedFilter(filter.first.c_str(), filter.second));
+        }
+    }
+
+    for (const WebResourceFilter& filter : filters)
+    {
+        if (std::find(m_webResourceFilters.begin(), m_webResourceFilters.end(), filter) == m_webResourceFilters.end())
+        {
+            RETURN_IF_FAILED(m_contentWebView->AddWebResourceRequestedFilter(filter.first.c_str(), filter.second));
+        }
+    }
+
+    m_webResourceFilters = filters;
+    return S_OK;
+}
+
+ComPtr<ICoreWebView2Controller> Tab::ReleaseController()
+{
+    ComPtr<ICoreWebView2Controller> controller = m_contentController;
+    if (!m_contentWebView)
+    {
+        // A controller still on its way is handed back, see Init
+        *m_released = true;
+        return controller;
+    }
+
+    // Nothing registered here may outlive the tab
+    LogEventVolume();
+    SetForeground(false);
+    m_contentWebView->remove_WebMessageReceived(m_messageBrokerToken);
+    m_contentWebView->remove_SourceChanged(m_uriUpdateForwarderToken);
+    m_contentWebView->remove_NavigationStarting(m_navStartingToken);
+    m_contentWebView->remove_NavigationCompleted(m_navCompletedToken);
+    m_contentWebView->remove_WebResourceRequested(m_webResourceRequestedToken);
+    m_contentWebView->remove_NewWindowRequested(m_newWindowRequestedToken);
+    wil::com_ptr<ICoreWebView2_4> webview4;
+    if (SUCCEEDED(m_contentWebView->QueryInterface(IID_PPV_ARGS(&webview4))))
+    {
+        webview4->remove_DownloadStarting(m_downloadStartingToken);
+        webview4->remove_WebResourceResponseReceived(m_webResourceResponseReceivedToken);
+    }
+    SetWebResourceFilters({});
+    m_contentController->remove_AcceleratorKeyPressed(m_acceleratorKeyPressedToken);
+    m_contentWebView->remove_ProcessFailed(m_processFailedToken);
+
+    m_securityStateChangedReceiver.Reset();
+
+    Unsubscribe(m_networkLogSubscriptions);
+    Unsubscribe(m_webSocketSubscriptions);
+    m_webSockets.clear();
+    m_contentWebView->CallDevToolsProtocolMethod(L"Network.disable", L"{}", nullptr);
+    m_contentWebView->CallDevToolsProtocolMethod(L"Performance.disable", L"{}", nullptr);
+    if (m_throttled)
+    {
+        m_contentWebView->CallDevToolsProtocolMethod(L"Emulation.setCPUThrottlingRate", L"{\"rate\":1}", nullptr);
+        m_throttled = false;
+    }
+
+    // Scripts whose IDs haven't come back yet are removed when they do,
+    // see AddDocumentScript
+    *m_released = true;
+    for (std::wstring* scriptId : { &m_scrollScriptId, &m_findScriptId, &m_dialogScriptId })
+    {
+        if (!scriptId->empty())
+        {
+            m_contentWebView->RemoveScriptToExecuteOnDocumentCreated(scriptId->c_str());
+            scriptId->clear();
+        }
+    }
+
+    // A heartbeat still out is for the old WebView
+    ++m_heartbeatCount;
+    m_heartbeatPending = false;
+    m_scriptDialogOpen = false;
+
+    // Content settings are applied per navigation, start from the defaults
+    ComPtr<ICoreWebView2Settings> settings;
+    if (SUCCEEDED(m_contentWebView->get_Settings(&settings)))
+    {
+        settings->put_IsScriptEnabled(TRUE);
+    }
+
+    m_contentWebView.Reset();
+    m_contentController.Reset();
+
+    return controller;
+}
+
+HRESULT Tab::SubscribeToDevToolsEvent(std::vector<DevToolsSubscription>& subscriptions, LPCWSTR eventName,
+    std::function<void(const web::json::value&)> handler)
+{
+    DevToolsSubscription subscription;
+    RETURN_IF_FAILED(m_contentWebView->GetDevToolsProtocolEventReceiver(eventName, &subscription.receiver));
+
+    RETURN_IF_FAILED(subscription.receiver->add_DevToolsProtocolEventReceived(Callback<ICoreWebView2DevToolsProtocolEventReceivedEventHandler>(
+        [this, handler](ICoreWebView2* webview, ICoreWebView2DevToolsProtocolEventReceivedEventArgs* args) -> HRESULT
+    {
+        CountEvent();
+        wil::unique_cotaskmem_string jsonArgs;
+        RETURN_IF_FAILED(args->get_ParameterObjectAsJson(&jsonArgs));
+        handler(web::json::value::parse(jsonArgs.get()));
+
+        return S_OK;
+    }).Get(), &subscription.token));
+
+    subscriptions.push_back(subscription);
+    return S_OK;
+}
+
+void Tab::Unsubscribe(std::vector<DevToolsSubscription>& subscriptions)
+{
+    for (DevToolsSubscription& subscription : subscriptions)
+    {
+        subscription.receiver->remove_DevToolsProtocolEventReceived(subscription.token);
+    }
+    subscriptions.clear();
+}
+
+HRESULT Tab::UpdateHeapUsage(std::function<void()> done)
+{
+    if (!m_contentWebView)
+    {
+        return E_UNEXPECTED;
+    }
+
+    // Unlike Performance.getMetrics this needs no domain enabled. The tab
+    // may be closed or discarded by the time it answers.
+    std::shared_ptr<bool> released = m_released;
+    ComPtr<ICoreWebView2> webview = m_contentWebView;
+    return webview->CallDevToolsProtocolMethod(L"Runtime.getHeapUsage", L"{}",
+        Callback<ICoreWebView2CallDevToolsProtocolMethodCompletedHandler>(
+            [this, released, webview, done](HRESULT error, PCWSTR resultJson) -> HRESULT
+    {
+        if (*released)
+        {
             return S_OK;
-        }).Get(), &m_navStartingToken));
+        }
+        RETURN_IF_FAILED(error);
+
+        web::json::value result = web::json::value::parse(resultJson);
+        if (result.has_field(L"usedSize") && result.at(L"usedSize").is_number())
+        {
+            m_jsHeapBytes = static_cast<uint64_t>(result.at(L"usedSize").as_double());
+        }
+
+        done();
+        return S_OK;
+    }).Get());
+}
+
+HRESULT Tab::Suspend(std::function<void(bool)> done)
+{
+    ComPtr<ICoreWebView2_3> webview3;
+    if (!m_contentWebView || FAILED(m_contentWebView.As(&webview3)))
+    {
+        return E_NOINTERFACE;
+    }
 
-        RETURN_IF_FAILED(m_contentWebView->add_NavigationCompleted(Callback<ICoreWebView2NavigationCompletedEventHandler>(
-            [this, browserWindow](ICoreWebView2* webview, ICoreWebView2NavigationCompletedEventArgs* args) -> HRESULT
+    // Also discarded when over budget, possibly before this is answered
+    std::shared_ptr<bool> released = m_released;
+    return webview3->TrySuspend(Callback<ICoreWebView2TrySuspendCompletedHandler>(
+        [this, released, webview3, done](HRESULT error, BOOL isSuccessful) -> HRESULT
+    {
+        if (*released)
         {
-            BrowserWindow::CheckFailure(browserWindow->HandleTabNavCompleted(m_tabId, webview, args), L"Can't udpate reload button");
             return S_OK;
-        }).Get(), &m_navCompletedToken));
+        }
 
-        // Enable listening for security events to update secure icon
-        RETURN_IF_FAILED(m_contentWebView->CallDevToolsProtocolMethod(L"Security.enable", L"{}", nullptr));
+        bool suspended = SUCCEEDED(error) && isSuccessful && m_memoryState == TabMemoryState::Active;
+        if (suspended)
+        {
+            m_memoryState = TabMemoryState::Suspended;
+        }
 
-        BrowserWindow::CheckFailure(m_contentWebView->GetDevToolsProtocolEventReceiver(L"Security.securityStateChanged", &m_securityStateChangedReceiver), L"");
+        done(suspended);
+        return S_OK;
+    }).Get());
+}
+
+bool Tab::IsPlayingAudio() const
+{
+    ComPtr<ICoreWebView2_8> webview8;
+    BOOL playingAudio = FALSE;
+
+    return m_contentWebView && SUCCEEDED(m_contentWebView.As(&webview8)) &&
+        SUCCEEDED(webview8->get_IsDocumentPlayingAudio(&playingAudio)) && playingAudio;
+}
 
-        // Forward security status updates to browser
-        RETURN_IF_FAILED(m_securityStateChangedReceiver->add_DevToolsProtocolEventReceived(Callback<ICoreWebView2DevToolsProtocolEventReceivedEventHandler>(
-            [this, browserWindow](ICoreWebView2* webview, ICoreWebView2DevToolsProtocolEventReceivedEventArgs* args) -> HRESULT
+void Tab::Discard()
+{
+    NavigationEntry entry = m_navigationHistory.GetCurrentEntry();
+
+    ComPtr<ICoreWebView2Controller> controller = ReleaseController();
+    if (controller)
+    {
+        controller->Close();
+    }
+
+    // The back/forward list went with the WebView
+    m_navigationHistory = NavigationHistory();
+    m_navigationHistory.RestoreDocument(entry);
+    m_memoryState = TabMemoryState::Discarded;
+    m_jsHeapBytes = 0;
+}
+
+void Tab::SetPendingNavigation(const std::wstring& uri)
+{
+    NavigationEntry entry;
+    entry.uri = uri;
+    m_navigationHistory.RestoreDocument(entry);
+    m_restoreScrollX = m_restoreScrollY = -1;
+}
+
+void Tab::Restore(ControllerPool& pool)
+{
+    Reopen(m_navigationHistory.GetCurrentEntry());
+    m_memoryState = TabMemoryState::Active;
+    // Shown if it's still the tab switched to, see BrowserWindow::SwitchToTab
+    Init(pool, false);
+}
+
+HRESULT Tab::TrackWebSockets()
+{
+    // Pages keeping a live connection stay unthrottled
+    RETURN_IF_FAILED(SubscribeToDevToolsEvent(m_webSocketSubscriptions, L"Network.webSocketCreated", [this](const web::json::value& params)
+    {
+        if (params.has_field(L"requestId") && params.at(L"requestId").is_string())
+        {
+            m_webSockets.insert(params.at(L"requestId").as_string());
+        }
+    }));
+
+    return SubscribeToDevToolsEvent(m_webSocketSubscriptions, L"Network.webSocketClosed", [this](const web::json::value& params)
+    {
+        if (params.has_field(L"requestId") && params.at(L"requestId").is_string())
+        {
+            m_webSockets.erase(params.at(L"requestId").as_string());
+        }
+    });
+}
+
+HRESULT Tab::GetThreadTime(std::function<void(double)> done)
+{
+    // |done| uses the tab, which may be closed or discarded by the time the
+    // metrics come back
+    std::shared_ptr<bool> released = m_released;
+    ComPtr<ICoreWebView2> webview = m_contentWebView;
+    return webview->CallDevToolsProtocolMethod(L"Performance.getMetrics", L"{}",
+        Callback<ICoreWebView2CallDevToolsProtocolMethodCompletedHandler>(
+            [released, webview, done](HRESULT error, PCWSTR resultJson) -> HRESULT
+    {
+        if (*released)
         {
-            BrowserWindow::CheckFailure(browserWindow->HandleTabSecurityUpdate(m_tabId, webview, args), L"Can't udpate security icon");
             return S_OK;
-        }).Get(), &m_securityUpdateToken));
+        }
+        RETURN_IF_FAILED(error);
 
-        RETURN_IF_FAILED(m_contentWebView->Navigate(L"https://www.bing.com"));
-        browserWindow->HandleTabCreated(m_tabId, shouldBeActive);
+        web::json::value result = web::json::value::parse(resultJson);
+        if (!result.has_field(L"metrics") || !result.at(L"metrics").is_array())
+        {
+            return S_OK;
+        }
+
+        for (const web::json::value& metric : result.at(L"metrics").as_array())
+        {
+            if (metric.has_field(L"name") && metric.at(L"name").is_string() &&
+                metric.at(L"name").as_string().compare(L"ThreadTime") == 0 &&
+                metric.has_field(L"value") && metric.at(L"value").is_number())
+            {
+                done(metric.at(L"value").as_double());
+                break;
+            }
+        }
 
         return S_OK;
     }).Get());
 }
 
-void Tab::SetMessageBroker()
+HRESULT Tab::HandleHidden()
 {
-    m_messageBroker = Callback<ICoreWebView2WebMessageReceivedEventHandler>(
-        [this](ICoreWebView2* webview, ICoreWebView2WebMessageReceivedEventArgs* eventArgs) -> HRESULT
+    if (!m_contentWebView)
     {
-        BrowserWindow* browserWindow = reinterpret_cast<BrowserWindow*>(GetWindowLongPtr(m_parentHWnd, GWLP_USERDATA));
-        BrowserWindow::CheckFailure(browserWindow->HandleTabMessageReceived(m_tabId, webview, eventArgs), L"");
+        return S_OK;
+    }
+
+    m_hiddenThreadTime = -1;
+    RETURN_IF_FAILED(m_contentWebView->CallDevToolsProtocolMethod(L"Performance.enable", L"{}", nullptr));
+
+    return GetThreadTime([this](double threadTime)
+    {
+        m_hiddenThreadTime = threadTime;
+    });
+}
+
+HRESULT Tab::Throttle(double rate)
+{
+    if (!m_contentWebView || (m_throttled && rate == m_throttleRate))
+    {
+        return S_OK;
+    }
+
+    std::wstring params = L"{\"rate\":" + std::to_wstring(rate) + L"}";
+    m_throttleRate = rate;
+    if (m_throttled)
+    {
+        // Only the rate changed
+        return m_contentWebView->CallDevToolsProtocolMethod(L"Emulation.setCPUThrottlingRate", params.c_str(), nullptr);
+    }
+
+    m_throttled = true;
+    m_throttleThreadTime = -1;
+    m_throttleStopwatch.Restart();
+    double hiddenSeconds = m_inactiveStopwatch.ElapsedMilliseconds() / 1000;
+
+    // Tabs opened in the background were never measured unthrottled, their
+    // savings aren't counted
+    RETURN_IF_FAILED(m_contentWebView->CallDevToolsProtocolMethod(L"Performance.enable", L"{}", nullptr));
+    RETURN_IF_FAILED(GetThreadTime([this, hiddenSeconds](double threadTime)
+    {
+        m_backgroundCpuRate = m_hiddenThreadTime >= 0 && hiddenSeconds > 0 ?
+            (threadTime - m_hiddenThreadTime) / hiddenSeconds : -1;
+        m_throttleThreadTime = threadTime;
+    }));
+
+    RETURN_IF_FAILED(m_contentWebView->CallDevToolsProtocolMethod(L"Emulation.setCPUThrottlingRate", params.c_str(), nullptr));
+
+    return PauseMedia(true);
+}
 
+HRESULT Tab::Unthrottle()
+{
+    if (!m_contentWebView || !m_throttled)
+    {
         return S_OK;
+    }
+
+    m_throttled = false;
+    double throttledSeconds = m_throttleStopwatch.ElapsedMilliseconds() / 1000;
+
+    RETURN_IF_FAILED(m_contentWebView->CallDevToolsProtocolMethod(L"Emulation.setCPUThrottlingRate", L"{\"rate\":1}", nullptr));
+    RETURN_IF_FAILED(PauseMedia(false));
+
+    // What the tab would have used at its unthrottled background rate,
+    // against what it did use
+    return GetThreadTime([this, throttledSeconds](double threadTime)
+    {
+        if (m_throttleThreadTime >= 0 && m_backgroundCpuRate >= 0)
+        {
+            double saved = m_backgroundCpuRate * throttledSeconds - (threadTime - m_throttleThreadTime);
+            m_cpuSaved += saved;
+
+            WCHAR log[160];
+            StringCchPrintf(log, ARRAYSIZE(log), L"Tab %llu: throttled for %.0f s, %.2f s CPU saved (%.2f s in total)\n",
+                static_cast<uint64_t>(m_tabId), throttledSeconds, saved, m_cpuSaved);
+            OutputDebugString(log);
+        }
+
+        if (m_contentWebView && !m_throttled)
+        {
+            m_contentWebView->CallDevToolsProtocolMethod(L"Performance.disable", L"{}", nullptr);
+        }
     });
 }
 
+HRESULT Tab::PauseMedia(bool pause)
+{
+    // Only silent media is left to pause, tabs playing audio aren't
+    // throttled. What gets paused here is resumed when the tab is shown.
+    std::wstring script = pause ?
+        L"(() => {"
+        L"    window.__wvbrowserPausedMedia = Array.from(document.querySelectorAll('video, audio'))"
+        L"        .filter(media => !media.paused);"
+        L"    window.__wvbrowserPausedMedia.forEach(media => media.pause());"
+        L"})();" :
+        L"(() => {"
+        L"    (window.__wvbrowserPausedMedia || []).forEach(media => media.play().catch(() => {}));"
+        L"    delete window.__wvbrowserPausedMedia;"
+        L"})();";
+
+    return m_contentWebView->ExecuteScript(script.c_str(), nullptr);
+}
+
 HRESULT Tab::ResizeWebView()
 {
+    // Discarded, or being recreated after a crash
+    if (!m_contentController)
+    {
+        return S_OK;
+    }
+
     RECT bounds;
     GetClientRect(m_parentHWnd, &bounds);
 
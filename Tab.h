@@ -5,6 +5,22 @@
 #pragma once
 
 #include "framework.h"
+#include "ControllerPool.h"
+#include "NavigationHistory.h"
+#include "NetworkLog.h"
+#include "Stopwatch.h"
+#include <set>
+
+// A URI pattern and resource context WebResourceRequested is raised for
+typedef std::pair<std::wstring, COREWEBVIEW2_WEB_RESOURCE_CONTEXT> WebResourceFilter;
+
+// What a tab holds on to while in the background
+enum class TabMemoryState
+{
+    Active,
+    Suspended,  // WebView suspended, resumes when shown
+    Discarded   // No WebView, reloads its entry when shown
+};
 
 class Tab
 {
@@ -12,9 +28,86 @@ public:
     Microsoft::WRL::ComPtr<ICoreWebView2Controller> m_contentController;
     Microsoft::WRL::ComPtr<ICoreWebView2> m_contentWebView;
     Microsoft::WRL::ComPtr<ICoreWebView2DevToolsProtocolEventReceiver> m_securityStateChangedReceiver;
+    NetworkLog m_networkLog;  // Recent requests, shown in browser://network
+    NavigationHistory m_navigationHistory;  // Back/forward list as the controls UI sees it
+    std::wstring m_documentUri;  // Committed top level document
+    std::wstring m_pendingNavigationUri;  // Top level navigation in progress, empty if none
+    uint64_t m_navigationId = 0;  // Of the last NavigationStarting
+    // Time to the first load of tabs opened from the controls UI
+    Stopwatch m_openStopwatch;
+    bool m_measureOpen = false;
+    bool m_reopened = false;
+    // Memory accounting, see BrowserWindow::EnforceMemoryBudget
+    TabMemoryState m_memoryState = TabMemoryState::Active;
+    Stopwatch m_inactiveStopwatch;  // Since the tab was last hidden
+    uint32_t m_browserProcessId = 0;
+    uint64_t m_jsHeapBytes = 0;
+    // Background throttling, see BrowserWindow::ThrottleBackgroundTabs
+    bool m_throttled = false;
+    double m_cpuSaved = 0;  // Estimated main thread CPU seconds
+    // Hang and crash recovery, see BrowserWindow::CheckTabResponsive
+    bool m_scriptDialogOpen = false;  // Heartbeats go unanswered meanwhile
+    bool m_hangReported = false;  // Renderer asked to crash, ProcessFailed follows
+    bool m_recovering = false;  // New WebView loading the last entry
+    Stopwatch m_recoveryStopwatch;  // Since the hang or the crash was noticed
+
+    ~Tab();
 
-    static std::unique_ptr<Tab> CreateNewTab(HWND hWnd, ICoreWebView2Environment* env, size_t id, bool shouldBeActive);
+    static std::unique_ptr<Tab> CreateNewTab(HWND hWnd, ControllerPool& pool, size_t id, bool shouldBeActive, const std::wstring& uri);
+    static std::unique_ptr<Tab> CreateWithController(HWND hWnd, ICoreWebView2Controller* controller, size_t id, const std::wstring& uri);
     HRESULT ResizeWebView();
+    // Used when a prerendered tab takes the place of a visible one
+    void SetId(size_t id) { m_tabId = id; }
+    bool IsLoading() const { return !m_pendingNavigationUri.empty(); }
+    // Load a closed tab's entry again, with its title, favicon and scroll
+    // position. Call before the tab's WebView is ready.
+    void Reopen(const NavigationEntry& entry);
+    // Every request WebResourceRequested is raised for waits on the UI
+    // thread, so only the ones something in the host looks at should be
+    HRESULT SetWebResourceFilters(const std::vector<WebResourceFilter>& filters);
+    // Unhook the tab from its controller so the controller can be reused.
+    // The tab is unusable afterwards.
+    Microsoft::WRL::ComPtr<ICoreWebView2Controller> ReleaseController();
+
+    // Refresh m_jsHeapBytes, |done| runs once it is
+    HRESULT UpdateHeapUsage(std::function<void()> done);
+    // Only background tabs can be suspended; |done| is told whether it was
+    HRESULT Suspend(std::function<void(bool)> done);
+    bool IsPlayingAudio() const;
+    // Close the WebView, keeping the current entry to load again in Restore
+    void Discard();
+    // Active again right away, though without a WebView until Init is done
+    void Restore(ControllerPool& pool);
+    // For a tab without a WebView yet: Init loads |uri| instead of the
+    // entry it was going to restore
+    void SetPendingNavigation(const std::wstring& uri);
+
+    // Start measuring main thread CPU time once the tab is hidden, so
+    // throttling can be compared against how busy it was unthrottled
+    HRESULT HandleHidden();
+    // Also changes the rate of a tab already throttled
+    HRESULT Throttle(double rate);
+    HRESULT Unthrottle();
+    // Runs a find in page action ("find", "next", "previous" or "stop") in
+    // the current document, see wvbrowser_ui/find_in_page.js
+    HRESULT Find(const std::wstring& action, const web::json::value& args);
+    // Runs a trivial script unless the previous one is still unanswered, in
+    // which case |unansweredMilliseconds| is how long it has been waiting
+    HRESULT Heartbeat(double& unansweredMilliseconds);
+    // From the page, see TrackScriptDialogs
+    void HandleScriptDialog(bool open);
+    bool HasOpenWebSockets() const { return !m_webSockets.empty(); }
+    // Follows requests for the network log while a network page is open, and
+    // WebSockets while background tabs are throttled. The Network domain is
+    // only enabled while either is.
+    HRESULT UpdateNetworkEvents(bool log, bool webSockets);
+
+    // Tabs start out in the background, with only the events the browser
+    // needs whether or not the tab is shown. The shown tab also gets the
+    // back/forward list and the Security domain, which only the controls UI
+    // uses; the caller brings the UI up to date when a tab comes forward.
+    HRESULT SetForeground(bool foreground);
+    bool IsForeground() const { return m_foreground; }
 protected:
     HWND m_parentHWnd = nullptr;
     size_t m_tabId = INVALID_TAB_ID;
@@ -22,10 +115,70 @@ protected:
     EventRegistrationToken m_uriUpdateForwarderToken = {};
     EventRegistrationToken m_navStartingToken = {};
     EventRegistrationToken m_navCompletedToken = {};
+    EventRegistrationToken m_webResourceRequestedToken = {};
+    EventRegistrationToken m_webResourceResponseReceivedToken = {};
+    EventRegistrationToken m_newWindowRequestedToken = {};
+    EventRegistrationToken m_downloadStartingToken = {};
+    EventRegistrationToken m_acceleratorKeyPressedToken = {};
+    EventRegistrationToken m_processFailedToken = {};
     EventRegistrationToken m_securityUpdateToken = {};
     EventRegistrationToken m_messageBrokerToken = {};  // Message broker for browser pages loaded in a tab
     Microsoft::WRL::ComPtr<ICoreWebView2WebMessageReceivedEventHandler> m_messageBroker;
+    std::wstring m_scrollScriptId;
+    std::wstring m_findScriptId;
+    std::wstring m_dialogScriptId;
+    // Set once the tab is done with its current WebView, for callbacks that
+    // may come after
+    std::shared_ptr<bool> m_released = std::make_shared<bool>(true);
+    uint64_t m_heartbeatCount = 0;
+    bool m_heartbeatPending = false;
+    Stopwatch m_heartbeatStopwatch;
+    std::set<std::wstring> m_webSockets;  // Request IDs of open WebSockets
+    std::vector<WebResourceFilter> m_webResourceFilters;  // Added to the WebView
+
+    // Events handled per tier and the time spent in each, see LogEventVolume
+    bool m_foreground = false;
+    uint64_t m_foregroundEvents = 0;
+    uint64_t m_backgroundEvents = 0;
+    double m_foregroundSeconds = 0;
+    double m_backgroundSeconds = 0;
+    Stopwatch m_tierStopwatch;
+
+    // Main thread CPU seconds (the ThreadTime metric) when the tab was
+    // hidden and when it was throttled, -1 if not known
+    double m_hiddenThreadTime = -1;
+    double m_throttleThreadTime = -1;
+    double m_throttleRate = 1;
+    double m_backgroundCpuRate = -1;  // CPU seconds per second before throttling
+    Stopwatch m_throttleStopwatch;
+
+    // Scroll position to go back to after the first load, -1 if none
+    double m_restoreScrollX = -1;
+    double m_restoreScrollY = -1;
+
+    struct DevToolsSubscription
+    {
+        Microsoft::WRL::ComPtr<ICoreWebView2DevToolsProtocolEventReceiver> receiver;
+        EventRegistrationToken token = {};
+    };
+    std::vector<DevToolsSubscription> m_networkLogSubscriptions;
+    std::vector<DevToolsSubscription> m_webSocketSubscriptions;
 
-    HRESULT Init(ICoreWebView2Environment* env, bool shouldBeActive);
+    void Init(ControllerPool& pool, bool shouldBeActive);
+    HRESULT SetUpWebView(ICoreWebView2Controller* controller);
     void SetMessageBroker();
+    HRESULT EnableNetworkLog();
+    HRESULT TrackScrollPosition();
+    HRESULT InjectFindScript();
+    HRESULT TrackScriptDialogs();
+    // Adds |script| to every new document and stores its ID in |scriptId|
+    HRESULT AddDocumentScript(const std::wstring& script, std::wstring Tab::* scriptId);
+    HRESULT TrackWebSockets();
+    HRESULT GetThreadTime(std::function<void(double)> done);
+    HRESULT PauseMedia(bool pause);
+    HRESULT SubscribeToDevToolsEvent(std::vector<DevToolsSubscription>& subscriptions, LPCWSTR eventName,
+        std::function<void(const web::json::value&)> handler);
+    static void Unsubscribe(std::vector<DevToolsSubscription>& subscriptions);
+    void CountEvent() { ++(m_foreground ? m_foregroundEvents : m_backgroundEvents); }
+    void LogEventVolume();
 };
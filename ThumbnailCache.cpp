@@ -0,0 +1,449 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "BrowserWindow.h"
+#include "ThumbnailCache.h"
+#include <fstream>
+#include <iterator>
+#include <shlobj.h>
+#pragma comment (lib, "windowscodecs.lib")
+
+using namespace Microsoft::WRL;
+
+namespace
+{
+    void DeleteThumbnails(const std::wstring& directory)
+    {
+        WIN32_FIND_DATAW findData;
+        HANDLE find = FindFirstFileW((directory + L"\\*.jpg").c_str(), &findData);
+        if (find == INVALID_HANDLE_VALUE)
+        {
+            return;
+        }
+
+        do
+        {
+            DeleteFileW((directory + L"\\" + findData.cFileName).c_str());
+        } while (FindNextFileW(find, &findData));
+        FindClose(find);
+    }
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_one();
+
+    if (m_worker.joinable())
+    {
+        m_worker.join();
+    }
+
+    if (!m_directory.empty())
+    {
+        DeleteThumbnails(m_directory);
+        RemoveDirectoryW(m_directory.c_str());
+    }
+}
+
+void ThumbnailCache::Init(HWND hWnd, const std::wstring& directory)
+{
+    // Tab IDs restart in every window, and other browser processes spill
+    // previews too. Each window gets its own directory, named after its
+    // process so the ones of processes that are gone can be cleaned up.
+    WCHAR name[64];
+    StringCchPrintf(name, ARRAYSIZE(name), L"%lu.%p", GetCurrentProcessId(), hWnd);
+    std::wstring windowDirectory = directory + L"\\" + name;
+
+    m_hWnd = hWnd;
+    m_directory = windowDirectory;
+    m_worker = std::thread([this]()
+    {
+        RunWorker();
+    });
+
+    RunOnWorker([directory, windowDirectory]()
+    {
+        // Left over by processes that didn't exit cleanly, and by versions
+        // that spilled straight to |directory|
+        DeleteThumbnails(directory);
+        WIN32_FIND_DATAW findData;
+        HANDLE find = FindFirstFileW((directory + L"\\*").c_str(), &findData);
+        if (find != INVALID_HANDLE_VALUE)
+        {
+            do
+            {
+                DWORD processId = wcstoul(findData.cFileName, nullptr, 10);
+                if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || processId == 0)
+                {
+                    continue;
+                }
+
+                wil::unique_handle process(OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId));
+                if (!process)
+                {
+                    std::wstring leftOver = directory + L"\\" + findData.cFileName;
+                    DeleteThumbnails(leftOver);
+                    RemoveDirectoryW(leftOver.c_str());
+                }
+            } while (FindNextFileW(find, &findData));
+            FindClose(find);
+        }
+
+        SHCreateDirectoryExW(nullptr, windowDirectory.c_str(), nullptr);
+    });
+}
+
+HRESULT ThumbnailCache::Capture(size_t tabId, ICoreWebView2* webview, std::function<void()> done)
+{
+    wil::com_ptr<IStream> stream;
+    RETURN_IF_FAILED(CreateStreamOnHGlobal(nullptr, TRUE, &stream));
+
+    uint64_t captureNumber = ++m_captureCount;
+    m_pendingCaptures[tabId] = captureNumber;
+    std::shared_ptr<Stopwatch> stopwatch = std::make_shared<Stopwatch>();
+
+    return webview->CapturePreview(COREWEBVIEW2_CAPTURE_PREVIEW_IMAGE_FORMAT_JPEG, stream.get(),
+        Callback<ICoreWebView2CapturePreviewCompletedHandler>(
+            [this, tabId, captureNumber, stream, stopwatch, done](HRESULT errorCode) -> HRESULT
+    {
+        double captureMilliseconds = stopwatch->ElapsedMilliseconds();
+        if (FAILED(errorCode))
+        {
+            ++m_capturesFailed;
+            OutputDebugString(L"Thumbnail capture failed\n");
+            if (done)
+            {
+                done();
+            }
+            return S_OK;
+        }
+
+        HWND hWnd = m_hWnd;
+        RunOnWorker([this, hWnd, tabId, captureNumber, stream, captureMilliseconds, done]()
+        {
+            Stopwatch scaleStopwatch;
+            std::shared_ptr<std::vector<BYTE>> jpeg = std::make_shared<std::vector<BYTE>>();
+            HRESULT hr = Downscale(stream.get(), *jpeg);
+            double scaleMilliseconds = scaleStopwatch.ElapsedMilliseconds();
+
+            BrowserWindow::PostToUIThread(hWnd, [this, tabId, captureNumber, jpeg, hr, captureMilliseconds, scaleMilliseconds, done]()
+            {
+                if (SUCCEEDED(hr))
+                {
+                    Insert(tabId, captureNumber, jpeg);
+                    ++m_capturesStored;
+                    m_captureMilliseconds += captureMilliseconds;
+                    m_scaleMilliseconds += scaleMilliseconds;
+                    m_capturedBytes += jpeg->size();
+
+                    WCHAR log[256];
+                    StringCchPrintf(log, ARRAYSIZE(log),
+                        L"Thumbnail for tab %zu: %.1f ms capture, %.1f ms downscale, %zu bytes; %zu in memory (%zu KB), %zu on disk\n",
+                        tabId, captureMilliseconds, scaleMilliseconds, jpeg->size(), m_lru.size(), m_memoryBytes / 1024,
+                        m_entries.size() - m_lru.size());
+                    OutputDebugString(log);
+                }
+                else
+                {
+                    ++m_capturesFailed;
+                    OutputDebugString(L"Thumbnail downscale failed\n");
+                }
+
+                if (done)
+                {
+                    done();
+                }
+            });
+        });
+
+        return S_OK;
+    }).Get());
+}
+
+void ThumbnailCache::Remove(size_t tabId)
+{
+    m_pendingCaptures.erase(tabId);
+
+    auto entry = m_entries.find(tabId);
+    if (entry == m_entries.end())
+    {
+        return;
+    }
+
+    if (entry->second.jpeg)
+    {
+        m_memoryBytes -= entry->second.jpeg->size();
+        m_lru.erase(entry->second.lruPosition);
+    }
+    else
+    {
+        std::wstring path = GetPath(tabId);
+        RunOnWorker([path]()
+        {
+            DeleteFileW(path.c_str());
+        });
+    }
+
+    m_entries.erase(entry);
+}
+
+void ThumbnailCache::GetThumbnails(const std::vector<size_t>& tabIds, std::function<void(const web::json::value&)> callback)
+{
+    // Spilled previews are read back for this only, the overview going
+    // through every tab shouldn't push the recent ones out of memory
+    std::vector<std::pair<size_t, std::shared_ptr<const std::vector<BYTE>>>> requested;
+    for (size_t tabId : tabIds)
+    {
+        auto entry = m_entries.find(tabId);
+        if (entry != m_entries.end())
+        {
+            requested.emplace_back(tabId, entry->second.jpeg);
+        }
+    }
+
+    HWND hWnd = m_hWnd;
+    RunOnWorker([this, hWnd, requested, callback]()
+    {
+        Stopwatch stopwatch;
+        size_t fromDisk = 0;
+        size_t bytes = 0;
+        std::shared_ptr<web::json::value> thumbnails = std::make_shared<web::json::value>(web::json::value::array());
+
+        for (const auto& thumbnail : requested)
+        {
+            std::vector<BYTE> loaded;
+            const std::vector<BYTE>* jpeg = thumbnail.second.get();
+            if (!jpeg)
+            {
+                std::ifstream file(GetPath(thumbnail.first), std::ios::binary);
+                loaded.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+                if (loaded.empty())
+                {
+                    continue;
+                }
+                jpeg = &loaded;
+                ++fromDisk;
+            }
+
+            web::json::value item = web::json::value::object();
+            item[L"tabId"] = web::json::value::number(thumbnail.first);
+            item[L"image"] = web::json::value(L"data:image/jpeg;base64," + utility::conversions::to_base64(*jpeg));
+            (*thumbnails)[thumbnails->size()] = item;
+            bytes += jpeg->size();
+        }
+
+        double milliseconds = stopwatch.ElapsedMilliseconds();
+        WCHAR log[128];
+        StringCchPrintf(log, ARRAYSIZE(log), L"Tab overview: %zu thumbnails (%zu from disk), %zu KB in %.1f ms\n",
+            thumbnails->size(), fromDisk, bytes / 1024, milliseconds);
+        OutputDebugString(log);
+
+        BrowserWindow::PostToUIThread(hWnd, [this, thumbnails, fromDisk, bytes, milliseconds, callback]()
+        {
+            m_overviewThumbnails = thumbnails->size();
+            m_overviewFromDisk = fromDisk;
+            m_overviewBytes = bytes;
+            m_overviewMilliseconds = milliseconds;
+            callback(*thumbnails);
+        });
+    });
+}
+
+web::json::value ThumbnailCache::GetStats() const
+{
+    double captures = m_capturesStored ? static_cast<double>(m_capturesStored) : 1;
+    web::json::value stats = web::json::value::object();
+    stats[L"captures"] = web::json::value::number(m_capturesStored);
+    stats[L"failedCaptures"] = web::json::value::number(m_capturesFailed);
+    stats[L"averageCaptureMilliseconds"] = web::json::value::number(m_captureMilliseconds / captures);
+    stats[L"averageDownscaleMilliseconds"] = web::json::value::number(m_scaleMilliseconds / captures);
+    stats[L"averageBytes"] = web::json::value::number(m_capturedBytes / captures);
+    stats[L"inMemory"] = web::json::value::number(static_cast<uint64_t>(m_lru.size()));
+    stats[L"memoryBytes"] = web::json::value::number(static_cast<uint64_t>(m_memoryBytes));
+    stats[L"onDisk"] = web::json::value::number(static_cast<uint64_t>(m_entries.size() - m_lru.size()));
+    stats[L"overviewThumbnails"] = web::json::value::number(static_cast<uint64_t>(m_overviewThumbnails));
+    stats[L"overviewFromDisk"] = web::json::value::number(static_cast<uint64_t>(m_overviewFromDisk));
+    stats[L"overviewBytes"] = web::json::value::number(static_cast<uint64_t>(m_overviewBytes));
+    stats[L"overviewMilliseconds"] = web::json::value::number(m_overviewMilliseconds);
+
+    return stats;
+}
+
+void ThumbnailCache::Insert(size_t tabId, uint64_t captureNumber, std::shared_ptr<const std::vector<BYTE>> jpeg)
+{
+    // Dropped if the tab closed or was captured again meanwhile
+    auto pending = m_pendingCaptures.find(tabId);
+    if (pending == m_pendingCaptures.end() || pending->second != captureNumber)
+    {
+        return;
+    }
+    m_pendingCaptures.erase(pending);
+
+    Entry& entry = m_entries[tabId];
+    if (entry.jpeg)
+    {
+        m_memoryBytes -= entry.jpeg->size();
+        m_lru.erase(entry.lruPosition);
+    }
+
+    // A stale copy on disk is left until the next spill overwrites it
+    m_lru.push_front(tabId);
+    entry.lruPosition = m_lru.begin();
+    entry.jpeg = jpeg;
+    m_memoryBytes += jpeg->size();
+
+    EnforceBudget();
+}
+
+void ThumbnailCache::EnforceBudget()
+{
+    while (m_memoryBytes > c_memoryBudget && !m_lru.empty())
+    {
+        size_t tabId = m_lru.back();
+        m_lru.pop_back();
+
+        Entry& entry = m_entries.at(tabId);
+        std::shared_ptr<const std::vector<BYTE>> jpeg = std::move(entry.jpeg);
+        m_memoryBytes -= jpeg->size();
+
+        std::wstring path = GetPath(tabId);
+        RunOnWorker([path, jpeg]()
+        {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(jpeg->data()), jpeg->size());
+        });
+    }
+}
+
+std::wstring ThumbnailCache::GetPath(size_t tabId) const
+{
+    return m_directory + L"\\" + std::to_wstring(tabId) + L".jpg";
+}
+
+void ThumbnailCache::RunOnWorker(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_condition.notify_one();
+}
+
+void ThumbnailCache::RunWorker()
+{
+    CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&m_imagingFactory));
+
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]()
+            {
+                return m_stopping || !m_tasks.empty();
+            });
+
+            // Whatever is left only mattered to this session
+            if (m_stopping)
+            {
+                break;
+            }
+
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+
+        task();
+    }
+
+    m_imagingFactory.reset();
+    CoUninitialize();
+}
+
+HRESULT ThumbnailCache::Downscale(IStream* image, std::vector<BYTE>& jpeg)
+{
+    if (!m_imagingFactory)
+    {
+        return E_NOINTERFACE;
+    }
+
+    LARGE_INTEGER start = {};
+    RETURN_IF_FAILED(image->Seek(start, STREAM_SEEK_SET, nullptr));
+
+    wil::com_ptr<IWICBitmapDecoder> decoder;
+    RETURN_IF_FAILED(m_imagingFactory->CreateDecoderFromStream(image, nullptr, WICDecodeMetadataCacheOnDemand, &decoder));
+    wil::com_ptr<IWICBitmapFrameDecode> frame;
+    RETURN_IF_FAILED(decoder->GetFrame(0, &frame));
+
+    UINT width = 0;
+    UINT height = 0;
+    RETURN_IF_FAILED(frame->GetSize(&width, &height));
+    if (width == 0 || height == 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    // Scaled to the thumbnail width, keeping the top of taller pages
+    UINT scaledWidth = (std::min)(c_width, width);
+    UINT scaledHeight = (std::max)(1U, static_cast<UINT>(static_cast<uint64_t>(height) * scaledWidth / width));
+    wil::com_ptr<IWICBitmapScaler> scaler;
+    RETURN_IF_FAILED(m_imagingFactory->CreateBitmapScaler(&scaler));
+    RETURN_IF_FAILED(scaler->Initialize(frame.get(), scaledWidth, scaledHeight, WICBitmapInterpolationModeFant));
+
+    WICRect visible = { 0, 0, static_cast<INT>(scaledWidth), static_cast<INT>((std::min)(c_height, scaledHeight)) };
+    wil::com_ptr<IWICBitmapClipper> clipper;
+    RETURN_IF_FAILED(m_imagingFactory->CreateBitmapClipper(&clipper));
+    RETURN_IF_FAILED(clipper->Initialize(scaler.get(), &visible));
+
+    wil::com_ptr<IWICFormatConverter> converter;
+    RETURN_IF_FAILED(m_imagingFactory->CreateFormatConverter(&converter));
+    RETURN_IF_FAILED(converter->Initialize(clipper.get(), GUID_WICPixelFormat24bppBGR, WICBitmapDitherTypeNone,
+        nullptr, 0.0, WICBitmapPaletteTypeCustom));
+
+    wil::com_ptr<IStream> output;
+    RETURN_IF_FAILED(CreateStreamOnHGlobal(nullptr, TRUE, &output));
+    wil::com_ptr<IWICBitmapEncoder> encoder;
+    RETURN_IF_FAILED(m_imagingFactory->CreateEncoder(GUID_ContainerFormatJpeg, nullptr, &encoder));
+    RETURN_IF_FAILED(encoder->Initialize(output.get(), WICBitmapEncoderNoCache));
+
+    wil::com_ptr<IWICBitmapFrameEncode> frameEncode;
+    wil::com_ptr<IPropertyBag2> properties;
+    RETURN_IF_FAILED(encoder->CreateNewFrame(&frameEncode, &properties));
+
+    PROPBAG2 quality = {};
+    quality.pstrName = const_cast<LPOLESTR>(L"ImageQuality");
+    VARIANT qualityValue;
+    VariantInit(&qualityValue);
+    qualityValue.vt = VT_R4;
+    qualityValue.fltVal = 0.8f;
+    RETURN_IF_FAILED(properties->Write(1, &quality, &qualityValue));
+
+    RETURN_IF_FAILED(frameEncode->Initialize(properties.get()));
+    RETURN_IF_FAILED(frameEncode->SetSize(visible.Width, visible.Height));
+    WICPixelFormatGUID pixelFormat = GUID_WICPixelFormat24bppBGR;
+    RETURN_IF_FAILED(frameEncode->SetPixelFormat(&pixelFormat));
+    RETURN_IF_FAILED(frameEncode->WriteSource(converter.get(), nullptr));
+    RETURN_IF_FAILED(frameEncode->Commit());
+    RETURN_IF_FAILED(encoder->Commit());
+
+    STATSTG stat = {};
+    RETURN_IF_FAILED(output->Stat(&stat, STATFLAG_NONAME));
+    HGLOBAL global = nullptr;
+    RETURN_IF_FAILED(GetHGlobalFromStream(output.get(), &global));
+
+    const BYTE* data = static_cast<const BYTE*>(GlobalLock(global));
+    if (!data)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    jpeg.assign(data, data + stat.cbSize.QuadPart);
+    GlobalUnlock(global);
+
+    return S_OK;
+}
@@ -0,0 +1,82 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "framework.h"
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <wincodec.h>
+
+// Downscaled previews of the tabs for the tab overview. A tab is captured
+// with CapturePreview as it's hidden, which is when its preview would start
+// going stale. Decoding, scaling and encoding happen on a worker thread, as
+// does all the disk work. The most recently captured previews stay in
+// memory up to c_memoryBudget bytes, older ones are spilled to a directory
+// of the window's own under Thumbnails in the app data, deleted with the
+// window. Tab IDs restart with every window, so does the directory.
+class ThumbnailCache
+{
+public:
+    static const UINT c_width = 320;
+    static const UINT c_height = 200;
+    static const size_t c_memoryBudget = 2 * 1024 * 1024;  // Encoded bytes
+
+    ~ThumbnailCache();
+
+    void Init(HWND hWnd, const std::wstring& directory);
+    // |done| runs on the UI thread once the preview is in the cache, or the
+    // capture failed
+    HRESULT Capture(size_t tabId, ICoreWebView2* webview, std::function<void()> done = nullptr);
+    void Remove(size_t tabId);
+    // |callback| gets an array of {tabId, image} on the UI thread, image
+    // being a data URI, for the tabs of |tabIds| that have a preview
+    void GetThumbnails(const std::vector<size_t>& tabIds, std::function<void(const web::json::value&)> callback);
+    // Capture and overview timings and sizes, for the telemetry
+    web::json::value GetStats() const;
+
+protected:
+    struct Entry
+    {
+        std::shared_ptr<const std::vector<BYTE>> jpeg;  // Null once spilled
+        std::list<size_t>::iterator lruPosition;
+    };
+
+    HWND m_hWnd = nullptr;
+    std::wstring m_directory;
+    std::map<size_t, Entry> m_entries;
+    std::list<size_t> m_lru;  // Tabs with a preview in memory, most recent first
+    size_t m_memoryBytes = 0;
+    std::map<size_t, uint64_t> m_pendingCaptures;  // Latest capture of each tab
+    uint64_t m_captureCount = 0;
+
+    // Statistics, UI thread only
+    uint64_t m_capturesStored = 0;
+    uint64_t m_capturesFailed = 0;
+    double m_captureMilliseconds = 0;
+    double m_scaleMilliseconds = 0;
+    uint64_t m_capturedBytes = 0;
+    size_t m_overviewThumbnails = 0;  // Last GetThumbnails
+    size_t m_overviewFromDisk = 0;
+    size_t m_overviewBytes = 0;
+    double m_overviewMilliseconds = 0;
+
+    // Serial, so a spilled preview is on disk before it's read back or
+    // deleted
+    std::thread m_worker;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<std::function<void()>> m_tasks;
+    bool m_stopping = false;
+    wil::com_ptr<IWICImagingFactory> m_imagingFactory;  // Worker thread only
+
+    void Insert(size_t tabId, uint64_t captureNumber, std::shared_ptr<const std::vector<BYTE>> jpeg);
+    void EnforceBudget();
+    std::wstring GetPath(size_t tabId) const;
+    void RunOnWorker(std::function<void()> task);
+    void RunWorker();
+    HRESULT Downscale(IStream* image, std::vector<BYTE>& jpeg);
+};
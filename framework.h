@@ -20,7 +20,13 @@
 #include <memory>
 #include <stdlib.h>
 #include <tchar.h>
+#include <algorithm>
+#include <functional>
+#include <limits>
 #include <map>
+#include <string>
+#include <thread>
+#include <vector>
 
 // App specific includes
 #include "resource.h"
@@ -31,6 +37,9 @@
 #define MIN_WINDOW_HEIGHT 75
 #define MAX_LOADSTRING 256
 
+// Posted by BrowserWindow::RunAsync, lParam is a heap allocated std::function<void()>
+#define WM_APP_RUN_ON_UI_THREAD (WM_APP + 1)
+
 #define INVALID_TAB_ID 0
 #define MG_NAVIGATE 1
 #define MG_UPDATE_URI 2
@@ -54,8 +63,29 @@
 #define MG_GET_SETTINGS 21
 #define MG_GET_FAVORITES 22
 #define MG_REMOVE_FAVORITE 23
-#define MG_CLEAR_CACHE 24
-#define MG_CLEAR_COOKIES 25
 #define MG_GET_HISTORY 26
 #define MG_REMOVE_HISTORY_ITEM 27
 #define MG_CLEAR_HISTORY 28
+#define MG_GET_NETWORK_LOG 29
+#define MG_UPDATE_SETTINGS 30
+#define MG_PREDICT_NAVIGATION 31
+#define MG_SHOW_HISTORY_MENU 32
+#define MG_SCROLL_POSITION 33
+#define MG_REOPEN_CLOSED_TAB 34
+#define MG_TAB_STATE 35
+#define MG_GET_DOWNLOADS 36
+#define MG_DOWNLOAD_ACTION 37
+#define MG_DOWNLOAD_PROGRESS 38
+#define MG_FIND 39
+#define MG_FIND_RESULT 40
+#define MG_CAPTURE_SNAPSHOT 41
+#define MG_OPEN_SNAPSHOT 42
+#define MG_DELETE_SNAPSHOT 43
+#define MG_TAB_OVERVIEW 44
+#define MG_GET_TOP_SITES 45
+#define MG_FOCUS_ADDRESS_BAR 46
+#define MG_SYNC_CONFIG 47
+#define MG_SCRIPT_DIALOG 48
+#define MG_CLEAR_BROWSING_DATA 49
+#define MG_GET_STORAGE_USAGE 50
+#define MG_CONTROLS_READY 51
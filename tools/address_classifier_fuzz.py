@@ -0,0 +1,150 @@
+"""Correctness and speed checks for the address bar classifier.
+
+Start the browser with --automation (or --automation=<pipe name>), then:
+
+    python tools/address_classifier_fuzz.py --inputs 20000 --iterations 100000
+
+Checks what known inputs classify as, then sends random address-like and
+garbage text through the classifyAddress command and checks that the answers
+hold: searches go to the search provider with the query encoded, addresses
+have no whitespace, and the same text always gets the same answer. Ends with
+how long a classification takes for a few typical inputs. Windows only, like
+tools/automation_load.py, whose client it uses.
+"""
+
+import argparse
+import asyncio
+import random
+import string
+
+from automation_load import DEFAULT_PIPE, AutomationClient
+
+# Text and whether it's an address, with the default settings
+KNOWN = [
+    ('example.com', True),
+    ('  example.com/path?q=1 ', True),
+    ('EXAMPLE.COM', True),
+    ('bbc.co.uk', True),
+    ('co.uk', False),
+    ('localhost', True),
+    ('localhost:3000', True),
+    ('192.168.1.1', True),
+    ('999.1.1.1', False),
+    ('[::1]:8080/x', True),
+    ('wiki/', True),
+    ('build:8080', True),
+    ('foo', False),
+    ('node.js', False),
+    ('hello world', False),
+    ('what is c++', False),
+    ('https://example.com', True),
+    ('http:example.com', True),
+    ('http://', False),
+    ('http://exa mple.com', False),
+    ('javascript:alert(1)', False),
+    ('mailto:a@b.com', False),
+    ('C:\\Windows', True),
+    ('browser://history', True),
+    ('file:///c:/a', True),
+    ('m\u00fcnchen.de', True),
+    ('\u00fcber', False),
+    ('\U0001F600 smile', False),
+    ('pizza.nyc', True),
+    ('foo.bar', True),
+    ('museum.london', True),
+    ('example.bank', True),
+    ('printer.local', True),
+    ('example.notatld', False),
+    ('C:\\Program Files\\App', True),
+]
+
+BENCHMARK = [
+    'example.com',
+    'https://www.example.com/some/long/path?query=value&other=thing',
+    'how to write a fast address bar classifier',
+    'intranet-host:8080/dashboard',
+]
+
+URI_CHARACTERS = string.ascii_letters + string.digits + "-._~:/?#[]@!$&'()*+,;=%"
+WHITESPACE = ' \t\n\u00a0\u3000'
+
+
+def random_text(rng):
+    kind = rng.random()
+    if kind < 0.4:
+        labels = [''.join(rng.choice(string.ascii_lowercase + string.digits + '-')
+                          for _ in range(rng.randint(1, 12))) for _ in range(rng.randint(1, 4))]
+        text = '.'.join(labels)
+        if rng.random() < 0.3:
+            text += f':{rng.randint(0, 99999)}'
+        if rng.random() < 0.5:
+            text += '/' + ''.join(rng.choice(URI_CHARACTERS) for _ in range(rng.randint(0, 30)))
+        if rng.random() < 0.2:
+            text = rng.choice(['http://', 'https:', 'ftp://', 'file:', 'about:', 'data:']) + text
+        return text
+    if kind < 0.7:
+        return ''.join(rng.choice(URI_CHARACTERS + WHITESPACE) for _ in range(rng.randint(0, 40)))
+    return ''.join(chr(rng.choice([rng.randint(1, 0x7f), rng.randint(0x80, 0xd7ff), rng.randint(0xe000, 0xfffd),
+                                   rng.randint(0x10000, 0x1ffff)])) for _ in range(rng.randint(0, 40)))
+
+
+async def run(options):
+    rng = random.Random(options.seed)
+    client = await AutomationClient.connect(options.pipe)
+    failures = 0
+
+    def fail(text, result, reason):
+        nonlocal failures
+        failures += 1
+        if failures <= 20:
+            print(f'{reason}: {text!r} -> {result}')
+
+    # The search provider is whatever the settings say
+    probe = await client.call('classifyAddress', text='a b')
+    search_prefix = probe['uri'].split('a%20b')[0]
+
+    for text, is_address in KNOWN:
+        result = await client.call('classifyAddress', text=text)
+        if result['isSearch'] == is_address:
+            fail(text, result, 'expected an address' if is_address else 'expected a search')
+
+    texts = [random_text(rng) for _ in range(options.inputs)]
+    results = await asyncio.gather(*[client.call('classifyAddress', text=text) for text in texts])
+    for text, result in zip(texts, results):
+        uri = result['uri']
+        if not uri:
+            if not all(c.isspace() or c in '\u200b\ufeff' for c in text):
+                fail(text, result, 'text goes nowhere')
+        elif result['isSearch']:
+            query = uri[len(search_prefix):]
+            if not uri.startswith(search_prefix) or any(c not in URI_CHARACTERS for c in query):
+                fail(text, result, 'search query not encoded')
+        elif any(c in WHITESPACE for c in uri):
+            fail(text, result, 'address with whitespace')
+
+    repeated = await asyncio.gather(*[client.call('classifyAddress', text=text) for text in texts[:1000]])
+    for text, first, second in zip(texts, results, repeated):
+        if first != second:
+            fail(text, second, f'changed from {first}')
+
+    print(f'{len(KNOWN) + len(texts)} inputs, {failures} failures')
+
+    for text in BENCHMARK:
+        result = await client.call('classifyAddress', text=text, iterations=options.iterations)
+        print(f'{result["nanoseconds"]:8.1f} ns  {text}')
+
+    client.close()
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--pipe', default=DEFAULT_PIPE)
+    parser.add_argument('--inputs', type=int, default=10000, help='random inputs to check')
+    parser.add_argument('--iterations', type=int, default=100000, help='classifications timed per benchmark input')
+    parser.add_argument('--seed', type=int, default=1)
+    raise SystemExit(1 if asyncio.run(run(parser.parse_args())) else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,149 @@
+"""Load generator for the browser's automation pipe.
+
+Start the browser with --automation (or --automation=<pipe name>), then:
+
+    python tools/automation_load.py --tabs 20 --operations 5000 --depth 32
+
+Opens tabs, then sends a random mix of navigate, switchTab, reload and
+getState requests, keeping up to --depth of them in flight, and closes the
+tabs it opened. Prints the throughput, the latency percentiles for every
+command and the browser's telemetry at the end. Windows only, needs only the
+standard library (asyncio's proactor loop connects to the named pipe).
+"""
+
+import argparse
+import asyncio
+import json
+import random
+import time
+
+DEFAULT_PIPE = r'\\.\pipe\wvbrowser-automation'
+DEFAULT_URIS = [
+    'about:blank',
+    'browser://newtab',
+    'https://example.com/',
+    'https://www.wikipedia.org/',
+]
+
+
+class AutomationError(Exception):
+    pass
+
+
+class AutomationClient(asyncio.Protocol):
+    """Pipelined requests over the pipe, answers are matched by id."""
+
+    def __init__(self):
+        self._transport = None
+        self._buffer = b''
+        self._next_id = 0
+        self._pending = {}  # id -> future
+
+    @classmethod
+    async def connect(cls, pipe_name):
+        loop = asyncio.get_running_loop()
+        _, client = await loop.create_pipe_connection(cls, pipe_name)
+        return client
+
+    def connection_made(self, transport):
+        self._transport = transport
+
+    def data_received(self, data):
+        *lines, self._buffer = (self._buffer + data).split(b'\n')
+        for line in lines:
+            if not line.strip():
+                continue
+            answer = json.loads(line)
+            future = self._pending.pop(answer.get('id'), None)
+            if not future or future.done():
+                continue
+            if 'error' in answer:
+                future.set_exception(AutomationError(f"{answer['error']} {answer.get('message', '')}"))
+            else:
+                future.set_result(answer['result'])
+
+    def connection_lost(self, exc):
+        for future in self._pending.values():
+            if not future.done():
+                future.set_exception(AutomationError('disconnected'))
+        self._pending.clear()
+
+    def close(self):
+        self._transport.close()
+
+    async def call(self, command, **args):
+        self._next_id += 1
+        future = asyncio.get_running_loop().create_future()
+        self._pending[self._next_id] = future
+        line = json.dumps({'id': self._next_id, 'command': command, 'args': args}) + '\n'
+        self._transport.write(line.encode('utf-8'))
+        return await future
+
+
+def percentile(values, fraction):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(fraction * len(values)))]
+
+
+async def run_load(options):
+    random.seed(options.seed)
+    uris = options.uri or DEFAULT_URIS
+    client = await AutomationClient.connect(options.pipe)
+    in_flight = asyncio.Semaphore(options.depth)
+    latencies = {}
+
+    async def timed(command, **args):
+        async with in_flight:
+            start = time.perf_counter()
+            try:
+                return await client.call(command, **args)
+            except AutomationError as error:
+                print(f'{command} failed: {error}')
+                return None
+            finally:
+                latencies.setdefault(command, []).append(time.perf_counter() - start)
+
+    start = time.perf_counter()
+    created = await asyncio.gather(*[
+        timed('createTab', uri=random.choice(uris), active=False) for _ in range(options.tabs)])
+    tab_ids = [result['tabId'] for result in created if result]
+    if not tab_ids:
+        raise AutomationError('no tab was created')
+
+    requests = []
+    for _ in range(options.operations):
+        command = random.choice(['navigate', 'switchTab', 'reload', 'getState'])
+        args = {'tabId': random.choice(tab_ids)}
+        if command == 'navigate':
+            args['uri'] = random.choice(uris)
+        requests.append(timed(command, **args))
+    await asyncio.gather(*requests)
+
+    await asyncio.gather(*[timed('closeTab', tabId=tab_id) for tab_id in tab_ids])
+    elapsed = time.perf_counter() - start
+
+    total = sum(len(values) for values in latencies.values())
+    print(f'{total} requests in {elapsed:.1f} s, {total / elapsed * 60:.0f} per minute')
+    for command, values in sorted(latencies.items()):
+        print(f'{command:>10}: {len(values):6} requests, '
+              f'p50 {percentile(values, 0.5) * 1000:7.1f} ms, '
+              f'p95 {percentile(values, 0.95) * 1000:7.1f} ms, '
+              f'max {max(values) * 1000:7.1f} ms')
+
+    print(json.dumps(await client.call('getTelemetry'), indent=2))
+    client.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--pipe', default=DEFAULT_PIPE)
+    parser.add_argument('--tabs', type=int, default=10, help='tabs to open for the run')
+    parser.add_argument('--operations', type=int, default=1000, help='requests to send after opening the tabs')
+    parser.add_argument('--depth', type=int, default=16, help='requests kept in flight')
+    parser.add_argument('--uri', action='append', help='URIs to navigate to, can be repeated')
+    parser.add_argument('--seed', type=int, default=1)
+    asyncio.run(run_load(parser.parse_args()))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,152 @@
+"""Stand-in HTTP server for testing the browser's shared response cache.
+
+    python tools/cache_test_server.py --port 8791
+
+Then add http://localhost:8791 to the shared cache origins on
+browser://settings. /page/<n> is an HTML page using --assets scripts of
+--asset-kb KB each from /asset/<n>/<i>.js, all sent with
+
+    Cache-Control: public, s-maxage=600, max-age=0
+
+so the WebView's own cache revalidates every time and only the shared cache
+answers without asking the server. /private/<n> is the same page marked
+private, which must never be shared. /stats has the requests per path.
+
+    python tools/cache_test_server.py --port 8791 --check
+
+also drives the browser through its automation pipe (start it with
+--automation): it prewarms the cache for one page and loads it, loads others
+in several tabs, and checks how often the server was asked for each. The
+shared cache's hit ratio and bytes saved are printed at the end. --check is
+Windows only, the server alone needs only the standard library.
+"""
+
+import argparse
+import asyncio
+import json
+import threading
+from collections import Counter
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+from automation_load import DEFAULT_PIPE, AutomationClient
+
+SHARED = 'public, s-maxage=600, max-age=0'
+PRIVATE = 'private, max-age=600'
+
+
+class CacheTestHandler(BaseHTTPRequestHandler):
+    counts = Counter()
+    lock = threading.Lock()
+    assets = 4
+    asset_bytes = 256 * 1024
+
+    def do_GET(self):
+        path = self.path.split('?')[0]
+        with self.lock:
+            self.counts[path] += 1
+
+        parts = path.strip('/').split('/')
+        if path == '/stats':
+            with self.lock:
+                self.send_body(json.dumps(dict(self.counts)).encode(), 'application/json', 'no-store')
+        elif len(parts) == 2 and parts[0] in ('page', 'private'):
+            scripts = ''.join(f'<script src="/asset/{parts[1]}/{i}.js"></script>' for i in range(self.assets))
+            body = f'<!DOCTYPE html><title>{parts[0]} {parts[1]}</title>{scripts}<p>{parts[0]} {parts[1]}</p>'
+            self.send_body(body.encode(), 'text/html', SHARED if parts[0] == 'page' else PRIVATE)
+        elif len(parts) == 3 and parts[0] == 'asset':
+            line = f'// asset {parts[1]}/{parts[2]}\n'.encode()
+            self.send_body(line * (self.asset_bytes // len(line) + 1), 'text/javascript', SHARED)
+        else:
+            self.send_error(404)
+
+    def send_body(self, body, content_type, cache_control):
+        self.send_response(200)
+        self.send_header('Content-Type', content_type)
+        self.send_header('Content-Length', str(len(body)))
+        self.send_header('Cache-Control', cache_control)
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, *args):
+        pass
+
+
+def count(path):
+    with CacheTestHandler.lock:
+        return CacheTestHandler.counts[path]
+
+
+async def run_check(base, options):
+    client = await AutomationClient.connect(options.pipe)
+    telemetry = await client.call('getTelemetry')
+    if not telemetry.get('sharedCache', {}).get('origins'):
+        raise SystemExit(f'Add {base} to the shared cache origins on browser://settings first')
+
+    failures = []
+
+    def expect(what, actual, expected):
+        status = 'ok' if actual == expected else 'FAILED'
+        print(f'{status:6} {what}: {actual}, expected {expected}')
+        if actual != expected:
+            failures.append(what)
+
+    # Prewarmed, the page and its assets never come from the server again
+    uris = [f'{base}/page/0'] + [f'{base}/asset/0/{i}.js' for i in range(options.assets)]
+    prewarmed = await client.call('prewarmSharedCache', uris=uris)
+    expect('responses prewarmed', prewarmed['stored'], len(uris))
+
+    tab = (await client.call('createTab', active=False))['tabId']
+    await client.call('navigate', tabId=tab, uri=f'{base}/page/0', waitForLoad=True)
+    expect('requests for a prewarmed page', count('/page/0'), 1)
+
+    # Loaded in every tab, asked for once
+    tabs = [(await client.call('createTab', active=False))['tabId'] for _ in range(options.tabs)]
+    for page in range(1, options.pages + 1):
+        for tab_id in tabs:
+            await client.call('navigate', tabId=tab_id, uri=f'{base}/page/{page}', waitForLoad=True)
+        expect(f'requests for page {page}', count(f'/page/{page}'), 1)
+        expect(f'requests for an asset of page {page}', count(f'/asset/{page}/0.js'), 1)
+
+    # Private responses aren't shared
+    for tab_id in tabs[:2]:
+        await client.call('navigate', tabId=tab_id, uri=f'{base}/private/1', waitForLoad=True)
+    expect('requests for a private page', count('/private/1'), min(2, len(tabs)))
+
+    for tab_id in [tab] + tabs:
+        await client.call('closeTab', tabId=tab_id)
+
+    stats = (await client.call('getTelemetry'))['sharedCache']
+    print(f"hit ratio {stats['hitRatio']:.2f}, {stats['hits']} hits, {stats['misses']} misses, "
+          f"{stats['bytesSaved'] / 1024 / 1024:.1f} MB saved")
+    client.close()
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--port', type=int, default=8791)
+    parser.add_argument('--assets', type=int, default=4, help='scripts per page')
+    parser.add_argument('--asset-kb', type=int, default=256, help='size of each script')
+    parser.add_argument('--check', action='store_true', help='drive the browser through the automation pipe')
+    parser.add_argument('--pipe', default=DEFAULT_PIPE)
+    parser.add_argument('--pages', type=int, default=3, help='pages to load for --check')
+    parser.add_argument('--tabs', type=int, default=3, help='tabs loading each page for --check')
+    options = parser.parse_args()
+
+    CacheTestHandler.assets = options.assets
+    CacheTestHandler.asset_bytes = options.asset_kb * 1024
+    server = ThreadingHTTPServer(('127.0.0.1', options.port), CacheTestHandler)
+    base = f'http://localhost:{server.server_port}'
+
+    if options.check:
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+        failures = asyncio.run(run_check(base, options))
+        server.shutdown()
+        raise SystemExit(1 if failures else 0)
+
+    print(f'Cache test server on {base}')
+    server.serve_forever()
+
+
+if __name__ == '__main__':
+    main()
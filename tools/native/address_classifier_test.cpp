@@ -0,0 +1,369 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Correctness checks and benchmark for the address bar classifier, which
+// builds anywhere with a C++14 compiler. From the repository root:
+//
+//   g++ -std=c++14 -O2 -I. tools/native/address_classifier_test.cpp AddressClassifier.cpp -o address_classifier_test
+//   ./address_classifier_test [--inputs 200000] [--iterations 1000000]
+//
+// Checks what known inputs classify as, then sends random address-like and
+// garbage text through the classifier and checks that the answers hold, like
+// tools/address_classifier_fuzz.py does through a running browser. Compares
+// the vectorized URI character scan with a plain loop, and ends with how
+// long a classification takes for a few typical inputs.
+
+#include "AddressClassifier.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double MillisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    std::string ToPrintable(const std::wstring& text)
+    {
+        std::string printable;
+        for (wchar_t c : text)
+        {
+            if (c >= 0x20 && c < 0x7F)
+            {
+                printable += static_cast<char>(c);
+            }
+            else
+            {
+                char escape[16];
+                snprintf(escape, sizeof(escape), "\\u%04X", static_cast<unsigned int>(c));
+                printable += escape;
+            }
+        }
+
+        return printable;
+    }
+
+    const wchar_t* const c_uriCharacters = L"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-._~:/?#[]@!$&'()*+,;=%";
+    const wchar_t* const c_whitespace = L" \t\n\u00A0\u3000";
+
+    bool IsUriCharacter(wchar_t c)
+    {
+        return c != 0 && wcschr(c_uriCharacters, c) != nullptr;
+    }
+
+    struct KnownCase
+    {
+        const wchar_t* text;
+        bool isAddress;
+    };
+
+    int CheckKnownCases(const AddressClassifier& classifier)
+    {
+        // The same as tools/address_classifier_fuzz.py, and top level domains
+        // only the full root zone list has
+        const KnownCase cases[] =
+        {
+            { L"example.com", true },
+            { L"  example.com/path?q=1 ", true },
+            { L"EXAMPLE.COM", true },
+            { L"bbc.co.uk", true },
+            { L"co.uk", false },
+            { L"localhost", true },
+            { L"localhost:3000", true },
+            { L"192.168.1.1", true },
+            { L"999.1.1.1", false },
+            { L"[::1]:8080/x", true },
+            { L"wiki/", true },
+            { L"build:8080", true },
+            { L"foo", false },
+            { L"node.js", false },
+            { L"hello world", false },
+            { L"what is c++", false },
+            { L"https://example.com", true },
+            { L"http:example.com", true },
+            { L"http://", false },
+            { L"http://exa mple.com", false },
+            { L"javascript:alert(1)", false },
+            { L"mailto:a@b.com", false },
+            { L"C:\\Windows", true },
+            { L"browser://history", true },
+            { L"file:///c:/a", true },
+            { L"m\u00FCnchen.de", true },
+            { L"\u00FCber", false },
+            { L"\U0001F600 smile", false },
+            { L"pizza.nyc", true },
+            { L"foo.bar", true },
+            { L"museum.london", true },
+            { L"example.bank", true },
+            { L"printer.local", true },
+            { L"example.notatld", false },
+            { L"C:\\Program Files\\App", true },
+        };
+
+        int failures = 0;
+        for (const KnownCase& known : cases)
+        {
+            AddressClassifier::Result result = classifier.Classify(known.text);
+            if (result.isSearch == known.isAddress)
+            {
+                printf("FAILED %s: %s, expected %s\n", ToPrintable(known.text).c_str(),
+                    result.isSearch ? "search" : "address", known.isAddress ? "address" : "search");
+                ++failures;
+            }
+        }
+
+        printf("%zu known inputs, %d failures\n", sizeof(cases) / sizeof(cases[0]), failures);
+        return failures;
+    }
+
+    std::wstring RandomText(std::mt19937& random)
+    {
+        auto between = [&random](int low, int high)
+        {
+            return std::uniform_int_distribution<int>(low, high)(random);
+        };
+        auto pick = [&random, &between](const wchar_t* choices)
+        {
+            return choices[between(0, static_cast<int>(wcslen(choices)) - 1)];
+        };
+
+        std::wstring text;
+        int kind = between(0, 9);
+        if (kind < 4)
+        {
+            for (int label = between(1, 4); label > 0; --label)
+            {
+                text += text.empty() ? L"" : L".";
+                for (int length = between(1, 12); length > 0; --length)
+                {
+                    text += pick(L"abcdefghijklmnopqrstuvwxyz0123456789-");
+                }
+            }
+            if (between(0, 9) < 3)
+            {
+                text += L":" + std::to_wstring(between(0, 99999));
+            }
+            if (between(0, 1))
+            {
+                text += L"/";
+                for (int length = between(0, 30); length > 0; --length)
+                {
+                    text += pick(c_uriCharacters);
+                }
+            }
+            if (between(0, 4) == 0)
+            {
+                const wchar_t* const schemes[] = { L"http://", L"https:", L"ftp://", L"file:", L"about:", L"data:" };
+                text = schemes[between(0, 5)] + text;
+            }
+        }
+        else if (kind < 7)
+        {
+            std::wstring characters = std::wstring(c_uriCharacters) + c_whitespace;
+            for (int length = between(0, 40); length > 0; --length)
+            {
+                text += characters[between(0, static_cast<int>(characters.size()) - 1)];
+            }
+        }
+        else
+        {
+            for (int length = between(0, 40); length > 0; --length)
+            {
+                int range = between(0, 3);
+                int c = range == 0 ? between(1, 0x7F) : range == 1 ? between(0x80, 0xD7FF) :
+                    range == 2 ? between(0xE000, 0xFFFD) : between(0x10000, 0x1FFFF);
+                if (c > 0xFFFF && sizeof(wchar_t) == 2)
+                {
+                    c -= 0x10000;
+                    text += static_cast<wchar_t>(0xD800 + (c >> 10));
+                    text += static_cast<wchar_t>(0xDC00 + (c & 0x3FF));
+                }
+                else
+                {
+                    text += static_cast<wchar_t>(c);
+                }
+            }
+        }
+
+        return text;
+    }
+
+    int Fuzz(const AddressClassifier& classifier, unsigned seed, int inputs)
+    {
+        // The search provider is whatever the template says
+        std::wstring probe = classifier.Classify(L"a b").uri;
+        std::wstring searchPrefix = probe.substr(0, probe.find(L"a%20b"));
+
+        std::mt19937 random(seed);
+        int failures = 0;
+        auto fail = [&failures](const std::wstring& text, const AddressClassifier::Result& result, const char* reason)
+        {
+            if (failures < 20)
+            {
+                printf("%s: %s -> %s\n", reason, ToPrintable(text).c_str(), ToPrintable(result.uri).c_str());
+            }
+            ++failures;
+        };
+
+        for (int i = 0; i < inputs; ++i)
+        {
+            std::wstring text = RandomText(random);
+            AddressClassifier::Result result = classifier.Classify(text);
+            if (result.uri.empty())
+            {
+                if (text.find_first_not_of(std::wstring(c_whitespace) + L"\u200B\uFEFF\r\v\f") != std::wstring::npos)
+                {
+                    fail(text, result, "text goes nowhere");
+                }
+            }
+            else if (result.isSearch)
+            {
+                if (result.uri.compare(0, searchPrefix.size(), searchPrefix) != 0 ||
+                    !std::all_of(result.uri.begin() + searchPrefix.size(), result.uri.end(), IsUriCharacter))
+                {
+                    fail(text, result, "search query not encoded");
+                }
+            }
+            else if (result.uri.find_first_of(c_whitespace) != std::wstring::npos)
+            {
+                fail(text, result, "address with whitespace");
+            }
+
+            AddressClassifier::Result again = classifier.Classify(text);
+            if (again.uri != result.uri || again.isSearch != result.isSearch)
+            {
+                fail(text, again, "answer changed");
+            }
+        }
+
+        printf("%d random inputs, %d failures\n", inputs, failures);
+        return failures;
+    }
+
+    size_t FindNonUriCharacterScalar(const wchar_t* text, size_t length)
+    {
+        for (size_t i = 0; i < length; ++i)
+        {
+            wchar_t c = text[i];
+            if (c < L'!' || c > L'~' || wcschr(L"\"<>\\^`{|}", c))
+            {
+                return i;
+            }
+        }
+
+        return length;
+    }
+
+    int CheckCharacterScan(unsigned seed, int rounds)
+    {
+        // Mostly URI characters so the odd one out lands anywhere in the
+        // eight character blocks, including the edges of the ranges
+        const wchar_t edges[] = { 0, L' ', L'!', L'~', 0x7F, 0x80, 0x7FFF, 0x8000, 0xFFFF, L'"', L'<', L'}' };
+        std::mt19937 random(seed);
+        int failures = 0;
+        for (int round = 0; round < rounds; ++round)
+        {
+            std::wstring text;
+            for (int length = static_cast<int>(random() % 40); length > 0; --length)
+            {
+                text += c_uriCharacters[random() % wcslen(c_uriCharacters)];
+            }
+            if (!text.empty() && random() % 4)
+            {
+                wchar_t odd = random() % 3 ? edges[random() % (sizeof(edges) / sizeof(edges[0]))] :
+                    static_cast<wchar_t>(random() % (WCHAR_MAX > 0xFFFF ? 0x110000 : 0x10000));
+                text[random() % text.size()] = odd;
+            }
+
+            size_t expected = FindNonUriCharacterScalar(text.data(), text.size());
+            size_t actual = AddressClassifier::FindNonUriCharacter(text.data(), text.size());
+            if (expected != actual)
+            {
+                if (failures < 10)
+                {
+                    printf("FAILED scan of %s: %zu, expected %zu\n", ToPrintable(text).c_str(), actual, expected);
+                }
+                ++failures;
+            }
+        }
+
+        printf("%d character scans compared with a plain loop, %d differed\n", rounds, failures);
+        return failures;
+    }
+
+    void Benchmark(const AddressClassifier& classifier, int iterations)
+    {
+        const wchar_t* const inputs[] =
+        {
+            L"example.com",
+            L"https://www.example.com/some/long/path?query=value&other=thing",
+            L"how to write a fast address bar classifier",
+            L"intranet-host:8080/dashboard",
+        };
+
+        for (const wchar_t* input : inputs)
+        {
+            std::wstring text(input);
+            size_t checksum = 0;
+            Clock::time_point start = Clock::now();
+            for (int i = 0; i < iterations; ++i)
+            {
+                checksum += classifier.Classify(text).uri.size();
+            }
+            double nanoseconds = MillisecondsSince(start) * 1e6 / iterations;
+            printf("%8.1f ns  %s (%zu)\n", nanoseconds, ToPrintable(text).c_str(), checksum % 10);
+        }
+
+        std::wstring longUri = L"https://example.com/";
+        while (longUri.size() < 4096)
+        {
+            longUri += L"path/segment-";
+        }
+        size_t checksum = 0;
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < iterations / 10; ++i)
+        {
+            checksum += AddressClassifier::FindNonUriCharacter(longUri.data(), longUri.size());
+        }
+        double milliseconds = MillisecondsSince(start);
+        printf("Character scan: %.2f GB/s over %zu characters (%zu)\n",
+            static_cast<double>(longUri.size()) * sizeof(wchar_t) * (iterations / 10) / milliseconds / 1e6,
+            longUri.size(), checksum % 10);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int inputs = 200000;
+    int iterations = 1000000;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--inputs") == 0)
+        {
+            inputs = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "--iterations") == 0)
+        {
+            iterations = (std::max)(10, atoi(argv[i + 1]));
+        }
+        else
+        {
+            printf("Unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    AddressClassifier classifier;
+    int failures = CheckKnownCases(classifier) + Fuzz(classifier, 1, inputs) + CheckCharacterScan(2, 200000);
+    Benchmark(classifier, iterations);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,493 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Benchmark and correctness checks for the content filter's matcher, which
+// builds anywhere with a C++14 compiler. From the repository root:
+//
+//   g++ -std=c++14 -O2 -I. tools/native/content_filter_benchmark.cpp FilterMatcher.cpp -o content_filter_benchmark
+//   ./content_filter_benchmark [--rules 50000] [--urls 200000] [--list easylist.txt] [--corpus urls.txt]
+//
+// Checks a few known rules, then compiles single random rules and compares
+// what they block with a regular expression written from the same pattern.
+// The benchmark compiles --list (or --rules generated ones shaped like
+// EasyList's), matches --corpus (or --urls generated ones) against them and
+// prints the compile time, the compiled size and the time per request. Ends
+// with patterns full of wildcards against long URLs, the matcher's worst case.
+// Also checks that damaged compiled files are turned down or matched safely.
+
+#include "FilterMatcher.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <regex>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double MillisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    std::vector<std::string> ReadLines(const char* path)
+    {
+        std::vector<std::string> lines;
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            lines.push_back(line);
+        }
+
+        return lines;
+    }
+
+    std::string ToLower(std::string text)
+    {
+        std::transform(text.begin(), text.end(), text.begin(), [](char c)
+        {
+            return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+        });
+        return text;
+    }
+
+    bool Blocks(const std::vector<std::string>& rules, const std::string& url, const std::string& documentUrl,
+        uint32_t resourceType, bool isTopLevelDocument = false)
+    {
+        uint32_t ruleCount = 0;
+        std::vector<uint8_t> compiled = FilterMatcher::Compile(rules, ruleCount);
+        FilterMatcher matcher;
+        return matcher.Attach(compiled.data(), compiled.size()) &&
+            matcher.ShouldBlock(FilterMatcher::MakeRequest(url, documentUrl, resourceType, isTopLevelDocument));
+    }
+
+    struct KnownCase
+    {
+        std::vector<std::string> rules;
+        const char* url;
+        const char* documentUrl;
+        uint32_t resourceType;
+        bool blocked;
+    };
+
+    int CheckKnownCases()
+    {
+        const KnownCase cases[] =
+        {
+            { { "||ads.example.com^" }, "https://ads.example.com/x.js", "https://site.test/", FILTER_RESOURCE_SCRIPT, true },
+            { { "||ads.example.com^" }, "https://cdn.ads.example.com/x.js", "https://site.test/", FILTER_RESOURCE_SCRIPT, true },
+            { { "||ads.example.com^" }, "https://notads.example.com/x.js", "https://site.test/", FILTER_RESOURCE_SCRIPT, false },
+            { { "||ads.example.com^" }, "https://ads.example.com.evil.test/", "https://site.test/", FILTER_RESOURCE_SCRIPT, false },
+            { { "/banner/*/img^" }, "https://site.test/banner/big/img?x=1", "https://site.test/", FILTER_RESOURCE_IMAGE, true },
+            { { "/banner/*/img^" }, "https://site.test/banner/big/imgs", "https://site.test/", FILTER_RESOURCE_IMAGE, false },
+            { { "|https://track." }, "https://track.test/p", "https://site.test/", FILTER_RESOURCE_PING, true },
+            { { "|https://track." }, "https://site.test/?u=https://track.test", "https://site.test/", FILTER_RESOURCE_PING, false },
+            { { "swf|" }, "https://site.test/movie.swf", "https://site.test/", FILTER_RESOURCE_OTHER, true },
+            { { "swf|" }, "https://site.test/movie.swf?x", "https://site.test/", FILTER_RESOURCE_OTHER, false },
+            { { "||cdn.test/ads/$script" }, "https://cdn.test/ads/a.js", "https://site.test/", FILTER_RESOURCE_SCRIPT, true },
+            { { "||cdn.test/ads/$script" }, "https://cdn.test/ads/a.png", "https://site.test/", FILTER_RESOURCE_IMAGE, false },
+            { { "||cdn.test^$third-party" }, "https://cdn.test/a.js", "https://site.test/", FILTER_RESOURCE_SCRIPT, true },
+            { { "||cdn.test^$third-party" }, "https://cdn.test/a.js", "https://www.cdn.test/", FILTER_RESOURCE_SCRIPT, false },
+            { { "||cdn.test^", "@@||cdn.test/ok/" }, "https://cdn.test/ok/a.js", "https://site.test/", FILTER_RESOURCE_SCRIPT, false },
+            { { "||cdn.test^", "@@||cdn.test/ok/" }, "https://cdn.test/no/a.js", "https://site.test/", FILTER_RESOURCE_SCRIPT, true },
+            { { "-ad-*-*-*-*-*-x." }, "https://site.test/-ad-1-2-3-4-5-x.gif", "https://site.test/", FILTER_RESOURCE_IMAGE, true },
+            { { "example.com##.ad", "! comment", "/re[g]ex/" }, "https://example.com/regex", "https://site.test/", FILTER_RESOURCE_SCRIPT, false },
+        };
+
+        int failures = 0;
+        for (const KnownCase& known : cases)
+        {
+            if (Blocks(known.rules, known.url, known.documentUrl, known.resourceType) != known.blocked)
+            {
+                printf("FAILED %s against %s, expected %s\n", known.rules[0].c_str(), known.url, known.blocked ? "blocked" : "allowed");
+                ++failures;
+            }
+        }
+
+        // Only $document rules block the page the user navigated to
+        if (Blocks({ "||site.test^" }, "https://site.test/", "https://site.test/", FILTER_RESOURCE_DOCUMENT, true) ||
+            !Blocks({ "||site.test^$document" }, "https://site.test/", "https://site.test/", FILTER_RESOURCE_DOCUMENT, true))
+        {
+            printf("FAILED $document rules\n");
+            ++failures;
+        }
+
+        printf("%zu known cases, %d failed\n", sizeof(cases) / sizeof(cases[0]) + 1, failures);
+        return failures;
+    }
+
+    // Attach has to turn down truncated files and ones whose buckets, postings
+    // or patterns point outside their sections, and matching whatever random
+    // damage it accepts mustn't crash
+    int CheckCorruptFiles(unsigned seed, int rounds)
+    {
+        uint32_t ruleCount = 0;
+        std::vector<uint8_t> compiled = FilterMatcher::Compile(
+            { "||ads.example.com^", "/banner/*/img^", "|https://track.", "@@||cdn.test/ok/", "swf|" }, ruleCount);
+        FilterFileHeader header;
+        memcpy(&header, compiled.data(), sizeof(header));
+
+        int failures = 0;
+        FilterMatcher matcher;
+        for (size_t size = 0; size < compiled.size(); ++size)
+        {
+            if (size < header.stringPoolOffset + header.stringPoolSize && matcher.Attach(compiled.data(), size))
+            {
+                printf("FAILED attached a file truncated to %zu bytes\n", size);
+                ++failures;
+                break;
+            }
+        }
+
+        auto attachesWith = [&](size_t offset, uint32_t value)
+        {
+            std::vector<uint8_t> damaged = compiled;
+            memcpy(damaged.data() + offset, &value, sizeof(value));
+            return matcher.Attach(damaged.data(), damaged.size());
+        };
+        for (uint32_t i = 0; i < header.domainBucketCount + header.tokenBucketCount; ++i)
+        {
+            size_t bucket = header.domainTableOffset + i * sizeof(FilterBucket);
+            FilterBucket value;
+            memcpy(&value, compiled.data() + bucket, sizeof(value));
+            if (value.key != 0 && attachesWith(bucket + offsetof(FilterBucket, count), header.postingCount + 1))
+            {
+                printf("FAILED attached a bucket past the postings\n");
+                ++failures;
+            }
+        }
+        for (uint32_t i = 0; i < header.ruleCount; ++i)
+        {
+            if (attachesWith(header.rulesOffset + i * sizeof(FilterRule), header.stringPoolSize + 1))
+            {
+                printf("FAILED attached a pattern past the string pool\n");
+                ++failures;
+            }
+        }
+        if (header.postingCount > 0 && attachesWith(header.postingsOffset, header.ruleCount))
+        {
+            printf("FAILED attached a posting past the rules\n");
+            ++failures;
+        }
+
+        std::mt19937 random(seed);
+        FilterRequest request = FilterMatcher::MakeRequest("https://ads.example.com/banner/x/img?track", "https://site.test/",
+            FILTER_RESOURCE_IMAGE, false);
+        int attached = 0;
+        for (int round = 0; round < rounds; ++round)
+        {
+            std::vector<uint8_t> damaged = compiled;
+            for (int flips = random() % 4 + 1; flips > 0; --flips)
+            {
+                damaged[random() % damaged.size()] ^= static_cast<uint8_t>(1 << (random() % 8));
+            }
+            if (matcher.Attach(damaged.data(), damaged.size()))
+            {
+                ++attached;
+                matcher.ShouldBlock(request);
+            }
+        }
+
+        printf("Corrupt files turned down, %d of %d randomly damaged ones attached and matched, %d failed\n",
+            attached, rounds, failures);
+        return failures;
+    }
+
+    // What the pattern of a rule without options blocks, as a regular
+    // expression over the lowercase URL
+    std::regex ReferenceRegex(std::string pattern)
+    {
+        std::string expression;
+        if (pattern.compare(0, 2, "||") == 0)
+        {
+            expression = "^[a-z]+://([a-z0-9-]+\\.)*";
+            pattern = pattern.substr(2);
+        }
+        else if (!pattern.empty() && pattern[0] == '|')
+        {
+            expression = "^";
+            pattern = pattern.substr(1);
+        }
+
+        bool anchorEnd = !pattern.empty() && pattern.back() == '|';
+        if (anchorEnd)
+        {
+            pattern.pop_back();
+        }
+
+        for (char c : pattern)
+        {
+            if (c == '*')
+            {
+                expression += ".*";
+            }
+            else if (c == '^')
+            {
+                expression += "([^a-zA-Z0-9_.%-]|$)";
+            }
+            else if (strchr(".?/:=-", c))
+            {
+                expression += std::string("\\") + c;
+            }
+            else
+            {
+                expression += c;
+            }
+        }
+
+        return std::regex(anchorEnd ? expression + "$" : expression);
+    }
+
+    int CheckAgainstReference(unsigned seed, int rounds)
+    {
+        // Small alphabets, so that random patterns and URLs often match
+        std::mt19937 random(seed);
+        auto pick = [&random](const char* choices)
+        {
+            return choices[std::uniform_int_distribution<size_t>(0, strlen(choices) - 1)(random)];
+        };
+        auto chance = [&random](int percent)
+        {
+            return std::uniform_int_distribution<int>(0, 99)(random) < percent;
+        };
+
+        int failures = 0;
+        for (int round = 0; round < rounds; ++round)
+        {
+            std::string url = "http://";
+            int labels = 1 + static_cast<int>(random() % 3);
+            for (int label = 0; label < labels; ++label)
+            {
+                url += label ? "." : "";
+                for (int length = 1 + static_cast<int>(random() % 3); length > 0; --length)
+                {
+                    url += pick("ab1-");
+                }
+            }
+            url += '/';
+            for (int length = static_cast<int>(random() % 12); length > 0; --length)
+            {
+                url += pick("ab1/?=.-");
+            }
+
+            std::string pattern = chance(25) ? "||" : chance(15) ? "|" : "";
+            for (int length = 1 + static_cast<int>(random() % 6); length > 0; --length)
+            {
+                pattern += pick("ab1/.-*^");
+            }
+            if (chance(20))
+            {
+                pattern += '|';
+            }
+
+            // Nothing but wildcards and /regex/ rules aren't compiled
+            if (pattern.find_first_not_of("*|") == std::string::npos ||
+                (pattern.size() > 1 && pattern.front() == '/' && pattern.back() == '/'))
+            {
+                continue;
+            }
+
+            bool expected = std::regex_search(url, ReferenceRegex(pattern));
+            bool actual = Blocks({ pattern }, url, "http://document.test/", FILTER_RESOURCE_SCRIPT);
+            if (expected != actual)
+            {
+                if (failures < 10)
+                {
+                    printf("FAILED %s against %s: %s, expected %s\n", pattern.c_str(), url.c_str(),
+                        actual ? "blocked" : "allowed", expected ? "blocked" : "allowed");
+                }
+                ++failures;
+            }
+        }
+
+        printf("%d random rules compared with regular expressions, %d differed\n", rounds, failures);
+        return failures;
+    }
+
+    std::string RandomWord(std::mt19937& random, int minLength, int maxLength)
+    {
+        std::string word;
+        for (int length = std::uniform_int_distribution<int>(minLength, maxLength)(random); length > 0; --length)
+        {
+            word += static_cast<char>('a' + random() % 26);
+        }
+
+        return word;
+    }
+
+    std::vector<std::string> GenerateRules(std::mt19937& random, size_t count)
+    {
+        // Roughly EasyList's mix: mostly ||domain^ rules, then path
+        // fragments, a few with options, wildcards and exceptions
+        std::vector<std::string> rules;
+        for (size_t i = 0; i < count; ++i)
+        {
+            std::string domain = RandomWord(random, 4, 10) + "." + (random() % 2 ? "com" : "net");
+            switch (random() % 10)
+            {
+            case 0:
+            case 1:
+            case 2:
+            case 3:
+                rules.push_back("||" + domain + "^");
+                break;
+            case 4:
+                rules.push_back("||" + domain + "^$third-party");
+                break;
+            case 5:
+                rules.push_back("/" + RandomWord(random, 3, 8) + "/" + RandomWord(random, 3, 8) + ".");
+                break;
+            case 6:
+                rules.push_back("-" + RandomWord(random, 3, 8) + "-ad-");
+                break;
+            case 7:
+                rules.push_back("||" + domain + "/" + RandomWord(random, 3, 6) + "/*.js$script");
+                break;
+            case 8:
+                rules.push_back("/" + RandomWord(random, 3, 6) + "*" + RandomWord(random, 3, 6) + "*/banner^");
+                break;
+            default:
+                rules.push_back("@@||" + domain + "/" + RandomWord(random, 3, 6) + "/");
+                break;
+            }
+        }
+
+        return rules;
+    }
+
+    std::vector<std::string> GenerateUrls(std::mt19937& random, const std::vector<std::string>& rules, size_t count)
+    {
+        // A tenth from the rules' domains, so some requests are blocked
+        std::vector<std::string> urls;
+        for (size_t i = 0; i < count; ++i)
+        {
+            std::string host = "www." + RandomWord(random, 4, 12) + ".com";
+            if (random() % 10 == 0 && !rules.empty())
+            {
+                const std::string& rule = rules[random() % rules.size()];
+                if (rule.compare(0, 2, "||") == 0)
+                {
+                    host = rule.substr(2, rule.find_first_of("^/") - 2);
+                }
+            }
+
+            std::string url = "https://" + host;
+            for (int segment = static_cast<int>(random() % 5); segment >= 0; --segment)
+            {
+                url += "/" + RandomWord(random, 2, 12);
+            }
+            url += random() % 3 ? ".js" : "?id=" + std::to_string(random() % 100000) + "&ref=" + RandomWord(random, 4, 10);
+            urls.push_back(url);
+        }
+
+        return urls;
+    }
+
+    void Benchmark(const std::vector<std::string>& rules, const std::vector<std::string>& urls)
+    {
+        Clock::time_point start = Clock::now();
+        uint32_t ruleCount = 0;
+        std::vector<uint8_t> compiled = FilterMatcher::Compile(rules, ruleCount);
+        printf("Compiled %u rules from %zu lines into %zu bytes in %.1f ms\n", ruleCount, rules.size(), compiled.size(),
+            MillisecondsSince(start));
+
+        FilterMatcher matcher;
+        if (!matcher.Attach(compiled.data(), compiled.size()))
+        {
+            printf("FAILED to attach the compiled rules\n");
+            exit(1);
+        }
+
+        std::vector<FilterRequest> requests;
+        requests.reserve(urls.size());
+        for (const std::string& url : urls)
+        {
+            requests.push_back(FilterMatcher::MakeRequest(ToLower(url), "https://www.site.test/", FILTER_RESOURCE_SCRIPT, false));
+        }
+
+        std::vector<double> nanoseconds;
+        nanoseconds.reserve(requests.size());
+        size_t blocked = 0;
+        start = Clock::now();
+        for (const FilterRequest& request : requests)
+        {
+            Clock::time_point requestStart = Clock::now();
+            blocked += matcher.ShouldBlock(request) ? 1 : 0;
+            nanoseconds.push_back(std::chrono::duration<double, std::nano>(Clock::now() - requestStart).count());
+        }
+        double total = MillisecondsSince(start);
+
+        std::sort(nanoseconds.begin(), nanoseconds.end());
+        auto percentile = [&nanoseconds](double fraction)
+        {
+            return nanoseconds.empty() ? 0 : nanoseconds[static_cast<size_t>(fraction * (nanoseconds.size() - 1))];
+        };
+        printf("Matched %zu URLs in %.1f ms, %zu blocked: %.0f ns average, %.0f ns p50, %.0f ns p99, %.0f ns max\n",
+            requests.size(), total, blocked, requests.empty() ? 0 : total * 1e6 / requests.size(),
+            percentile(0.5), percentile(0.99), percentile(1));
+    }
+
+    void BenchmarkWildcards()
+    {
+        // Every '*' but the last used to retry the rest of the pattern at
+        // every position, exponential in the number of wildcards
+        for (int wildcards : { 4, 8, 16 })
+        {
+            std::string pattern;
+            for (int i = 0; i < wildcards; ++i)
+            {
+                pattern += "a*";
+            }
+            pattern += "b";
+
+            std::string url = "https://site.test/" + std::string(2000, 'a');
+            Clock::time_point start = Clock::now();
+            bool blocked = Blocks({ pattern }, url, "https://site.test/", FILTER_RESOURCE_SCRIPT);
+            printf("%d wildcards against a %zu character URL: %s in %.3f ms\n", wildcards, url.size(),
+                blocked ? "blocked" : "allowed", MillisecondsSince(start));
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t ruleCount = 50000;
+    size_t urlCount = 200000;
+    const char* listPath = nullptr;
+    const char* corpusPath = nullptr;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--rules") == 0)
+        {
+            ruleCount = strtoul(argv[i + 1], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--urls") == 0)
+        {
+            urlCount = strtoul(argv[i + 1], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--list") == 0)
+        {
+            listPath = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "--corpus") == 0)
+        {
+            corpusPath = argv[i + 1];
+        }
+    }
+
+    int failures = CheckKnownCases() + CheckAgainstReference(1, 20000) + CheckCorruptFiles(3, 20000);
+
+    std::mt19937 random(2);
+    std::vector<std::string> rules = listPath ? ReadLines(listPath) : GenerateRules(random, ruleCount);
+    std::vector<std::string> urls = corpusPath ? ReadLines(corpusPath) : GenerateUrls(random, rules, urlCount);
+    Benchmark(rules, urls);
+    BenchmarkWildcards();
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,238 @@
+"""Stand-in sync server for the browser's favorites and history sync.
+
+    python tools/sync_server.py --port 8790 [--seed 100000]
+
+Then set the sync server to http://localhost:8790 on browser://settings.
+Everything is kept in memory. --seed fills the server with synthetic history
+records first, for measuring an initial sync from the browser's console log.
+
+    python tools/sync_server.py --benchmark 100000
+
+measures the server and the protocol alone: a client pushes that many
+records in batches, as a device would on its initial sync, and a second
+device pulls them. Needs only the standard library.
+
+Protocol: the browser POSTs a gzip compressed JSON body to /sync
+
+    {"device": "...", "cursor": 12, "limit": 500, "changes": [record, ...]}
+
+with record being {"key", "vv", "modified", "device", "data"}, and gets
+
+    {"cursor": 530, "more": false, "changes": [record, ...]}
+
+back: the records changed after its cursor, except those it sent itself.
+Conflicts are resolved the way wvbrowser_ui/controls_ui/sync.js does.
+"""
+
+import argparse
+import bisect
+import gzip
+import json
+import threading
+import time
+import urllib.request
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+DEFAULT_LIMIT = 500
+MAX_LIMIT = 5000
+
+
+def compare_version_vectors(a, b):
+    newer = older = False
+    for device in set(a) | set(b):
+        newer = newer or a.get(device, 0) > b.get(device, 0)
+        older = older or a.get(device, 0) < b.get(device, 0)
+    if newer and older:
+        return 'concurrent'
+    return 'newer' if newer else 'older' if older else 'equal'
+
+
+def resolve(stored, incoming):
+    """The record to keep and whether it's a merge, None to keep |stored|."""
+    if stored is None:
+        return incoming, False
+    order = compare_version_vectors(stored['vv'], incoming['vv'])
+    if order == 'older':
+        return incoming, False
+    if order != 'concurrent':
+        return None, False
+
+    incoming_wins = (incoming['modified'], incoming['device']) > (stored['modified'], stored['device'])
+    winner = dict(incoming if incoming_wins else stored)
+    winner['vv'] = {device: max(stored['vv'].get(device, 0), incoming['vv'].get(device, 0))
+                    for device in set(stored['vv']) | set(incoming['vv'])}
+    return winner, True
+
+
+class SyncStore:
+    def __init__(self):
+        self._lock = threading.Lock()
+        self._records = {}  # key -> (seq, origin, record)
+        self._log = []  # (seq, key) in seq order, entries of replaced versions are skipped
+        self._seq = 0
+
+    def _put(self, record, origin):
+        self._seq += 1
+        self._records[record['key']] = (self._seq, origin, record)
+        self._log.append((self._seq, record['key']))
+
+    def sync(self, device, cursor, limit, changes):
+        with self._lock:
+            for incoming in changes:
+                current = self._records.get(incoming['key'])
+                winner, merged = resolve(current[2] if current else None, incoming)
+                if winner is not None:
+                    # A merge is news to the sender as well
+                    self._put(winner, None if merged else device)
+
+            answer = []
+            position = bisect.bisect_right(self._log, (cursor, chr(0x10FFFF)))
+            while position < len(self._log) and len(answer) < limit:
+                seq, key = self._log[position]
+                position += 1
+                current_seq, origin, record = self._records[key]
+                if seq == current_seq and origin != device:
+                    answer.append(record)
+                cursor = seq
+            return {'cursor': cursor, 'more': position < len(self._log), 'changes': answer}
+
+    def seed(self, count):
+        now = int(time.time() * 1000)
+        for record in synthetic_records('seed', count, now):
+            self._put(record, 'seed')
+
+
+def synthetic_records(device, count, now):
+    for index in range(count):
+        uri = f'https://site{index % 5000}.example/page/{index}'
+        timestamp = now - index * 60000
+        day = time.localtime(timestamp / 1000)
+        yield {
+            'key': f'h:{day.tm_year}-{day.tm_mon}-{day.tm_mday}:{uri}',
+            'vv': {device: 1},
+            'modified': timestamp,
+            'device': device,
+            'data': {'uri': uri, 'title': f'Page {index}', 'favicon': '', 'timestamp': timestamp},
+        }
+
+
+class SyncHandler(BaseHTTPRequestHandler):
+    store = None
+
+    def _send_cors_headers(self):
+        # The controls UI is a file:// page
+        self.send_header('Access-Control-Allow-Origin', '*')
+        self.send_header('Access-Control-Allow-Methods', 'POST, OPTIONS')
+        self.send_header('Access-Control-Allow-Headers', 'Content-Type, Content-Encoding')
+
+    def do_OPTIONS(self):
+        self.send_response(204)
+        self._send_cors_headers()
+        self.end_headers()
+
+    def do_POST(self):
+        if self.path != '/sync':
+            self.send_error(404)
+            return
+
+        start = time.perf_counter()
+        body = self.rfile.read(int(self.headers.get('Content-Length', 0)))
+        try:
+            if self.headers.get('Content-Encoding') == 'gzip':
+                body = gzip.decompress(body)
+            request = json.loads(body)
+            limit = max(1, min(MAX_LIMIT, int(request.get('limit', DEFAULT_LIMIT))))
+            answer = self.store.sync(str(request['device']), int(request.get('cursor', 0)), limit,
+                                     request.get('changes', []))
+        except (OSError, ValueError, KeyError, TypeError) as error:
+            self.send_error(400, str(error))
+            return
+
+        payload = json.dumps(answer, separators=(',', ':')).encode('utf-8')
+        gzipped = 'gzip' in self.headers.get('Accept-Encoding', '')
+        if gzipped:
+            payload = gzip.compress(payload, compresslevel=6)
+
+        self.send_response(200)
+        self._send_cors_headers()
+        self.send_header('Content-Type', 'application/json')
+        if gzipped:
+            self.send_header('Content-Encoding', 'gzip')
+        self.send_header('Content-Length', str(len(payload)))
+        self.end_headers()
+        self.wfile.write(payload)
+
+        self.log_message('%s: %d up, %d down, %.1f ms', request['device'][:8],
+                         len(request.get('changes', [])), len(answer['changes']),
+                         (time.perf_counter() - start) * 1000)
+
+
+def post_batch(url, request):
+    body = gzip.compress(json.dumps(request).encode('utf-8'))
+    http_request = urllib.request.Request(url, data=body, headers={
+        'Content-Type': 'application/json', 'Content-Encoding': 'gzip', 'Accept-Encoding': 'gzip'})
+    with urllib.request.urlopen(http_request) as response:
+        payload = response.read()
+        received = len(payload)
+        if response.headers.get('Content-Encoding') == 'gzip':
+            payload = gzip.decompress(payload)
+        return json.loads(payload), len(body), received
+
+
+def run_benchmark(url, count, batch):
+    records = list(synthetic_records('benchmark-a', count, int(time.time() * 1000)))
+
+    start = time.perf_counter()
+    sent = received = cursor = 0
+    for offset in range(0, len(records), batch):
+        answer, up, down = post_batch(url, {'device': 'benchmark-a', 'cursor': cursor, 'limit': batch,
+                                            'changes': records[offset:offset + batch]})
+        cursor = answer['cursor']
+        sent += up
+        received += down
+    report('push', count, time.perf_counter() - start, sent, received)
+
+    start = time.perf_counter()
+    sent = received = cursor = pulled = 0
+    more = True
+    while more:
+        answer, up, down = post_batch(url, {'device': 'benchmark-b', 'cursor': cursor, 'limit': batch,
+                                            'changes': []})
+        cursor, more = answer['cursor'], answer['more']
+        pulled += len(answer['changes'])
+        sent += up
+        received += down
+    report('pull', pulled, time.perf_counter() - start, sent, received)
+
+
+def report(phase, count, seconds, sent, received):
+    print(f'{phase}: {count} records in {seconds:.1f} s, {count / seconds:.0f} records/s, '
+          f'{sent / 1024:.0f} kB sent, {received / 1024:.0f} kB received')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--port', type=int, default=8790)
+    parser.add_argument('--seed', type=int, default=0, help='synthetic history records to start with')
+    parser.add_argument('--benchmark', type=int, metavar='RECORDS',
+                        help='push and pull that many records against a fresh server, then exit')
+    parser.add_argument('--batch', type=int, default=DEFAULT_LIMIT, help='records per request for --benchmark')
+    options = parser.parse_args()
+
+    SyncHandler.store = SyncStore()
+    SyncHandler.store.seed(options.seed)
+    server = ThreadingHTTPServer(('127.0.0.1', options.port), SyncHandler)
+
+    if options.benchmark:
+        SyncHandler.log_message = lambda *args: None
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+        run_benchmark(f'http://127.0.0.1:{server.server_port}/sync', options.benchmark, options.batch)
+        server.shutdown()
+        return
+
+    print(f'Sync server on http://localhost:{server.server_port}')
+    server.serve_forever()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,96 @@
+"""Memory and throughput of the tab overview thumbnails with many tabs.
+
+Start the browser with --automation (or --automation=<pipe name>), then:
+
+    python tools/thumbnail_load.py --tabs 200 --dwell 0.5
+
+Opens the tabs in the background and switches through all of them, so each
+one is captured as it's hidden, the way it would be with a user going
+through their tabs. Once the captures are in, reads all the thumbnails back
+like the tab overview does, a few times. Prints the capture rate and
+timings, what the cache holds in memory and on disk, and how long the
+overview's read takes, then closes the tabs it opened. Windows only, like
+tools/automation_load.py, whose client it uses.
+"""
+
+import argparse
+import asyncio
+import json
+import time
+
+from automation_load import DEFAULT_PIPE, AutomationClient
+
+DEFAULT_URIS = [
+    'browser://newtab',
+    'https://example.com/',
+    'https://www.wikipedia.org/',
+]
+
+
+async def wait_for_captures(client, expected, timeout):
+    """The thumbnails telemetry once |expected| captures are done."""
+    deadline = time.perf_counter() + timeout
+    while True:
+        stats = (await client.call('getTelemetry'))['thumbnails']
+        if stats['captures'] + stats['failedCaptures'] >= expected or time.perf_counter() > deadline:
+            return stats
+        await asyncio.sleep(0.25)
+
+
+async def run(options):
+    uris = options.uri or DEFAULT_URIS
+    client = await AutomationClient.connect(options.pipe)
+    before = (await client.call('getTelemetry'))['thumbnails']
+    first_tab = (await client.call('getState'))['activeTabId']
+
+    start = time.perf_counter()
+    created = await asyncio.gather(*[
+        client.call('createTab', uri=uris[i % len(uris)], active=False) for i in range(options.tabs)])
+    tab_ids = [result['tabId'] for result in created]
+    print(f'{len(tab_ids)} tabs opened in {time.perf_counter() - start:.1f} s')
+
+    # Every switch captures the tab being left, the last one is captured
+    # when going back to where the run started
+    start = time.perf_counter()
+    for tab_id in tab_ids + [first_tab]:
+        await client.call('switchTab', tabId=tab_id)
+        await asyncio.sleep(options.dwell)
+    expected = before['captures'] + before['failedCaptures'] + len(tab_ids)
+    stats = await wait_for_captures(client, expected, options.timeout)
+    elapsed = time.perf_counter() - start
+
+    captures = stats['captures'] - before['captures']
+    print(f'{captures} thumbnails captured ({stats["failedCaptures"] - before["failedCaptures"]} failed) '
+          f'in {elapsed:.1f} s, {captures / elapsed:.1f} per second including {options.dwell} s per tab shown')
+    print(f'  {stats["averageCaptureMilliseconds"]:.1f} ms capture and '
+          f'{stats["averageDownscaleMilliseconds"]:.1f} ms downscale on average, '
+          f'{stats["averageBytes"] / 1024:.1f} KB each')
+    print(f'  {stats["inMemory"]} in memory ({stats["memoryBytes"] / 1024:.0f} KB), {stats["onDisk"]} on disk')
+
+    for _ in range(options.reads):
+        start = time.perf_counter()
+        result = await client.call('getThumbnails')
+        print(f'Overview read: {result["thumbnails"]} thumbnails, '
+              f'{result["dataUriBytes"] / 1024 / 1024:.1f} MB of data URIs, '
+              f'{result["milliseconds"]:.0f} ms in the browser, {(time.perf_counter() - start) * 1000:.0f} ms round trip')
+
+    telemetry = await client.call('getTelemetry')
+    print(json.dumps({'thumbnails': telemetry['thumbnails'], 'memoryBytes': telemetry['memoryBytes']}, indent=2))
+
+    await asyncio.gather(*[client.call('closeTab', tabId=tab_id) for tab_id in tab_ids])
+    client.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--pipe', default=DEFAULT_PIPE)
+    parser.add_argument('--tabs', type=int, default=200, help='tabs to open for the run')
+    parser.add_argument('--dwell', type=float, default=0.5, help='seconds each tab is shown for')
+    parser.add_argument('--reads', type=int, default=3, help='times the overview reads the thumbnails')
+    parser.add_argument('--timeout', type=float, default=60, help='seconds to wait for the last captures')
+    parser.add_argument('--uri', action='append', help='URIs to open, can be repeated')
+    asyncio.run(run(parser.parse_args()))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,87 @@
+// Reader for the columnar lists the host sends through shared buffers. See
+// BulkDataChannel.h for the layout.
+const BULK_DATA_MAGIC = 0x44425657;
+const BULK_DATA_VERSION = 1;
+const BULK_COLUMN_STRING = 0;
+const BULK_COLUMN_NUMBER = 1;
+
+function decodeBulkRows(buffer) {
+    const view = new DataView(buffer);
+    if (view.getUint32(0, true) != BULK_DATA_MAGIC || view.getUint32(4, true) != BULK_DATA_VERSION) {
+        throw new Error('Unexpected bulk data format');
+    }
+
+    const rowCount = view.getUint32(8, true);
+    const columnCount = view.getUint32(12, true);
+    const decoder = new TextDecoder('utf-16le', { ignoreBOM: true });
+
+    let rows = new Array(rowCount);
+    for (let row = 0; row < rowCount; ++row) {
+        rows[row] = {};
+    }
+
+    for (let column = 0; column < columnCount; ++column) {
+        const descriptorOffset = 16 + column * 16;
+        const type = view.getUint32(descriptorOffset, true);
+        const nameOffset = view.getUint32(descriptorOffset + 4, true);
+        const nameLength = view.getUint32(descriptorOffset + 8, true);
+        const dataOffset = view.getUint32(descriptorOffset + 12, true);
+
+        const path = decoder.decode(new Uint16Array(buffer, nameOffset, nameLength)).split('.');
+        const field = path.pop();
+
+        let values;
+        if (type == BULK_COLUMN_NUMBER) {
+            values = new Float64Array(buffer, dataOffset, rowCount);
+        } else {
+            // Decode the whole heap once and slice it, offsets are in UTF-16
+            // code units so they map directly onto string indices.
+            const offsets = new Uint32Array(buffer, dataOffset, rowCount + 1);
+            const heapOffset = dataOffset + (rowCount + 1) * 4;
+            const heap = decoder.decode(new Uint16Array(buffer, heapOffset, offsets[rowCount]));
+            values = {
+                get: (row) => heap.substring(offsets[row], offsets[row + 1])
+            };
+        }
+
+        for (let row = 0; row < rowCount; ++row) {
+            let target = rows[row];
+            path.map(key => {
+                target[key] = target[key] || {};
+                target = target[key];
+            });
+
+            target[field] = type == BULK_COLUMN_NUMBER ? values[row] : values.get(row);
+        }
+    }
+
+    return rows;
+}
+
+// Deliver shared buffer lists to |handler| as regular message events, with
+// the decoded rows put back in the field the host moved them out of.
+function addBulkDataListener(handler) {
+    window.chrome.webview.addEventListener('sharedbufferreceived', event => {
+        let data = event.additionalData;
+        const buffer = event.getBuffer();
+
+        try {
+            data.args[data.args.bulkField] = decodeBulkRows(buffer);
+        } finally {
+            window.chrome.webview.releaseBuffer(buffer);
+        }
+
+        delete data.args.bulkField;
+        handler({ data: data });
+    });
+}
+
+// Log how long a list took to get from the host to the page
+function logTransferLatency(args, rowCount) {
+    if (!args.sentAt) {
+        return;
+    }
+
+    const latency = performance.timeOrigin + performance.now() - args.sentAt;
+    console.log(`Received ${rowCount} rows in ${latency.toFixed(1)} ms`);
+}
@@ -21,9 +21,30 @@ const commands = {
     MG_GET_SETTINGS: 21,
     MG_GET_FAVORITES: 22,
     MG_REMOVE_FAVORITE: 23,
-    MG_CLEAR_CACHE: 24,
-    MG_CLEAR_COOKIES: 25,
     MG_GET_HISTORY: 26,
     MG_REMOVE_HISTORY_ITEM: 27,
-    MG_CLEAR_HISTORY: 28
+    MG_CLEAR_HISTORY: 28,
+    MG_GET_NETWORK_LOG: 29,
+    MG_UPDATE_SETTINGS: 30,
+    MG_PREDICT_NAVIGATION: 31,
+    MG_SHOW_HISTORY_MENU: 32,
+    MG_SCROLL_POSITION: 33,
+    MG_REOPEN_CLOSED_TAB: 34,
+    MG_TAB_STATE: 35,
+    MG_GET_DOWNLOADS: 36,
+    MG_DOWNLOAD_ACTION: 37,
+    MG_DOWNLOAD_PROGRESS: 38,
+    MG_FIND: 39,
+    MG_FIND_RESULT: 40,
+    MG_CAPTURE_SNAPSHOT: 41,
+    MG_OPEN_SNAPSHOT: 42,
+    MG_DELETE_SNAPSHOT: 43,
+    MG_TAB_OVERVIEW: 44,
+    MG_GET_TOP_SITES: 45,
+    MG_FOCUS_ADDRESS_BAR: 46,
+    MG_SYNC_CONFIG: 47,
+    MG_SCRIPT_DIALOG: 48,
+    MG_CLEAR_BROWSING_DATA: 49,
+    MG_GET_STORAGE_USAGE: 50,
+    MG_CONTROLS_READY: 51
 };
@@ -0,0 +1,233 @@
+const EMPTY_DOWNLOADS_MESSAGE = `You haven't downloaded anything yet.`;
+
+const messageHandler = event => {
+    var message = event.data.message;
+    var args = event.data.args;
+
+    switch (message) {
+        case commands.MG_GET_DOWNLOADS:
+            loadDownloads(args.downloads);
+            break;
+        case commands.MG_DOWNLOAD_PROGRESS:
+            // Only the downloads that changed since the last batch
+            args.downloads.forEach(updateDownload);
+            break;
+        default:
+            console.log(`Unexpected message: ${JSON.stringify(event.data)}`);
+            break;
+    }
+};
+
+function requestDownloads() {
+    let message = {
+        message: commands.MG_GET_DOWNLOADS,
+        args: {}
+    };
+
+    window.chrome.webview.postMessage(message);
+}
+
+function sendDownloadAction(id, action) {
+    let message = {
+        message: commands.MG_DOWNLOAD_ACTION,
+        args: {
+            id: id,
+            action: action
+        }
+    };
+
+    window.chrome.webview.postMessage(message);
+}
+
+function formatBytes(bytes) {
+    if (bytes < 1024) {
+        return `${bytes} B`;
+    } else if (bytes < 1024 * 1024) {
+        return `${(bytes / 1024).toFixed(0)} KB`;
+    } else if (bytes < 1024 * 1024 * 1024) {
+        return `${(bytes / (1024 * 1024)).toFixed(1)} MB`;
+    }
+
+    return `${(bytes / (1024 * 1024 * 1024)).toFixed(2)} GB`;
+}
+
+function getProgressText(download) {
+    if (download.totalBytes > 0) {
+        return `${formatBytes(download.receivedBytes)} of ${formatBytes(download.totalBytes)}`;
+    }
+
+    return formatBytes(download.receivedBytes);
+}
+
+function getStatusText(download) {
+    switch (download.state) {
+        case 'inProgress': {
+            let status = getProgressText(download);
+            if (download.bytesPerSecond > 0) {
+                status += `, ${formatBytes(download.bytesPerSecond)}/s`;
+                if (download.totalBytes > 0) {
+                    const secondsLeft = (download.totalBytes - download.receivedBytes) / download.bytesPerSecond;
+                    status += secondsLeft < 60 ? `, ${Math.ceil(secondsLeft)} s left` : `, ${Math.ceil(secondsLeft / 60)} min left`;
+                }
+            }
+            return status;
+        }
+        case 'queued':
+            return `Waiting, ${getProgressText(download)}`;
+        case 'paused':
+            return `Paused, ${getProgressText(download)}`;
+        case 'completed':
+            return formatBytes(download.receivedBytes);
+        case 'interrupted':
+            return download.interruptReason || 'Failed';
+        case 'cancelled':
+            return 'Cancelled';
+    }
+
+    return '';
+}
+
+function getActions(download) {
+    switch (download.state) {
+        case 'inProgress':
+        case 'queued':
+            return [['pause', 'Pause'], ['cancel', 'Cancel']];
+        case 'paused':
+            return [['resume', 'Resume'], ['cancel', 'Cancel']];
+        case 'interrupted':
+            return download.canResume ? [['resume', 'Retry'], ['cancel', 'Cancel']] : [['remove', 'Remove']];
+        case 'completed':
+            return [['open', 'Open'], ['show', 'Show in folder'], ['remove', 'Remove']];
+    }
+
+    return [['remove', 'Remove']];
+}
+
+function createDownloadElement(download) {
+    let itemContainer = document.createElement('div');
+    itemContainer.id = `download-${download.id}`;
+    itemContainer.className = 'item-container download';
+
+    let itemElement = document.createElement('div');
+    itemElement.className = 'item';
+
+    let labelElement = document.createElement('div');
+    labelElement.className = 'label-download';
+
+    // File name
+    let titleLabel = document.createElement('div');
+    titleLabel.className = 'label-title';
+    let linkElement = document.createElement('a');
+    linkElement.addEventListener('click', function(e) {
+        if (itemContainer.dataset.state == 'completed') {
+            sendDownloadAction(download.id, 'open');
+        }
+    });
+    titleLabel.append(linkElement);
+    labelElement.append(titleLabel);
+
+    // URI
+    let uriLabel = document.createElement('div');
+    uriLabel.className = 'label-uri';
+    let uriText = document.createElement('p');
+    uriLabel.append(uriText);
+    labelElement.append(uriLabel);
+
+    let statusLabel = document.createElement('div');
+    statusLabel.className = 'label-status';
+    labelElement.append(statusLabel);
+
+    let progressBar = document.createElement('div');
+    progressBar.className = 'progress-bar';
+    progressBar.append(document.createElement('div'));
+    labelElement.append(progressBar);
+    itemElement.append(labelElement);
+
+    let actionsElement = document.createElement('div');
+    actionsElement.className = 'download-actions';
+    itemElement.append(actionsElement);
+
+    itemContainer.append(itemElement);
+    return itemContainer;
+}
+
+function updateDownloadElement(itemContainer, download) {
+    itemContainer.dataset.state = download.state;
+
+    let linkElement = itemContainer.querySelector('.label-title a');
+    linkElement.textContent = download.name;
+    linkElement.title = download.path;
+
+    let uriText = itemContainer.querySelector('.label-uri p');
+    uriText.textContent = download.uri;
+    uriText.title = download.uri;
+
+    itemContainer.querySelector('.label-status').textContent = getStatusText(download);
+
+    let progressBar = itemContainer.querySelector('.progress-bar');
+    const isTransferring = download.state == 'inProgress' || download.state == 'queued' || download.state == 'paused';
+    progressBar.style.display = isTransferring ? '' : 'none';
+    progressBar.firstChild.style.width = download.totalBytes > 0 ?
+        `${(100 * download.receivedBytes / download.totalBytes).toFixed(1)}%` : '0';
+
+    // Actions only change with the state, progress batches leave them alone
+    let actionsElement = itemContainer.querySelector('.download-actions');
+    if (actionsElement.dataset.state == download.state && actionsElement.dataset.canResume == `${download.canResume}`) {
+        return;
+    }
+    actionsElement.dataset.state = download.state;
+    actionsElement.dataset.canResume = `${download.canResume}`;
+    actionsElement.textContent = '';
+
+    getActions(download).forEach(([action, label]) => {
+        let actionElement = document.createElement('span');
+        actionElement.className = 'download-action';
+        actionElement.textContent = label;
+        actionElement.addEventListener('click', function(e) {
+            sendDownloadAction(download.id, action);
+            if (action == 'remove') {
+                itemContainer.remove();
+                loadUIIfEmpty();
+            }
+        });
+        actionsElement.append(actionElement);
+    });
+}
+
+function updateDownload(download) {
+    let itemContainer = document.getElementById(`download-${download.id}`);
+    if (!itemContainer) {
+        // Newest first
+        let entriesContainer = document.getElementById('entries-container');
+        if (!entriesContainer.querySelector('.download')) {
+            entriesContainer.textContent = '';
+        }
+
+        itemContainer = createDownloadElement(download);
+        entriesContainer.prepend(itemContainer);
+    }
+
+    updateDownloadElement(itemContainer, download);
+}
+
+function loadDownloads(downloads) {
+    let entriesContainer = document.getElementById('entries-container');
+    entriesContainer.textContent = '';
+
+    downloads.forEach(updateDownload);
+    loadUIIfEmpty();
+}
+
+function loadUIIfEmpty() {
+    let entriesContainer = document.getElementById('entries-container');
+    if (!entriesContainer.querySelector('.download')) {
+        entriesContainer.textContent = EMPTY_DOWNLOADS_MESSAGE;
+    }
+}
+
+function init() {
+    window.chrome.webview.addEventListener('message', messageHandler);
+    requestDownloads();
+}
+
+init();
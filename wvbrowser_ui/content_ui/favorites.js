@@ -4,6 +4,7 @@ const messageHandler = event => {
 
     switch (message) {
         case commands.MG_GET_FAVORITES:
+            logTransferLatency(args, args.favorites.length);
             loadFavorites(args.favorites);
             break;
         default:
@@ -32,6 +33,17 @@ function removeFavorite(uri) {
     window.chrome.webview.postMessage(message);
 }
 
+function openSnapshot(snapshotId) {
+    let message = {
+        message: commands.MG_OPEN_SNAPSHOT,
+        args: {
+            id: snapshotId
+        }
+    };
+
+    window.chrome.webview.postMessage(message);
+}
+
 function loadFavorites(payload) {
     let fragment = document.createDocumentFragment();
 
@@ -67,6 +79,17 @@ function loadFavorites(payload) {
         textElement.title = favorite.uriToShow || favorite.uri;
         uriElement.appendChild(textElement);
 
+        let offlineElement = document.createElement('div');
+        offlineElement.className = 'label-offline';
+        if (favorite.snapshotId) {
+            let offlineLink = document.createElement('a');
+            offlineLink.textContent = favorite.snapshotFormat == 'pdf' ? 'Offline PDF' : 'Offline copy';
+            offlineLink.addEventListener('click', function(e) {
+                openSnapshot(favorite.snapshotId);
+            });
+            offlineElement.appendChild(offlineLink);
+        }
+
         let buttonElement = document.createElement('div');
         buttonElement.className = 'btn-close';
         buttonElement.addEventListener('click', function(e) {
@@ -77,6 +100,7 @@ function loadFavorites(payload) {
         favoriteElement.appendChild(faviconElement);
         favoriteElement.appendChild(labelElement);
         favoriteElement.appendChild(uriElement);
+        favoriteElement.appendChild(offlineElement);
         favoriteElement.appendChild(buttonElement);
 
         favoriteContainer.appendChild(favoriteElement);
@@ -89,6 +113,7 @@ function loadFavorites(payload) {
 
 function init() {
     window.chrome.webview.addEventListener('message', messageHandler);
+    addBulkDataListener(messageHandler);
     requestFavorites();
 }
 
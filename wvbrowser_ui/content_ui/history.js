@@ -22,6 +22,7 @@ const messageHandler = event => {
 
     switch (message) {
         case commands.MG_GET_HISTORY:
+            logTransferLatency(args, args.items.length);
             let entriesContainer = document.getElementById('entries-container');
             if (args.from == 0 && args.items.length) {
                 entriesContainer.textContent = '';
@@ -264,6 +265,7 @@ function clearHistory() {
 
 function init() {
     window.chrome.webview.addEventListener('message', messageHandler);
+    addBulkDataListener(messageHandler);
 
     let viewportItemsCapacity = Math.round(window.innerHeight / itemHeight);
     addUIListeners();
@@ -0,0 +1,272 @@
+const UNFINISHED_REQUEST_TIME = 0;
+let networkLog = {
+    tabId: 0,
+    tabs: [],
+    origins: [],
+    requests: []
+};
+
+const messageHandler = event => {
+    var message = event.data.message;
+    var args = event.data.args;
+
+    switch (message) {
+        case commands.MG_GET_NETWORK_LOG:
+            logTransferLatency(args, args.requests.length);
+            networkLog = args;
+            loadTabSelector(args.tabs, args.tabId);
+            loadOrigins(args.origins);
+            loadWaterfall(args.requests);
+            break;
+        default:
+            console.log(`Unexpected message: ${JSON.stringify(event.data)}`);
+            break;
+    }
+};
+
+function requestNetworkLog(tabId, clear) {
+    let message = {
+        message: commands.MG_GET_NETWORK_LOG,
+        args: {
+            tabId: tabId,
+            clear: clear || false
+        }
+    };
+
+    window.chrome.webview.postMessage(message);
+}
+
+function formatBytes(bytes) {
+    if (bytes < 1024) {
+        return `${bytes} B`;
+    }
+
+    if (bytes < 1024 * 1024) {
+        return `${(bytes / 1024).toFixed(1)} kB`;
+    }
+
+    return `${(bytes / (1024 * 1024)).toFixed(1)} MB`;
+}
+
+function loadTabSelector(tabs, selectedTabId) {
+    let select = document.getElementById('select-tab');
+    select.textContent = '';
+
+    tabs.map(tab => {
+        let option = document.createElement('option');
+        option.value = tab.tabId;
+        option.textContent = tab.uri || `Tab ${tab.tabId}`;
+        option.selected = tab.tabId == selectedTabId;
+        select.append(option);
+    });
+}
+
+function loadOrigins(origins) {
+    let container = document.getElementById('origins-container');
+    container.textContent = '';
+
+    let fragment = document.createDocumentFragment();
+    origins.sort((a, b) => b.bytes - a.bytes).map(origin => {
+        let row = document.createElement('tr');
+        [
+            origin.origin,
+            origin.requests,
+            origin.cached,
+            origin.failed,
+            formatBytes(origin.bytes),
+            `${Math.round(origin.averageTime)} ms`
+        ].map(value => {
+            let cell = document.createElement('td');
+            cell.textContent = value;
+            row.append(cell);
+        });
+
+        fragment.append(row);
+    });
+
+    container.append(fragment);
+}
+
+function getRequestEnd(request) {
+    if (request.endTime != UNFINISHED_REQUEST_TIME) {
+        return request.endTime;
+    }
+
+    return request.responseTime || request.startTime;
+}
+
+function loadWaterfall(requests) {
+    let container = document.getElementById('waterfall-container');
+    container.textContent = '';
+
+    if (requests.length == 0) {
+        container.textContent = 'No requests recorded for this tab.';
+        return;
+    }
+
+    let start = Math.min(...requests.map(request => request.startTime));
+    let end = Math.max(...requests.map(getRequestEnd));
+    let span = Math.max(end - start, 0.001);
+    const toPercent = time => `${((time - start) / span) * 100}%`;
+    const toWidth = duration => `${Math.max((duration / span) * 100, 0.2)}%`;
+
+    let fragment = document.createDocumentFragment();
+    requests.map(request => {
+        let row = document.createElement('div');
+        row.className = 'request-row';
+        if (request.error) {
+            row.classList.add('failed');
+        }
+        if (request.cache != 'network') {
+            row.classList.add('cached');
+        }
+
+        let label = document.createElement('div');
+        label.className = 'request-label';
+        label.textContent = request.url;
+        label.title = request.url;
+        row.append(label);
+
+        let status = document.createElement('div');
+        status.className = 'request-status';
+        status.textContent = request.error ? 'failed' : (request.status || 'pending');
+        status.title = request.error || request.cache;
+        row.append(status);
+
+        let size = document.createElement('div');
+        size.className = 'request-size';
+        size.textContent = formatBytes(request.bytes);
+        row.append(size);
+
+        let timeline = document.createElement('div');
+        timeline.className = 'request-timeline';
+
+        let responseTime = request.responseTime || getRequestEnd(request);
+        let waiting = document.createElement('div');
+        waiting.className = 'bar-waiting';
+        waiting.style.left = toPercent(request.startTime);
+        waiting.style.width = toWidth(responseTime - request.startTime);
+        timeline.append(waiting);
+
+        let receiving = document.createElement('div');
+        receiving.className = 'bar-receiving';
+        receiving.style.left = toPercent(responseTime);
+        receiving.style.width = toWidth(getRequestEnd(request) - responseTime);
+        timeline.append(receiving);
+
+        let duration = (getRequestEnd(request) - request.startTime) * 1000;
+        timeline.title = `${Math.round(duration)} ms`;
+        row.append(timeline);
+
+        fragment.append(row);
+    });
+
+    container.append(fragment);
+}
+
+// HAR 1.2, see http://www.softwareishard.com/blog/har-12-spec/
+function toHarPhase(value) {
+    return value >= 0 ? value : -1;
+}
+
+function buildHar(requests) {
+    let entries = requests.map(request => {
+        let total = (getRequestEnd(request) - request.startTime) * 1000;
+        let waitEnd = request.responseTime || getRequestEnd(request);
+        let receive = (getRequestEnd(request) - waitEnd) * 1000;
+
+        return {
+            startedDateTime: new Date(request.wallTime * 1000).toISOString(),
+            time: total,
+            request: {
+                method: request.method,
+                url: request.url,
+                httpVersion: request.protocol,
+                cookies: [],
+                headers: [],
+                queryString: [],
+                headersSize: -1,
+                bodySize: -1
+            },
+            response: {
+                status: request.status,
+                statusText: request.error,
+                httpVersion: request.protocol,
+                cookies: [],
+                headers: [],
+                content: {
+                    size: request.bytes,
+                    mimeType: request.mimeType
+                },
+                redirectURL: '',
+                headersSize: -1,
+                bodySize: request.bytes,
+                _transferSize: request.bytes
+            },
+            cache: {},
+            timings: {
+                blocked: -1,
+                dns: toHarPhase(request.dns),
+                connect: toHarPhase(request.connect),
+                ssl: toHarPhase(request.ssl),
+                send: Math.max(request.send, 0),
+                wait: Math.max(request.wait, 0),
+                receive: Math.max(receive, 0)
+            },
+            _cache: request.cache
+        };
+    });
+
+    return {
+        log: {
+            version: '1.2',
+            creator: {
+                name: 'WebView2Browser',
+                version: '1.0'
+            },
+            pages: [],
+            entries: entries
+        }
+    };
+}
+
+function exportHar() {
+    let har = buildHar(networkLog.requests);
+    let blob = new Blob([JSON.stringify(har, null, 2)], { type: 'application/json' });
+
+    let link = document.createElement('a');
+    link.href = URL.createObjectURL(blob);
+    link.download = `tab-${networkLog.tabId}.har`;
+    link.click();
+
+    // Give the download a chance to start before dropping the blob
+    setTimeout(() => URL.revokeObjectURL(link.href), 1000);
+}
+
+function addUIListeners() {
+    let select = document.getElementById('select-tab');
+    select.addEventListener('change', function(e) {
+        requestNetworkLog(parseInt(select.value));
+    });
+
+    document.getElementById('btn-refresh').addEventListener('click', function(e) {
+        requestNetworkLog(networkLog.tabId);
+    });
+
+    document.getElementById('btn-clear').addEventListener('click', function(e) {
+        requestNetworkLog(networkLog.tabId, true);
+    });
+
+    document.getElementById('btn-export').addEventListener('click', function(e) {
+        exportHar();
+    });
+}
+
+function init() {
+    window.chrome.webview.addEventListener('message', messageHandler);
+    addBulkDataListener(messageHandler);
+    addUIListeners();
+    requestNetworkLog();
+}
+
+init();
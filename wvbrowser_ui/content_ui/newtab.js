@@ -0,0 +1,105 @@
+// Start page for new tabs. Everything it shows is local: the page is part of
+// the UI files and the sites come from the history and favorites of the
+// controls UI, so it's interactive without waiting on the network.
+const TOP_SITES_COUNT = 8;
+const FAVORITES_COUNT = 10;
+const FALLBACK_FAVICON = 'img/favorites.png';
+
+const messageHandler = event => {
+    var message = event.data.message;
+    var args = event.data.args;
+
+    switch (message) {
+        case commands.MG_GET_TOP_SITES:
+            loadTopSites(args.topSites);
+            loadFavorites(args.favorites);
+            console.log(`New tab interactive in ${performance.now().toFixed(1)} ms`);
+            break;
+        default:
+            console.log(`Unexpected message: ${JSON.stringify(event.data)}`);
+            break;
+    }
+};
+
+function requestTopSites() {
+    let message = {
+        message: commands.MG_GET_TOP_SITES,
+        args: {
+            count: TOP_SITES_COUNT
+        }
+    };
+
+    window.chrome.webview.postMessage(message);
+}
+
+function createFavicon(src) {
+    let faviconImage = document.createElement('img');
+    faviconImage.className = 'favicon';
+    faviconImage.src = src || FALLBACK_FAVICON;
+    faviconImage.onerror = () => {
+        faviconImage.onerror = null;
+        faviconImage.src = FALLBACK_FAVICON;
+    };
+
+    return faviconImage;
+}
+
+function hostOf(uri) {
+    try {
+        return new URL(uri).host.replace(/^www\./, '');
+    } catch (e) {
+        return uri;
+    }
+}
+
+function loadTopSites(topSites) {
+    let container = document.getElementById('top-sites');
+    let fragment = document.createDocumentFragment();
+
+    topSites.forEach((site) => {
+        let tile = document.createElement('a');
+        tile.className = 'tile';
+        tile.href = site.uri;
+        tile.title = site.title || site.uri;
+
+        let label = document.createElement('span');
+        label.className = 'tile-label';
+        label.textContent = site.title || hostOf(site.uri);
+
+        tile.appendChild(createFavicon(site.favicon));
+        tile.appendChild(label);
+        fragment.appendChild(tile);
+    });
+
+    container.textContent = topSites.length ? '' : 'Sites you visit often will show up here.';
+    container.appendChild(fragment);
+}
+
+function loadFavorites(favorites) {
+    let container = document.getElementById('favorites');
+    let fragment = document.createDocumentFragment();
+
+    favorites.slice(0, FAVORITES_COUNT).forEach((favorite) => {
+        let link = document.createElement('a');
+        link.className = 'link';
+        link.href = favorite.uri;
+        link.title = favorite.uriToShow || favorite.uri;
+
+        let label = document.createElement('span');
+        label.textContent = favorite.title || favorite.uri;
+
+        link.appendChild(createFavicon(favorite.favicon));
+        link.appendChild(label);
+        fragment.appendChild(link);
+    });
+
+    container.textContent = favorites.length ? '' : `You don't have any favorites.`;
+    container.appendChild(fragment);
+}
+
+function init() {
+    window.chrome.webview.addEventListener('message', messageHandler);
+    requestTopSites();
+}
+
+init();
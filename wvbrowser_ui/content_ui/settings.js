@@ -1,3 +1,7 @@
+let currentSettings = {};
+let clearDataRequests = new Map();  // Request ID to the function showing its progress
+let clearDataRequestCount = 0;
+
 const messageHandler = event => {
     var message = event.data.message;
     var args = event.data.args;
@@ -6,19 +10,11 @@ const messageHandler = event => {
         case commands.MG_GET_SETTINGS:
             loadSettings(args.settings);
             break;
-        case commands.MG_CLEAR_CACHE:
-            if (args.content && args.controls) {
-                updateLabelForEntry('entry-cache', 'Cleared');
-            } else {
-                updateLabelForEntry('entry-cache', 'Try again');
-            }
+        case commands.MG_CLEAR_BROWSING_DATA:
+            handleClearDataProgress(args);
             break;
-        case commands.MG_CLEAR_COOKIES:
-            if (args.content && args.controls) {
-                updateLabelForEntry('entry-cookies', 'Cleared');
-            } else {
-                updateLabelForEntry('entry-cookies', 'Try again');
-            }
+        case commands.MG_GET_STORAGE_USAGE:
+            loadStorageUsage(args);
             break;
         default:
             console.log(`Unexpected message: ${JSON.stringify(event.data)}`);
@@ -29,35 +25,269 @@ const messageHandler = event => {
 function addEntriesListeners() {
     let cacheEntry = document.getElementById('entry-cache');
     cacheEntry.addEventListener('click', function(e) {
-        let message = {
-            message: commands.MG_CLEAR_CACHE,
-            args: {}
-        };
-
-        window.chrome.webview.postMessage(message);
+        clearBrowsingData({ kinds: ['cache'] }, (text) => updateLabelForEntry('entry-cache', text));
     });
 
     let cookiesEntry = document.getElementById('entry-cookies');
     cookiesEntry.addEventListener('click', function(e) {
-        let message = {
-            message: commands.MG_CLEAR_COOKIES,
-            args: {}
-        };
-
-        window.chrome.webview.postMessage(message);
+        clearBrowsingData({ kinds: ['cookies'] }, (text) => updateLabelForEntry('entry-cookies', text));
     });
 
     let scriptEntry = document.getElementById('entry-script');
     scriptEntry.addEventListener('click', function(e) {
-        // Toggle script support
+        updateBrowserSettings({ scriptsEnabled: !currentSettings.scriptsEnabled });
     });
 
     let popupsEntry = document.getElementById('entry-popups');
     popupsEntry.addEventListener('click', function(e) {
-        // Toggle popups
+        updateBrowserSettings({ blockPopups: !currentSettings.blockPopups });
+    });
+
+    let imagesEntry = document.getElementById('entry-images');
+    imagesEntry.addEventListener('click', function(e) {
+        updateBrowserSettings({ imagesEnabled: !currentSettings.imagesEnabled });
+    });
+
+    // Off, then connections only, then whole pages
+    let preloadEntry = document.getElementById('entry-preload');
+    preloadEntry.addEventListener('click', function(e) {
+        const modes = ['off', 'preconnect', 'prerender'];
+        const next = modes[(modes.indexOf(currentSettings.preload) + 1) % modes.length];
+        updateBrowserSettings({ preload: next });
+    });
+
+    let throttlingEntry = document.getElementById('entry-throttling');
+    throttlingEntry.addEventListener('click', function(e) {
+        updateBrowserSettings({ throttleBackgroundTabs: !currentSettings.throttleBackgroundTabs });
+    });
+
+    for (const id of ['override-scripts', 'override-popups', 'override-images']) {
+        let select = document.getElementById(id);
+        for (const value of ['default', 'allow', 'block']) {
+            let option = document.createElement('option');
+            option.value = value;
+            option.textContent = value.charAt(0).toUpperCase() + value.slice(1);
+            select.appendChild(option);
+        }
+    }
+
+    // Left empty, new tabs open the local start page
+    let startPageForm = document.getElementById('start-page-form');
+    startPageForm.addEventListener('submit', function(e) {
+        e.preventDefault();
+        updateBrowserSettings({ startPage: document.getElementById('start-page').value.trim() });
+    });
+
+    // Left empty, searches go to Bing
+    let searchTemplateForm = document.getElementById('search-template-form');
+    searchTemplateForm.addEventListener('submit', function(e) {
+        e.preventDefault();
+        updateBrowserSettings({ searchTemplate: document.getElementById('search-template').value.trim() });
+    });
+
+    // Left empty, nothing is cached by the browser itself
+    let sharedCacheForm = document.getElementById('shared-cache-form');
+    sharedCacheForm.addEventListener('submit', function(e) {
+        e.preventDefault();
+        const origins = document.getElementById('shared-cache-origins').value.split(/[\s,]+/).filter((origin) => origin);
+        updateBrowserSettings({ sharedCacheOrigins: origins });
+    });
+
+    // Left empty, nothing is synced
+    let syncServerForm = document.getElementById('sync-server-form');
+    syncServerForm.addEventListener('submit', function(e) {
+        e.preventDefault();
+        updateBrowserSettings({ syncServer: document.getElementById('sync-server').value.trim() });
+    });
+
+    // Applies to tabs already throttled too
+    let throttleForm = document.getElementById('throttle-form');
+    throttleForm.addEventListener('submit', function(e) {
+        e.preventDefault();
+        updateBrowserSettings({
+            backgroundThrottleDelay: Number(document.getElementById('throttle-delay').value),
+            backgroundThrottleRate: Number(document.getElementById('throttle-rate').value)
+        });
+    });
+
+    // Over budget, least recently used background tabs are discarded
+    let memoryBudgetForm = document.getElementById('memory-budget-form');
+    memoryBudgetForm.addEventListener('submit', function(e) {
+        e.preventDefault();
+        updateBrowserSettings({ memoryBudget: Number(document.getElementById('memory-budget').value) });
+    });
+
+    // Quotas are in MB, 0 for none
+    let storageQuotaForm = document.getElementById('storage-quota-form');
+    storageQuotaForm.addEventListener('submit', function(e) {
+        e.preventDefault();
+        updateBrowserSettings({
+            cacheQuota: Number(document.getElementById('cache-quota').value),
+            siteDataQuota: Number(document.getElementById('site-data-quota').value)
+        });
+    });
+
+    let storageRefresh = document.getElementById('storage-refresh');
+    storageRefresh.addEventListener('click', function(e) {
+        requestStorageUsage(true);
+    });
+
+    // Sites listed are cleared whatever the time range
+    let clearDataForm = document.getElementById('clear-data-form');
+    clearDataForm.addEventListener('submit', function(e) {
+        e.preventDefault();
+
+        const kinds = Array.from(document.querySelectorAll('#clear-data-kinds input:checked'), (input) => input.value);
+        if (!kinds.length) {
+            return;
+        }
+
+        const range = Number(document.getElementById('clear-data-range').value);
+        const sites = document.getElementById('clear-data-sites').value.split(/[\s,]+/).filter((site) => site);
+        let status = document.getElementById('clear-data-status');
+        clearBrowsingData({ kinds: kinds, since: range ? Date.now() - range : 0, origins: sites }, (text) => {
+            status.textContent = text;
+        });
+    });
+
+    let overrideForm = document.getElementById('override-form');
+    overrideForm.addEventListener('submit', function(e) {
+        e.preventDefault();
+
+        let host = document.getElementById('override-host').value.trim().toLowerCase();
+        if (!host) {
+            return;
+        }
+
+        let site = {};
+        for (const setting of ['scripts', 'popups', 'images']) {
+            let value = document.getElementById(`override-${setting}`).value;
+            if (value != 'default') {
+                site[setting] = value;
+            }
+        }
+
+        updateBrowserSettings({ overrides: { [host]: site } });
+        overrideForm.reset();
     });
 }
 
+// The browser reports every step and the end, see BrowsingDataCleaner
+function clearBrowsingData(request, showProgress) {
+    request.id = ++clearDataRequestCount;
+    clearDataRequests.set(request.id, showProgress);
+    showProgress('Clearing');
+
+    let message = {
+        message: commands.MG_CLEAR_BROWSING_DATA,
+        args: request
+    };
+
+    window.chrome.webview.postMessage(message);
+}
+
+function handleClearDataProgress(progress) {
+    const showProgress = clearDataRequests.get(progress.id);
+    if (!showProgress) {
+        return;
+    }
+
+    if (!progress.done) {
+        showProgress(`Clearing, ${progress.step} of ${progress.steps} done`);
+        return;
+    }
+
+    clearDataRequests.delete(progress.id);
+    if (!progress.succeeded) {
+        showProgress('Try again');
+        return;
+    }
+
+    let status = `Cleared in ${Math.round(progress.milliseconds)} ms`;
+    if (progress.skipped && progress.skipped.length) {
+        status += `, ${progress.skipped.join(' and ')} can't be cleared per site`;
+    }
+    showProgress(status);
+}
+
+// Without |refresh| the last audit is reported, see StorageAuditor
+function requestStorageUsage(refresh) {
+    document.getElementById('storage-status').textContent = 'Measuring';
+
+    let message = {
+        message: commands.MG_GET_STORAGE_USAGE,
+        args: { refresh: refresh }
+    };
+
+    window.chrome.webview.postMessage(message);
+}
+
+function formatBytes(bytes) {
+    if (bytes >= 1024 * 1024 * 1024) {
+        return `${(bytes / (1024 * 1024 * 1024)).toFixed(1)} GB`;
+    }
+    if (bytes >= 1024 * 1024) {
+        return `${(bytes / (1024 * 1024)).toFixed(1)} MB`;
+    }
+    return `${Math.round(bytes / 1024)} kB`;
+}
+
+function loadStorageUsage(usage) {
+    const categoryLabels = {
+        httpCache: 'Cache',
+        codeCache: 'Code cache',
+        indexedDb: 'IndexedDB',
+        serviceWorkers: 'Service workers',
+        otherSiteData: 'Other site data',
+        other: 'Other'
+    };
+
+    let rows = [['Tabs', usage.content.totalBytes]];
+    for (const category of Object.keys(categoryLabels)) {
+        rows.push([`\u00a0\u00a0${categoryLabels[category]}`, usage.content.categories[category] || 0]);
+    }
+    rows.push(['Browser UI', usage.browserUI.totalBytes]);
+    for (const site of usage.origins) {
+        rows.push([site.origin, site.bytes]);
+    }
+
+    let usageList = document.getElementById('storage-usage');
+    usageList.textContent = '';
+    for (const [label, bytes] of rows) {
+        let row = document.createElement('div');
+        row.className = 'override-row';
+
+        let labelSpan = document.createElement('span');
+        labelSpan.className = 'override-host';
+        labelSpan.textContent = label;
+        row.appendChild(labelSpan);
+
+        let bytesSpan = document.createElement('span');
+        bytesSpan.className = 'override-value';
+        bytesSpan.textContent = formatBytes(bytes);
+        row.appendChild(bytesSpan);
+
+        usageList.appendChild(row);
+    }
+
+    let status = `Measured in ${Math.round(usage.auditMilliseconds)} ms at ${new Date(usage.audited).toLocaleTimeString()}`;
+    if (usage.evictedOrigins || usage.cacheEvictions) {
+        status += `, ${usage.evictedOrigins} sites and ${usage.cacheEvictions} cache evictions over quota`;
+    }
+    document.getElementById('storage-status').textContent = status;
+}
+
+function updateBrowserSettings(update) {
+    // The browser applies the change to open tabs and answers with the
+    // resulting settings
+    let message = {
+        message: commands.MG_UPDATE_SETTINGS,
+        args: update
+    };
+
+    window.chrome.webview.postMessage(message);
+}
+
 function requestBrowserSettings() {
     let message = {
         message: commands.MG_GET_SETTINGS,
@@ -68,6 +298,8 @@ function requestBrowserSettings() {
 }
 
 function loadSettings(settings) {
+    currentSettings = settings;
+
     if (settings.scriptsEnabled) {
         updateLabelForEntry('entry-script', 'Enabled');
     } else {
@@ -79,6 +311,67 @@ function loadSettings(settings) {
     } else {
         updateLabelForEntry('entry-popups', 'Allowed');
     }
+
+    if (settings.imagesEnabled) {
+        updateLabelForEntry('entry-images', 'Enabled');
+    } else {
+        updateLabelForEntry('entry-images', 'Disabled');
+    }
+
+    const preloadLabels = {
+        off: 'Off',
+        preconnect: 'Connections only',
+        prerender: 'Connections and pages'
+    };
+    updateLabelForEntry('entry-preload', preloadLabels[settings.preload] || '');
+
+    if (settings.throttleBackgroundTabs) {
+        updateLabelForEntry('entry-throttling', `After ${settings.backgroundThrottleDelay} s`);
+    } else {
+        updateLabelForEntry('entry-throttling', 'Off');
+    }
+
+    document.getElementById('start-page').value = settings.startPage || '';
+    document.getElementById('search-template').value = settings.searchTemplate || '';
+    document.getElementById('sync-server').value = settings.syncServer || '';
+    document.getElementById('shared-cache-origins').value = (settings.sharedCacheOrigins || []).join(' ');
+    document.getElementById('throttle-delay').value = settings.backgroundThrottleDelay;
+    document.getElementById('throttle-rate').value = settings.backgroundThrottleRate;
+    document.getElementById('memory-budget').value = settings.memoryBudget;
+    document.getElementById('cache-quota').value = settings.cacheQuota;
+    document.getElementById('site-data-quota').value = settings.siteDataQuota;
+
+    loadOverrides(settings.overrides || {});
+}
+
+function loadOverrides(overrides) {
+    let overridesList = document.getElementById('overrides-list');
+    overridesList.textContent = '';
+
+    for (const host of Object.keys(overrides)) {
+        let site = overrides[host];
+        let row = document.createElement('div');
+        row.className = 'override-row';
+
+        let hostLabel = document.createElement('span');
+        hostLabel.className = 'override-host';
+        hostLabel.textContent = host;
+        row.appendChild(hostLabel);
+
+        let summary = document.createElement('span');
+        summary.className = 'override-value';
+        summary.textContent = Object.keys(site).map(setting => `${setting}: ${site[setting]}`).join(', ');
+        row.appendChild(summary);
+
+        let removeButton = document.createElement('button');
+        removeButton.textContent = 'Remove';
+        removeButton.addEventListener('click', function(e) {
+            updateBrowserSettings({ overrides: { [host]: {} } });
+        });
+        row.appendChild(removeButton);
+
+        overridesList.appendChild(row);
+    }
 }
 
 function updateLabelForEntry(elementId, label) {
@@ -101,6 +394,7 @@ function updateLabelForEntry(elementId, label) {
 function init() {
     window.chrome.webview.addEventListener('message', messageHandler);
     requestBrowserSettings();
+    requestStorageUsage(false);
     addEntriesListeners();
 }
 
@@ -1,12 +1,3 @@
-const WORD_REGEX = /^[^//][^.]*$/;
-const VALID_URI_REGEX = /^[-:.&#+()[\]$'*;@~!,?%=\/\w]+$/; // Will check that only RFC3986 allowed characters are included
-const SCHEMED_URI_REGEX = /^\w+:.+$/;
-
-let settings = {
-    scriptsEnabled: true,
-    blockPopups: true
-};
-
 const messageHandler = event => {
     var message = event.data.message;
     var args = event.data.args;
@@ -20,8 +11,13 @@ const messageHandler = event => {
                 // Update the tab state
                 tab.uri = args.uri;
                 tab.uriToShow = args.uriToShow;
-                tab.canGoBack = args.canGoBack;
-                tab.canGoForward = args.canGoForward;
+                // Background tabs are only sent the URI, the rest follows
+                // once they are shown
+                if (args.entries) {
+                    tab.canGoBack = args.canGoBack;
+                    tab.canGoForward = args.canGoForward;
+                    setNavigationEntries(args.tabId, args.entries, args.currentEntry, args.uri);
+                }
 
                 // If the tab is active, update the controls UI
                 if (args.tabId == activeTabId) {
@@ -51,6 +47,7 @@ const messageHandler = event => {
 
                 addHistoryItem(historyItemFromTab(args.tabId), (id) => {
                     tab.historyItemId = id;
+                    invalidateFrecencyIndex();
                 });
             }
             break;
@@ -73,6 +70,7 @@ const messageHandler = event => {
                 // If the tab is active, update the controls UI
                 if (args.tabId == activeTabId) {
                     updateNavigationUI(message);
+                    refreshFind();
                 }
             }
             break;
@@ -126,11 +124,51 @@ const messageHandler = event => {
         case commands.MG_CLOSE_WINDOW:
             closeWindow();
             break;
+        // Tab operations the browser starts itself, from shortcuts (see
+        // BrowserWindow::HandleAcceleratorKeyPressed) or automation
+        case commands.MG_CREATE_TAB:
+            createNewTab(args.active !== false, null, args);
+            break;
         case commands.MG_CLOSE_TAB:
             if (isValidTabId(args.tabId)) {
                 closeTab(args.tabId);
             }
             break;
+        case commands.MG_SWITCH_TAB:
+            switchToTab(args.tabId, false);
+            break;
+        case commands.MG_GO_BACK:
+            goBackOrForward(-1, false);
+            break;
+        case commands.MG_GO_FORWARD:
+            goBackOrForward(1, false);
+            break;
+        case commands.MG_FOCUS_ADDRESS_BAR:
+            focusAddressBar();
+            break;
+        case commands.MG_REOPEN_CLOSED_TAB:
+            createNewTab(true, args);
+            break;
+        case commands.MG_DOWNLOAD_PROGRESS:
+            updateDownloads(args.downloads);
+            break;
+        case commands.MG_FIND:
+            showFindBar();
+            break;
+        case commands.MG_FIND_RESULT:
+            updateFindResult(args);
+            break;
+        case commands.MG_TAB_OVERVIEW:
+            loadTabThumbnails(args.thumbnails);
+            break;
+        case commands.MG_CAPTURE_SNAPSHOT:
+            setFavoriteSnapshot(args.uri, args.snapshotId, args.format);
+            break;
+        case commands.MG_TAB_STATE:
+            if (isValidTabId(args.tabId)) {
+                updateTabState(args.tabId, args.state, args.memory, args.throttled, args.cpuSaved);
+            }
+            break;
         case commands.MG_GET_FAVORITES:
             if (isValidTabId(args.tabId)) {
                 getFavoritesAsJson((payload) => {
@@ -139,15 +177,20 @@ const messageHandler = event => {
                 });
             }
             break;
-        case commands.MG_REMOVE_FAVORITE:
-            removeFavorite(args.uri);
-            break;
-        case commands.MG_GET_SETTINGS:
+        case commands.MG_GET_TOP_SITES:
             if (isValidTabId(args.tabId)) {
-                args.settings = settings;
-                window.chrome.webview.postMessage(event.data);
+                getTopSites(args.count, (topSites) => {
+                    args.topSites = topSites;
+                    getFavoritesAsJson((payload) => {
+                        args.favorites = payload;
+                        window.chrome.webview.postMessage(event.data);
+                    });
+                });
             }
             break;
+        case commands.MG_REMOVE_FAVORITE:
+            removeFavorite(args.uri);
+            break;
         case commands.MG_GET_HISTORY:
             if (isValidTabId(args.tabId)) {
                 getHistoryItems(args.from, args.count, (payload) => {
@@ -162,6 +205,9 @@ const messageHandler = event => {
         case commands.MG_CLEAR_HISTORY:
             clearHistory();
             break;
+        case commands.MG_SYNC_CONFIG:
+            setSyncServer(args.server);
+            break;
         default:
             console.log(`Received unexpected message: ${JSON.stringify(event.data)}`);
     }
@@ -169,49 +215,33 @@ const messageHandler = event => {
 
 function processAddressBarInput() {
     var text = document.querySelector('#address-field').value;
+    let completedURI = takeAutocompletion(text);
+    if (completedURI) {
+        navigateActiveTab(completedURI);
+        return;
+    }
+
     tryNavigate(text);
 }
 
+// The host decides whether the text is an address or a search, see
+// AddressClassifier
 function tryNavigate(text) {
-    try {
-        var uriParser = new URL(text);
-
-        // URL creation succeeded, verify protocol is allowed
-        switch (uriParser.protocol) {
-            case 'http:':
-            case 'https:':
-            case 'file:':
-            case 'ftp:':
-                // Allowed protocol, navigate
-                navigateActiveTab(uriParser.href, false);
-                break;
-            default:
-                // Protocol not allowed, search Bing
-                navigateActiveTab(getSearchURI(text), true);
-                break;
-        }
-    } catch (e) {
-        // URL creation failed, check for invalid characters
-        if (containsIlegalCharacters(text) || isSingleWord(text)) {
-            // Search Bing
-            navigateActiveTab(getSearchURI(text), true);
-        } else {
-            // Try with HTTP
-            if (!hasScheme(text)) {
-                tryNavigate(`http:${text}`);
-            } else {
-                navigateActiveTab(getSearchURI(text), true);
-            }
+    var message = {
+        message: commands.MG_NAVIGATE,
+        args: {
+            text: text
         }
-    }
+    };
+
+    window.chrome.webview.postMessage(message);
 }
 
-function navigateActiveTab(uri, isSearch) {
+function navigateActiveTab(uri) {
     var message = {
         message: commands.MG_NAVIGATE,
         args: {
-            uri: uri,
-            encodedSearchURI: isSearch ? uri : getSearchURI(uri)
+            uri: uri
         }
     };
 
@@ -226,22 +256,6 @@ function reloadActiveTabContent() {
     window.chrome.webview.postMessage(message);
 }
 
-function containsIlegalCharacters(query) {
-    return !VALID_URI_REGEX.test(query);
-}
-
-function isSingleWord(query) {
-    return WORD_REGEX.test(query);
-}
-
-function hasScheme(query) {
-    return SCHEMED_URI_REGEX.test(query);
-}
-
-function getSearchURI(query) {
-    return `https://www.bing.com/search?q=${encodeURIComponent(query)}`;
-}
-
 function closeWindow() {
     var message = {
         message: commands.MG_CLOSE_WINDOW,
@@ -251,6 +265,12 @@ function closeWindow() {
     window.chrome.webview.postMessage(message);
 }
 
+function focusAddressBar() {
+    let addressField = document.getElementById('address-field');
+    addressField.focus();
+    addressField.select();
+}
+
 // Show active tab's URI in the address bar
 function updateURI() {
     if (activeTabId == INVALID_TAB_ID) {
@@ -258,7 +278,9 @@ function updateURI() {
     }
 
     let activeTab = tabs.get(activeTabId);
-    document.getElementById('address-field').value = activeTab.uriToShow || activeTab.uri;
+    let uri = activeTab.uriToShow || activeTab.uri;
+    // The new tab page is where typing starts, keep the field clear for it
+    document.getElementById('address-field').value = uri == 'browser://newtab' ? '' : uri;
 }
 
 // Show active tab's favicon in the address bar
@@ -415,6 +437,7 @@ function loadTabUI(tabId) {
         let tabElement = document.createElement('div');
         tabElement.className = tabId == activeTabId ? 'tab-active' : 'tab';
         tabElement.id = `tab-${tabId}`;
+        tabElement.dataset.state = tab.memoryState;
 
         let tabLabel = document.createElement('div');
         tabLabel.className = 'tab-label';
@@ -550,6 +573,12 @@ function refreshControls() {
     manageControls.className = 'controls-group';
     manageControls.id = 'manage-controls-container';
 
+    let downloadsButton = document.createElement('div');
+    downloadsButton.className = 'btn hidden';
+    downloadsButton.id = 'btn-downloads';
+    downloadsButton.textContent = '\u2193';
+    manageControls.append(downloadsButton);
+
     let optionsButton = document.createElement('div');
     optionsButton.className = 'btn';
     optionsButton.id = 'btn-options';
@@ -567,6 +596,7 @@ function refreshControls() {
 
     addControlsListeners();
     updateNavigationUI();
+    updateDownloadsButton();
 }
 
 function refreshTabs() {
@@ -587,6 +617,15 @@ function refreshTabs() {
     newTabButton.append(buttonSpan);
     tabsStrip.append(newTabButton);
 
+    let overviewButton = document.createElement('div');
+    overviewButton.id = 'btn-tab-overview';
+    overviewButton.title = 'All tabs (Ctrl+Shift+A)';
+    let overviewSpan = document.createElement('span');
+    overviewSpan.textContent = '\u229e';
+    overviewSpan.id = 'overview-label';
+    overviewButton.append(overviewSpan);
+    tabsStrip.append(overviewButton);
+
     let bodyElement = document.getElementsByTagName('body')[0];
     bodyElement.append(tabsStrip);
 
@@ -608,10 +647,28 @@ function toggleFavorite() {
         addFavorite(favoriteFromTab(activeTabId), () => {
             activeTab.isFavorite = true;
             updateFavoriteIcon();
+            saveOfflineCopy(activeTabId, 'mhtml');
         });
     }
 }
 
+// Refreshes the offline copy of the active tab, favoriting it first if
+// needed
+function saveActiveTabOffline(format) {
+    const tabId = activeTabId;
+    activeTab = tabs.get(tabId);
+    if (activeTab.isFavorite) {
+        saveOfflineCopy(tabId, format);
+        return;
+    }
+
+    addFavorite(favoriteFromTab(tabId), () => {
+        activeTab.isFavorite = true;
+        updateFavoriteIcon();
+        saveOfflineCopy(tabId, format);
+    });
+}
+
 function addControlsListeners() {
     let inputField = document.querySelector('#address-field');
     let clearButton = document.querySelector('#btn-clear');
@@ -626,6 +683,11 @@ function addControlsListeners() {
 
     inputField.addEventListener('focus', function(e) {
         e.target.select();
+        refreshFrecencyIndexIfStale();
+    });
+
+    inputField.addEventListener('input', function(e) {
+        handleAddressBarInput(inputField, e);
     });
 
     inputField.addEventListener('blur', function(e) {
@@ -642,25 +704,28 @@ function addControlsListeners() {
     });
 
     document.querySelector('#btn-forward').addEventListener('click', function(e) {
+        if (takeHistoryMenuClick()) {
+            return;
+        }
+
         if (document.getElementById('btn-forward').className === 'btn') {
-            var message = {
-                message: commands.MG_GO_FORWARD,
-                args: {}
-            };
-            window.chrome.webview.postMessage(message);
+            goBackOrForward(1);
         }
     });
 
     document.querySelector('#btn-back').addEventListener('click', function(e) {
+        if (takeHistoryMenuClick()) {
+            return;
+        }
+
         if (document.getElementById('btn-back').className === 'btn') {
-            var message = {
-                message: commands.MG_GO_BACK,
-                args: {}
-            };
-            window.chrome.webview.postMessage(message);
+            goBackOrForward(-1);
         }
     });
 
+    addHistoryMenuListeners(document.querySelector('#btn-forward'), true);
+    addHistoryMenuListeners(document.querySelector('#btn-back'), false);
+
     document.querySelector('#btn-reload').addEventListener('click', function(e) {
         var btnReload = document.getElementById('btn-reload');
         if (btnReload.className === 'btn-cancel') {
@@ -678,20 +743,40 @@ function addControlsListeners() {
         toggleOptionsDropdown();
     });
 
+    document.querySelector('#btn-downloads').addEventListener('click', function(e) {
+        navigateActiveTab('browser://downloads');
+    });
+
+    // New, close and switch tab, reload, back/forward and the address bar
+    // shortcuts are run by the browser before any WebView gets the key
     window.onkeydown = function(event) {
         if (event.ctrlKey) {
             switch (event.key) {
-                case 'r':
-                case 'R':
-                    reloadActiveTabContent();
-                    break;
                 case 'd':
                 case 'D':
                     toggleFavorite();
                     break;
+                case 'f':
+                case 'F':
+                    showFindBar();
+                    break;
+                case 'a':
+                case 'A':
+                    if (!event.shiftKey) {
+                        return;
+                    }
+                    toggleTabOverview();
+                    break;
+                case 's':
+                case 'S':
+                    saveActiveTabOffline(event.shiftKey ? 'pdf' : 'mhtml');
+                    break;
                 case 't':
                 case 'T':
-                    createNewTab(true);
+                    if (!event.shiftKey) {
+                        return;
+                    }
+                    reopenClosedTab();
                     break;
                 case 'p':
                 case 'P':
@@ -720,17 +805,118 @@ function addTabsListeners() {
         createNewTab(true);
     });
 
+    document.querySelector('#btn-tab-overview').addEventListener('click', function(e) {
+        toggleTabOverview();
+    });
+
     document.querySelector('#btn-fav').addEventListener('click', function(e) {
         toggleFavorite();
     });
 }
 
+// The browser paints these natively at the next start until this page is
+// ready, see ControlsSnapshot. In document order, later ones on top.
+const SNAPSHOT_SELECTORS = [
+    '#controls-bar', '#tabs-strip', '.tab', '.tab-active', '#address-bar-container', '#security-label span',
+    '#address-field', '#btn-back', '#btn-forward', '#btn-reload', '#btn-options', '#btn-new-tab', '#btn-tab-overview'
+];
+const SNAPSHOT_STRETCHING = ['controls-bar', 'tabs-strip', 'address-bar-container', 'address-field'];
+// Stand-ins for the buttons' images
+const SNAPSHOT_GLYPHS = {
+    'btn-back': '\u2190',
+    'btn-forward': '\u2192',
+    'btn-reload': '\u21bb',
+    'btn-options': '\u22ef'
+};
+
+// [r, g, b, a] from a computed color
+function parseColor(color) {
+    const channels = (color.match(/[\d.]+/g) || []).map(Number);
+    return channels.length < 3 ? [0, 0, 0, 0] : [channels[0], channels[1], channels[2], channels.length > 3 ? channels[3] : 1];
+}
+
+function getControlsSnapshot() {
+    const width = window.innerWidth;
+    const box = (rect) => ({ x: rect.left, y: rect.top, width: rect.width, height: rect.height });
+
+    let elements = [];
+    for (const element of document.querySelectorAll(SNAPSHOT_SELECTORS.join(','))) {
+        const rect = element.getBoundingClientRect();
+        if (!rect.width || !rect.height) {
+            continue;
+        }
+
+        const style = getComputedStyle(element);
+        let item = box(rect);
+        item.anchor = SNAPSHOT_STRETCHING.includes(element.id) ? 'stretch' :
+            rect.left + rect.width / 2 > width / 2 ? 'right' : 'left';
+        item.background = parseColor(style.backgroundColor);
+        item.radius = parseFloat(style.borderTopLeftRadius) || 0;
+
+        // Only borders all around, the strip's separators are left out
+        const borderWidth = parseFloat(style.borderTopWidth) || 0;
+        if (borderWidth && ['Right', 'Bottom', 'Left'].every((side) => parseFloat(style[`border${side}Width`]) == borderWidth)) {
+            item.border = parseColor(style.borderTopColor);
+            item.borderWidth = borderWidth;
+        }
+
+        // Text comes from the label span, the field's value or placeholder,
+        // or the button's glyph; the bars' own is painted with their children
+        const isContainer = SNAPSHOT_STRETCHING.includes(element.id) && element.tagName != 'INPUT';
+        let textElement = element.querySelector('span') || element;
+        let text = isContainer ? '' : textElement.textContent;
+        let color = getComputedStyle(textElement).color;
+        if (element.tagName == 'INPUT') {
+            text = element.value || element.placeholder;
+            color = element.value ? color : 'rgb(117, 117, 117)';
+        } else if (SNAPSHOT_GLYPHS[element.id]) {
+            text = SNAPSHOT_GLYPHS[element.id];
+            color = 'rgb(96, 96, 96)';
+        }
+
+        if (text.trim()) {
+            const textRect = textElement.getBoundingClientRect();
+            const textStyle = getComputedStyle(textElement);
+            item.text = text.trim();
+            item.textX = textRect.left + (parseFloat(textStyle.paddingLeft) || 0);
+            item.textY = textRect.top;
+            item.textWidth = textRect.width;
+            item.textHeight = textRect.height;
+            item.color = parseColor(color);
+            item.fontSize = SNAPSHOT_GLYPHS[element.id] ? 18 : parseFloat(textStyle.fontSize);
+            item.fontFamily = textStyle.fontFamily.split(',')[0].replace(/["']/g, '').trim();
+            item.align = SNAPSHOT_GLYPHS[element.id] || textStyle.textAlign == 'center' ? 'center' : 'left';
+        }
+
+        elements.push(item);
+    }
+
+    return { width: width, height: window.innerHeight, elements: elements };
+}
+
+// Once the first frame is on screen, the browser stops painting its
+// snapshot of the bar and keeps this one for the next start
+function postControlsReady() {
+    requestAnimationFrame(() => setTimeout(() => {
+        let message = {
+            message: commands.MG_CONTROLS_READY,
+            args: { snapshot: getControlsSnapshot() }
+        };
+
+        window.chrome.webview.postMessage(message);
+    }, 0));
+}
+
 function init() {
     window.chrome.webview.addEventListener('message', messageHandler);
     refreshControls();
     refreshTabs();
+    createFindBar();
+    createTabOverview();
+    requestSyncConfig();
 
     createNewTab(true);
+    postControlsReady();
 }
 
 init();
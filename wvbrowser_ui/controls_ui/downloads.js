@@ -0,0 +1,35 @@
+// Download progress comes from the browser in batches of the downloads that
+// changed. The downloads button shows up with the first one and fills with
+// the combined progress of the transfers still going.
+let downloads = new Map();
+
+function updateDownloads(batch) {
+    batch.forEach((download) => downloads.set(download.id, download));
+    updateDownloadsButton();
+}
+
+function updateDownloadsButton() {
+    let downloadsButton = document.getElementById('btn-downloads');
+    if (!downloadsButton || downloads.size == 0) {
+        return;
+    }
+
+    let active = 0;
+    let receivedBytes = 0;
+    let totalBytes = 0;
+    for (const download of downloads.values()) {
+        if (download.state == 'inProgress' || download.state == 'queued' || download.state == 'paused') {
+            active++;
+            if (download.totalBytes > 0) {
+                receivedBytes += download.receivedBytes;
+                totalBytes += download.totalBytes;
+            }
+        }
+    }
+
+    const progress = totalBytes > 0 ? (100 * receivedBytes / totalBytes).toFixed(0) : 0;
+    downloadsButton.classList.remove('hidden');
+    downloadsButton.classList.toggle('downloading', active > 0);
+    downloadsButton.style.setProperty('--progress', `${progress}%`);
+    downloadsButton.title = active > 0 ? `${active} download${active > 1 ? 's' : ''} in progress (${progress}%)` : 'Downloads';
+}
@@ -16,9 +16,10 @@ function isFavorite(uri, callback) {
 
 function addFavorite(favorite, callback) {
     queryDB((db) => {
-        let transaction = db.transaction(['favorites'], 'readwrite');
+        let transaction = db.transaction(['favorites', 'syncRecords'], 'readwrite');
         let favoritesStore = transaction.objectStore('favorites');
         let addFavoriteRequest = favoritesStore.add(favorite);
+        recordSyncChange(transaction, favoriteSyncKey(favorite.uri), favoriteSyncData(favorite));
 
         addFavoriteRequest.onerror = function(event) {
             console.log(`Could not add favorite with key: ${favorite.uri}`);
@@ -35,9 +36,19 @@ function addFavorite(favorite, callback) {
 
 function removeFavorite(key, callback) {
     queryDB((db) => {
-        let transaction = db.transaction(['favorites'], 'readwrite');
+        let transaction = db.transaction(['favorites', 'syncRecords'], 'readwrite');
         let favoritesStore = transaction.objectStore('favorites');
+
+        // The offline copy goes with the favorite
+        let getFavoriteRequest = favoritesStore.get(key);
+        getFavoriteRequest.onsuccess = function() {
+            if (getFavoriteRequest.result && getFavoriteRequest.result.snapshotId) {
+                deleteSnapshot(getFavoriteRequest.result.snapshotId);
+            }
+        };
+
         let removeFavoriteRequest = favoritesStore.delete(key);
+        recordSyncChange(transaction, favoriteSyncKey(key), null);
 
         removeFavoriteRequest.onerror = function(event) {
             console.log(`Could not remove favorite with key: ${key}`);
@@ -70,3 +81,64 @@ function getFavoritesAsJson(callback) {
         };
     });
 }
+
+// Offline copies are kept by the browser, the favorite only knows the ID
+function saveOfflineCopy(tabId, format) {
+    let message = {
+        message: commands.MG_CAPTURE_SNAPSHOT,
+        args: {
+            tabId: tabId,
+            format: format
+        }
+    };
+
+    window.chrome.webview.postMessage(message);
+}
+
+function deleteSnapshot(snapshotId) {
+    let message = {
+        message: commands.MG_DELETE_SNAPSHOT,
+        args: {
+            id: snapshotId
+        }
+    };
+
+    window.chrome.webview.postMessage(message);
+}
+
+function setFavoriteSnapshot(uri, snapshotId, format) {
+    queryDB((db) => {
+        let transaction = db.transaction(['favorites'], 'readwrite');
+        let favoritesStore = transaction.objectStore('favorites');
+        let getFavoriteRequest = favoritesStore.get(uri);
+
+        getFavoriteRequest.onerror = function(event) {
+            console.log(`Could not query for ${uri}: ${event.target.error.message}`);
+        };
+
+        getFavoriteRequest.onsuccess = function() {
+            let favorite = getFavoriteRequest.result;
+            if (!favorite) {
+                // Removed while the page was being saved
+                deleteSnapshot(snapshotId);
+                return;
+            }
+
+            let previousSnapshotId = favorite.snapshotId;
+            favorite.snapshotId = snapshotId;
+            favorite.snapshotFormat = format;
+            let putFavoriteRequest = favoritesStore.put(favorite);
+
+            putFavoriteRequest.onerror = function(event) {
+                console.log(`Could not update favorite with key: ${uri}`);
+                console.log(event.target.error.message);
+            };
+
+            putFavoriteRequest.onsuccess = function() {
+                if (previousSnapshotId && previousSnapshotId != snapshotId) {
+                    deleteSnapshot(previousSnapshotId);
+                }
+            };
+        };
+    });
+}
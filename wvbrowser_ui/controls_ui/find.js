@@ -0,0 +1,140 @@
+// Find bar over the right end of the tab strip. Every keystroke sends the
+// query to the find script in the active tab (wvbrowser_ui/find_in_page.js),
+// which reports the match count as it searches; reports for older queries
+// are dropped.
+let findRequestId = 0;
+
+function isFindBarVisible() {
+    let findBar = document.getElementById('find-bar');
+    return findBar && !findBar.classList.contains('hidden');
+}
+
+function sendFind(action, extraArgs) {
+    if (action == 'find') {
+        findRequestId++;
+    }
+
+    let message = {
+        message: commands.MG_FIND,
+        args: Object.assign({
+            action: action,
+            requestId: findRequestId,
+            query: document.getElementById('find-field').value
+        }, extraArgs)
+    };
+
+    window.chrome.webview.postMessage(message);
+}
+
+function showFindBar() {
+    let findBar = document.getElementById('find-bar');
+    let findField = document.getElementById('find-field');
+    findBar.classList.remove('hidden');
+    findField.focus();
+    findField.select();
+
+    if (findField.value) {
+        sendFind('find');
+    }
+}
+
+// The host clears the page when switching tabs, |focusTab| is for the user
+// closing the bar
+function hideFindBar(focusTab) {
+    if (!isFindBarVisible()) {
+        return;
+    }
+
+    document.getElementById('find-bar').classList.add('hidden');
+    document.getElementById('find-count').textContent = '';
+    if (focusTab) {
+        sendFind('stop', { focusTab: true });
+    }
+}
+
+// A new document in the active tab has to be searched again
+function refreshFind() {
+    if (isFindBarVisible() && document.getElementById('find-field').value) {
+        sendFind('find');
+    }
+}
+
+function updateFindResult(args) {
+    if (args.tabId != activeTabId || args.requestId != findRequestId || !isFindBarVisible()) {
+        return;
+    }
+
+    let countText = '';
+    if (args.matches) {
+        countText = `${args.activeMatch + 1}/${args.matches}${args.capped ? '+' : ''}`;
+    } else if (args.query) {
+        countText = args.done ? 'No results' : '';
+    }
+
+    let findCount = document.getElementById('find-count');
+    findCount.textContent = countText;
+    findCount.classList.toggle('searching', !args.done);
+}
+
+function createFindBar() {
+    let findBar = document.createElement('div');
+    findBar.id = 'find-bar';
+    findBar.className = 'hidden';
+
+    let findField = document.createElement('input');
+    findField.id = 'find-field';
+    findField.placeholder = 'Find in page';
+    findBar.append(findField);
+
+    let findCount = document.createElement('span');
+    findCount.id = 'find-count';
+    findBar.append(findCount);
+
+    [['btn-find-previous', '\u2191', 'Previous match (Shift+Enter)'],
+     ['btn-find-next', '\u2193', 'Next match (Enter)'],
+     ['btn-find-close', '\u00d7', 'Close (Esc)']].forEach(([id, label, title]) => {
+        let button = document.createElement('div');
+        button.id = id;
+        button.className = 'btn-find';
+        button.textContent = label;
+        button.title = title;
+        findBar.append(button);
+    });
+
+    document.body.append(findBar);
+    addFindBarListeners();
+}
+
+function addFindBarListeners() {
+    let findField = document.getElementById('find-field');
+    findField.addEventListener('input', function(e) {
+        sendFind('find');
+    });
+
+    findField.addEventListener('keydown', function(e) {
+        switch (e.key) {
+            case 'Enter':
+                sendFind(e.shiftKey ? 'previous' : 'next');
+                break;
+            case 'Escape':
+                hideFindBar(true);
+                break;
+            default:
+                return;
+        }
+
+        e.preventDefault();
+    });
+
+    document.querySelector('#btn-find-previous').addEventListener('click', function(e) {
+        sendFind('previous');
+    });
+
+    document.querySelector('#btn-find-next').addEventListener('click', function(e) {
+        sendFind('next');
+    });
+
+    document.querySelector('#btn-find-close').addEventListener('click', function(e) {
+        hideFindBar(true);
+    });
+}
@@ -2,7 +2,7 @@ const INVALID_HISTORY_ID = -1;
 
 function addHistoryItem(item, callback) {
     queryDB((db) => {
-        let transaction = db.transaction(['history'], 'readwrite');
+        let transaction = db.transaction(['history', 'syncRecords'], 'readwrite');
         let historyStore = transaction.objectStore('history');
 
         // Check if an item for this URI exists on this day
@@ -24,6 +24,7 @@ function addHistoryItem(item, callback) {
                 // There's an entry for this URI, update the item
                 cursor.value.timestamp = item.timestamp;
                 let updateRequest = cursor.update(cursor.value);
+                recordSyncChange(transaction, historySyncKey(cursor.value), historySyncData(cursor.value));
 
                 updateRequest.onsuccess = function(event) {
                     if (callback) {
@@ -35,6 +36,7 @@ function addHistoryItem(item, callback) {
                 let addItemRequest = historyStore.add(item);
 
                 addItemRequest.onsuccess = function(event) {
+                    recordSyncChange(transaction, historySyncKey(item), historySyncData(item), event.target.result);
                     if (callback) {
                         callback(event.target.result);
                     }
@@ -51,14 +53,20 @@ function updateHistoryItem(id, item, callback) {
     }
 
     queryDB((db) => {
-        let transaction = db.transaction(['history'], 'readwrite');
+        let transaction = db.transaction(['history', 'syncRecords'], 'readwrite');
         let historyStore = transaction.objectStore('history');
         let storedItemRequest = historyStore.get(id);
         storedItemRequest.onsuccess = function(event) {
             let storedItem = event.target.result;
+            if (!storedItem) {
+                // Removed meanwhile
+                return;
+            }
+
             item.timestamp = storedItem.timestamp;
 
             let updateRequest = historyStore.put(item, id);
+            recordSyncChange(transaction, historySyncKey(item), historySyncData(item), id);
 
             updateRequest.onsuccess = function(event) {
                 if (callback) {
@@ -111,8 +119,15 @@ function getHistoryItems(from, n, callback) {
 
 function removeHistoryItem(id, callback) {
     queryDB((db) => {
-        let transaction = db.transaction(['history'], 'readwrite');
+        let transaction = db.transaction(['history', 'syncRecords'], 'readwrite');
         let historyStore = transaction.objectStore('history');
+        let storedItemRequest = historyStore.get(id);
+        storedItemRequest.onsuccess = function() {
+            if (storedItemRequest.result) {
+                recordSyncChange(transaction, historySyncKey(storedItemRequest.result), null);
+            }
+        };
+
         let removeItemRequest = historyStore.delete(id);
 
         removeItemRequest.onerror = function(event) {
@@ -130,10 +145,23 @@ function removeHistoryItem(id, callback) {
 
 function clearHistory(callback) {
     queryDB((db) => {
-        let transaction = db.transaction(['history'], 'readwrite');
+        let transaction = db.transaction(['history', 'syncRecords'], 'readwrite');
         let historyStore = transaction.objectStore('history');
         let clearRequest = historyStore.clear();
 
+        // Every synced item is removed on the other devices too
+        let syncStore = transaction.objectStore('syncRecords');
+        let syncCursorRequest = syncStore.openCursor(IDBKeyRange.bound('h:', 'h:\uffff'));
+        syncCursorRequest.onsuccess = function(event) {
+            let cursor = event.target.result;
+            if (cursor) {
+                if (cursor.value.data) {
+                    recordSyncChange(transaction, cursor.primaryKey, null);
+                }
+                cursor.continue();
+            }
+        };
+
         clearRequest.onsuccess = function(event) {
             if (callback) {
                 callback();
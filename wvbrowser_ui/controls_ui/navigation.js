@@ -0,0 +1,128 @@
+// Back/forward from the navigation entries the browser sends along with
+// MG_UPDATE_URI. The controls show the entry as soon as a button is pressed
+// and the browser confirms it once the navigation commits.
+const HISTORY_MENU_DELAY = 500; // ms a back/forward press is held for the history menu
+
+let historyMenuTimer = 0;
+let historyMenuShown = false;
+
+function setNavigationEntries(tabId, entries, currentEntry, uri) {
+    const tab = tabs.get(tabId);
+    tab.entries = entries;
+    tab.currentEntry = currentEntry;
+
+    // The list may not have caught up with a new document yet
+    const entry = entries[currentEntry];
+    if (entry && entry.uri == uri) {
+        showEntryDetails(tabId, entry);
+    }
+}
+
+// Title, favicon and lock icon the entry had when it was last shown
+function showEntryDetails(tabId, entry) {
+    const tab = tabs.get(tabId);
+
+    const tabElement = document.getElementById(`tab-${tabId}`);
+    if (entry.title && tabElement) {
+        tab.title = entry.title;
+        tabElement.firstChild.firstChild.textContent = tab.title;
+    }
+
+    if (entry.favicon) {
+        updateFaviconURI(tabId, entry.favicon);
+    }
+
+    if (entry.securityState) {
+        tab.securityState = entry.securityState;
+        if (tabId == activeTabId) {
+            updateLockIcon();
+        }
+    }
+}
+
+// |updateOnHost| is false for the browser's own Alt+Left/Right, which it
+// has navigated already
+function goBackOrForward(offset, updateOnHost = true) {
+    if (activeTabId == INVALID_TAB_ID) {
+        return;
+    }
+
+    const tab = tabs.get(activeTabId);
+    const index = tab.currentEntry + offset;
+    if (tab.entries && index >= 0 && index < tab.entries.length) {
+        const entry = tab.entries[index];
+        tab.currentEntry = index;
+
+        // tab.uri waits for the browser, the visit is added to history then
+        tab.uriToShow = entry.uriToShow || entry.uri;
+        tab.canGoBack = index > 0;
+        tab.canGoForward = index < tab.entries.length - 1;
+
+        showEntryDetails(activeTabId, entry);
+        updateURI();
+        updateBackForwardButtons();
+    }
+
+    if (!updateOnHost) {
+        return;
+    }
+
+    var message = {
+        message: offset < 0 ? commands.MG_GO_BACK : commands.MG_GO_FORWARD,
+        args: {}
+    };
+    window.chrome.webview.postMessage(message);
+}
+
+// The browser builds the menu from its own copy of the entries
+function showHistoryMenu(button, forward) {
+    historyMenuShown = true;
+
+    const bounds = button.getBoundingClientRect();
+    var message = {
+        message: commands.MG_SHOW_HISTORY_MENU,
+        args: {
+            forward: forward,
+            x: Math.round(bounds.left * window.devicePixelRatio),
+            y: Math.round(bounds.bottom * window.devicePixelRatio)
+        }
+    };
+    window.chrome.webview.postMessage(message);
+}
+
+// Long press or right click on back/forward opens the history menu
+function addHistoryMenuListeners(button, forward) {
+    button.addEventListener('mousedown', function(e) {
+        historyMenuShown = false;
+        clearTimeout(historyMenuTimer);
+
+        if (e.button == 0 && button.className === 'btn') {
+            historyMenuTimer = setTimeout(() => {
+                showHistoryMenu(button, forward);
+            }, HISTORY_MENU_DELAY);
+        }
+    });
+
+    button.addEventListener('mouseup', function(e) {
+        clearTimeout(historyMenuTimer);
+    });
+
+    button.addEventListener('mouseleave', function(e) {
+        clearTimeout(historyMenuTimer);
+    });
+
+    button.addEventListener('contextmenu', function(e) {
+        e.preventDefault();
+        if (button.className === 'btn') {
+            showHistoryMenu(button, forward);
+        }
+    });
+}
+
+// Whether the click ends a press that opened the history menu
+function takeHistoryMenuClick() {
+    const shown = historyMenuShown;
+    historyMenuShown = false;
+
+    return shown;
+}
@@ -30,6 +30,7 @@ function addItemsListeners() {
                 case 'settings':
                 case 'history':
                 case 'favorites':
+                case 'downloads':
                     item.addEventListener('click', function(e) {
                         navigateToBrowserPage(entry);
                     });
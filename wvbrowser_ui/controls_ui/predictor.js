@@ -0,0 +1,206 @@
+// Guesses where the address bar input is going and tells the browser, which
+// preconnects to (or prerenders) the candidate depending on the preload
+// setting and the confidence sent along.
+const PREDICTION_DELAY = 80; // ms of typing pause before predicting
+const TYPED_HOST_DELAY = 500; // ms of pause before a typed host counts as whole
+const FRECENCY_HISTORY_DEPTH = 1000;
+const FRECENCY_REFRESH_INTERVAL = 60 * 1000;
+const TYPED_URI_CONFIDENCE = 0.5;
+
+let frecencyIndex = [];
+let frecencyIndexTime = 0;
+let predictionTimer = 0;
+let lastPrediction = '';
+let autocompletion = null; // { text, uri } shown inline in the address bar
+
+// Recent visits weigh more, one history entry is kept per URI per day
+function frecencyWeight(timestamp, now) {
+    const days = (now - new Date(timestamp).getTime()) / (24 * 60 * 60 * 1000);
+    if (days < 4) {
+        return 100;
+    } else if (days < 14) {
+        return 70;
+    } else if (days < 31) {
+        return 50;
+    } else if (days < 90) {
+        return 30;
+    }
+
+    return 10;
+}
+
+function stripForMatching(uri) {
+    return uri.toLowerCase().replace(/^[a-z]+:\/\//, '').replace(/^www\./, '');
+}
+
+function refreshFrecencyIndex(callback) {
+    getHistoryItems(0, FRECENCY_HISTORY_DEPTH, (items) => {
+        const now = Date.now();
+        let scores = new Map();
+
+        // History comes newest first, so a URI keeps the title and favicon
+        // of its latest visit
+        for (const entry of items) {
+            const uri = entry.item.uri;
+            if (!uri || uri.substring(0, 4) != 'http') {
+                continue;
+            }
+
+            let indexEntry = scores.get(uri);
+            if (!indexEntry) {
+                indexEntry = {
+                    uri: uri,
+                    key: stripForMatching(uri),
+                    title: entry.item.title,
+                    favicon: entry.item.favicon,
+                    score: 0
+                };
+                scores.set(uri, indexEntry);
+            }
+            indexEntry.score += frecencyWeight(entry.item.timestamp, now);
+        }
+
+        frecencyIndex = Array.from(scores.values()).sort((a, b) => b.score - a.score);
+        frecencyIndexTime = now;
+
+        if (callback) {
+            callback();
+        }
+    });
+}
+
+function invalidateFrecencyIndex() {
+    frecencyIndexTime = 0;
+}
+
+// The most frecent sites for the new tab page, one per host
+function getTopSites(count, callback) {
+    refreshFrecencyIndexIfStale(() => {
+        let hosts = new Set();
+        let topSites = [];
+        for (const entry of frecencyIndex) {
+            const host = entry.key.split('/')[0];
+            if (hosts.has(host)) {
+                continue;
+            }
+
+            hosts.add(host);
+            topSites.push({ uri: entry.uri, title: entry.title, favicon: entry.favicon });
+            if (topSites.length == count) {
+                break;
+            }
+        }
+
+        callback(topSites);
+    });
+}
+
+function refreshFrecencyIndexIfStale(callback) {
+    if (Date.now() - frecencyIndexTime > FRECENCY_REFRESH_INTERVAL) {
+        refreshFrecencyIndex(callback);
+    } else if (callback) {
+        callback();
+    }
+}
+
+// Best history match for the typed text, with the share of the matching
+// frecency it holds as confidence
+function predictFromHistory(text) {
+    const typed = stripForMatching(text);
+    let best = null;
+    let total = 0;
+
+    for (const entry of frecencyIndex) {
+        if (entry.key.startsWith(typed)) {
+            total += entry.score;
+            if (!best) {
+                best = entry;
+            }
+        }
+    }
+
+    if (!best) {
+        return null;
+    }
+
+    // The constant keeps a single old visit from looking like a sure thing
+    return { uri: best.uri, confidence: best.score / (total + 50) };
+}
+
+function handleAddressBarInput(inputField, event) {
+    const typedText = inputField.value;
+    autocompletion = null;
+
+    // Complete inline with the best history match, so a prediction the
+    // user accepts is exactly what gets navigated to
+    const isDeletion = event.inputType && event.inputType.startsWith('delete');
+    const typed = stripForMatching(typedText.trim());
+    const prediction = typed && !isDeletion ? predictFromHistory(typedText.trim()) : null;
+    if (prediction) {
+        const completedText = typedText + stripForMatching(prediction.uri).substring(typed.length);
+        if (completedText != typedText) {
+            inputField.value = completedText;
+            inputField.setSelectionRange(typedText.length, completedText.length);
+        }
+        autocompletion = { text: completedText, uri: prediction.uri };
+    }
+
+    predictNavigation(typedText);
+}
+
+// The history URI if the address bar still shows its completion
+function takeAutocompletion(text) {
+    const completion = autocompletion;
+    autocompletion = null;
+
+    return completion && completion.text == text ? completion.uri : null;
+}
+
+function predictNavigation(text) {
+    clearTimeout(predictionTimer);
+
+    text = text.trim();
+    if (!text) {
+        return;
+    }
+
+    // Preconnecting to every prefix of a host as it's typed ("example.co"
+    // on the way to "example.com") would be worse than not at all, so a
+    // typed host counts once a path follows it or the typing stops
+    const isWholeHost = /^([a-z][a-z0-9+.-]*:\/\/)?[^\/?#]+[\/?#]/i.test(text);
+
+    predictionTimer = setTimeout(() => {
+        const predict = (settled) => {
+            let prediction = predictFromHistory(text);
+            if (!prediction && !isWholeHost && !settled) {
+                predictionTimer = setTimeout(() => predict(true), TYPED_HOST_DELAY - PREDICTION_DELAY);
+                return;
+            }
+
+            if (!prediction) {
+                // Nothing in history, the target is whatever Enter would
+                // open, which the host works out from the text
+                prediction = {
+                    text: text,
+                    confidence: TYPED_URI_CONFIDENCE
+                };
+            }
+
+            // Only tell the browser when something changed
+            const key = `${prediction.uri || prediction.text} ${prediction.confidence.toFixed(1)}`;
+            if (key == lastPrediction) {
+                return;
+            }
+            lastPrediction = key;
+
+            let message = {
+                message: commands.MG_PREDICT_NAVIGATION,
+                args: prediction
+            };
+
+            window.chrome.webview.postMessage(message);
+        };
+
+        refreshFrecencyIndexIfStale(() => predict(false));
+    }, PREDICTION_DELAY);
+}
@@ -1,5 +1,7 @@
+const DB_VERSION = 2;
+
 function handleUpgradeEvent(event) {
-    console.log('Creating DB');
+    console.log(`Upgrading DB from version ${event.oldVersion}`);
     let newDB = event.target.result;
 
     newDB.onerror = function(event) {
@@ -7,6 +9,25 @@ function handleUpgradeEvent(event) {
         console.log(event);
     };
 
+    // Stores added by every version, for the versions the DB doesn't have yet
+    if (event.oldVersion < 1) {
+        createHistoryAndFavoritesStores(newDB);
+    }
+
+    if (event.oldVersion < 2) {
+        let newSyncStore = newDB.createObjectStore('syncRecords', {
+            keyPath: 'key'
+        });
+
+        newSyncStore.createIndex('dirty', 'dirty', {
+            unique: false
+        });
+
+        seedSyncRecords(event.target.transaction);
+    }
+}
+
+function createHistoryAndFavoritesStores(newDB) {
     let newFavoritesStore = newDB.createObjectStore('favorites', {
         keyPath: 'uri'
     });
@@ -29,7 +50,7 @@ function handleUpgradeEvent(event) {
 }
 
 function queryDB(query) {
-    let request = window.indexedDB.open('WVBrowser');
+    let request = window.indexedDB.open('WVBrowser', DB_VERSION);
 
     request.onerror = function(event) {
         console.log('Failed to open database');
@@ -0,0 +1,442 @@
+// Sync of favorites and history through a sync server, the syncServer
+// setting (tools/sync_server.py is a stand-in for testing).
+//
+// Every change to a favorite or a history item also writes a record to the
+// syncRecords store, in the same transaction: the item's data, or null once
+// it's removed, and a version vector counting the changes every device made
+// to it. Records stay dirty until the server has them. A sync sends the
+// dirty records and gets the ones changed since its cursor, in gzip
+// compressed batches, one batch at a time and at idle time, so navigation
+// never waits on it.
+//
+// Conflicts are resolved the same way here and on the server: a version
+// vector that has seen every change of the other one wins. For concurrent
+// changes the latest modified time wins, then the greater device ID, and
+// the winner carries both vectors merged.
+const SYNC_BATCH_SIZE = 500;
+const SYNC_INTERVAL = 5 * 60 * 1000;
+const SYNC_CHANGE_DELAY = 5 * 1000;  // After a local change
+const SYNC_RETRY_DELAY = 60 * 1000;
+
+let syncServer = '';
+let syncTimer = 0;
+let syncDue = 0;
+let syncInProgress = false;
+let syncPending = false;  // Changes made while a sync was running
+
+function getSyncDeviceId() {
+    let deviceId = localStorage.getItem('syncDeviceId');
+    if (!deviceId) {
+        let bytes = crypto.getRandomValues(new Uint8Array(16));
+        deviceId = Array.from(bytes, (byte) => byte.toString(16).padStart(2, '0')).join('');
+        localStorage.setItem('syncDeviceId', deviceId);
+    }
+
+    return deviceId;
+}
+
+function favoriteSyncKey(uri) {
+    return `f:${uri}`;
+}
+
+// History keeps one item per URI and day, so does sync
+function historySyncKey(item) {
+    const date = item.timestamp;
+    return `h:${date.getFullYear()}-${date.getMonth() + 1}-${date.getDate()}:${item.uri}`;
+}
+
+// Offline copies stay on the device that saved them
+function favoriteSyncData(favorite) {
+    return {
+        uri: favorite.uri,
+        uriToShow: favorite.uriToShow,
+        title: favorite.title,
+        favicon: favorite.favicon
+    };
+}
+
+function historySyncData(item) {
+    return {
+        uri: item.uri,
+        title: item.title,
+        favicon: item.favicon,
+        timestamp: item.timestamp.getTime()
+    };
+}
+
+// Records a local change of the item behind |key| in |transaction|, which
+// must include the syncRecords store. |data| is null for a removal.
+function recordSyncChange(transaction, key, data, localId) {
+    let syncStore = transaction.objectStore('syncRecords');
+    let getRecordRequest = syncStore.get(key);
+
+    getRecordRequest.onsuccess = function() {
+        const deviceId = getSyncDeviceId();
+        let record = getRecordRequest.result || { key: key, vv: {} };
+        record.vv[deviceId] = (record.vv[deviceId] || 0) + 1;
+        record.modified = Date.now();
+        record.device = deviceId;
+        record.data = data;
+        record.dirty = 1;
+        if (localId !== undefined) {
+            record.localId = localId;
+        }
+
+        syncStore.put(record);
+    };
+
+    scheduleSync(SYNC_CHANGE_DELAY);
+}
+
+// Items stored before sync existed, recorded as changes of this device
+function seedSyncRecords(transaction) {
+    const deviceId = getSyncDeviceId();
+    const now = Date.now();
+    let syncStore = transaction.objectStore('syncRecords');
+    let seedRecord = (key, data, localId) => {
+        let record = { key: key, vv: { [deviceId]: 1 }, modified: now, device: deviceId, data: data, dirty: 1 };
+        if (localId !== undefined) {
+            record.localId = localId;
+        }
+
+        syncStore.put(record);
+    };
+
+    transaction.objectStore('favorites').openCursor().onsuccess = function(event) {
+        let cursor = event.target.result;
+        if (cursor) {
+            seedRecord(favoriteSyncKey(cursor.value.uri), favoriteSyncData(cursor.value));
+            cursor.continue();
+        }
+    };
+
+    transaction.objectStore('history').openCursor().onsuccess = function(event) {
+        let cursor = event.target.result;
+        if (cursor) {
+            seedRecord(historySyncKey(cursor.value), historySyncData(cursor.value), cursor.primaryKey);
+            cursor.continue();
+        }
+    };
+}
+
+function compareVersionVectors(a, b) {
+    let newer = false;
+    let older = false;
+    for (const device of new Set([...Object.keys(a), ...Object.keys(b)])) {
+        const countA = a[device] || 0;
+        const countB = b[device] || 0;
+        newer = newer || countA > countB;
+        older = older || countA < countB;
+    }
+
+    return newer && older ? 'concurrent' : newer ? 'newer' : older ? 'older' : 'equal';
+}
+
+// The version of |local| and |remote| to keep, null to keep |local| as is
+function resolveSyncConflict(local, remote) {
+    if (!local) {
+        return remote;
+    }
+
+    switch (compareVersionVectors(local.vv, remote.vv)) {
+        case 'older':
+            return remote;
+        case 'concurrent':
+            break;
+        default:
+            return null;
+    }
+
+    const remoteWins = remote.modified > local.modified ||
+        (remote.modified == local.modified && remote.device > local.device);
+    let winner = Object.assign({}, remoteWins ? remote : local);
+    winner.vv = Object.assign({}, local.vv);
+    for (const device in remote.vv) {
+        winner.vv[device] = Math.max(winner.vv[device] || 0, remote.vv[device]);
+    }
+    // Neither side has the merged version yet
+    winner.merged = true;
+
+    return winner;
+}
+
+function syncRecordToWire(record) {
+    return {
+        key: record.key,
+        vv: record.vv,
+        modified: record.modified,
+        device: record.device,
+        data: record.data
+    };
+}
+
+function getDirtySyncRecords(count, callback) {
+    queryDB((db) => {
+        let transaction = db.transaction(['syncRecords']);
+        let dirtyIndex = transaction.objectStore('syncRecords').index('dirty');
+        let getDirtyRequest = dirtyIndex.getAll(IDBKeyRange.only(1), count);
+
+        getDirtyRequest.onerror = function(event) {
+            console.log(`Could not read sync changes: ${event.target.error.message}`);
+            callback(null);
+        };
+
+        getDirtyRequest.onsuccess = function() {
+            callback(getDirtyRequest.result);
+        };
+    });
+}
+
+// Writes the version |record| won with to the favorites or history store
+function applySyncRecord(transaction, record) {
+    let syncStore = transaction.objectStore('syncRecords');
+    const data = record.data;
+
+    if (record.key.startsWith('f:')) {
+        let favoritesStore = transaction.objectStore('favorites');
+        const uri = record.key.substring(2);
+        let getFavoriteRequest = favoritesStore.get(uri);
+        getFavoriteRequest.onsuccess = function() {
+            let existing = getFavoriteRequest.result;
+            if (!data) {
+                if (existing && existing.snapshotId) {
+                    deleteSnapshot(existing.snapshotId);
+                }
+                favoritesStore.delete(uri);
+            } else {
+                let favorite = Object.assign({}, data);
+                if (existing && existing.snapshotId) {
+                    favorite.snapshotId = existing.snapshotId;
+                    favorite.snapshotFormat = existing.snapshotFormat;
+                }
+                favoritesStore.put(favorite);
+            }
+        };
+
+        syncStore.put(record);
+        return;
+    }
+
+    let historyStore = transaction.objectStore('history');
+    if (!data) {
+        if (record.localId !== undefined) {
+            historyStore.delete(record.localId);
+            delete record.localId;
+        }
+        syncStore.put(record);
+        return;
+    }
+
+    let item = {
+        uri: data.uri,
+        title: data.title,
+        favicon: data.favicon,
+        timestamp: new Date(data.timestamp)
+    };
+
+    let writeItemRequest = record.localId !== undefined ?
+        historyStore.put(item, record.localId) : historyStore.add(item);
+    writeItemRequest.onsuccess = function() {
+        record.localId = writeItemRequest.result;
+        syncStore.put(record);
+    };
+}
+
+// Clears the dirty flag of the records the server took, unless they changed
+// again meanwhile, and merges the records the server sent back
+function storeSyncResult(sentRecords, receivedRecords, callback) {
+    let sent = new Map(sentRecords.map((record) => [record.key, record]));
+    let received = new Map(receivedRecords.map((record) => [record.key, record]));
+    let changedFavorites = false;
+    let changedHistory = false;
+
+    queryDB((db) => {
+        let transaction = db.transaction(['favorites', 'history', 'syncRecords'], 'readwrite');
+        let syncStore = transaction.objectStore('syncRecords');
+
+        for (const key of new Set([...sent.keys(), ...received.keys()])) {
+            let getRecordRequest = syncStore.get(key);
+            getRecordRequest.onsuccess = function() {
+                let local = getRecordRequest.result;
+                const sentRecord = sent.get(key);
+                if (local && sentRecord && compareVersionVectors(local.vv, sentRecord.vv) == 'equal') {
+                    local.dirty = 0;
+                }
+
+                const remote = received.get(key);
+                let winner = remote ? resolveSyncConflict(local, remote) : null;
+                if (!winner) {
+                    if (local && sentRecord) {
+                        syncStore.put(local);
+                    }
+                    return;
+                }
+
+                winner.dirty = winner.merged ? 1 : 0;
+                delete winner.merged;
+                if (local && local.localId !== undefined) {
+                    winner.localId = local.localId;
+                }
+
+                changedFavorites = changedFavorites || key.startsWith('f:');
+                changedHistory = changedHistory || key.startsWith('h:');
+                applySyncRecord(transaction, winner);
+            };
+        }
+
+        transaction.oncomplete = function() {
+            if (changedHistory) {
+                invalidateFrecencyIndex();
+            }
+            if (changedFavorites && isValidTabId(activeTabId)) {
+                let activeTab = tabs.get(activeTabId);
+                isFavorite(activeTab.uri, (favorite) => {
+                    activeTab.isFavorite = favorite;
+                    updateFavoriteIcon();
+                });
+            }
+
+            callback(true);
+        };
+
+        transaction.onabort = function(event) {
+            console.log(`Could not store sync changes: ${transaction.error && transaction.error.message}`);
+            callback(false);
+        };
+    });
+}
+
+function postSyncBatch(server, request) {
+    const body = new Blob([JSON.stringify(request)]).stream().pipeThrough(new CompressionStream('gzip'));
+    return new Response(body).arrayBuffer().then((compressed) => {
+        return fetch(`${server}/sync`, {
+            method: 'POST',
+            headers: {
+                'Content-Type': 'application/json',
+                'Content-Encoding': 'gzip'
+            },
+            body: compressed
+        }).then((response) => {
+            if (!response.ok) {
+                throw new Error(`Sync server answered ${response.status}`);
+            }
+
+            const received = Number(response.headers.get('Content-Length')) || 0;
+            return response.json().then((answer) => {
+                return { answer: answer, sent: compressed.byteLength, received: received };
+            });
+        });
+    });
+}
+
+function syncBatch(server, stats, callback) {
+    getDirtySyncRecords(SYNC_BATCH_SIZE, (dirtyRecords) => {
+        if (!dirtyRecords || server != syncServer) {
+            callback(!!dirtyRecords);
+            return;
+        }
+
+        const cursorKey = `syncCursor:${server}`;
+        const request = {
+            device: getSyncDeviceId(),
+            cursor: Number(localStorage.getItem(cursorKey)) || 0,
+            limit: SYNC_BATCH_SIZE,
+            changes: dirtyRecords.map(syncRecordToWire)
+        };
+
+        postSyncBatch(server, request).then((result) => {
+            const changes = result.answer.changes || [];
+            storeSyncResult(dirtyRecords, changes, (stored) => {
+                if (!stored) {
+                    callback(false);
+                    return;
+                }
+
+                localStorage.setItem(cursorKey, result.answer.cursor);
+                stats.batches++;
+                stats.sent += dirtyRecords.length;
+                stats.received += changes.length;
+                stats.bytesSent += result.sent;
+                stats.bytesReceived += result.received;
+
+                if (result.answer.more || dirtyRecords.length == SYNC_BATCH_SIZE) {
+                    requestIdleCallback(() => syncBatch(server, stats, callback), { timeout: 1000 });
+                } else {
+                    callback(true);
+                }
+            });
+        }).catch((error) => {
+            console.log(`Sync failed: ${error.message}`);
+            callback(false);
+        });
+    });
+}
+
+function runSync() {
+    syncTimer = 0;
+    if (!syncServer || syncInProgress) {
+        return;
+    }
+
+    syncInProgress = true;
+    syncPending = false;
+    let stats = { batches: 0, sent: 0, received: 0, bytesSent: 0, bytesReceived: 0 };
+    const start = performance.now();
+
+    syncBatch(syncServer, stats, (succeeded) => {
+        syncInProgress = false;
+
+        const seconds = (performance.now() - start) / 1000;
+        const records = stats.sent + stats.received;
+        if (records > 0) {
+            console.log(`Synced ${stats.sent} records up and ${stats.received} down in ${stats.batches} batches, ` +
+                `${seconds.toFixed(1)} s, ${Math.round(records / seconds)} records/s, ` +
+                `${Math.round(stats.bytesSent / 1024)} kB sent, ${Math.round(stats.bytesReceived / 1024)} kB received`);
+        }
+
+        scheduleSync(!succeeded ? SYNC_RETRY_DELAY : syncPending ? SYNC_CHANGE_DELAY : SYNC_INTERVAL);
+    });
+}
+
+function scheduleSync(delay) {
+    if (!syncServer) {
+        return;
+    }
+
+    if (syncInProgress) {
+        syncPending = true;
+        return;
+    }
+
+    // An earlier sync already planned covers this one
+    const due = Date.now() + delay;
+    if (syncTimer && syncDue <= due) {
+        return;
+    }
+
+    clearTimeout(syncTimer);
+    syncDue = due;
+    syncTimer = setTimeout(() => {
+        requestIdleCallback(runSync, { timeout: SYNC_CHANGE_DELAY });
+    }, delay);
+}
+
+function setSyncServer(server) {
+    if (server == syncServer) {
+        return;
+    }
+
+    clearTimeout(syncTimer);
+    syncTimer = 0;
+    syncServer = server || '';
+    scheduleSync(0);
+}
+
+function requestSyncConfig() {
+    let message = {
+        message: commands.MG_SYNC_CONFIG,
+        args: {}
+    };
+
+    window.chrome.webview.postMessage(message);
+}
@@ -0,0 +1,134 @@
+// Grid of the open tabs with their thumbnails. The controls WebView is
+// stretched over the whole window while it's up. Cards show right away
+// with title and favicon, the thumbnails follow once the browser has read
+// them back from its cache.
+function isTabOverviewVisible() {
+    let overview = document.getElementById('tab-overview');
+    return overview && !overview.classList.contains('hidden');
+}
+
+function postTabOverview(show) {
+    let message = {
+        message: commands.MG_TAB_OVERVIEW,
+        args: {
+            show: show
+        }
+    };
+
+    window.chrome.webview.postMessage(message);
+}
+
+function createOverviewCard(tabId, tab) {
+    let card = document.createElement('div');
+    card.id = `overview-tab-${tabId}`;
+    card.className = tabId == activeTabId ? 'overview-card overview-card-active' : 'overview-card';
+    card.title = tab.uriToShow || tab.uri;
+
+    let thumbnail = document.createElement('div');
+    thumbnail.className = 'overview-thumbnail';
+    card.append(thumbnail);
+
+    let label = document.createElement('div');
+    label.className = 'overview-label';
+    let favicon = document.createElement('img');
+    favicon.src = tab.favicon;
+    label.append(favicon);
+    let title = document.createElement('span');
+    title.textContent = tab.title;
+    label.append(title);
+    card.append(label);
+
+    card.addEventListener('click', function(e) {
+        hideTabOverview();
+        switchToTab(tabId, true);
+    });
+
+    return card;
+}
+
+function showTabOverview() {
+    if (isTabOverviewVisible()) {
+        return;
+    }
+
+    hideFindBar(false);
+
+    let grid = document.getElementById('overview-grid');
+    grid.textContent = '';
+    let fragment = document.createDocumentFragment();
+    tabs.forEach((tab, tabId) => {
+        fragment.append(createOverviewCard(tabId, tab));
+    });
+    grid.append(fragment);
+
+    document.getElementById('tab-overview').classList.remove('hidden');
+    document.getElementById('tab-overview').focus();
+    postTabOverview(true);
+}
+
+function hideTabOverview() {
+    if (!isTabOverviewVisible()) {
+        return;
+    }
+
+    document.getElementById('tab-overview').classList.add('hidden');
+    document.getElementById('overview-grid').textContent = '';
+    postTabOverview(false);
+}
+
+function toggleTabOverview() {
+    if (isTabOverviewVisible()) {
+        hideTabOverview();
+    } else {
+        showTabOverview();
+    }
+}
+
+function loadTabThumbnails(thumbnails) {
+    if (!isTabOverviewVisible()) {
+        return;
+    }
+
+    thumbnails.forEach((thumbnail) => {
+        let card = document.getElementById(`overview-tab-${thumbnail.tabId}`);
+        if (card) {
+            card.querySelector('.overview-thumbnail').style.backgroundImage = `url(${thumbnail.image})`;
+        }
+    });
+}
+
+function createTabOverview() {
+    let overview = document.createElement('div');
+    overview.id = 'tab-overview';
+    overview.className = 'hidden';
+    overview.tabIndex = -1;
+
+    let header = document.createElement('div');
+    header.id = 'overview-header';
+    let title = document.createElement('span');
+    title.textContent = 'Tabs';
+    header.append(title);
+    let closeButton = document.createElement('div');
+    closeButton.id = 'btn-overview-close';
+    closeButton.textContent = '\u00d7';
+    closeButton.title = 'Close (Esc)';
+    header.append(closeButton);
+    overview.append(header);
+
+    let grid = document.createElement('div');
+    grid.id = 'overview-grid';
+    overview.append(grid);
+
+    document.body.append(overview);
+
+    closeButton.addEventListener('click', function(e) {
+        hideTabOverview();
+    });
+
+    overview.addEventListener('keydown', function(e) {
+        if (e.key == 'Escape') {
+            e.preventDefault();
+            hideTabOverview();
+        }
+    });
+}
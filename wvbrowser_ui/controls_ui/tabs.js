@@ -11,39 +11,99 @@ function isValidTabId(tabId) {
     return tabId != INVALID_TAB_ID && tabs.has(tabId);
 }
 
-function createNewTab(shouldBeActive) {
+// |closedTab| is what the browser kept of a closed tab being reopened,
+// |hostRequest| the browser's own request for a tab, handed back to it
+function createNewTab(shouldBeActive, closedTab, hostRequest) {
     const tabId = getNewTabId();
 
     var message = {
         message: commands.MG_CREATE_TAB,
         args: {
             tabId: parseInt(tabId),
-            active: shouldBeActive || false
+            active: shouldBeActive || false,
+            reopen: closedTab ? true : false
         }
     };
 
+    if (hostRequest) {
+        message.args.uri = hostRequest.uri;
+        message.args.automationRequest = hostRequest.automationRequest;
+    }
+
     window.chrome.webview.postMessage(message);
 
     tabs.set(parseInt(tabId), {
-        title: 'New Tab',
+        title: closedTab ? closedTab.title || 'Tab' : 'New Tab',
         uri: '',
-        uriToShow: '',
+        uriToShow: closedTab ? closedTab.uriToShow || closedTab.uri : '',
         favicon: 'img/favicon.png',
         isFavorite: false,
         isLoading: false,
         canGoBack: false,
         canGoForward: false,
+        entries: [],
+        currentEntry: 0,
+        memoryState: 'active',
+        memory: 0,
         securityState: 'unknown',
         historyItemId: INVALID_HISTORY_ID
     });
 
     loadTabUI(tabId);
 
+    if (closedTab && closedTab.favicon) {
+        updateFaviconURI(tabId, closedTab.favicon);
+    }
+
     if (shouldBeActive) {
         switchToTab(tabId, false);
     }
 }
 
+// The browser suspends and discards background tabs to stay within its
+// memory budget, those are dimmed in the strip
+function updateTabState(tabId, state, memory, throttled, cpuSaved) {
+    let tab = tabs.get(tabId);
+    tab.memoryState = state;
+    tab.memory = memory;
+    tab.throttled = throttled;
+    tab.cpuSaved = cpuSaved;
+
+    let tabElement = document.getElementById(`tab-${tabId}`);
+    if (!tabElement) {
+        return;
+    }
+
+    tabElement.dataset.state = state;
+    switch (state) {
+        case 'suspended':
+            tabElement.title = 'Suspended to save memory';
+            break;
+        case 'discarded':
+            tabElement.title = 'Discarded to save memory, reloads when selected';
+            break;
+        default:
+            tabElement.title = memory ? `JavaScript memory: ${(memory / (1024 * 1024)).toFixed(1)} MB` : '';
+            break;
+    }
+
+    if (throttled) {
+        tabElement.title += `${tabElement.title ? '\n' : ''}Throttled in the background`;
+    }
+    if (cpuSaved > 0) {
+        tabElement.title += `${tabElement.title ? '\n' : ''}CPU saved: ${cpuSaved.toFixed(1)} s`;
+    }
+}
+
+function reopenClosedTab() {
+    var message = {
+        message: commands.MG_REOPEN_CLOSED_TAB,
+        args: {}
+    };
+
+    window.chrome.webview.postMessage(message);
+}
+
 function switchToTab(id, updateOnHost) {
     if (!id) {
         console.log('ID not provided');
@@ -60,6 +120,8 @@ function switchToTab(id, updateOnHost) {
         return;
     }
 
+    hideFindBar(false);
+
     // Get the tab element to switch to
     var tab = document.getElementById(`tab-${id}`);
     if (!tab) {
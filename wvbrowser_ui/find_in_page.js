@@ -0,0 +1,275 @@
+// Find in page, added to every top level document of a tab by
+// Tab::InjectFindScript. The host wraps this file in a function getting the
+// message codes as |commands| and drives it through window.__wvbrowserFind.
+//
+// Matching walks the text nodes in slices of FRAME_BUDGET ms so a huge page
+// keeps painting, and posts the count found so far after every slice.
+// Typing more of the same query only filters the matches already found.
+// Only the matches around the viewport are highlighted, again on scroll.
+if (window.top !== window || window.__wvbrowserFind) {
+    return;
+}
+
+const FRAME_BUDGET = 4; // ms of matching per frame
+const MAX_MATCHES = 10000;
+const VIEWPORT_MARGIN = 500; // px above and below the viewport to highlight
+const SKIPPED_TAGS = new Set(['SCRIPT', 'STYLE', 'NOSCRIPT', 'TEMPLATE', 'TEXTAREA']);
+const HIGHLIGHT = 'wvbrowser-find';
+const ACTIVE_HIGHLIGHT = 'wvbrowser-find-active';
+
+let job = null;
+let matches = []; // Ranges, in document order
+let activeMatch = -1;
+let highlightFrame = 0;
+let style = null;
+
+function postResult() {
+    window.chrome.webview.postMessage({
+        message: commands.MG_FIND_RESULT,
+        args: {
+            requestId: job.requestId,
+            query: job.query,
+            matches: matches.length,
+            activeMatch: activeMatch,
+            done: job.done,
+            capped: job.capped
+        }
+    });
+}
+
+function ensureStyle() {
+    if (style && style.isConnected) {
+        return;
+    }
+
+    style = document.createElement('style');
+    style.textContent =
+        `::highlight(${HIGHLIGHT}) { background-color: rgb(255, 235, 60); color: black; }` +
+        `::highlight(${ACTIVE_HIGHLIGHT}) { background-color: rgb(255, 150, 50); color: black; }`;
+    (document.head || document.documentElement).append(style);
+}
+
+function createWalker() {
+    return document.createTreeWalker(document.body || document.documentElement, NodeFilter.SHOW_TEXT, {
+        acceptNode: (node) => {
+            const parent = node.parentNode;
+            return parent && SKIPPED_TAGS.has(parent.nodeName) ? NodeFilter.FILTER_REJECT : NodeFilter.FILTER_ACCEPT;
+        }
+    });
+}
+
+// Matches are found within single text nodes
+function matchNode(node, query) {
+    const text = node.data.toLocaleLowerCase();
+    let offset = text.indexOf(query);
+    while (offset != -1) {
+        if (matches.length == MAX_MATCHES) {
+            job.capped = true;
+            return false;
+        }
+
+        let range = document.createRange();
+        range.setStart(node, offset);
+        range.setEnd(node, offset + query.length);
+        matches.push(range);
+        offset = text.indexOf(query, offset + query.length);
+    }
+
+    return true;
+}
+
+function runSlice() {
+    const currentJob = job;
+    currentJob.frame = 0;
+    if (currentJob.cancelled) {
+        return;
+    }
+
+    const deadline = performance.now() + FRAME_BUDGET;
+    let node = null;
+    while (performance.now() < deadline) {
+        node = currentJob.walker.nextNode();
+        if (!node || !matchNode(node, currentJob.query)) {
+            currentJob.done = true;
+            break;
+        }
+    }
+
+    if (activeMatch == -1 && matches.length) {
+        activeMatch = firstMatchInViewport();
+    }
+
+    scheduleHighlight();
+    postResult();
+
+    if (!currentJob.done) {
+        currentJob.frame = requestAnimationFrame(runSlice);
+    }
+}
+
+function cancelJob() {
+    if (job) {
+        job.cancelled = true;
+        cancelAnimationFrame(job.frame);
+    }
+}
+
+// Index of the first match whose rect is at or below |top|, matches being
+// in document order are close enough to vertical order for this
+function searchMatches(top) {
+    let low = 0;
+    let high = matches.length;
+    while (low < high) {
+        const middle = (low + high) >> 1;
+        if (matches[middle].getBoundingClientRect().bottom < top) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+function firstMatchInViewport() {
+    const index = searchMatches(0);
+    return index < matches.length ? index : 0;
+}
+
+function scheduleHighlight() {
+    if (!highlightFrame) {
+        highlightFrame = requestAnimationFrame(updateHighlights);
+    }
+}
+
+function updateHighlights() {
+    highlightFrame = 0;
+    if (!window.CSS || !CSS.highlights) {
+        return;
+    }
+
+    ensureStyle();
+
+    let visible = new Highlight();
+    const viewportBottom = window.innerHeight + VIEWPORT_MARGIN;
+    for (let i = searchMatches(-VIEWPORT_MARGIN); i < matches.length; i++) {
+        if (matches[i].getBoundingClientRect().top > viewportBottom) {
+            break;
+        }
+        if (i != activeMatch) {
+            visible.add(matches[i]);
+        }
+    }
+    CSS.highlights.set(HIGHLIGHT, visible);
+
+    if (activeMatch >= 0 && activeMatch < matches.length) {
+        CSS.highlights.set(ACTIVE_HIGHLIGHT, new Highlight(matches[activeMatch]));
+    } else {
+        CSS.highlights.delete(ACTIVE_HIGHLIGHT);
+    }
+}
+
+function scrollToActiveMatch() {
+    if (activeMatch < 0 || activeMatch >= matches.length) {
+        return;
+    }
+
+    const rect = matches[activeMatch].getBoundingClientRect();
+    if (rect.top < 0 || rect.bottom > window.innerHeight) {
+        window.scrollBy(0, rect.top - window.innerHeight / 2);
+    }
+}
+
+function find(args) {
+    const query = (args.query || '').toLocaleLowerCase();
+    const previous = job;
+    cancelJob();
+    if (!query) {
+        // Cleared before the new job exists, so it's the one answered
+        stop();
+    }
+
+    job = {
+        requestId: args.requestId,
+        query: query,
+        walker: null,
+        frame: 0,
+        done: false,
+        capped: false,
+        cancelled: false
+    };
+
+    if (!query) {
+        job.done = true;
+        postResult();
+        return;
+    }
+
+    if (previous && previous.done && !previous.capped && previous.query && query.startsWith(previous.query)) {
+        // Narrowing the last query, every new match is one of the old ones
+        matches = matches.filter((range) => range.toString().length == previous.query.length &&
+            range.startContainer.data.substr(range.startOffset, query.length).toLocaleLowerCase() == query);
+        matches.forEach((range) => range.setEnd(range.startContainer, range.startOffset + query.length));
+        activeMatch = matches.length ? firstMatchInViewport() : -1;
+        job.done = true;
+        scheduleHighlight();
+        scrollToActiveMatch();
+        postResult();
+        return;
+    }
+
+    matches = [];
+    activeMatch = -1;
+    job.walker = createWalker();
+    runSlice();
+    scrollToActiveMatch();
+}
+
+function step(forward) {
+    if (!job || !matches.length) {
+        return;
+    }
+
+    activeMatch = (activeMatch + (forward ? 1 : -1) + matches.length) % matches.length;
+    scrollToActiveMatch();
+    scheduleHighlight();
+    postResult();
+}
+
+// Also forgets the query, a later find with it mustn't narrow the cleared
+// matches
+function stop() {
+    cancelJob();
+    job = null;
+    matches = [];
+    activeMatch = -1;
+    if (window.CSS && CSS.highlights) {
+        CSS.highlights.delete(HIGHLIGHT);
+        CSS.highlights.delete(ACTIVE_HIGHLIGHT);
+    }
+}
+
+window.addEventListener('scroll', () => {
+    if (matches.length) {
+        scheduleHighlight();
+    }
+}, { passive: true });
+
+// The shortcut reaches the page while it has focus, the host moves the
+// focus over to the find bar
+window.addEventListener('keydown', (event) => {
+    if ((event.ctrlKey && (event.key == 'f' || event.key == 'F')) || event.key == 'F3') {
+        event.preventDefault();
+        window.chrome.webview.postMessage({
+            message: commands.MG_FIND,
+            args: { action: 'show' }
+        });
+    }
+});
+
+window.__wvbrowserFind = {
+    find: find,
+    next: () => step(true),
+    previous: () => step(false),
+    stop: stop
+};